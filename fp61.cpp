@@ -26,203 +26,2131 @@
     POSSIBILITY OF SUCH DAMAGE.
 */
 
+// Compile the readers and writers that fp61.h defines for header-only builds
+#define FP61_DEFINE_HEADER_INLINE
 #include "fp61.h"
 
+// Compile in the x86 kernels when the compiler can target them without
+// changing the flags for the whole file
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define FP61_TARGET_X86
+# if defined(_MSC_VER) && _MSC_VER >= 1900
+#  define FP61_TRY_AVX2
+#  define FP61_TRY_AVX512
+#  define FP61_TARGET_AVX2
+#  define FP61_TARGET_AVX512
+# elif defined(__GNUC__) || defined(__clang__)
+#  define FP61_TRY_BMI2
+#  define FP61_TRY_AVX2
+#  define FP61_TRY_AVX512
+#  define FP61_TARGET_BMI2 __attribute__((target("bmi2")))
+#  define FP61_TARGET_AVX2 __attribute__((target("avx2")))
+#  define FP61_TARGET_AVX512 __attribute__((target("avx512f")))
+# endif
+#endif
+
+#if defined(FP61_TARGET_X86)
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h> // __cpuid
+# endif
+#elif defined(__arm__) && defined(__linux__)
+# include <sys/auxv.h> // getauxval
+#endif
+
+#include <atomic>
+#include <mutex> // std::call_once
+
 namespace fp61 {
 
 
-// This is an unrolled implementation of Knuth's unsigned version of the eGCD,
-// specialized for the prime.  It handles any input.
-uint64_t Inverse(uint64_t u)
+//------------------------------------------------------------------------------
+// Runtime CPU Architecture Check
+
+#if defined(FP61_TARGET_X86)
+
+#define CPUID_ECX_OSXSAVE       0x08000000
+#define CPUID_EBX_BMI2          0x00000100
+#define CPUID_EBX_AVX2          0x00000020
+#define CPUID_EBX_AVX512F       0x00010000
+#define CPUID_EBX_AVX512IFMA    0x00200000
+
+#define XCR0_YMM_STATE          0x00000006
+#define XCR0_ZMM_STATE          0x000000e6
+
+static void _cpuid(
+    unsigned int cpu_info[4U],
+    const unsigned int cpu_info_type,
+    const unsigned int cpu_info_subleaf = 0)
+{
+#if defined(_MSC_VER)
+    __cpuidex((int *) cpu_info, cpu_info_type, cpu_info_subleaf);
+#elif defined(__i386__)
+    __asm__ __volatile__ ("xchgl %%ebx, %k1; cpuid; xchgl %%ebx, %k1" :
+                          "=a" (cpu_info[0]), "=&r" (cpu_info[1]),
+                          "=c" (cpu_info[2]), "=d" (cpu_info[3]) :
+                          "0" (cpu_info_type), "2" (cpu_info_subleaf));
+#else
+    __asm__ __volatile__ ("xchgq %%rbx, %q1; cpuid; xchgq %%rbx, %q1" :
+                          "=a" (cpu_info[0]), "=&r" (cpu_info[1]),
+                          "=c" (cpu_info[2]), "=d" (cpu_info[3]) :
+                          "0" (cpu_info_type), "2" (cpu_info_subleaf));
+#endif
+}
+
+// Returns the XCR0 register indicating which vector state the OS saves
+static uint64_t _xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0U));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif // FP61_TARGET_X86
+
+// Returns the kCpuFeature* flags supported by the CPU and OS
+static unsigned DetectCpuFeatures()
+{
+    unsigned features = 0;
+
+#if defined(FP61_TARGET_X86)
+    unsigned int cpu_info[4];
+
+    _cpuid(cpu_info, 0);
+    const unsigned maxLeaf = cpu_info[0];
+
+    _cpuid(cpu_info, 1);
+    const bool osxsave = (cpu_info[2] & CPUID_ECX_OSXSAVE) != 0;
+
+    if (maxLeaf >= 7)
+    {
+        _cpuid(cpu_info, 7);
+        const unsigned ebx = cpu_info[1];
+
+        if (ebx & CPUID_EBX_BMI2) {
+            features |= kCpuFeatureBMI2;
+        }
+
+        // Vector registers can only be used if the OS saves their state
+        const uint64_t xcr0 = osxsave ? _xgetbv0() : 0;
+
+        if ((xcr0 & XCR0_YMM_STATE) == XCR0_YMM_STATE)
+        {
+            if (ebx & CPUID_EBX_AVX2) {
+                features |= kCpuFeatureAVX2;
+            }
+        }
+        if ((xcr0 & XCR0_ZMM_STATE) == XCR0_ZMM_STATE)
+        {
+            if (ebx & CPUID_EBX_AVX512F) {
+                features |= kCpuFeatureAVX512F;
+            }
+            if (ebx & CPUID_EBX_AVX512IFMA) {
+                features |= kCpuFeatureAVX512IFMA;
+            }
+        }
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    // NEON (ASIMD) is part of the base ARMv8 architecture
+    features |= kCpuFeatureNeon;
+#elif defined(__arm__) && defined(__linux__)
+    // HWCAP_NEON
+    if (getauxval(AT_HWCAP) & 4096) {
+        features |= kCpuFeatureNeon;
+    }
+#endif
+
+    return features;
+}
+
+// Cache sizes to assume if they cannot be detected
+static const unsigned kDefaultL1DataCacheBytes = 32 * 1024;
+static const unsigned kDefaultL2CacheBytes = 256 * 1024;
+
+// Detects the L1 data cache and L2 cache sizes in bytes
+static void DetectCacheSizes(unsigned& l1Bytes, unsigned& l2Bytes)
+{
+    l1Bytes = 0;
+    l2Bytes = 0;
+
+#if defined(FP61_TARGET_X86)
+    unsigned int cpu_info[4];
+
+    _cpuid(cpu_info, 0);
+    const unsigned maxLeaf = cpu_info[0];
+
+    // Intel: Deterministic cache parameters
+    if (maxLeaf >= 4)
+    {
+        for (unsigned subleaf = 0; subleaf < 16; ++subleaf)
+        {
+            _cpuid(cpu_info, 4, subleaf);
+
+            // 0 = No more caches, 1 = Data, 2 = Instruction, 3 = Unified
+            const unsigned type = cpu_info[0] & 0x1f;
+            if (type == 0) {
+                break;
+            }
+            if (type == 2) {
+                continue;
+            }
+
+            const unsigned level = (cpu_info[0] >> 5) & 7;
+            const unsigned ways = (cpu_info[1] >> 22) + 1;
+            const unsigned partitions = ((cpu_info[1] >> 12) & 0x3ff) + 1;
+            const unsigned lineBytes = (cpu_info[1] & 0xfff) + 1;
+            const unsigned sets = cpu_info[2] + 1;
+            const unsigned bytes = ways * partitions * lineBytes * sets;
+
+            if (level == 1) {
+                l1Bytes = bytes;
+            }
+            else if (level == 2) {
+                l2Bytes = bytes;
+            }
+        }
+    }
+
+    // AMD: L1 and L2 cache identifiers report sizes in KB
+    if (l1Bytes == 0 || l2Bytes == 0)
+    {
+        _cpuid(cpu_info, 0x80000000);
+        const unsigned maxExtendedLeaf = cpu_info[0];
+
+        if (maxExtendedLeaf >= 0x80000006)
+        {
+            _cpuid(cpu_info, 0x80000005);
+            if (l1Bytes == 0) {
+                l1Bytes = (cpu_info[2] >> 24) * 1024;
+            }
+
+            _cpuid(cpu_info, 0x80000006);
+            if (l2Bytes == 0) {
+                l2Bytes = (cpu_info[2] >> 16) * 1024;
+            }
+        }
+    }
+#endif // FP61_TARGET_X86
+
+    if (l1Bytes == 0) {
+        l1Bytes = kDefaultL1DataCacheBytes;
+    }
+    if (l2Bytes == 0) {
+        l2Bytes = kDefaultL2CacheBytes;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Kernel Dispatch
+
+// Table of bulk kernels selected by fp61::Init()
+struct KernelTable
+{
+    void (*MulAddMem)(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count);
+    unsigned (*ReadWordsBulk)(ByteReader& reader, uint64_t* fpOut, unsigned count, unsigned maxWords);
+    void (*PackWords64)(uint8_t* dest, const uint64_t* words);
+    void (*FillRandom)(uint64_t* lanes, uint64_t* out, unsigned blocks, bool nonzero);
+    void (*Fp2MulMem)(Fp2* x, const Fp2* y, unsigned count);
+    void (*Fp2MulAddMem)(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count);
+    const FixedMulAddKernel (*FixedMulAdd)[kFixedMaxM]; // [row for N][M - 1]
+};
+
+static KernelTable Kernels;
+static KernelInfo Info;
+
+// Set with release order after the tables are written by Init(), so a
+// thread that reads it with acquire order also sees the tables
+static std::atomic<bool> Initialized(false);
+
+// Serializes the first-use Init() when several threads need the kernels
+static std::once_flag DefaultInitOnce;
+
+static void DefaultInit()
+{
+    // Init() may already have been called by the application
+    if (!Initialized.load(std::memory_order_acquire)) {
+        Init();
+    }
+}
+
+static FP61_FORCE_INLINE void EnsureInitialized()
+{
+    if (!Initialized.load(std::memory_order_acquire)) {
+        std::call_once(DefaultInitOnce, DefaultInit);
+    }
+}
+
+static FP61_FORCE_INLINE const KernelTable& GetKernels()
+{
+    EnsureInitialized();
+    return Kernels;
+}
+
+
+// This is an unrolled implementation of Knuth's unsigned version of the eGCD,
+// specialized for the prime.  It handles any input.
+uint64_t Inverse(uint64_t u)
+{
+    uint64_t u1, u3, v1, v3, qt;
+
+    qt = u / kPrime;
+    u3 = u % kPrime;
+    u1 = 1;
+
+    if (u3 == 0) {
+        return 0; // No inverse
+    }
+
+    qt = kPrime / u3;
+    v3 = kPrime % u3;
+    v1 = qt;
+
+    for (;;)
+    {
+        if (v3 == 0) {
+            return u3 == 1 ? u1 : 0;
+        }
+
+        qt = u3 / v3;
+        u3 %= v3;
+        u1 += qt * v1;
+
+        if (u3 == 0) {
+            return v3 == 1 ? kPrime - v1 : 0;
+        }
+
+        qt = v3 / u3;
+        v3 %= u3;
+        v1 += qt * u1;
+    }
+}
+
+void InverseBatch(const uint64_t* in, uint64_t* out, unsigned count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    /*
+        Montgomery's trick:
+
+        Forward: out[i] = x_0 * x_1 * ... * x_i
+        Invert the product of all of them once.
+        Backward: x_i^-1 = (x_0 * ... * x_i)^-1 * out[i-1]
+        and then (x_0 * ... * x_(i-1))^-1 = (x_0 * ... * x_i)^-1 * x_i
+
+        Zero inputs are replaced by 1 in the products so that they do not
+        zero out the rest of the batch, and their outputs are set to 0.
+
+        The products are kept partially reduced (62 bits).  Multiply() allows
+        62-bit inputs on both sides, so only the outputs are finalized.
+    */
+
+    uint64_t x = Finalize(PartialReduce(in[0]));
+    uint64_t product = x + (x == 0);
+    out[0] = product;
+
+    for (unsigned i = 1; i < count; ++i)
+    {
+        x = Finalize(PartialReduce(in[i]));
+        product = Multiply(product, x + (x == 0));
+        out[i] = product;
+    }
+
+    uint64_t inv = Inverse(product);
+
+    for (unsigned i = count - 1; i > 0; --i)
+    {
+        x = Finalize(PartialReduce(in[i]));
+
+        const uint64_t r = Finalize(Multiply(inv, out[i - 1]));
+        out[i] = (x == 0) ? 0 : r;
+
+        inv = Multiply(inv, x + (x == 0));
+    }
+
+    x = Finalize(PartialReduce(in[0]));
+    out[0] = (x == 0) ? 0 : Finalize(PartialReduce(inv));
+}
+
+uint64_t Pow(uint64_t x, uint64_t e)
+{
+    // Partially reduce so that the first squaring has 62-bit inputs
+    x = PartialReduce(x);
+
+    uint64_t r = 1;
+
+    while (e != 0)
+    {
+        if (e & 1) {
+            r = Multiply(r, x);
+        }
+        x = Multiply(x, x);
+        e >>= 1;
+    }
+
+    return Finalize(r);
+}
+
+/// Square x n times.  n is a constant at every call site
+static FP61_FORCE_INLINE uint64_t SquareN(uint64_t x, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i) {
+        x = Multiply(x, x);
+    }
+    return x;
+}
+
+uint64_t InverseCT(uint64_t x)
+{
+    /*
+        p - 2 = 2^61 - 3 = (2^59 - 1) * 4 + 1
+
+        Build up x_k = x^(2^k - 1) using x_(a+b) = x_a^(2^b) * x_b until
+        x_59, then x^(p-2) = x_59^4 * x.
+
+        Multiply() accepts 62-bit inputs on both sides and produces 62-bit
+        outputs, so nothing needs to be reduced until the end.
+        If x is a multiple of p then every product is 0 and so is the result.
+    */
+
+    const uint64_t x1 = PartialReduce(x);
+    const uint64_t x2 = Multiply(SquareN(x1, 1), x1);
+    const uint64_t x3 = Multiply(SquareN(x2, 1), x1);
+    const uint64_t x5 = Multiply(SquareN(x3, 2), x2);
+    const uint64_t x10 = Multiply(SquareN(x5, 5), x5);
+    const uint64_t x20 = Multiply(SquareN(x10, 10), x10);
+    const uint64_t x40 = Multiply(SquareN(x20, 20), x20);
+    const uint64_t x50 = Multiply(SquareN(x40, 10), x10);
+    const uint64_t x55 = Multiply(SquareN(x50, 5), x5);
+    const uint64_t x58 = Multiply(SquareN(x55, 3), x3);
+    const uint64_t x59 = Multiply(SquareN(x58, 1), x1);
+
+    return Finalize(Multiply(SquareN(x59, 2), x1));
+}
+
+
+//------------------------------------------------------------------------------
+// Bulk Math
+
+/*
+    Vector MulAddMem:
+
+    There is no 64x64->128 vector multiply, so the product is built from
+    32x32->64 bit products.  Split x = x1 * 2^32 + x0 and c = c1 * 2^32 + c0,
+    where c < 2^61 and x < 2^62, so c1 < 2^29 and x1 < 2^30:
+
+        x * c = x1*c1 * 2^64 + (x1*c0 + x0*c1) * 2^32 + x0*c0
+
+    Since 2^61 = 1 (mod p), we have 2^64 = 2^3 (mod p):
+
+        x0*c0 < 2^64 is partially reduced to (lo & p) + (lo >> 61) < 2^61 + 8
+        x1*c1 * 2^64 = x1*c1 * 2^3 < 2^62
+
+    The middle sum m = x1*c0 + x0*c1 < 2^62 + 2^61 is split at bit #29:
+
+        m * 2^32 = (m >> 29) * 2^61 + (m & (2^29-1)) * 2^32
+                 = (m >> 29) + (m & (2^29-1)) * 2^32 (mod p)
+
+    where (m >> 29) < 2^34 and (m & (2^29-1)) * 2^32 < 2^61.
+
+    Adding these up is less than 2^63 + 2^35, and adding the accumulator
+    (< 2^62) still fits in 64 bits.  One partial reduction brings the result
+    back down to 62 bits, matching the lazy reduction rules for Multiply().
+*/
+
+static FP61_FORCE_INLINE void MulAddMem_Impl(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count)
+{
+    while (count >= 4)
+    {
+        const uint64_t r0 = acc[0] + Multiply(coeff, words[0]);
+        const uint64_t r1 = acc[1] + Multiply(coeff, words[1]);
+        const uint64_t r2 = acc[2] + Multiply(coeff, words[2]);
+        const uint64_t r3 = acc[3] + Multiply(coeff, words[3]);
+        acc[0] = PartialReduce(r0);
+        acc[1] = PartialReduce(r1);
+        acc[2] = PartialReduce(r2);
+        acc[3] = PartialReduce(r3);
+
+        acc += 4, words += 4, count -= 4;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        acc[i] = PartialReduce(acc[i] + Multiply(coeff, words[i]));
+    }
+}
+
+static void MulAddMem_Scalar(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count)
+{
+    MulAddMem_Impl(acc, words, coeff, count);
+}
+
+#if defined(FP61_TRY_BMI2)
+
+// Same as the scalar version, but the compiler can use MULX
+FP61_TARGET_BMI2 static void MulAddMem_BMI2(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count)
+{
+    MulAddMem_Impl(acc, words, coeff, count);
+}
+
+#endif // FP61_TRY_BMI2
+
+#if defined(FP61_TRY_AVX2)
+
+FP61_TARGET_AVX2 static void MulAddMem_AVX2(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count)
+{
+    const __m256i c0 = _mm256_set1_epi64x(static_cast<uint32_t>(coeff));
+    const __m256i c1 = _mm256_set1_epi64x(coeff >> 32);
+    const __m256i prime = _mm256_set1_epi64x(kPrime);
+    const __m256i mask29 = _mm256_set1_epi64x(((uint64_t)1 << 29) - 1);
+
+#define FP61_MULADD_AVX2(offset) \
+    { \
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + (offset))); \
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + (offset))); \
+        const __m256i x1 = _mm256_srli_epi64(x, 32); \
+        const __m256i p00 = _mm256_mul_epu32(x, c0); \
+        const __m256i p11 = _mm256_mul_epu32(x1, c1); \
+        const __m256i mid = _mm256_add_epi64(_mm256_mul_epu32(x1, c0), _mm256_mul_epu32(x, c1)); \
+        __m256i r = _mm256_add_epi64(_mm256_and_si256(p00, prime), _mm256_srli_epi64(p00, 61)); \
+        r = _mm256_add_epi64(r, _mm256_slli_epi64(p11, 3)); \
+        r = _mm256_add_epi64(r, _mm256_srli_epi64(mid, 29)); \
+        r = _mm256_add_epi64(r, _mm256_slli_epi64(_mm256_and_si256(mid, mask29), 32)); \
+        r = _mm256_add_epi64(r, a); \
+        r = _mm256_add_epi64(_mm256_and_si256(r, prime), _mm256_srli_epi64(r, 61)); \
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + (offset)), r); \
+    }
+
+    while (count >= 8)
+    {
+        FP61_MULADD_AVX2(0);
+        FP61_MULADD_AVX2(4);
+        acc += 8, words += 8, count -= 8;
+    }
+
+    if (count >= 4)
+    {
+        FP61_MULADD_AVX2(0);
+        acc += 4, words += 4, count -= 4;
+    }
+
+#undef FP61_MULADD_AVX2
+
+    MulAddMem_Impl(acc, words, coeff, count);
+}
+
+#endif // FP61_TRY_AVX2
+
+#if defined(FP61_TRY_AVX512)
+
+FP61_TARGET_AVX512 static void MulAddMem_AVX512(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count)
+{
+    const __m512i c0 = _mm512_set1_epi64(static_cast<uint32_t>(coeff));
+    const __m512i c1 = _mm512_set1_epi64(coeff >> 32);
+    const __m512i prime = _mm512_set1_epi64(kPrime);
+    const __m512i mask29 = _mm512_set1_epi64(((uint64_t)1 << 29) - 1);
+
+#define FP61_MULADD_AVX512(offset) \
+    { \
+        const __m512i x = _mm512_loadu_si512(words + (offset)); \
+        const __m512i a = _mm512_loadu_si512(acc + (offset)); \
+        const __m512i x1 = _mm512_srli_epi64(x, 32); \
+        const __m512i p00 = _mm512_mul_epu32(x, c0); \
+        const __m512i p11 = _mm512_mul_epu32(x1, c1); \
+        const __m512i mid = _mm512_add_epi64(_mm512_mul_epu32(x1, c0), _mm512_mul_epu32(x, c1)); \
+        __m512i r = _mm512_add_epi64(_mm512_and_si512(p00, prime), _mm512_srli_epi64(p00, 61)); \
+        r = _mm512_add_epi64(r, _mm512_slli_epi64(p11, 3)); \
+        r = _mm512_add_epi64(r, _mm512_srli_epi64(mid, 29)); \
+        r = _mm512_add_epi64(r, _mm512_slli_epi64(_mm512_and_si512(mid, mask29), 32)); \
+        r = _mm512_add_epi64(r, a); \
+        r = _mm512_add_epi64(_mm512_and_si512(r, prime), _mm512_srli_epi64(r, 61)); \
+        _mm512_storeu_si512(acc + (offset), r); \
+    }
+
+    while (count >= 16)
+    {
+        FP61_MULADD_AVX512(0);
+        FP61_MULADD_AVX512(8);
+        acc += 16, words += 16, count -= 16;
+    }
+
+    if (count >= 8)
+    {
+        FP61_MULADD_AVX512(0);
+        acc += 8, words += 8, count -= 8;
+    }
+
+#undef FP61_MULADD_AVX512
+
+    MulAddMem_Impl(acc, words, coeff, count);
+}
+
+#endif // FP61_TRY_AVX512
+
+void MulAddMem(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count)
+{
+    GetKernels().MulAddMem(acc, words, coeff, count);
+}
+
+/*
+    Dot products accumulate the full 122-bit products into a pair of 128-bit
+    sums, and only reduce once per block of kDotProductBlockTerms products.
+    Two sums are used so that the add-with-carry chains of neighboring
+    terms do not depend on each other.
+*/
+
+// r{hi,lo} += x * y
+#define FP61_MULADD128(r_hi, r_lo, x, y) \
+    {                                    \
+        uint64_t t_lo, t_hi;             \
+        CAT_MUL128(t_hi, t_lo, x, y);    \
+        r_lo += t_lo;                    \
+        r_hi += t_hi + (r_lo < t_lo);    \
+    }
+
+// Partially reduce a 128-bit sum {hi,lo}.  The result is less than 2^62 + 72
+static FP61_FORCE_INLINE uint64_t Reduce128(uint64_t hi, uint64_t lo)
+{
+    // hi * 2^64 = hi * 2^3 * 2^61 = hi * 8 (mod p)
+    return (lo & kPrime) + (lo >> 61) + ((hi << 3) & kPrime) + (hi >> 58);
+}
+
+uint64_t DotProduct(const uint64_t* a, const uint64_t* b, unsigned n)
+{
+    uint64_t r = 0;
+
+    while (n > 0)
+    {
+        unsigned terms = n;
+        if (terms > kDotProductBlockTerms) {
+            terms = kDotProductBlockTerms;
+        }
+        n -= terms;
+
+        uint64_t hi0 = 0, lo0 = 0, hi1 = 0, lo1 = 0;
+        unsigned i = 0;
+        for (; i + 2 <= terms; i += 2)
+        {
+            FP61_MULADD128(hi0, lo0, a[i], b[i]);
+            FP61_MULADD128(hi1, lo1, a[i + 1], b[i + 1]);
+        }
+        if (i < terms) {
+            FP61_MULADD128(hi0, lo0, a[i], b[i]);
+        }
+        a += terms, b += terms;
+
+        r = PartialReduce(r + PartialReduce(Reduce128(hi0, lo0) + Reduce128(hi1, lo1)));
+    }
+
+    return Finalize(r);
+}
+
+uint64_t DotProductStrided(
+    const uint64_t* a,
+    unsigned aStride,
+    const uint64_t* b,
+    unsigned bStride,
+    unsigned n)
+{
+    uint64_t r = 0;
+    size_t ia = 0, ib = 0;
+
+    while (n > 0)
+    {
+        unsigned terms = n;
+        if (terms > kDotProductBlockTerms) {
+            terms = kDotProductBlockTerms;
+        }
+        n -= terms;
+
+        uint64_t hi0 = 0, lo0 = 0, hi1 = 0, lo1 = 0;
+        unsigned i = 0;
+        for (; i + 2 <= terms; i += 2)
+        {
+            FP61_MULADD128(hi0, lo0, a[ia], b[ib]);
+            FP61_MULADD128(hi1, lo1, a[ia + aStride], b[ib + bStride]);
+            ia += (size_t)aStride * 2, ib += (size_t)bStride * 2;
+        }
+        if (i < terms)
+        {
+            FP61_MULADD128(hi0, lo0, a[ia], b[ib]);
+            ia += aStride, ib += bStride;
+        }
+
+        r = PartialReduce(r + PartialReduce(Reduce128(hi0, lo0) + Reduce128(hi1, lo1)));
+    }
+
+    return Finalize(r);
+}
+
+
+//------------------------------------------------------------------------------
+// Quadratic Extension Field
+
+Fp2 Fp2Inverse(const Fp2& x)
+{
+    const uint64_t norm = PartialReduce(Multiply(x.Re, x.Re) + Multiply(x.Im, x.Im));
+    const uint64_t inv = Inverse(norm);
+
+    Fp2 r;
+    r.Re = Finalize(Multiply(x.Re, inv));
+    r.Im = Finalize(Negate(Finalize(Multiply(x.Im, inv))));
+    return r;
+}
+
+static FP61_FORCE_INLINE void Fp2MulMem_Impl(Fp2* x, const Fp2* y, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        x[i] = Fp2Multiply(x[i], y[i]);
+    }
+}
+
+static FP61_FORCE_INLINE void Fp2MulAddMem_Impl(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        acc[i] = Fp2Add(acc[i], Fp2Multiply(x[i], coeff));
+    }
+}
+
+static void Fp2MulMem_Scalar(Fp2* x, const Fp2* y, unsigned count)
+{
+    Fp2MulMem_Impl(x, y, count);
+}
+
+static void Fp2MulAddMem_Scalar(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count)
+{
+    Fp2MulAddMem_Impl(acc, x, coeff, count);
+}
+
+/*
+    The vector kernels hold two Fp2 elements per 128 bits as (Re, Im) and
+    use the four-multiply product, which maps better onto lanes:
+
+        P = x * y           = (ac, bd)
+        Q = x * swap(y)     = (ad, bc)
+        x * y = (ac - bd, ad + bc) = unpacklo(P, Q) +/- unpackhi(P, Q)
+
+    Each lane product is built from 32x32->64 bit multiplies in the same way
+    as MulAddMem(), which requires one input to be less than 2^61.
+*/
+
+#if defined(FP61_TRY_AVX2)
+
+// x * c (with partial reduction modulo p) in each lane.
+// Preconditions: x < 2^63, c < 2^61
+FP61_TARGET_AVX2 static FP61_FORCE_INLINE __m256i Multiply_AVX2(__m256i x, __m256i c)
+{
+    const __m256i prime = _mm256_set1_epi64x(kPrime);
+    const __m256i mask29 = _mm256_set1_epi64x(((uint64_t)1 << 29) - 1);
+
+    const __m256i x1 = _mm256_srli_epi64(x, 32);
+    const __m256i c1 = _mm256_srli_epi64(c, 32);
+    const __m256i p00 = _mm256_mul_epu32(x, c);
+    const __m256i p11 = _mm256_mul_epu32(x1, c1);
+    const __m256i mid = _mm256_add_epi64(_mm256_mul_epu32(x1, c), _mm256_mul_epu32(x, c1));
+    __m256i r = _mm256_add_epi64(_mm256_and_si256(p00, prime), _mm256_srli_epi64(p00, 61));
+    r = _mm256_add_epi64(r, _mm256_slli_epi64(p11, 3));
+    r = _mm256_add_epi64(r, _mm256_srli_epi64(mid, 29));
+    r = _mm256_add_epi64(r, _mm256_slli_epi64(_mm256_and_si256(mid, mask29), 32));
+    return _mm256_add_epi64(_mm256_and_si256(r, prime), _mm256_srli_epi64(r, 61));
+}
+
+// x * y for two Fp2 elements, before the final partial reduction
+FP61_TARGET_AVX2 static FP61_FORCE_INLINE __m256i Fp2Multiply_AVX2(__m256i x, __m256i y)
+{
+    const __m256i p = Multiply_AVX2(x, y);
+    const __m256i q = Multiply_AVX2(x, _mm256_shuffle_epi32(y, 0x4e));
+    const __m256i lo = _mm256_unpacklo_epi64(p, q);
+    const __m256i hi = _mm256_unpackhi_epi64(p, q);
+
+    // Subtract bd from the real parts with 4p - bd
+    const __m256i neg = _mm256_sub_epi64(_mm256_set1_epi64x(kPrime4), hi);
+    return _mm256_add_epi64(lo, _mm256_blend_epi32(hi, neg, 0x33));
+}
+
+FP61_TARGET_AVX2 static FP61_FORCE_INLINE __m256i PartialReduce_AVX2(__m256i x)
+{
+    const __m256i prime = _mm256_set1_epi64x(kPrime);
+    return _mm256_add_epi64(_mm256_and_si256(x, prime), _mm256_srli_epi64(x, 61));
+}
+
+FP61_TARGET_AVX2 static void Fp2MulMem_AVX2(Fp2* x, const Fp2* y, unsigned count)
+{
+    __m256i* xv = reinterpret_cast<__m256i*>(x);
+    const __m256i* yv = reinterpret_cast<const __m256i*>(y);
+
+    for (; count >= 2; count -= 2, ++xv, ++yv)
+    {
+        const __m256i r = Fp2Multiply_AVX2(_mm256_loadu_si256(xv), _mm256_loadu_si256(yv));
+        _mm256_storeu_si256(xv, PartialReduce_AVX2(r));
+    }
+
+    Fp2MulMem_Impl(reinterpret_cast<Fp2*>(xv), reinterpret_cast<const Fp2*>(yv), count);
+}
+
+FP61_TARGET_AVX2 static void Fp2MulAddMem_AVX2(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count)
+{
+    __m256i* accv = reinterpret_cast<__m256i*>(acc);
+    const __m256i* xv = reinterpret_cast<const __m256i*>(x);
+    const __m256i c = _mm256_set_epi64x(coeff.Im, coeff.Re, coeff.Im, coeff.Re);
+
+    for (; count >= 2; count -= 2, ++accv, ++xv)
+    {
+        const __m256i r = PartialReduce_AVX2(Fp2Multiply_AVX2(_mm256_loadu_si256(xv), c));
+        _mm256_storeu_si256(accv, PartialReduce_AVX2(_mm256_add_epi64(r, _mm256_loadu_si256(accv))));
+    }
+
+    Fp2MulAddMem_Impl(reinterpret_cast<Fp2*>(accv), reinterpret_cast<const Fp2*>(xv), coeff, count);
+}
+
+#endif // FP61_TRY_AVX2
+
+#if defined(FP61_TRY_AVX512)
+
+// x * c (with partial reduction modulo p) in each lane.
+// Preconditions: x < 2^63, c < 2^61
+FP61_TARGET_AVX512 static FP61_FORCE_INLINE __m512i Multiply_AVX512(__m512i x, __m512i c)
+{
+    const __m512i prime = _mm512_set1_epi64(kPrime);
+    const __m512i mask29 = _mm512_set1_epi64(((uint64_t)1 << 29) - 1);
+
+    const __m512i x1 = _mm512_srli_epi64(x, 32);
+    const __m512i c1 = _mm512_srli_epi64(c, 32);
+    const __m512i p00 = _mm512_mul_epu32(x, c);
+    const __m512i p11 = _mm512_mul_epu32(x1, c1);
+    const __m512i mid = _mm512_add_epi64(_mm512_mul_epu32(x1, c), _mm512_mul_epu32(x, c1));
+    __m512i r = _mm512_add_epi64(_mm512_and_si512(p00, prime), _mm512_srli_epi64(p00, 61));
+    r = _mm512_add_epi64(r, _mm512_slli_epi64(p11, 3));
+    r = _mm512_add_epi64(r, _mm512_srli_epi64(mid, 29));
+    r = _mm512_add_epi64(r, _mm512_slli_epi64(_mm512_and_si512(mid, mask29), 32));
+    return _mm512_add_epi64(_mm512_and_si512(r, prime), _mm512_srli_epi64(r, 61));
+}
+
+// x * y for four Fp2 elements, before the final partial reduction
+FP61_TARGET_AVX512 static FP61_FORCE_INLINE __m512i Fp2Multiply_AVX512(__m512i x, __m512i y)
+{
+    const __m512i p = Multiply_AVX512(x, y);
+    const __m512i q = Multiply_AVX512(x, _mm512_shuffle_epi32(y, _MM_PERM_BADC));
+    const __m512i lo = _mm512_unpacklo_epi64(p, q);
+    const __m512i hi = _mm512_unpackhi_epi64(p, q);
+
+    // Subtract bd from the real parts with 4p - bd
+    const __m512i adj = _mm512_mask_sub_epi64(hi, 0x55, _mm512_set1_epi64(kPrime4), hi);
+    return _mm512_add_epi64(lo, adj);
+}
+
+FP61_TARGET_AVX512 static FP61_FORCE_INLINE __m512i PartialReduce_AVX512(__m512i x)
+{
+    const __m512i prime = _mm512_set1_epi64(kPrime);
+    return _mm512_add_epi64(_mm512_and_si512(x, prime), _mm512_srli_epi64(x, 61));
+}
+
+FP61_TARGET_AVX512 static void Fp2MulMem_AVX512(Fp2* x, const Fp2* y, unsigned count)
+{
+    for (; count >= 4; count -= 4, x += 4, y += 4)
+    {
+        const __m512i r = Fp2Multiply_AVX512(_mm512_loadu_si512(x), _mm512_loadu_si512(y));
+        _mm512_storeu_si512(x, PartialReduce_AVX512(r));
+    }
+
+    Fp2MulMem_Impl(x, y, count);
+}
+
+FP61_TARGET_AVX512 static void Fp2MulAddMem_AVX512(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count)
+{
+    const __m512i c = _mm512_set_epi64(
+        coeff.Im, coeff.Re, coeff.Im, coeff.Re,
+        coeff.Im, coeff.Re, coeff.Im, coeff.Re);
+
+    for (; count >= 4; count -= 4, acc += 4, x += 4)
+    {
+        const __m512i r = PartialReduce_AVX512(Fp2Multiply_AVX512(_mm512_loadu_si512(x), c));
+        _mm512_storeu_si512(acc, PartialReduce_AVX512(_mm512_add_epi64(r, _mm512_loadu_si512(acc))));
+    }
+
+    Fp2MulAddMem_Impl(acc, x, coeff, count);
+}
+
+#endif // FP61_TRY_AVX512
+
+void Fp2MulMem(Fp2* x, const Fp2* y, unsigned count)
+{
+    GetKernels().Fp2MulMem(x, y, count);
+}
+
+void Fp2MulAddMem(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count)
+{
+    GetKernels().Fp2MulAddMem(acc, x, coeff, count);
+}
+
+
+//------------------------------------------------------------------------------
+// Fixed Geometry Kernels
+
+// Ask the compiler to fully unroll loops with a compile-time trip count
+#if defined(__clang__)
+# define FP61_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && (__GNUC__ >= 8)
+# define FP61_UNROLL _Pragma("GCC unroll 64")
+#else
+# define FP61_UNROLL
+#endif
+
+// Number of partially reduced products that the vector kernels add to a
+// sum between reductions, on top of the reduced sum itself
+static const unsigned kFixedLazyTerms = 6;
+
+// Returns true if the vector sums should be reduced after adding input i
+static constexpr bool FixedReduceAfter(unsigned i, unsigned N)
+{
+    return i > 0 && i % kFixedLazyTerms == 0 && i + 1 < N;
+}
+
+// Scalar version: 128-bit sums of the 122-bit products, which do not
+// overflow for N up to 64, reduced once at the end
+template<unsigned N, unsigned M>
+static FP61_FORCE_INLINE void FixedMulAdd_Impl(
+    const uint64_t* words,
+    unsigned wordStride,
+    const uint64_t* coeffs,
+    uint64_t* out,
+    unsigned outStride,
+    unsigned count)
+{
+    static_assert(N <= 64, "128-bit sums can overflow");
+
+    for (unsigned j = 0; j < count; ++j)
+    {
+        uint64_t hi[M], lo[M];
+        FP61_UNROLL for (unsigned r = 0; r < M; ++r) {
+            hi[r] = 0, lo[r] = 0;
+        }
+
+        FP61_UNROLL for (unsigned i = 0; i < N; ++i)
+        {
+            const uint64_t x = words[i * wordStride + j];
+            FP61_UNROLL for (unsigned r = 0; r < M; ++r) {
+                FP61_MULADD128(hi[r], lo[r], x, coeffs[r * N + i]);
+            }
+        }
+
+        FP61_UNROLL for (unsigned r = 0; r < M; ++r) {
+            out[r * outStride + j] = Finalize(PartialReduce(Reduce128(hi[r], lo[r])));
+        }
+    }
+}
+
+template<unsigned N, unsigned M>
+static void FixedMulAdd_Scalar(
+    const uint64_t* words,
+    unsigned wordStride,
+    const uint64_t* coeffs,
+    uint64_t* out,
+    unsigned outStride,
+    unsigned count)
+{
+    FixedMulAdd_Impl<N, M>(words, wordStride, coeffs, out, outStride, count);
+}
+
+#if defined(FP61_TRY_BMI2)
+
+// Same as the scalar version, but the compiler can use MULX
+template<unsigned N, unsigned M>
+FP61_TARGET_BMI2 static void FixedMulAdd_BMI2(
+    const uint64_t* words,
+    unsigned wordStride,
+    const uint64_t* coeffs,
+    uint64_t* out,
+    unsigned outStride,
+    unsigned count)
+{
+    FixedMulAdd_Impl<N, M>(words, wordStride, coeffs, out, outStride, count);
+}
+
+#endif // FP61_TRY_BMI2
+
+#if defined(FP61_TRY_AVX2)
+
+template<unsigned N, unsigned M>
+FP61_TARGET_AVX2 static void FixedMulAdd_AVX2(
+    const uint64_t* words,
+    unsigned wordStride,
+    const uint64_t* coeffs,
+    uint64_t* out,
+    unsigned outStride,
+    unsigned count)
+{
+    const __m256i prime = _mm256_set1_epi64x(kPrime);
+
+    unsigned j = 0;
+    for (; j + 4 <= count; j += 4)
+    {
+        __m256i sums[M];
+
+        FP61_UNROLL for (unsigned i = 0; i < N; ++i)
+        {
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i * wordStride + j));
+
+            FP61_UNROLL for (unsigned r = 0; r < M; ++r)
+            {
+                const __m256i product = Multiply_AVX2(x, _mm256_set1_epi64x(coeffs[r * N + i]));
+                if (i == 0) {
+                    sums[r] = product;
+                }
+                else {
+                    sums[r] = _mm256_add_epi64(sums[r], product);
+                }
+                if (FixedReduceAfter(i, N)) {
+                    sums[r] = PartialReduce_AVX2(sums[r]);
+                }
+            }
+        }
+
+        FP61_UNROLL for (unsigned r = 0; r < M; ++r)
+        {
+            // Finalize(): x + ((x + 1) >> 61), masked to 61 bits
+            const __m256i x = PartialReduce_AVX2(sums[r]);
+            const __m256i carry = _mm256_srli_epi64(_mm256_add_epi64(x, _mm256_set1_epi64x(1)), 61);
+            const __m256i result = _mm256_and_si256(_mm256_add_epi64(x, carry), prime);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + r * outStride + j), result);
+        }
+    }
+
+    FixedMulAdd_Impl<N, M>(words + j, wordStride, coeffs, out + j, outStride, count - j);
+}
+
+#endif // FP61_TRY_AVX2
+
+#if defined(FP61_TRY_AVX512)
+
+template<unsigned N, unsigned M>
+FP61_TARGET_AVX512 static void FixedMulAdd_AVX512(
+    const uint64_t* words,
+    unsigned wordStride,
+    const uint64_t* coeffs,
+    uint64_t* out,
+    unsigned outStride,
+    unsigned count)
+{
+    const __m512i prime = _mm512_set1_epi64(kPrime);
+
+    unsigned j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m512i sums[M];
+
+        FP61_UNROLL for (unsigned i = 0; i < N; ++i)
+        {
+            const __m512i x = _mm512_loadu_si512(words + i * wordStride + j);
+
+            FP61_UNROLL for (unsigned r = 0; r < M; ++r)
+            {
+                const __m512i product = Multiply_AVX512(x, _mm512_set1_epi64(coeffs[r * N + i]));
+                if (i == 0) {
+                    sums[r] = product;
+                }
+                else {
+                    sums[r] = _mm512_add_epi64(sums[r], product);
+                }
+                if (FixedReduceAfter(i, N)) {
+                    sums[r] = PartialReduce_AVX512(sums[r]);
+                }
+            }
+        }
+
+        FP61_UNROLL for (unsigned r = 0; r < M; ++r)
+        {
+            // Finalize(): x + ((x + 1) >> 61), masked to 61 bits
+            const __m512i x = PartialReduce_AVX512(sums[r]);
+            const __m512i carry = _mm512_srli_epi64(_mm512_add_epi64(x, _mm512_set1_epi64(1)), 61);
+            _mm512_storeu_si512(out + r * outStride + j, _mm512_and_si512(_mm512_add_epi64(x, carry), prime));
+        }
+    }
+
+    FixedMulAdd_Impl<N, M>(words + j, wordStride, coeffs, out + j, outStride, count - j);
+}
+
+#endif // FP61_TRY_AVX512
+
+#undef FP61_UNROLL
+#undef FP61_MULADD128
+
+// Table of the instantiations for each fixed N, and M = 1..kFixedMaxM
+static const unsigned kFixedN[] = { 4, 8, 10, 16, 32 };
+static const unsigned kFixedNCount = static_cast<unsigned>(sizeof(kFixedN) / sizeof(kFixedN[0]));
+
+static_assert(kFixedMaxM == 4, "FP61_FIXED_ROW lists M = 1..4");
+
+#define FP61_FIXED_ROW(kernel, n) \
+    { kernel<n, 1>, kernel<n, 2>, kernel<n, 3>, kernel<n, 4> }
+#define FP61_FIXED_TABLE(kernel) { \
+    FP61_FIXED_ROW(kernel, 4), \
+    FP61_FIXED_ROW(kernel, 8), \
+    FP61_FIXED_ROW(kernel, 10), \
+    FP61_FIXED_ROW(kernel, 16), \
+    FP61_FIXED_ROW(kernel, 32) }
+
+typedef FixedMulAddKernel FixedKernelTable[kFixedNCount][kFixedMaxM];
+
+static const FixedKernelTable kFixedKernels_Scalar = FP61_FIXED_TABLE(FixedMulAdd_Scalar);
+#if defined(FP61_TRY_BMI2)
+static const FixedKernelTable kFixedKernels_BMI2 = FP61_FIXED_TABLE(FixedMulAdd_BMI2);
+#endif // FP61_TRY_BMI2
+#if defined(FP61_TRY_AVX2)
+static const FixedKernelTable kFixedKernels_AVX2 = FP61_FIXED_TABLE(FixedMulAdd_AVX2);
+#endif // FP61_TRY_AVX2
+#if defined(FP61_TRY_AVX512)
+static const FixedKernelTable kFixedKernels_AVX512 = FP61_FIXED_TABLE(FixedMulAdd_AVX512);
+#endif // FP61_TRY_AVX512
+
+#undef FP61_FIXED_TABLE
+#undef FP61_FIXED_ROW
+
+FixedMulAddKernel GetFixedMulAddKernel(unsigned N, unsigned M)
+{
+    if (M < 1 || M > kFixedMaxM) {
+        return nullptr;
+    }
+
+    const KernelTable& kernels = GetKernels();
+    for (unsigned row = 0; row < kFixedNCount; ++row)
+    {
+        if (kFixedN[row] == N) {
+            return kernels.FixedMulAdd[row][M - 1];
+        }
+    }
+    return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+// Memory Reading
+
+// Extract 61 bits starting at the given bit offset from the data pointer.
+// Reads 9 bytes starting at byte offset `bitOffset / 8`.
+static FP61_FORCE_INLINE uint64_t ExtractBits61(const uint8_t* data, uint64_t bitOffset)
+{
+    const uint8_t* p = data + (bitOffset >> 3);
+    const unsigned shift = static_cast<unsigned>(bitOffset & 7);
+
+    const uint64_t lo = ReadU64_LE(p);
+    const uint64_t hi = p[8];
+
+    // The (hi << 1) << (63 - shift) form avoids a 64-bit shift when shift = 0
+    return ((lo >> shift) | ((hi << 1) << (63 - shift))) & kPrime;
+}
+
+// Set up a bit cursor that points at the first pending bit of the reader.
+// Precondition: All pending workspace bits are the high bits of the last
+// 8 bytes that were read, or nothing has been read yet
+static FP61_FORCE_INLINE void GetReaderCursor(
+    const ByteReader& reader,
+    const uint8_t*& data,
+    uint64_t& bitOffset,
+    uint64_t& endBytes)
+{
+    data = reader.Data;
+    bitOffset = 0;
+    endBytes = reader.Bytes;
+    if (reader.Available > 0)
+    {
+        data -= 8;
+        bitOffset = 64 - reader.Available;
+        endBytes += 8;
+    }
+}
+
+// Convert a bit cursor back into the Read() state
+static FP61_FORCE_INLINE void SetReaderCursor(
+    ByteReader& reader,
+    const uint8_t* data,
+    uint64_t bitOffset,
+    uint64_t endBytes,
+    bool pending,
+    uint64_t carry)
+{
+    const uint64_t nextByte = (bitOffset + 7) >> 3;
+    int available = static_cast<int>(nextByte * 8 - bitOffset);
+    uint64_t workspace = 0;
+    if (available > 0) {
+        workspace = static_cast<uint64_t>(data[nextByte - 1]) >> (8 - available);
+    }
+    if (pending)
+    {
+        workspace = (workspace << 1) | carry;
+        ++available;
+    }
+
+    reader.Data = data + nextByte;
+    reader.Bytes = static_cast<unsigned>(endBytes - nextByte);
+    reader.Workspace = workspace;
+    reader.Available = available;
+}
+
+// Bulk unpacker used by ReadWords() once the reader state is aligned
+static FP61_FORCE_INLINE unsigned ReadWordsBulk_Impl(
+    ByteReader& reader,
+    uint64_t* fpOut,
+    unsigned count,
+    unsigned maxWords)
+{
+    const uint8_t* data;
+    uint64_t bitOffset, endBytes;
+    GetReaderCursor(reader, data, bitOffset, endBytes);
+
+    // Extracting a word reads 9 bytes, so the fast paths stop short of the end
+    const uint64_t kBlockBits = 8 * 61;
+    const uint64_t kSafeBytes = 9;
+    uint64_t carry = 0;
+    bool pending = false;
+
+    for (;;)
+    {
+        const uint64_t lastNeededByte = (bitOffset + kBlockBits - 61) >> 3;
+
+        // Fast path: 8 words in 61 bytes, with no ambiguity in the block
+        if (!pending &&
+            count + 8 <= maxWords &&
+            lastNeededByte + kSafeBytes <= endBytes)
+        {
+            const uint64_t w0 = ExtractBits61(data, bitOffset);
+            const uint64_t w1 = ExtractBits61(data, bitOffset + 61);
+            const uint64_t w2 = ExtractBits61(data, bitOffset + 61 * 2);
+            const uint64_t w3 = ExtractBits61(data, bitOffset + 61 * 3);
+            const uint64_t w4 = ExtractBits61(data, bitOffset + 61 * 4);
+            const uint64_t w5 = ExtractBits61(data, bitOffset + 61 * 5);
+            const uint64_t w6 = ExtractBits61(data, bitOffset + 61 * 6);
+            const uint64_t w7 = ExtractBits61(data, bitOffset + 61 * 7);
+
+            // A word is ambiguous if its low 60 bits are all set.
+            // Adding 1 to each word carries into bit #60 only in that case.
+            const uint64_t anyAmbiguous =
+                ((w0 & kAmbiguityMask) + 1) | ((w1 & kAmbiguityMask) + 1) |
+                ((w2 & kAmbiguityMask) + 1) | ((w3 & kAmbiguityMask) + 1) |
+                ((w4 & kAmbiguityMask) + 1) | ((w5 & kAmbiguityMask) + 1) |
+                ((w6 & kAmbiguityMask) + 1) | ((w7 & kAmbiguityMask) + 1);
+
+            if ((anyAmbiguous >> 60) == 0)
+            {
+                fpOut[count] = w0;
+                fpOut[count + 1] = w1;
+                fpOut[count + 2] = w2;
+                fpOut[count + 3] = w3;
+                fpOut[count + 4] = w4;
+                fpOut[count + 5] = w5;
+                fpOut[count + 6] = w6;
+                fpOut[count + 7] = w7;
+                count += 8;
+                bitOffset += kBlockBits;
+                continue;
+            }
+        }
+
+        // Slow path: one word at a time, handling the ambiguity bit
+        if (count >= maxWords || (bitOffset >> 3) + kSafeBytes > endBytes) {
+            break;
+        }
+
+        uint64_t r = ExtractBits61(data, bitOffset);
+        if (pending)
+        {
+            // Insert bit 0 for 0ff..ff and 1 for 1ff..ff below the next bits
+            r = ((r << 1) | carry) & kPrime;
+            bitOffset += 60;
+        }
+        else {
+            bitOffset += 61;
+        }
+
+        pending = IsU64Ambiguous(r);
+        if (pending)
+        {
+            carry = r >> 60;
+            r = kAmbiguityMask;
+        }
+
+        fpOut[count++] = r;
+    }
+
+    SetReaderCursor(reader, data, bitOffset, endBytes, pending, carry);
+
+    return count;
+}
+
+static unsigned ReadWordsBulk_Scalar(ByteReader& reader, uint64_t* fpOut, unsigned count, unsigned maxWords)
+{
+    return ReadWordsBulk_Impl(reader, fpOut, count, maxWords);
+}
+
+#if defined(FP61_TRY_BMI2)
+
+// Same as the scalar version, but the compiler can use SHRX/SHLX
+FP61_TARGET_BMI2 static unsigned ReadWordsBulk_BMI2(ByteReader& reader, uint64_t* fpOut, unsigned count, unsigned maxWords)
+{
+    return ReadWordsBulk_Impl(reader, fpOut, count, maxWords);
+}
+
+#endif // FP61_TRY_BMI2
+
+unsigned ByteReader::ReadWords(uint64_t* fpOut, unsigned maxWords)
+{
+    unsigned count = 0;
+
+    /*
+        The bulk reader tracks a bit offset into the data rather than the
+        Workspace/Available state used by Read(), so it needs the reader to
+        be in a state where all pending workspace bits are the high bits of
+        the last 8 bytes that were read.  This is true at the start, or after
+        any call to Read() that fetched a full word and returned a word that
+        was not ambiguous (so no extra bit is pending).
+    */
+    if (Available != 0)
+    {
+        // After ResumeRead() the workspace bits are not in the bytes before
+        // Data, so keep reading until they are refilled from Data
+        const uint8_t* resumeData = Resumed ? Data : nullptr;
+
+        while (count < maxWords)
+        {
+            if (Read(fpOut[count]) != ReadResult::Success) {
+                return count;
+            }
+            const bool pending = (fpOut[count] == kAmbiguityMask);
+            ++count;
+
+            if (!pending && Data != resumeData) {
+                Resumed = false;
+                break;
+            }
+        }
+
+        if (Resumed) {
+            return count;
+        }
+    }
+    Resumed = false;
+
+    // If the Read() path has not already consumed the tail:
+    if (count < maxWords && Bytes > 0) {
+        count = GetKernels().ReadWordsBulk(*this, fpOut, count, maxWords);
+    }
+
+    // Finish up using the scalar reader
+    while (count < maxWords)
+    {
+        if (Read(fpOut[count]) != ReadResult::Success) {
+            break;
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+unsigned ByteReader::ReadWordsPartial(uint64_t* fpOut, unsigned maxWords)
 {
-    uint64_t u1, u3, v1, v3, qt;
+    /*
+        Each word takes at most 61 bits out of the workspace, and Read() only
+        pads the data with zeros when it needs more bits and fewer than 8
+        bytes are left.  So as long as 63 bits of the data would be left
+        after taking 61 bits per word, the words cannot depend on the end.
+    */
+    const uint64_t bits = static_cast<uint64_t>(Available) + static_cast<uint64_t>(Bytes) * 8;
 
-    qt = u / kPrime;
-    u3 = u % kPrime;
-    u1 = 1;
+    unsigned count = 0;
+    if (bits >= 63 + 61)
+    {
+        uint64_t safeWords = (bits - 63) / 61;
+        if (safeWords > maxWords) {
+            safeWords = maxWords;
+        }
+        count = ReadWords(fpOut, static_cast<unsigned>(safeWords));
+    }
 
-    if (u3 == 0) {
-        return 0; // No inverse
+    // Finish up with the scalar reader, as long as it does not need the tail
+    while (count < maxWords && (Bytes >= 8 || Available >= 61))
+    {
+        Read(fpOut[count]);
+        ++count;
     }
 
-    qt = kPrime / u3;
-    v3 = kPrime % u3;
-    v1 = qt;
+    return count;
+}
 
-    for (;;)
+// Returns true if the bytes in [begin, end) contain 4 bytes of 0xff
+// starting at an offset that is a multiple of 4
+static bool HasAlignedFFs(const uint8_t* begin, const uint8_t* end)
+{
+    // Flags a 32-bit lane of x that is zero, so ~w flags a lane of all ones.
+    // The subtraction borrows across lanes only from a lane that is zero
+    static const uint64_t kLow = 0x0000000100000001ULL;
+    static const uint64_t kHigh = 0x8000000080000000ULL;
+#define FP61_HAS_ZERO_U32(x) (((x) - kLow) & ~(x) & kHigh)
+
+    for (; begin + 32 <= end; begin += 32)
     {
-        if (v3 == 0) {
-            return u3 == 1 ? u1 : 0;
+        const uint64_t x0 = ~ReadU64_LE(begin);
+        const uint64_t x1 = ~ReadU64_LE(begin + 8);
+        const uint64_t x2 = ~ReadU64_LE(begin + 16);
+        const uint64_t x3 = ~ReadU64_LE(begin + 24);
+
+        if (FP61_HAS_ZERO_U32(x0) | FP61_HAS_ZERO_U32(x1) |
+            FP61_HAS_ZERO_U32(x2) | FP61_HAS_ZERO_U32(x3))
+        {
+            return true;
         }
+    }
 
-        qt = u3 / v3;
-        u3 %= v3;
-        u1 += qt * v1;
+#undef FP61_HAS_ZERO_U32
 
-        if (u3 == 0) {
-            return v3 == 1 ? kPrime - v1 : 0;
+    for (; begin + 8 <= end; begin += 8)
+    {
+        const uint64_t w = ReadU64_LE(begin);
+        if ((uint32_t)w == 0xffffffff || (w >> 32) == 0xffffffff) {
+            return true;
+        }
+    }
+    for (; begin + 4 <= end; begin += 4) {
+        if (ReadU32_LE(begin) == 0xffffffff) {
+            return true;
         }
+    }
+    return false;
+}
 
-        qt = v3 / u3;
-        v3 %= u3;
-        v1 += qt * u1;
+unsigned ByteReader::SkipWords(unsigned maxWords)
+{
+    /*
+        An ambiguous word has 60 bits set in a row, so it covers at least
+        7 whole bytes of 0xff, and any 7 bytes in a row include 4 bytes that
+        start at an offset that is a multiple of 4.  If a span of the data
+        does not have any of those, then each word in it consumes exactly
+        61 bits, and the cursor can jump over the span without unpacking it.
+    */
+    static const unsigned kSkipBlockWords = 512;
+    uint64_t scratch[kSkipBlockWords];
+
+    unsigned count = 0;
+    bool cursorKnown = false;
+
+    while (count < maxWords)
+    {
+        // Get the reader into a state where the bit cursor is known,
+        // the same way that ReadWords() does
+        if (!cursorKnown && Available != 0)
+        {
+            const uint8_t* readData = Data;
+            uint64_t word;
+            if (Read(word) != ReadResult::Success) {
+                break;
+            }
+            ++count;
+            if (word == kAmbiguityMask) {
+                continue;
+            }
+            // After ResumeRead() wait until the workspace is refilled from Data
+            if (Resumed && Data == readData) {
+                continue;
+            }
+        }
+        cursorKnown = true;
+        Resumed = false;
+
+        unsigned block = maxWords - count;
+        if (block > kSkipBlockWords) {
+            block = kSkipBlockWords;
+        }
+
+        if (Bytes > 0)
+        {
+            const uint8_t* data;
+            uint64_t bitOffset, endBytes;
+            GetReaderCursor(*this, data, bitOffset, endBytes);
+
+            const uint64_t nextBitOffset = bitOffset + (uint64_t)block * 61;
+            const uint64_t spanEnd = (nextBitOffset + 7) >> 3;
+
+            // Stay clear of the end so the word count is not affected by it
+            if (spanEnd + 9 <= endBytes &&
+                !HasAlignedFFs(data + (bitOffset >> 3), data + spanEnd))
+            {
+                SetReaderCursor(*this, data, nextBitOffset, endBytes, false, 0);
+                count += block;
+                continue;
+            }
+        }
+
+        const unsigned readCount = ReadWords(scratch, block);
+        count += readCount;
+        if (readCount < block) {
+            break;
+        }
+        cursorKnown = false;
     }
+
+    return count;
 }
 
 
 //------------------------------------------------------------------------------
-// Memory Reading
+// MultiByteReader
+
+void MultiByteReader::GetLane(unsigned lane, ByteReader& reader) const
+{
+    reader.Data = Data[lane];
+    reader.Bytes = Bytes[lane];
+    reader.Workspace = Workspace[lane];
+    reader.Available = Available[lane];
+    reader.Resumed = false;
+}
+
+void MultiByteReader::SetLane(unsigned lane, const ByteReader& reader)
+{
+    Data[lane] = reader.Data;
+    Bytes[lane] = reader.Bytes;
+    Workspace[lane] = reader.Workspace;
+    Available[lane] = reader.Available;
+}
+
+/*
+    One step of ByteReader::Read() for a lane, written with masks.
+
+    Precondition: The lane has at least 8 bytes left, so the next 8 bytes
+    can always be loaded even if they are not used.  Available is then
+    between 0 and 64.
+
+    If fewer than 61 bits are available, the next 8 bytes are shifted in
+    and Available grows by 3 bits, otherwise 61 bits are taken from the
+    workspace.  If the word is ambiguous, its high bit is pushed back into
+    the workspace and the word becomes kAmbiguityMask.
+*/
+static FP61_FORCE_INLINE uint64_t MultiReadStep(
+    const uint8_t*& data,
+    unsigned& bytes,
+    uint64_t& workspace,
+    int& available)
+{
+    const uint64_t word = ReadU64_LE(data);
+    const uint64_t ws = workspace;
+    const int a = available;
+
+    // All ones if the next 8 bytes are needed
+    const uint64_t need = (uint64_t)0 - (uint64_t)(a < 61);
+
+    uint64_t r = (ws | ((word << (a & 63)) & need)) & kPrime;
+    uint64_t next = (need & (word >> ((61 - a) & 63))) | (~need & (ws >> 61));
+    int nextAvailable = a - 61 + (int)(need & 64);
+
+    data += need & 8;
+    bytes -= (unsigned)(need & 8);
+
+    // All ones if the word is ambiguous
+    const uint64_t amb = (uint64_t)0 - (uint64_t)((r & kAmbiguityMask) == kAmbiguityMask);
+    nextAvailable += (int)(amb & 1);
+    next = (next << (amb & 1)) | ((r >> 60) & amb);
+    r &= ~(amb & ((uint64_t)1 << 60));
+
+    workspace = next;
+    available = nextAvailable;
+    return r;
+}
+
+// Returns the fewest bytes left in any lane
+static FP61_FORCE_INLINE unsigned GetMinBytes(const unsigned* bytes)
+{
+    unsigned minBytes = bytes[0];
+    for (unsigned lane = 1; lane < kMultiReaderLanes; ++lane) {
+        if (minBytes > bytes[lane]) {
+            minBytes = bytes[lane];
+        }
+    }
+    return minBytes;
+}
 
-uint64_t ReadBytes_LE(const uint8_t* data, unsigned bytes)
+unsigned MultiByteReader::Read(uint64_t* fpOut)
 {
-    switch (bytes)
+    if (GetMinBytes(Bytes) >= 8)
+    {
+        for (unsigned lane = 0; lane < kMultiReaderLanes; ++lane) {
+            fpOut[lane] = MultiReadStep(Data[lane], Bytes[lane], Workspace[lane], Available[lane]);
+        }
+        return (1u << kMultiReaderLanes) - 1;
+    }
+
+    unsigned mask = 0;
+    for (unsigned lane = 0; lane < kMultiReaderLanes; ++lane)
     {
-    case 8: return ReadU64_LE(data);
-    case 7: return ((uint64_t)data[6] << 48) | ((uint64_t)data[5] << 40) | ((uint64_t)data[4] << 32) | ReadU32_LE(data);
-    case 6: return ((uint64_t)data[5] << 40) | ((uint64_t)data[4] << 32) | ReadU32_LE(data);
-    case 5: return ((uint64_t)data[4] << 32) | ReadU32_LE(data);
-    case 4: return ReadU32_LE(data);
-    case 3: return ((uint32_t)data[2] << 16) | ((uint32_t)data[1] << 8) | data[0];
-    case 2: return ((uint32_t)data[1] << 8) | data[0];
-    case 1: return data[0];
-    default: break;
+        ByteReader reader;
+        GetLane(lane, reader);
+        if (reader.Read(fpOut[lane]) == ReadResult::Success) {
+            mask |= 1u << lane;
+        }
+        else {
+            fpOut[lane] = 0;
+        }
+        SetLane(lane, reader);
     }
-    return 0;
+    return mask;
 }
 
-ReadResult ByteReader::Read(uint64_t& fpOut)
+// Run the steps [count, end) for every lane.  Each lane must have at least
+// 8 * (end - count) bytes left
+static FP61_FORCE_INLINE void MultiReadSteps_Impl(
+    MultiByteReader& reader,
+    uint64_t* const* fpOut,
+    unsigned count,
+    unsigned end)
 {
-    uint64_t word, r, workspace = Workspace;
-    int nextAvailable, available = Available;
+    static_assert(kMultiReaderLanes == 4, "Written out for 4 lanes");
+
+    // The four lanes are written out so each lane's state is held in registers
+    const uint8_t* d0 = reader.Data[0], *d1 = reader.Data[1];
+    const uint8_t* d2 = reader.Data[2], *d3 = reader.Data[3];
+    unsigned b0 = reader.Bytes[0], b1 = reader.Bytes[1];
+    unsigned b2 = reader.Bytes[2], b3 = reader.Bytes[3];
+    uint64_t w0 = reader.Workspace[0], w1 = reader.Workspace[1];
+    uint64_t w2 = reader.Workspace[2], w3 = reader.Workspace[3];
+    int a0 = reader.Available[0], a1 = reader.Available[1];
+    int a2 = reader.Available[2], a3 = reader.Available[3];
+    uint64_t* o0 = fpOut[0], *o1 = fpOut[1], *o2 = fpOut[2], *o3 = fpOut[3];
 
-    // If enough bits are already available:
-    if (available >= 61)
+    for (; count < end; ++count)
     {
-        r = workspace & kPrime;
-        workspace >>= 61;
-        nextAvailable = available - 61;
+        o0[count] = MultiReadStep(d0, b0, w0, a0);
+        o1[count] = MultiReadStep(d1, b1, w1, a1);
+        o2[count] = MultiReadStep(d2, b2, w2, a2);
+        o3[count] = MultiReadStep(d3, b3, w3, a3);
     }
-    else
+
+    reader.Data[0] = d0, reader.Data[1] = d1, reader.Data[2] = d2, reader.Data[3] = d3;
+    reader.Bytes[0] = b0, reader.Bytes[1] = b1, reader.Bytes[2] = b2, reader.Bytes[3] = b3;
+    reader.Workspace[0] = w0, reader.Workspace[1] = w1;
+    reader.Workspace[2] = w2, reader.Workspace[3] = w3;
+    reader.Available[0] = a0, reader.Available[1] = a1;
+    reader.Available[2] = a2, reader.Available[3] = a3;
+}
+
+void MultiByteReader::ReadWords(uint64_t* const* fpOut, unsigned maxWords, unsigned* counts)
+{
+    // Each step uses at most 8 bytes of a lane, so with at least 8 * k bytes
+    // left in every lane the next k steps can run without checking the end
+    unsigned count = 0;
+    for (;;)
     {
-        unsigned bytes = Bytes;
+        unsigned steps = GetMinBytes(Bytes) / 8;
+        if (steps > maxWords - count) {
+            steps = maxWords - count;
+        }
+        if (steps == 0) {
+            break;
+        }
+
+        MultiReadSteps_Impl(*this, fpOut, count, count + steps);
+        count += steps;
+    }
 
-        // Read a word to fill in the difference
-        if (bytes >= 8)
+    // Finish each lane on its own
+    for (unsigned lane = 0; lane < kMultiReaderLanes; ++lane)
+    {
+        counts[lane] = count;
+        if (count < maxWords)
         {
-            word = ReadU64_LE(Data);
-            Data += 8;
-            Bytes = bytes - 8;
-            nextAvailable = available + 3;
+            ByteReader reader;
+            GetLane(lane, reader);
+            counts[lane] += reader.ReadWords(fpOut[lane] + count, maxWords - count);
+            SetLane(lane, reader);
         }
-        else
+    }
+}
+
+
+void WordReader::ReadWords(uint64_t* fpOut, unsigned count)
+{
+    unsigned i = 0;
+
+    // WordReader workspace bits are always the high bits of the last full
+    // 8 bytes that were read, so the bit cursor can start from there
+    if (Bytes > 0)
+    {
+        const uint8_t* data = Data;
+        uint64_t bitOffset = 0;
+        uint64_t endBytes = Bytes;
+        if (Available > 0)
         {
-            if (bytes == 0 && available <= 0) {
-                return ReadResult::Empty;
-            }
+            data -= 8;
+            bitOffset = 64 - Available;
+            endBytes += 8;
+        }
 
-            word = ReadBytes_LE(Data, bytes);
-            Bytes = 0;
+        // Extracting a word reads 9 bytes, so this stops short of the end
+        while (i < count && (bitOffset >> 3) + 9 <= endBytes)
+        {
+            fpOut[i++] = ExtractBits61(data, bitOffset);
+            bitOffset += 61;
+        }
 
-            // Note this may go negative but we check for that above
-            nextAvailable = available + bytes * 8 - 61;
+        // Convert the bit cursor back into the Read() state
+        const uint64_t nextByte = (bitOffset + 7) >> 3;
+        const unsigned available = static_cast<unsigned>(nextByte * 8 - bitOffset);
+        uint64_t workspace = 0;
+        if (available > 0) {
+            workspace = static_cast<uint64_t>(data[nextByte - 1]) >> (8 - available);
         }
 
-        // This assumes workspace high bits (beyond `available`) are 0
-        r = (workspace | (word << available)) & kPrime;
+        Data = data + nextByte;
+        Bytes = static_cast<unsigned>(endBytes - nextByte);
+        Workspace = workspace;
+        Available = available;
+    }
 
-        // Remaining workspace bits are taken from read word
-        workspace = word >> (61 - available);
+    for (; i < count; ++i) {
+        fpOut[i] = Read();
     }
+}
 
-    // If there is ambiguity in the representation:
-    if (IsU64Ambiguous(r))
-    {
-        // This will not overflow because available <= 60.
-        // We add up to 3 more bits, so adding one more keeps us within 64 bits.
-        ++nextAvailable;
 
-        // Insert bit 0 for 0ff..ff and 1 for 1ff..ff to resolve the ambiguity
-        workspace = (workspace << 1) | (r >> 60);
+//------------------------------------------------------------------------------
+// Memory Writing
+
+/**
+    Pack 64 words of 61 bits into 61 words of 64 bits.
 
-        // Use kAmbiguity value for a placeholder
-        r = kAmbiguityMask;
+    Output word j holds stream bits 64*j .. 64*j+63, which come from input
+    word i = (64*j)/61 shifted down by 64*j - 61*i, plus the next one or two
+    input words.  This schedule does not depend on the data, so when it is
+    unrolled all the shifts are constants and there are no branches.
+
+    Preconditions: The writer workspace is empty (Available = 0).
+    After packing 64 words the workspace is still empty.
+*/
+static void PackWords64(uint8_t* dest, const uint64_t* words)
+{
+#define FP61_PACK_WORD(j) \
+    { \
+        const unsigned i = ((j) * 64) / 61; \
+        const unsigned shift = ((j) * 64) % 61; \
+        uint64_t packed = (words[i] >> shift) | (words[i + 1] << (61 - shift)); \
+        if (shift > 58) { \
+            packed |= words[i + 2] << ((122 - shift) & 63); \
+        } \
+        WriteU64_LE(dest + (j) * 8, packed); \
     }
 
-    Workspace = workspace;
-    Available = nextAvailable;
+    FP61_PACK_WORD(0) FP61_PACK_WORD(1) FP61_PACK_WORD(2) FP61_PACK_WORD(3) FP61_PACK_WORD(4)
+    FP61_PACK_WORD(5) FP61_PACK_WORD(6) FP61_PACK_WORD(7) FP61_PACK_WORD(8) FP61_PACK_WORD(9)
+    FP61_PACK_WORD(10) FP61_PACK_WORD(11) FP61_PACK_WORD(12) FP61_PACK_WORD(13) FP61_PACK_WORD(14)
+    FP61_PACK_WORD(15) FP61_PACK_WORD(16) FP61_PACK_WORD(17) FP61_PACK_WORD(18) FP61_PACK_WORD(19)
+    FP61_PACK_WORD(20) FP61_PACK_WORD(21) FP61_PACK_WORD(22) FP61_PACK_WORD(23) FP61_PACK_WORD(24)
+    FP61_PACK_WORD(25) FP61_PACK_WORD(26) FP61_PACK_WORD(27) FP61_PACK_WORD(28) FP61_PACK_WORD(29)
+    FP61_PACK_WORD(30) FP61_PACK_WORD(31) FP61_PACK_WORD(32) FP61_PACK_WORD(33) FP61_PACK_WORD(34)
+    FP61_PACK_WORD(35) FP61_PACK_WORD(36) FP61_PACK_WORD(37) FP61_PACK_WORD(38) FP61_PACK_WORD(39)
+    FP61_PACK_WORD(40) FP61_PACK_WORD(41) FP61_PACK_WORD(42) FP61_PACK_WORD(43) FP61_PACK_WORD(44)
+    FP61_PACK_WORD(45) FP61_PACK_WORD(46) FP61_PACK_WORD(47) FP61_PACK_WORD(48) FP61_PACK_WORD(49)
+    FP61_PACK_WORD(50) FP61_PACK_WORD(51) FP61_PACK_WORD(52) FP61_PACK_WORD(53) FP61_PACK_WORD(54)
+    FP61_PACK_WORD(55) FP61_PACK_WORD(56) FP61_PACK_WORD(57) FP61_PACK_WORD(58) FP61_PACK_WORD(59)
+    FP61_PACK_WORD(60)
+
+#undef FP61_PACK_WORD
+}
 
-    fpOut = r;
-    return ReadResult::Success;
+/**
+    Words are 61 bits, so each one written moves Available from A to A - 3
+    (mod 64).  The inverse of 3 (mod 64) is 43, so this many words need to be
+    written one at a time before the workspace is empty again.
+*/
+static FP61_FORCE_INLINE unsigned WordsUntilAligned(unsigned available)
+{
+    return (available * 43) % 64;
 }
 
-uint64_t WordReader::Read()
+void WordWriter::WriteWords(const uint64_t* words, unsigned count)
 {
-    int nextAvailable, available = Available;
-    uint64_t r, workspace = Workspace;
+    void (*packWords64)(uint8_t* dest, const uint64_t* words) = GetKernels().PackWords64;
+    const unsigned prologue = WordsUntilAligned(Available);
 
-    if (available >= 61)
+    if (count >= prologue + 64)
     {
-        r = workspace & kPrime;
-        nextAvailable = available - 61;
-        workspace >>= 61;
+        for (unsigned i = 0; i < prologue; ++i) {
+            Write(words[i]);
+        }
+        words += prologue;
+        count -= prologue;
+
+        do
+        {
+            packWords64(DataWritePtr, words);
+            DataWritePtr += 61 * 8;
+            words += 64;
+            count -= 64;
+        } while (count >= 64);
     }
-    else
+
+    for (unsigned i = 0; i < count; ++i) {
+        Write(words[i]);
+    }
+}
+
+void ByteWriter::WriteWords(const uint64_t* words, unsigned count)
+{
+    void (*packWords64)(uint8_t* dest, const uint64_t* words) = GetKernels().PackWords64;
+    while (count >= 64)
     {
-        uint64_t word;
-        unsigned bytes = Bytes;
+        // Write words one at a time until the workspace is empty
+        if (Writer.Available != 0)
+        {
+            Write(words[0]);
+            ++words;
+            --count;
+            continue;
+        }
+
+        // Check if any word in the block needs to be written with 60 bits
+        uint64_t ambiguous = 0;
+        for (unsigned i = 0; i < 64; ++i) {
+            ambiguous |= (words[i] == kAmbiguityMask);
+        }
 
-        // If we can read a full word:
-        if (bytes >= 8)
+        if (ambiguous == 0)
         {
-            word = ReadU64_LE(Data);
-            Data += 8;
-            Bytes = bytes - 8;
-            nextAvailable = available + 3; // +64 - 61
+            packWords64(Writer.DataWritePtr, words);
+            Writer.DataWritePtr += 61 * 8;
         }
         else
         {
-            if (bytes == 0 && available <= 0) {
-                return 0; // No data left to read
+            for (unsigned i = 0; i < 64; ++i) {
+                Write(words[i]);
             }
+        }
+
+        words += 64;
+        count -= 64;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        Write(words[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Fixed Layout Packing
+
+unsigned FixedByteReader::ReadWords(uint64_t* fpOut, unsigned maxWords)
+{
+    const unsigned wordCount = WordCount(Bytes);
+    const unsigned first = NextWord;
+    unsigned k = first;
+    const unsigned end = (maxWords < wordCount - k) ? k + maxWords : wordCount;
+
+    // Start on an even word so that pairs begin on a 15 byte boundary
+    if ((k & 1) != 0 && k < end) {
+        *fpOut++ = ReadWord(k++);
+    }
+
+    // Pairs of words that are entirely inside the data.
+    // The second word is loaded from byte 7 of the pair, so the 8-byte loads
+    // stay within the 15 bytes of the pair
+    const unsigned fullPairs = Bytes / 15;
+    const unsigned firstPair = k / 2;
+    unsigned pairs = (end - k) / 2;
+    if (firstPair + pairs > fullPairs) {
+        pairs = (firstPair < fullPairs) ? fullPairs - firstPair : 0;
+    }
+
+    const uint8_t* data = Data + firstPair * 15;
+    for (unsigned i = 0; i < pairs; ++i)
+    {
+        fpOut[0] = ReadU64_LE(data) & kFixedWordMask;
+        fpOut[1] = ReadU64_LE(data + 7) >> 4;
+        fpOut += 2;
+        data += 15;
+    }
+    k += pairs * 2;
+
+    // Finish the tail, which may be short of 8 bytes
+    while (k < end) {
+        *fpOut++ = ReadWord(k++);
+    }
+
+    NextWord = k;
+    return k - first;
+}
+
+void FixedByteWriter::WriteWords(const uint64_t* words, unsigned count)
+{
+    // Write words one at a time until the output is at a pair boundary
+    while (count > 0 && Available != 0)
+    {
+        Write(words[0]);
+        ++words;
+        --count;
+    }
+
+    // Write pairs of words as 15 bytes.  The second store writes one extra
+    // zero byte, which is overwritten by the next pair or left in bounds
+    while (count >= 2 && Bytes >= 16)
+    {
+        const uint64_t w0 = words[0] & kFixedWordMask;
+        const uint64_t w1 = words[1] & kFixedWordMask;
+
+        WriteU64_LE(DataWritePtr, w0 | (w1 << 60));
+        WriteU64_LE(DataWritePtr + 8, w1 >> 4);
+
+        DataWritePtr += 15;
+        Bytes -= 15;
+        words += 2;
+        count -= 2;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        Write(words[i]);
+    }
+}
+
 
-            word = ReadBytes_LE(Data, bytes);
+//------------------------------------------------------------------------------
+// Random Fill Kernels
+
+// Lane states are stored word-major: lanes[k * kRandomFillLanes + l] holds
+// State[k] of stream l, so each state word loads as one vector.
+// Each block writes one output from every lane, in lane order.
+
+static void FillRandom_Scalar(uint64_t* lanes, uint64_t* out, unsigned blocks, bool nonzero)
+{
+    uint64_t s0[kRandomFillLanes], s1[kRandomFillLanes];
+    uint64_t s2[kRandomFillLanes], s3[kRandomFillLanes];
+
+    for (unsigned l = 0; l < kRandomFillLanes; ++l)
+    {
+        s0[l] = lanes[l];
+        s1[l] = lanes[kRandomFillLanes + l];
+        s2[l] = lanes[kRandomFillLanes * 2 + l];
+        s3[l] = lanes[kRandomFillLanes * 3 + l];
+    }
+
+    for (unsigned b = 0; b < blocks; ++b, out += kRandomFillLanes)
+    {
+        for (unsigned l = 0; l < kRandomFillLanes; ++l)
+        {
+            const uint64_t result = s0[l] + s3[l];
 
-            // Note this may go negative but we check for negative above
-            nextAvailable = available + bytes * 8 - 61;
+            const uint64_t t = s1[l] << 17;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = CAT_ROL64(s3[l], 45);
 
-            Bytes = 0;
+            out[l] = nonzero ? Random::ConvertRandToNonzeroFp(result)
+                : Random::ConvertRandToFp(result);
         }
+    }
 
-        r = (workspace | (word << available)) & kPrime;
-        workspace = word >> (61 - available);
+    for (unsigned l = 0; l < kRandomFillLanes; ++l)
+    {
+        lanes[l] = s0[l];
+        lanes[kRandomFillLanes + l] = s1[l];
+        lanes[kRandomFillLanes * 2 + l] = s2[l];
+        lanes[kRandomFillLanes * 3 + l] = s3[l];
     }
+}
 
-    Workspace = workspace;
-    Available = nextAvailable;
+#if defined(FP61_TRY_AVX2)
 
-    return r;
+FP61_TARGET_AVX2 static void FillRandom_AVX2(uint64_t* lanes, uint64_t* out, unsigned blocks, bool nonzero)
+{
+    static_assert(kRandomFillLanes == 8, "Kernel steps two groups of four lanes");
+
+    __m256i* state = reinterpret_cast<__m256i*>(lanes);
+    __m256i a0 = _mm256_loadu_si256(state + 0), b0 = _mm256_loadu_si256(state + 1);
+    __m256i a1 = _mm256_loadu_si256(state + 2), b1 = _mm256_loadu_si256(state + 3);
+    __m256i a2 = _mm256_loadu_si256(state + 4), b2 = _mm256_loadu_si256(state + 5);
+    __m256i a3 = _mm256_loadu_si256(state + 6), b3 = _mm256_loadu_si256(state + 7);
+
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i zeroFix = nonzero ? one : _mm256_setzero_si256();
+
+#define FP61_RANDOM_AVX2(s0, s1, s2, s3, offset) \
+    { \
+        __m256i r = _mm256_add_epi64(s0, s3); \
+        const __m256i t = _mm256_slli_epi64(s1, 17); \
+        s2 = _mm256_xor_si256(s2, s0); \
+        s3 = _mm256_xor_si256(s3, s1); \
+        s1 = _mm256_xor_si256(s1, s2); \
+        s0 = _mm256_xor_si256(s0, s3); \
+        s2 = _mm256_xor_si256(s2, t); \
+        s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19)); \
+        r = _mm256_srli_epi64(r, 3); \
+        r = _mm256_sub_epi64(r, _mm256_srli_epi64(_mm256_add_epi64(r, one), 61)); \
+        r = _mm256_add_epi64(r, _mm256_and_si256(zeroFix, \
+            _mm256_srli_epi64(_mm256_sub_epi64(r, one), 63))); \
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (offset)), r); \
+    }
+
+    for (unsigned b = 0; b < blocks; ++b, out += kRandomFillLanes)
+    {
+        FP61_RANDOM_AVX2(a0, a1, a2, a3, 0);
+        FP61_RANDOM_AVX2(b0, b1, b2, b3, 4);
+    }
+
+#undef FP61_RANDOM_AVX2
+
+    _mm256_storeu_si256(state + 0, a0), _mm256_storeu_si256(state + 1, b0);
+    _mm256_storeu_si256(state + 2, a1), _mm256_storeu_si256(state + 3, b1);
+    _mm256_storeu_si256(state + 4, a2), _mm256_storeu_si256(state + 5, b2);
+    _mm256_storeu_si256(state + 6, a3), _mm256_storeu_si256(state + 7, b3);
+}
+
+#endif // FP61_TRY_AVX2
+
+#if defined(FP61_TRY_AVX512)
+
+FP61_TARGET_AVX512 static void FillRandom_AVX512(uint64_t* lanes, uint64_t* out, unsigned blocks, bool nonzero)
+{
+    static_assert(kRandomFillLanes == 8, "Kernel steps eight lanes per vector");
+
+    __m512i s0 = _mm512_loadu_si512(lanes);
+    __m512i s1 = _mm512_loadu_si512(lanes + kRandomFillLanes);
+    __m512i s2 = _mm512_loadu_si512(lanes + kRandomFillLanes * 2);
+    __m512i s3 = _mm512_loadu_si512(lanes + kRandomFillLanes * 3);
+
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i zeroFix = nonzero ? one : _mm512_setzero_si512();
+
+    for (unsigned b = 0; b < blocks; ++b, out += kRandomFillLanes)
+    {
+        __m512i r = _mm512_add_epi64(s0, s3);
+        const __m512i t = _mm512_slli_epi64(s1, 17);
+        s2 = _mm512_xor_si512(s2, s0);
+        s3 = _mm512_xor_si512(s3, s1);
+        s1 = _mm512_xor_si512(s1, s2);
+        s0 = _mm512_xor_si512(s0, s3);
+        s2 = _mm512_xor_si512(s2, t);
+        s3 = _mm512_rol_epi64(s3, 45);
+
+        r = _mm512_srli_epi64(r, 3);
+        r = _mm512_sub_epi64(r, _mm512_srli_epi64(_mm512_add_epi64(r, one), 61));
+        r = _mm512_add_epi64(r, _mm512_and_si512(zeroFix,
+            _mm512_srli_epi64(_mm512_sub_epi64(r, one), 63)));
+        _mm512_storeu_si512(out, r);
+    }
+
+    _mm512_storeu_si512(lanes, s0);
+    _mm512_storeu_si512(lanes + kRandomFillLanes, s1);
+    _mm512_storeu_si512(lanes + kRandomFillLanes * 2, s2);
+    _mm512_storeu_si512(lanes + kRandomFillLanes * 3, s3);
 }
 
+#endif // FP61_TRY_AVX512
+
 
 //------------------------------------------------------------------------------
-// Memory Writing
+// Initialization
 
-void WriteBytes_LE(uint8_t* data, unsigned bytes, uint64_t value)
+void Init(unsigned disabledFeatures)
 {
-    switch (bytes)
+    const unsigned features = DetectCpuFeatures() & ~disabledFeatures;
+
+    KernelTable kernels;
+    KernelInfo info;
+    info.CpuFeatures = features;
+    DetectCacheSizes(info.L1DataCacheBytes, info.L2CacheBytes);
+
+    // The fixed geometry kernels use the same instruction set as MulAddMem()
+    kernels.MulAddMem = MulAddMem_Scalar;
+    kernels.FixedMulAdd = kFixedKernels_Scalar;
+    info.MulAdd = "Scalar";
+#if defined(FP61_TRY_BMI2)
+    if (features & kCpuFeatureBMI2)
     {
-    case 8: WriteU64_LE(data, value);
-        return;
-    case 7: data[6] = (uint8_t)(value >> 48);
-    case 6: data[5] = (uint8_t)(value >> 40);
-    case 5: data[4] = (uint8_t)(value >> 32);
-    case 4: WriteU32_LE(data, static_cast<uint32_t>(value));
-        return;
-    case 3: data[2] = (uint8_t)(value >> 16);
-    case 2: data[1] = (uint8_t)(value >> 8);
-    case 1: data[0] = (uint8_t)value;
-    default: break;
+        kernels.MulAddMem = MulAddMem_BMI2;
+        kernels.FixedMulAdd = kFixedKernels_BMI2;
+        info.MulAdd = "BMI2";
+    }
+#endif // FP61_TRY_BMI2
+#if defined(FP61_TRY_AVX2)
+    if (features & kCpuFeatureAVX2)
+    {
+        kernels.MulAddMem = MulAddMem_AVX2;
+        kernels.FixedMulAdd = kFixedKernels_AVX2;
+        info.MulAdd = "AVX2";
+    }
+#endif // FP61_TRY_AVX2
+#if defined(FP61_TRY_AVX512)
+    if (features & kCpuFeatureAVX512F)
+    {
+        kernels.MulAddMem = MulAddMem_AVX512;
+        kernels.FixedMulAdd = kFixedKernels_AVX512;
+        info.MulAdd = "AVX-512F";
+    }
+#endif // FP61_TRY_AVX512
+
+    kernels.Fp2MulMem = Fp2MulMem_Scalar;
+    kernels.Fp2MulAddMem = Fp2MulAddMem_Scalar;
+    info.Fp2 = "Scalar";
+#if defined(FP61_TRY_AVX2)
+    if (features & kCpuFeatureAVX2)
+    {
+        kernels.Fp2MulMem = Fp2MulMem_AVX2;
+        kernels.Fp2MulAddMem = Fp2MulAddMem_AVX2;
+        info.Fp2 = "AVX2";
+    }
+#endif // FP61_TRY_AVX2
+#if defined(FP61_TRY_AVX512)
+    if (features & kCpuFeatureAVX512F)
+    {
+        kernels.Fp2MulMem = Fp2MulMem_AVX512;
+        kernels.Fp2MulAddMem = Fp2MulAddMem_AVX512;
+        info.Fp2 = "AVX-512F";
+    }
+#endif // FP61_TRY_AVX512
+
+    kernels.ReadWordsBulk = ReadWordsBulk_Scalar;
+    info.Read = "Scalar";
+#if defined(FP61_TRY_BMI2)
+    if (features & kCpuFeatureBMI2)
+    {
+        kernels.ReadWordsBulk = ReadWordsBulk_BMI2;
+        info.Read = "BMI2";
+    }
+#endif // FP61_TRY_BMI2
+
+    // The fixed packing schedule only uses constant shifts
+    kernels.PackWords64 = PackWords64;
+    info.Write = "Scalar";
+
+    kernels.FillRandom = FillRandom_Scalar;
+    info.Random = "Scalar";
+#if defined(FP61_TRY_AVX2)
+    if (features & kCpuFeatureAVX2)
+    {
+        kernels.FillRandom = FillRandom_AVX2;
+        info.Random = "AVX2";
+    }
+#endif // FP61_TRY_AVX2
+#if defined(FP61_TRY_AVX512)
+    if (features & kCpuFeatureAVX512F)
+    {
+        kernels.FillRandom = FillRandom_AVX512;
+        info.Random = "AVX-512F";
     }
+#endif // FP61_TRY_AVX512
+
+    Kernels = kernels;
+    Info = info;
+    Initialized.store(true, std::memory_order_release);
+}
+
+const KernelInfo& GetKernelInfo()
+{
+    EnsureInitialized();
+    return Info;
 }
 
 
@@ -253,5 +2181,41 @@ void Random::Seed(uint64_t x)
     State[3] = h;
 }
 
+static void FillRandom(Random& prng, uint64_t* out, unsigned count, bool nonzero)
+{
+    // Seed the streams from one output of the main generator
+    uint64_t lanes[4 * kRandomFillLanes];
+    const uint64_t base = prng.Next();
+    for (unsigned i = 0; i < 4 * kRandomFillLanes; ++i) {
+        lanes[i] = HashU64(base + i);
+    }
+
+    const KernelTable& kernels = GetKernels();
+
+    const unsigned blocks = count / kRandomFillLanes;
+    kernels.FillRandom(lanes, out, blocks, nonzero);
+
+    const unsigned tail = count % kRandomFillLanes;
+    if (tail > 0)
+    {
+        uint64_t last[kRandomFillLanes];
+        kernels.FillRandom(lanes, last, 1, nonzero);
+        out += blocks * kRandomFillLanes;
+        for (unsigned i = 0; i < tail; ++i) {
+            out[i] = last[i];
+        }
+    }
+}
+
+void Random::FillFp(uint64_t* out, unsigned count)
+{
+    FillRandom(*this, out, count, false);
+}
+
+void Random::FillNonzeroFp(uint64_t* out, unsigned count)
+{
+    FillRandom(*this, out, count, true);
+}
+
 
 } // namespace fp61
@@ -62,6 +62,46 @@
 # define FP61_FORCE_INLINE inline __attribute__((always_inline))
 #endif
 
+// Marks an intended fall through to the next case of a switch
+#if __cplusplus >= 201703L
+# define FP61_FALLTHROUGH [[fallthrough]]
+#elif defined(__clang__) && defined(__has_cpp_attribute)
+# if __has_cpp_attribute(clang::fallthrough)
+#  define FP61_FALLTHROUGH [[clang::fallthrough]]
+# else
+#  define FP61_FALLTHROUGH
+# endif
+#elif defined(__GNUC__) && __GNUC__ >= 7
+# define FP61_FALLTHROUGH __attribute__((fallthrough))
+#else
+# define FP61_FALLTHROUGH
+#endif
+
+// Define FP61_HEADER_ONLY to define ByteReader::Read(), WordReader::Read(),
+// ReadBytes_LE() and WriteBytes_LE() in this header and force-inline them,
+// so the compiler can fuse them into the calling loops without link-time
+// optimization.  The fp61_header_only CMake target defines it.
+// The library sources must be compiled with the same setting as the
+// application, or these functions would be defined twice
+#if defined(FP61_HEADER_ONLY)
+# define FP61_HEADER_INLINE FP61_FORCE_INLINE
+#else
+# define FP61_HEADER_INLINE
+#endif
+
+// The inline arithmetic is constexpr, for tables computed at compile time.
+// Functions with several statements, such as Multiply(), need C++14, and
+// the 128-bit product needs a compiler with a 128-bit integer type.
+// 64-bit MSVC targets (including clang-cl) use the _umul128() intrinsic
+// for the product, which is not constexpr
+#if __cplusplus >= 201402L && defined(__SIZEOF_INT128__) && \
+    !(defined(_MSC_VER) && defined(_WIN64))
+# define FP61_CONSTEXPR14 constexpr
+# define FP61_HAS_CONSTEXPR_MULTIPLY
+#else
+# define FP61_CONSTEXPR14
+#endif
+
 
 //------------------------------------------------------------------------------
 // Portable 64x64->128 Multiply
@@ -167,6 +207,68 @@ static const uint64_t kPrime = ((uint64_t)1 << 61) - 1;
 static const uint64_t kMask63 = ((uint64_t)1 << 63) - 1;
 
 
+//------------------------------------------------------------------------------
+// Initialization
+
+/// CPU features that fp61::Init() can detect
+static const unsigned kCpuFeatureBMI2 = 1;       ///< x86 MULX, SHRX, SHLX
+static const unsigned kCpuFeatureAVX2 = 2;       ///< x86 256-bit vectors
+static const unsigned kCpuFeatureAVX512F = 4;    ///< x86 512-bit vectors
+static const unsigned kCpuFeatureAVX512IFMA = 8; ///< x86 52-bit vector multiply
+static const unsigned kCpuFeatureNeon = 16;      ///< ARM NEON vectors
+
+/// Kernels selected by fp61::Init()
+struct KernelInfo
+{
+    /// Detected kCpuFeature* flags, minus any that were disabled
+    unsigned CpuFeatures;
+
+    /// Name of the kernel used by fp61::MulAddMem()
+    const char* MulAdd;
+
+    /// Name of the kernel used by ByteReader::ReadWords()
+    const char* Read;
+
+    /// Name of the kernel used by WordWriter/ByteWriter::WriteWords()
+    const char* Write;
+
+    /// Name of the kernel used by Random::FillFp()
+    const char* Random;
+
+    /// Name of the kernel used by fp61::Fp2MulMem() and Fp2MulAddMem()
+    const char* Fp2;
+
+    /// Detected cache sizes in bytes, used to pick tile sizes.
+    /// Defaults to 32 KB and 256 KB if they cannot be detected
+    unsigned L1DataCacheBytes;
+    unsigned L2CacheBytes;
+};
+
+/**
+    fp61::Init()
+
+    Detects the CPU features once and selects the fastest kernels for the
+    bulk operations: fp61::MulAddMem(), fp61::GetFixedMulAddKernel(),
+    fp61::Fp2MulMem(), ByteReader::ReadWords(),
+    WordWriter/ByteWriter::WriteWords(), and Random::FillFp().
+
+    The bulk operations call it on first use if the application did not.
+    That first-use call is thread-safe, so threads can start using the bulk
+    operations at the same time.  An explicit call to select different
+    kernels must not run while other threads are using them.
+
+    Pass a combination of kCpuFeature* flags in `disabledFeatures` to avoid
+    selecting kernels that use them, for example to test fallback paths.
+    It can be called again to make a different selection.
+
+    The inline functions like fp61::Multiply() do not depend on this.
+*/
+void Init(unsigned disabledFeatures = 0);
+
+/// Returns the kernels selected by fp61::Init(), e.g. to log at startup
+const KernelInfo& GetKernelInfo();
+
+
 //------------------------------------------------------------------------------
 // API
 
@@ -178,7 +280,7 @@ static const uint64_t kMask63 = ((uint64_t)1 << 63) - 1;
     The result can be passed directly to fp61::Add4(), fp61::Multiply(),
     and fp61::Finalize().
 */
-FP61_FORCE_INLINE uint64_t PartialReduce(uint64_t x)
+FP61_FORCE_INLINE constexpr uint64_t PartialReduce(uint64_t x)
 {
     // Eliminate bits #63 to #61, which may carry back up into bit #61,
     // So we will only definitely reduce #63 and #62.
@@ -199,7 +301,7 @@ FP61_FORCE_INLINE uint64_t PartialReduce(uint64_t x)
 
     Returns a value in Fp (less than p).
 */
-FP61_FORCE_INLINE uint64_t Finalize(uint64_t x)
+FP61_FORCE_INLINE constexpr uint64_t Finalize(uint64_t x)
 {
     // Eliminate #61.
     // The +1 also handles the case where x = p and x = 0x3fffffffffffffffULL.
@@ -219,7 +321,7 @@ FP61_FORCE_INLINE uint64_t Finalize(uint64_t x)
     The result can be passed directly to fp61::Add4(), fp61::Multiply(), and
     fp61::Finalize().
 */
-FP61_FORCE_INLINE uint64_t Add4(uint64_t x, uint64_t y, uint64_t z, uint64_t w)
+FP61_FORCE_INLINE constexpr uint64_t Add4(uint64_t x, uint64_t y, uint64_t z, uint64_t w)
 {
     return PartialReduce(x + y + z + w);
 }
@@ -237,7 +339,7 @@ FP61_FORCE_INLINE uint64_t Add4(uint64_t x, uint64_t y, uint64_t z, uint64_t w)
 
     Return a value <= p.
 */
-FP61_FORCE_INLINE uint64_t Negate(uint64_t x)
+FP61_FORCE_INLINE constexpr uint64_t Negate(uint64_t x)
 {
     return kPrime - x;
 }
@@ -269,9 +371,9 @@ FP61_FORCE_INLINE uint64_t Negate(uint64_t x)
         The result is stored in bits #61 to #0 (62 bits of the word).
         Call fp61::Finalize() to reduce the result to 61 bits.
 */
-FP61_FORCE_INLINE uint64_t Multiply(uint64_t x, uint64_t y)
+FP61_FORCE_INLINE FP61_CONSTEXPR14 uint64_t Multiply(uint64_t x, uint64_t y)
 {
-    uint64_t p_lo, p_hi;
+    uint64_t p_lo = 0, p_hi = 0;
     CAT_MUL128(p_hi, p_lo, x, y);
 
     /*
@@ -313,6 +415,53 @@ FP61_FORCE_INLINE uint64_t Multiply(uint64_t x, uint64_t y)
     return PartialReduce(r);
 }
 
+/**
+    ConstMultiplier
+
+    Multiplies by a constant c, with a precomputed Shoup-style quotient
+    c' = floor(c * 2^64 / p) stored next to it.
+
+    For a product x * c, the high word of x * c' is q = floor(x * c / p) or
+    one less, so x * c - q * p is less than 2p and needs only the low words
+    of the two products.  For p = 2^61 - 1, q * p is a shift and subtract.
+    So each product is one high multiply, one low multiply, and a final
+    conditional subtraction, with no 128-bit reduction.
+
+    Since 2^64 = 8 * (p + 1), the quotient is 8c + floor(8c / p),
+    which Initialize() computes without a 128-bit division.
+
+    Preconditions: c < p (e.g. from fp61::Finalize())
+
+    Multiply(x) accepts any 64-bit x and returns x * c fully reduced in Fp.
+*/
+struct ConstMultiplier
+{
+    uint64_t Value = 0;
+    uint64_t Quotient = 0;
+
+
+    /// Precompute the quotient for multiplying by c
+    FP61_FORCE_INLINE FP61_CONSTEXPR14 void Initialize(uint64_t c)
+    {
+        Value = c;
+        Quotient = (c << 3) + (c << 3) / kPrime;
+    }
+
+    /// Returns x * c (mod p) for any x, in Fp (less than p)
+    FP61_FORCE_INLINE FP61_CONSTEXPR14 uint64_t Multiply(uint64_t x) const
+    {
+        uint64_t q = 0, lo = 0;
+        CAT_MUL128(q, lo, x, Quotient);
+        (void)lo;
+
+        // x * c - q * p (mod 2^64), with q * p = (q << 61) - q
+        const uint64_t r = x * Value - (q << 61) + q;
+
+        // r < 2p, so Finalize() subtracts p at most once
+        return Finalize(r);
+    }
+};
+
 /**
     r = fp61::Inverse(x)
 
@@ -322,8 +471,7 @@ FP61_FORCE_INLINE uint64_t Multiply(uint64_t x, uint64_t y)
     This operation is kind of heavy so it should be avoided where possible.
 
     This operation is not constant-time.
-    A constant-time version can be implemented using Euler's totient method and
-    a straight line similar to https://github.com/catid/snowshoe/blob/master/src/fp.inc#L545
+    See fp61::InverseCT() for a constant-time version.
 
     Returns the multiplicative inverse of x modulo p.
     0 < result < p
@@ -332,6 +480,308 @@ FP61_FORCE_INLINE uint64_t Multiply(uint64_t x, uint64_t y)
 */
 uint64_t Inverse(uint64_t x);
 
+/**
+    fp61::InverseBatch(in, out, count)
+
+    out[i] = in[i]^-1 (mod p) for i = 0..count-1
+    The input values can be any 64-bit values.
+
+    Uses Montgomery's simultaneous inversion trick, so the whole batch costs
+    one Inverse() and 3*(count-1) Multiply() calls.
+
+    Inputs that have no inverse (multiples of p) produce 0, the same as
+    Inverse(), and do not affect the other results.
+
+    The in and out arrays must not overlap.
+*/
+void InverseBatch(const uint64_t* in, uint64_t* out, unsigned count);
+
+/**
+    r = fp61::Pow(x, e)
+
+    r = x^e (mod p)
+    The input value x can be any 64-bit value.
+
+    Uses right-to-left square-and-multiply, so it costs up to 64 squarings
+    and one Multiply() per set bit of e.  The run time depends on e but not on
+    the value of x.
+
+    Pow(x, 0) = 1, including for x = 0.
+
+    0 <= result < p
+*/
+uint64_t Pow(uint64_t x, uint64_t e);
+
+/**
+    r = fp61::InverseCT(x)
+
+    r = x^-1 (mod p)
+    The input value x can be any 64-bit value.
+
+    Computes x^(p-2) = x^(2^61-3) by Fermat's little theorem, using a fixed
+    addition chain of 60 squarings and 11 multiplies.  This is slower than
+    Inverse() but runs in constant time, with no data-dependent branches.
+
+    Returns the multiplicative inverse of x modulo p.
+    0 < result < p
+
+    If the inverse does not exist, it returns 0.
+*/
+uint64_t InverseCT(uint64_t x);
+
+
+//------------------------------------------------------------------------------
+// Bulk Math
+
+/**
+    fp61::MulAddMem(acc, words, coeff, count)
+
+    acc[i] = acc[i] + coeff * words[i] (with partial reduction modulo p)
+    for i = 0..count-1
+
+    Preconditions:
+        coeff < 2^61 (e.g. from fp61::Finalize())
+        words[i] < 2^62 (e.g. from fp61::PartialReduce() or ByteReader)
+        acc[i] < 2^62 (e.g. from fp61::PartialReduce() or set to 0)
+
+    Result:
+
+        Each acc[i] is partially reduced (62 bits), so this can be called
+        repeatedly to accumulate a sum of products without any other
+        reduction step.  Call fp61::Finalize() to reduce the results to Fp.
+
+    This is the bulk counterpart of Multiply() used by erasure codes.
+    On x86 it uses AVX-512 or AVX2 if the CPU supports it, building the
+    products out of 32x32->64 bit vector multiplies.  Otherwise it falls
+    back to fp61::Multiply().  See fp61::Init().
+*/
+void MulAddMem(uint64_t* acc, const uint64_t* words, uint64_t coeff, unsigned count);
+
+/// Products summed in 128 bits by DotProduct() before each reduction.
+/// Each product of two values less than 2^61 is less than 2^122,
+/// so 64 of them fit in 128 bits
+static const unsigned kDotProductBlockTerms = 64;
+
+/**
+    r = fp61::DotProduct(a, b, n)
+
+    r = sum(a[i] * b[i]) (mod p) for i = 0..n-1
+
+    Preconditions: a[i] < 2^61 and b[i] < 2^61 (e.g. from fp61::Finalize()
+    or ByteReader)
+
+    Unlike a loop over Multiply(), the 122-bit products are not reduced one
+    at a time.  They are added into 128-bit sums, and each block of
+    kDotProductBlockTerms products is reduced once, so the inner loop is one
+    64x64->128 multiply and a 128-bit add per term.
+
+    Returns the sum fully reduced, in Fp.  Returns 0 if n is 0.
+*/
+uint64_t DotProduct(const uint64_t* a, const uint64_t* b, unsigned n);
+
+/**
+    r = fp61::DotProductStrided(a, aStride, b, bStride, n)
+
+    r = sum(a[i * aStride] * b[i * bStride]) (mod p) for i = 0..n-1
+
+    Same as fp61::DotProduct() for elements spaced out in memory, for
+    example a column of a row-major matrix with aStride = rows length.
+*/
+uint64_t DotProductStrided(
+    const uint64_t* a,
+    unsigned aStride,
+    const uint64_t* b,
+    unsigned bStride,
+    unsigned n);
+
+
+//------------------------------------------------------------------------------
+// Fixed Geometry Kernels
+
+/// Largest number of inputs N and outputs M with fixed geometry kernels
+static const unsigned kFixedMaxN = 32;
+static const unsigned kFixedMaxM = 4;
+
+/// Returns true if there is a fixed geometry kernel for N inputs and M outputs:
+/// N = 4, 8, 10, 16 or 32 and M = 1..kFixedMaxM
+constexpr bool IsFixedGeometry(unsigned N, unsigned M)
+{
+    return (N == 4 || N == 8 || N == 10 || N == 16 || N == kFixedMaxN) && M >= 1 && M <= kFixedMaxM;
+}
+
+/**
+    Kernel for a fixed number of inputs N and outputs M:
+
+        out[r * outStride + j] = sum(words[i * wordStride + j] * coeffs[r * N + i])
+
+    for each output r = 0..M-1 and position j = 0..count-1, fully reduced.
+
+    Each kernel is an instantiation for one (N, M) with the loop over the
+    inputs fully unrolled.  All M sums stay in registers across the N inputs,
+    rather than being loaded and stored for every input as with MulAddMem().
+    The vector kernels add up the partially reduced products lazily, and
+    the places to reduce the sums are fixed at compile time: every 6
+    products, so a sum never exceeds 7 * (p + 7) < 2^64.  The scalar
+    kernels accumulate the 122-bit products in 128 bits instead and
+    reduce once at the end.
+
+    Words must be less than 2^61 (as from ByteReader) and coefficients in Fp.
+*/
+typedef void (*FixedMulAddKernel)(
+    const uint64_t* words,
+    unsigned wordStride,
+    const uint64_t* coeffs,
+    uint64_t* out,
+    unsigned outStride,
+    unsigned count);
+
+/**
+    kernel = fp61::GetFixedMulAddKernel(N, M)
+
+    Returns the kernel for N inputs and M outputs selected by fp61::Init(),
+    using the same instruction set as fp61::MulAddMem(), or nullptr if
+    IsFixedGeometry(N, M) is false.
+*/
+FixedMulAddKernel GetFixedMulAddKernel(unsigned N, unsigned M);
+
+
+//------------------------------------------------------------------------------
+// Quadratic Extension Field
+
+/**
+    Fp2
+
+    Element Re + Im*i of the field Fp^2 = Fp[i]/(i^2+1).
+
+    Since p = 3 (mod 4), -1 is not a square in Fp and this is a field, a lot
+    like the Gaussian integers.  It has p^2 - 1 = (p - 1) * 2^61 units, and
+    the elements of norm Re^2 + Im^2 = 1 form a cyclic group of order
+    p + 1 = 2^61.  So there are roots of unity for any power-of-two transform
+    size, unlike in Fp where p - 1 has only one factor of two.
+
+    The operations work like fp61::Multiply(): Inputs can have parts up to
+    62 bits, and results are partially reduced with parts of 62 bits.
+    Call fp61::Fp2Finalize() to reduce both parts to Fp.
+*/
+struct Fp2
+{
+    uint64_t Re;
+    uint64_t Im;
+};
+
+/// 4p = 2^63 - 4, added before subtracting a partially reduced word
+static const uint64_t kPrime4 = kPrime * 4;
+
+/// r = x + y.  Preconditions: All parts < 2^62
+FP61_FORCE_INLINE Fp2 Fp2Add(const Fp2& x, const Fp2& y)
+{
+    Fp2 r;
+    r.Re = PartialReduce(x.Re + y.Re);
+    r.Im = PartialReduce(x.Im + y.Im);
+    return r;
+}
+
+/// r = x - y.  Preconditions: All parts < 2^62
+FP61_FORCE_INLINE Fp2 Fp2Sub(const Fp2& x, const Fp2& y)
+{
+    Fp2 r;
+    r.Re = PartialReduce(x.Re + kPrime4 - y.Re);
+    r.Im = PartialReduce(x.Im + kPrime4 - y.Im);
+    return r;
+}
+
+/// r = conj(x) = Re - Im*i.  Preconditions: All parts < 2^62.
+/// For x of norm 1 (e.g. roots of unity), this is x^-1
+FP61_FORCE_INLINE Fp2 Fp2Conjugate(const Fp2& x)
+{
+    Fp2 r;
+    r.Re = x.Re;
+    r.Im = PartialReduce(kPrime4 - x.Im);
+    return r;
+}
+
+/**
+    r = fp61::Fp2Multiply(x, y)
+
+    r = x * y with three Multiply() calls (Karatsuba):
+
+        (a + bi)(c + di) = (ac - bd) + ((a + b)(c + d) - ac - bd)i
+
+    Preconditions: All parts < 2^62, or parts of x < 2^63 if parts of y < 2^61
+*/
+FP61_FORCE_INLINE Fp2 Fp2Multiply(const Fp2& x, const Fp2& y)
+{
+    const uint64_t ac = Multiply(x.Re, y.Re);
+    const uint64_t bd = Multiply(x.Im, y.Im);
+    const uint64_t m = Multiply(PartialReduce(x.Re + x.Im), PartialReduce(y.Re + y.Im));
+
+    Fp2 r;
+    r.Re = PartialReduce(ac + kPrime4 - bd);
+    r.Im = PartialReduce(m + kPrime4 - PartialReduce(ac + bd));
+    return r;
+}
+
+/// r = x^2 = (a + b)(a - b) + 2ab*i with two Multiply() calls.
+/// Preconditions: All parts < 2^62
+FP61_FORCE_INLINE Fp2 Fp2Square(const Fp2& x)
+{
+    Fp2 r;
+    r.Re = Multiply(PartialReduce(x.Re + x.Im), PartialReduce(x.Re + kPrime4 - x.Im));
+    r.Im = PartialReduce(Multiply(x.Re, x.Im) * 2);
+    return r;
+}
+
+/// Reduce both parts to Fp.  Preconditions: Same as fp61::Finalize()
+FP61_FORCE_INLINE Fp2 Fp2Finalize(const Fp2& x)
+{
+    Fp2 r;
+    r.Re = Finalize(x.Re);
+    r.Im = Finalize(x.Im);
+    return r;
+}
+
+/**
+    r = fp61::Fp2Inverse(x)
+
+    r = x^-1 = conj(x) / (Re^2 + Im^2)
+
+    The norm Re^2 + Im^2 is in Fp, and is zero only for x = 0, so this costs
+    one fp61::Inverse() and four Multiply() calls.
+    Preconditions: All parts < 2^62
+
+    Returns the inverse with both parts in Fp, or 0 if x = 0.
+*/
+Fp2 Fp2Inverse(const Fp2& x);
+
+/**
+    fp61::Fp2MulMem(x, y, count)
+
+    x[i] = x[i] * y[i] (with partial reduction modulo p) for i = 0..count-1
+
+    Preconditions:
+        Parts of x[i] < 2^63, for example sums of a few partially reduced words
+        Parts of y[i] < 2^61 (e.g. from fp61::Fp2Finalize())
+
+    This is the pointwise product used by transforms.
+    On x86 it uses AVX-512 or AVX2 if the CPU supports it, with the same
+    32x32->64 bit vector multiplies as fp61::MulAddMem().  See fp61::Init().
+*/
+void Fp2MulMem(Fp2* x, const Fp2* y, unsigned count);
+
+/**
+    fp61::Fp2MulAddMem(acc, x, coeff, count)
+
+    acc[i] = acc[i] + coeff * x[i] (with partial reduction modulo p)
+    for i = 0..count-1
+
+    Preconditions:
+        Parts of coeff < 2^61 (e.g. from fp61::Fp2Finalize())
+        Parts of x[i] and acc[i] < 2^62
+
+    This is the Fp^2 counterpart of fp61::MulAddMem().
+*/
+void Fp2MulAddMem(Fp2* acc, const Fp2* x, const Fp2& coeff, unsigned count);
+
 
 //------------------------------------------------------------------------------
 // Memory Reading
@@ -362,7 +812,7 @@ FP61_FORCE_INLINE uint32_t ReadU32_LE(const uint8_t* data)
 
 /// Read between 0..8 bytes in little-endian byte order
 /// Returns 0 for any other value for `bytes`
-uint64_t ReadBytes_LE(const uint8_t* data, unsigned bytes);
+FP61_HEADER_INLINE uint64_t ReadBytes_LE(const uint8_t* data, unsigned bytes);
 
 enum class ReadResult
 {
@@ -397,13 +847,13 @@ enum class ReadResult
 static const uint64_t kAmbiguityMask = ((uint64_t)1 << 60) - 1; // 0x0ff...fff
 
 /// Returns true if the U64 word provided needs an extra bit to represent it
-FP61_FORCE_INLINE bool IsU64Ambiguous(uint64_t u64_word)
+FP61_FORCE_INLINE constexpr bool IsU64Ambiguous(uint64_t u64_word)
 {
     return (u64_word & kAmbiguityMask) == kAmbiguityMask;
 }
 
 /// Returns true if this Fp word could have originally been 0ff..ff or 1ff..ff
-FP61_FORCE_INLINE bool IsFpAmbiguous(uint64_t fp_word)
+FP61_FORCE_INLINE constexpr bool IsFpAmbiguous(uint64_t fp_word)
 {
     return fp_word == kAmbiguityMask;
 }
@@ -426,6 +876,15 @@ FP61_FORCE_INLINE bool IsFpAmbiguous(uint64_t fp_word)
 
     Call ReadNext() repeatedly to read all words from the data.
     It will return ReadResult::Empty when all bits are empty.
+
+    Or call ReadWords() to unpack many words at once, which is faster.
+
+    Call SkipWords() to advance past words without unpacking them.
+
+    To read a stream that arrives in pieces, call ReadWordsPartial() on each
+    piece, which stops before the last partial word, and pass the unread
+    bytes (fewer than 8) at the front of the next piece to ResumeRead().
+    Call ReadWords() on the last piece to pad the final word.
 */
 struct ByteReader
 {
@@ -434,6 +893,10 @@ struct ByteReader
     uint64_t Workspace;
     int Available;
 
+    /// Set by ResumeRead() until the workspace bits have been refilled from
+    /// the new data, since the bulk readers re-read the previous 8 bytes
+    bool Resumed;
+
 
     /// Calculates and returns the maximum number of Fp field words that may be
     /// produced by the ByteReader.
@@ -441,9 +904,9 @@ struct ByteReader
     {
         unsigned bits = bytes * 8;
 
-        // Round up to the nearest word.
-        // All words may be expanded by one bit, hence the (bits/61) factor.
-        return (bits + (bits / 61) + 60) / 61;
+        // In the worst case every word is ambiguous and only consumes 60 bits
+        // of the input, so round up to the nearest 60 bits.
+        return (bits + 59) / 60;
     }
 
     /// Begin reading data
@@ -453,11 +916,102 @@ struct ByteReader
         Bytes = bytes;
         Workspace = 0;
         Available = 0;
+        Resumed = false;
+    }
+
+    /// Continue reading a stream from the next buffer of data, keeping the
+    /// partial word from the previous buffer.  Only the partial word in the
+    /// workspace is kept, so the previous buffer must have been read with
+    /// ReadWordsPartial() until fewer than 8 bytes were left unread, and
+    /// any unread bytes must be at the front of the new buffer.
+    FP61_FORCE_INLINE void ResumeRead(const uint8_t* data, unsigned bytes)
+    {
+        Data = data;
+        Bytes = bytes;
+        Resumed = true;
     }
 
     /// Returns ReadResult::Empty when no more data is available.
     /// Otherwise fpOut will be a value between 0 and p-1.
-    ReadResult Read(uint64_t& fpOut);
+    FP61_HEADER_INLINE ReadResult Read(uint64_t& fpOut);
+
+    /// Read up to maxWords words into the fpOut array.
+    /// Returns the number of words written, which is less than maxWords only
+    /// when the data runs out.  Produces the same words as calling Read()
+    /// repeatedly, and calls to Read() and ReadWords() can be mixed.
+    /// Most of the data is unpacked 8 words (61 bytes) at a time without
+    /// branching, falling back to a slower path for ambiguous words.
+    unsigned ReadWords(uint64_t* fpOut, unsigned maxWords);
+
+    /// Read up to maxWords words like ReadWords(), but stop before the last
+    /// partial word of the data instead of padding it with zeros, so that
+    /// more of the stream can be provided with ResumeRead().
+    /// Returns the number of words written.  When it returns fewer than
+    /// maxWords, fewer than 8 bytes of the data are left unread.
+    unsigned ReadWordsPartial(uint64_t* fpOut, unsigned maxWords);
+
+    /// Skip up to maxWords words, leaving the reader in the same state as
+    /// calling ReadWords() would.  Returns the number of words skipped,
+    /// which is less than maxWords only if the end of the data was reached.
+    /// Spans of data that cannot contain an ambiguous word are skipped
+    /// without unpacking them, which is much faster than reading.
+    unsigned SkipWords(unsigned maxWords);
+};
+
+/// Number of byte arrays read side by side by MultiByteReader
+static const unsigned kMultiReaderLanes = 4;
+
+/**
+    MultiByteReader
+
+    Reads kMultiReaderLanes byte arrays side by side, producing the same words
+    for each lane as a separate ByteReader would.
+
+    The lane state is kept as arrays (structure of arrays), and each step
+    advances all of the lanes together without branching: Whether a lane
+    needs the next 8 bytes, and whether its word is ambiguous and needs an
+    extra bit, are turned into masks that select between the results.
+    The lanes do not depend on each other, so their dependency chains
+    overlap instead of running one reader at a time.
+
+    The branch-free steps are used while every lane has at least 8 bytes
+    left.  Near the end of the shortest lane the reader falls back to the
+    ByteReader code for each lane.
+
+    Call BeginRead() for every lane before reading.  A lane can be given no
+    data (nullptr, 0 bytes), which makes every call take the slower path.
+*/
+struct MultiByteReader
+{
+    const uint8_t* Data[kMultiReaderLanes];
+    unsigned Bytes[kMultiReaderLanes];
+    uint64_t Workspace[kMultiReaderLanes];
+    int Available[kMultiReaderLanes];
+
+
+    /// Begin reading data for one lane
+    FP61_FORCE_INLINE void BeginRead(unsigned lane, const uint8_t* data, unsigned bytes)
+    {
+        Data[lane] = data;
+        Bytes[lane] = bytes;
+        Workspace[lane] = 0;
+        Available[lane] = 0;
+    }
+
+    /// Read the next word of every lane into fpOut[lane].
+    /// Returns a mask with bit `lane` set for each lane that produced a word.
+    /// Lanes without data left write 0 to fpOut.
+    unsigned Read(uint64_t* fpOut);
+
+    /// Read up to maxWords words from each lane into fpOut[lane][...],
+    /// and write the number of words read from each lane to counts[lane].
+    /// A lane returns fewer than maxWords words only when its data runs out.
+    void ReadWords(uint64_t* const* fpOut, unsigned maxWords, unsigned* counts);
+
+    /// Copy one lane to or from a ByteReader, for example to continue
+    /// reading it alone
+    void GetLane(unsigned lane, ByteReader& reader) const;
+    void SetLane(unsigned lane, const ByteReader& reader);
 };
 
 /**
@@ -475,6 +1029,7 @@ struct ByteReader
 
     Call BeginRead() to start reading.
     Call Read() to retrieve each consecutive word.
+    Call ReadWords() to retrieve an array of words, which is faster.
 */
 struct WordReader
 {
@@ -503,7 +1058,12 @@ struct WordReader
     /// Read the next word.
     /// It is up to the application to know when to stop reading,
     /// based on the WordCount() count of words to read.
-    uint64_t Read();
+    FP61_HEADER_INLINE uint64_t Read();
+
+    /// Read the next `count` words into the fpOut array.
+    /// Produces the same words as calling Read() repeatedly,
+    /// and calls to Read() and ReadWords() can be mixed.
+    void ReadWords(uint64_t* fpOut, unsigned count);
 };
 
 
@@ -543,7 +1103,7 @@ FP61_FORCE_INLINE void WriteU64_LE(uint8_t* data, uint64_t value)
 }
 
 /// Write between 0..8 bytes in little-endian byte order
-void WriteBytes_LE(uint8_t* data, unsigned bytes, uint64_t value);
+FP61_HEADER_INLINE void WriteBytes_LE(uint8_t* data, unsigned bytes, uint64_t value);
 
 /**
     WordWriter
@@ -556,6 +1116,10 @@ void WriteBytes_LE(uint8_t* data, unsigned bytes, uint64_t value);
 
     Call BeginWrite() to start writing.
     Call Write() to write the next word.
+    Call WriteWords() to write an array of words, which is faster.
+
+    Call GetCompletedBytes() to get the number of bytes at the front of the
+    output that are final, so the output can be sent as it is written.
 
     Call Flush() to write the last few bytes.
     Flush() returns the number of overall written bytes.
@@ -616,6 +1180,18 @@ struct WordWriter
         Available = available;
     }
 
+    /// Write an array of words.
+    /// Produces the same output as calling Write() for each word.
+    /// Each 64 words are packed into 61 output words with a fixed schedule.
+    void WriteWords(const uint64_t* words, unsigned count);
+
+    /// Returns the number of bytes at the front of the output that are
+    /// complete and will not change, for sending the output progressively
+    FP61_FORCE_INLINE unsigned GetCompletedBytes() const
+    {
+        return static_cast<unsigned>(DataWritePtr - Data);
+    }
+
     /// Flush the output, writing fractions of a word if needed.
     /// This must be called or the output may be truncated.
     /// Returns the number of bytes written overall.
@@ -647,6 +1223,7 @@ struct WordWriter
 
     Call BeginWrite() to start writing.
     Call Write() to write the next word.
+    Call WriteWords() to write an array of words, which is faster.
 
     Call Flush() to write the last few bytes.
     Flush() returns the number of overall written bytes.
@@ -700,6 +1277,12 @@ struct ByteWriter
         Writer.Available = available;
     }
 
+    /// Write an array of words.
+    /// Produces the same output as calling Write() for each word.
+    /// Blocks of 64 words without any ambiguous words are packed into
+    /// 61 output words with a fixed schedule.
+    void WriteWords(const uint64_t* words, unsigned count);
+
     /// Flush the output, writing fractions of a word if needed.
     /// This must be called or the output may be truncated.
     /// Returns the number of bytes written overall.
@@ -710,11 +1293,202 @@ struct ByteWriter
 };
 
 
+//------------------------------------------------------------------------------
+// Fixed Layout Packing
+
+/**
+    Fixed Layout Packing
+
+    ByteReader packs 61 bits per word and fixes up ambiguous words by
+    injecting an extra bit, so the number of words depends on the data.
+    The fixed layout instead packs exactly 60 bits of input into each word,
+    which is always below p, so no fix-up is ever needed:
+
+        word k = bits [60*k, 60*k + 60) of the input, zero padded at the end
+
+    The number of words depends only on the number of bytes, and it is the
+    same as ByteReader::MaxWords(), so a fixed layout packet never needs
+    more words than the worst case of ByteReader.  Each word can be read on
+    its own: two words are packed into every 15 bytes, and word k is an
+    8-byte load from byte offset 60*k/8 shifted by 0 or 4 bits.  That allows
+    random access to any word and unpacking without serial dependencies,
+    at the cost of 1.6% more words than ByteReader for typical data.
+*/
+
+/// Mask for the 60 bits of input in each fixed layout word
+static const uint64_t kFixedWordMask = ((uint64_t)1 << 60) - 1;
+
+/**
+    FixedByteReader
+
+    Reads 60 bits at a time from the input data and outputs Fp words in the
+    fixed layout.  Pads the final word with zeros.
+
+    Call WordCount() to calculate the number of words produced from a number
+    of bytes.  Unlike ByteReader, this is exact.
+
+    Call BeginRead() to begin reading.
+    Call ReadWord() to read any word by its index.
+    Call Read() or ReadWords() to read the words in order.
+*/
+struct FixedByteReader
+{
+    const uint8_t* Data;
+    unsigned Bytes;
+    unsigned NextWord;
+
+
+    /// Number of words produced from the given number of bytes
+    static FP61_FORCE_INLINE unsigned WordCount(unsigned bytes)
+    {
+        return static_cast<unsigned>(((uint64_t)bytes * 8 + 59) / 60);
+    }
+
+    /// Begin reading data
+    FP61_FORCE_INLINE void BeginRead(const uint8_t* data, unsigned bytes)
+    {
+        Data = data;
+        Bytes = bytes;
+        NextWord = 0;
+    }
+
+    /// Read the word at the given index, which must be below WordCount().
+    /// Does not change the position of Read()
+    FP61_FORCE_INLINE uint64_t ReadWord(unsigned index) const
+    {
+        const uint64_t bitOffset = (uint64_t)index * 60;
+        const unsigned byteOffset = static_cast<unsigned>(bitOffset >> 3);
+        const unsigned shift = static_cast<unsigned>(bitOffset & 7);
+        const unsigned remaining = Bytes - byteOffset;
+
+        const uint64_t word = (remaining >= 8) ?
+            ReadU64_LE(Data + byteOffset) :
+            ReadBytes_LE(Data + byteOffset, remaining);
+
+        return (word >> shift) & kFixedWordMask;
+    }
+
+    /// Returns ReadResult::Empty when no more data is available.
+    /// Otherwise fpOut will be a value between 0 and 2^60-1.
+    FP61_FORCE_INLINE ReadResult Read(uint64_t& fpOut)
+    {
+        if (NextWord >= WordCount(Bytes)) {
+            return ReadResult::Empty;
+        }
+        fpOut = ReadWord(NextWord++);
+        return ReadResult::Success;
+    }
+
+    /// Read up to maxWords words into the fpOut array.
+    /// Returns the number of words written, which is less than maxWords only
+    /// when the data runs out.  Produces the same words as calling Read()
+    /// repeatedly.  Pairs of words are unpacked from 15 bytes at a time.
+    unsigned ReadWords(uint64_t* fpOut, unsigned maxWords);
+};
+
+/**
+    FixedByteWriter
+
+    Writes Fp words in the fixed layout to a byte array, reversing the
+    encoding of FixedByteReader.  Only the low 60 bits of each word are
+    written, and the output is cut off at the original number of bytes,
+    so the padding bits of the last word are dropped.
+
+    Call BeginWrite() with the original number of bytes to start writing.
+    Call Write() to write the next word.
+    Call WriteWords() to write an array of words, which is faster.
+
+    Call Flush() to write the last few bytes.
+    Flush() returns the number of overall written bytes.
+*/
+struct FixedByteWriter
+{
+    uint8_t* Data;
+    uint8_t* DataWritePtr;
+    unsigned Bytes;
+    uint64_t Workspace;
+    unsigned Available;
+
+
+    /// Begin writing up to `bytes` bytes to the given memory location
+    FP61_FORCE_INLINE void BeginWrite(uint8_t* data, unsigned bytes)
+    {
+        Data = data;
+        DataWritePtr = data;
+        Bytes = bytes;
+        Workspace = 0;
+        Available = 0;
+    }
+
+    /// Write the next word
+    FP61_FORCE_INLINE void Write(uint64_t word)
+    {
+        word &= kFixedWordMask;
+
+        unsigned available = Available;
+        uint64_t workspace = Workspace;
+
+        // Include any bits that fit
+        workspace |= word << available;
+        available += 60;
+
+        // If there is a full word now:
+        if (available >= 64)
+        {
+            // Write the word, or whatever fits at the end
+            const unsigned writeBytes = (Bytes >= 8) ? 8 : Bytes;
+            if (writeBytes == 8) {
+                WriteU64_LE(DataWritePtr, workspace);
+            }
+            else {
+                WriteBytes_LE(DataWritePtr, writeBytes, workspace);
+            }
+            DataWritePtr += writeBytes;
+            Bytes -= writeBytes;
+            available -= 64;
+
+            // Keep remaining bits
+            workspace = word >> (60 - available);
+        }
+
+        Workspace = workspace;
+        Available = available;
+    }
+
+    /// Write an array of words.
+    /// Produces the same output as calling Write() for each word.
+    /// Pairs of words are packed into 15 bytes at a time.
+    void WriteWords(const uint64_t* words, unsigned count);
+
+    /// Flush the output, writing fractions of a word if needed.
+    /// This must be called or the output may be truncated.
+    /// Returns the number of bytes written overall.
+    FP61_FORCE_INLINE unsigned Flush()
+    {
+        unsigned finalBytes = (Available + 7) / 8;
+        if (finalBytes > Bytes) {
+            finalBytes = Bytes;
+        }
+
+        WriteBytes_LE(DataWritePtr, finalBytes, Workspace);
+        DataWritePtr += finalBytes;
+        Bytes -= finalBytes;
+        Available = 0;
+        Workspace = 0;
+
+        return static_cast<unsigned>(DataWritePtr - Data);
+    }
+};
+
+
 //------------------------------------------------------------------------------
 // Random Numbers
 
 #define CAT_ROL64(x, bits) ( ((uint64_t)(x) << (bits)) | ((uint64_t)(x) >> (64 - (bits))) )
 
+/// Number of interleaved streams used by Random::FillFp()
+static const unsigned kRandomFillLanes = 8;
+
 /**
     Random
 
@@ -726,6 +1500,7 @@ struct ByteWriter
     Call NextNonzeroFp() to produce a random 61-bit number from 1..p
     Call NextFp() to produce a random 61-bit number from 0..p
     Call Next() to produce a random 64-bit number.
+    Call FillFp() or FillNonzeroFp() to produce many numbers at once.
 */
 struct Random
 {
@@ -792,13 +1567,34 @@ struct Random
     {
         return ConvertRandToNonzeroFp(Next());
     }
+
+    /**
+        FillFp()
+
+        Fill `out` with `count` random values between 0..p.
+
+        This draws one value from Next() to seed kRandomFillLanes
+        independent xoshiro256+ streams, and interleaves their outputs so
+        that out[i] comes from stream (i % kRandomFillLanes).  The streams
+        are stepped together in vector registers by a kernel selected in
+        fp61::Init(), several times faster than calling NextFp() in a loop.
+
+        The output depends only on the seed and the sequence of calls, so
+        it is the same for every kernel.  It is not the same sequence
+        that NextFp() would produce.
+    */
+    void FillFp(uint64_t* out, unsigned count);
+
+    /// Fill `out` with `count` random values between 1..p.
+    /// Same as FillFp() except that zero is never produced
+    void FillNonzeroFp(uint64_t* out, unsigned count);
 };
 
 /// Hash a 64-bit value to another 64-bit value
 uint64_t HashU64(uint64_t x);
 
 /// Hash a seed into a value from 1..p-1
-FP61_FORCE_INLINE uint64_t HashToNonzeroFp(uint64_t word)
+FP61_FORCE_INLINE FP61_CONSTEXPR14 uint64_t HashToNonzeroFp(uint64_t word)
 {
     // Run a simple mixer based on HashU64()
     word += 0x9e3779b97f4a7c15;
@@ -817,6 +1613,172 @@ FP61_FORCE_INLINE uint64_t HashToNonzeroFp(uint64_t word)
 }
 
 
+//------------------------------------------------------------------------------
+// Header Inline Readers and Writers
+
+/*
+    These are defined here rather than in fp61.cpp so that FP61_HEADER_ONLY
+    builds can inline them into the loops that call them.  Otherwise only
+    fp61.cpp, which defines FP61_DEFINE_HEADER_INLINE, compiles them.
+*/
+#if defined(FP61_HEADER_ONLY) || defined(FP61_DEFINE_HEADER_INLINE)
+
+FP61_HEADER_INLINE uint64_t ReadBytes_LE(const uint8_t* data, unsigned bytes)
+{
+    switch (bytes)
+    {
+    case 8: return ReadU64_LE(data);
+    case 7: return ((uint64_t)data[6] << 48) | ((uint64_t)data[5] << 40) | ((uint64_t)data[4] << 32) | ReadU32_LE(data);
+    case 6: return ((uint64_t)data[5] << 40) | ((uint64_t)data[4] << 32) | ReadU32_LE(data);
+    case 5: return ((uint64_t)data[4] << 32) | ReadU32_LE(data);
+    case 4: return ReadU32_LE(data);
+    case 3: return ((uint32_t)data[2] << 16) | ((uint32_t)data[1] << 8) | data[0];
+    case 2: return ((uint32_t)data[1] << 8) | data[0];
+    case 1: return data[0];
+    default: break;
+    }
+    return 0;
+}
+
+FP61_HEADER_INLINE ReadResult ByteReader::Read(uint64_t& fpOut)
+{
+    uint64_t word, r, workspace = Workspace;
+    int nextAvailable, available = Available;
+
+    // If enough bits are already available:
+    if (available >= 61)
+    {
+        r = workspace & kPrime;
+        workspace >>= 61;
+        nextAvailable = available - 61;
+    }
+    else
+    {
+        unsigned bytes = Bytes;
+
+        // Read a word to fill in the difference
+        if (bytes >= 8)
+        {
+            word = ReadU64_LE(Data);
+            Data += 8;
+            Bytes = bytes - 8;
+            nextAvailable = available + 3;
+        }
+        else
+        {
+            if (bytes == 0 && available <= 0) {
+                return ReadResult::Empty;
+            }
+
+            word = ReadBytes_LE(Data, bytes);
+            Bytes = 0;
+
+            // Note this may go negative but we check for that above
+            nextAvailable = available + bytes * 8 - 61;
+        }
+
+        // This assumes workspace high bits (beyond `available`) are 0
+        r = (workspace | (word << available)) & kPrime;
+
+        // Remaining workspace bits are taken from read word
+        workspace = word >> (61 - available);
+    }
+
+    // If there is ambiguity in the representation:
+    if (IsU64Ambiguous(r))
+    {
+        // This will not overflow because available <= 60.
+        // We add up to 3 more bits, so adding one more keeps us within 64 bits.
+        ++nextAvailable;
+
+        // Insert bit 0 for 0ff..ff and 1 for 1ff..ff to resolve the ambiguity
+        workspace = (workspace << 1) | (r >> 60);
+
+        // Use kAmbiguity value for a placeholder
+        r = kAmbiguityMask;
+    }
+
+    Workspace = workspace;
+    Available = nextAvailable;
+
+    fpOut = r;
+    return ReadResult::Success;
+}
+
+FP61_HEADER_INLINE uint64_t WordReader::Read()
+{
+    int nextAvailable, available = Available;
+    uint64_t r, workspace = Workspace;
+
+    if (available >= 61)
+    {
+        r = workspace & kPrime;
+        nextAvailable = available - 61;
+        workspace >>= 61;
+    }
+    else
+    {
+        uint64_t word;
+        unsigned bytes = Bytes;
+
+        // If we can read a full word:
+        if (bytes >= 8)
+        {
+            word = ReadU64_LE(Data);
+            Data += 8;
+            Bytes = bytes - 8;
+            nextAvailable = available + 3; // +64 - 61
+        }
+        else
+        {
+            if (bytes == 0 && available <= 0) {
+                return 0; // No data left to read
+            }
+
+            word = ReadBytes_LE(Data, bytes);
+
+            // Note this may go negative but we check for negative above
+            nextAvailable = available + bytes * 8 - 61;
+
+            Bytes = 0;
+        }
+
+        r = (workspace | (word << available)) & kPrime;
+        workspace = word >> (61 - available);
+    }
+
+    Workspace = workspace;
+    Available = nextAvailable;
+
+    return r;
+}
+
+FP61_HEADER_INLINE void WriteBytes_LE(uint8_t* data, unsigned bytes, uint64_t value)
+{
+    switch (bytes)
+    {
+    case 8: WriteU64_LE(data, value);
+        return;
+    case 7: data[6] = (uint8_t)(value >> 48);
+        FP61_FALLTHROUGH;
+    case 6: data[5] = (uint8_t)(value >> 40);
+        FP61_FALLTHROUGH;
+    case 5: data[4] = (uint8_t)(value >> 32);
+        FP61_FALLTHROUGH;
+    case 4: WriteU32_LE(data, static_cast<uint32_t>(value));
+        return;
+    case 3: data[2] = (uint8_t)(value >> 16);
+        FP61_FALLTHROUGH;
+    case 2: data[1] = (uint8_t)(value >> 8);
+        FP61_FALLTHROUGH;
+    case 1: data[0] = (uint8_t)value;
+    default: break;
+    }
+}
+
+#endif // FP61_HEADER_ONLY || FP61_DEFINE_HEADER_INLINE
+
+
 } // namespace fp61
 
 
@@ -0,0 +1,1330 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "fp61_codec.h"
+#include "fp61_matrix.h"
+
+#include <string.h> // memcpy, memset
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Code Parameters
+
+unsigned GetCodecChunkWords(unsigned rows)
+{
+    const KernelInfo& info = GetKernelInfo();
+
+    // Leave half of the L1 cache for the original data streaming through
+    // and for the bytes being written out
+    const unsigned budgetBytes = info.L1DataCacheBytes / 2;
+    const unsigned arrays = rows + 1;
+
+    unsigned chunkWords = budgetBytes / (arrays * 8);
+    chunkWords -= chunkWords % 64;
+
+    if (chunkWords < kCodecMinChunkWords) {
+        chunkWords = kCodecMinChunkWords;
+    }
+    else if (chunkWords > kCodecMaxChunkWords) {
+        chunkWords = kCodecMaxChunkWords;
+    }
+    return chunkWords;
+}
+
+
+//------------------------------------------------------------------------------
+// Generator Matrix
+
+void CoefficientSet::HashRows(unsigned firstRow, unsigned count)
+{
+    for (unsigned r = firstRow; r < firstRow + count; ++r)
+    {
+        const uint64_t rowSeed = GetRowSeed(Seed, FirstRecoveryIndex + r);
+        uint64_t* row = &Matrix[r * N];
+        for (unsigned i = 0; i < N; ++i) {
+            row[i] = GetRowCoefficient(rowSeed, i);
+        }
+    }
+}
+
+const uint64_t* CoefficientSet::Get(
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned n,
+    unsigned m)
+{
+    const uint64_t cachedEnd = (uint64_t)FirstRecoveryIndex + M;
+    const uint64_t requestEnd = (uint64_t)firstRecoveryIndex + m;
+
+    if (seed == Seed && n == N && M > 0)
+    {
+        // Extend the cached range to cover the requested rows, hashing only
+        // the missing rows, so that calling Encode() for each recovery index
+        // in turn also hits the cache
+        const uint64_t first = (firstRecoveryIndex < FirstRecoveryIndex) ? firstRecoveryIndex : FirstRecoveryIndex;
+        const uint64_t end = (requestEnd > cachedEnd) ? requestEnd : cachedEnd;
+
+        if (end - first <= kCodecMaxCachedRows)
+        {
+            const unsigned before = static_cast<unsigned>(FirstRecoveryIndex - first);
+            const unsigned after = static_cast<unsigned>(end - cachedEnd);
+
+            if (before > 0)
+            {
+                Matrix.insert(Matrix.begin(), before * N, 0);
+                FirstRecoveryIndex -= before;
+                M += before;
+                HashRows(0, before);
+            }
+            if (after > 0)
+            {
+                Matrix.resize((M + after) * N);
+                M += after;
+                HashRows(M - after, after);
+            }
+
+            return Matrix.data() + (firstRecoveryIndex - FirstRecoveryIndex) * N;
+        }
+    }
+
+    Seed = seed;
+    FirstRecoveryIndex = firstRecoveryIndex;
+    N = n;
+    M = m;
+
+    Matrix.resize(m * n);
+    HashRows(0, m);
+
+    return Matrix.data();
+}
+
+
+//------------------------------------------------------------------------------
+// Encoder Statistics
+
+void EncoderStats::Add(const EncoderStats& other)
+{
+    Bytes += other.Bytes;
+    Words += other.Words;
+    Escapes += other.Escapes;
+    Reductions += other.Reductions;
+    Flushes += other.Flushes;
+}
+
+#if defined(FP61_ENABLE_STATS)
+
+/// Count the bytes consumed, words and escapes of one ReadWords() call
+static void CountReadStats(
+    EncoderStats* stats,
+    unsigned bytes,
+    const uint64_t* words,
+    unsigned count)
+{
+    if (!stats) {
+        return;
+    }
+
+    unsigned escapes = 0;
+    for (unsigned j = 0; j < count; ++j) {
+        escapes += IsFpAmbiguous(words[j]) ? 1 : 0;
+    }
+
+    stats->Bytes += bytes;
+    stats->Words += count;
+    stats->Escapes += escapes;
+}
+
+#endif // FP61_ENABLE_STATS
+
+
+//------------------------------------------------------------------------------
+// Encoder
+
+unsigned Encoder::Encode(
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned recoveryIndex,
+    uint8_t* recovery)
+{
+    return EncodeMultiple(originals, N, bytes, seed, recoveryIndex, 1, &recovery);
+}
+
+unsigned Encoder::EncodeMultiple(
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* const* recovery)
+{
+    if (M == 0) {
+        return 0;
+    }
+
+    Readers.resize(N);
+    for (unsigned i = 0; i < N; ++i) {
+        Readers[i].BeginRead(originals[i], bytes);
+    }
+
+    Writers.resize(M);
+    for (unsigned r = 0; r < M; ++r) {
+        Writers[r].BeginWrite(recovery[r]);
+    }
+
+    const uint64_t* coefficients = Coefficients.Get(seed, firstRecoveryIndex, N, M);
+
+    EncodeWords(coefficients, N, M, ~0u);
+
+    unsigned recoveryBytes = 0;
+    for (unsigned r = 0; r < M; ++r) {
+        recoveryBytes = Writers[r].Flush();
+    }
+    FP61_STATS(Stats.Flushes += M;)
+    return recoveryBytes;
+}
+
+
+/// Returns the number of chunkWords-sized rows that the words array for
+/// EncodeStrips() needs: One for each original with a fixed geometry kernel
+static unsigned GetStripWordRows(unsigned N, unsigned M)
+{
+    return GetFixedMulAddKernel(N, M) ? N : 1;
+}
+
+/// EncodeStrips() for geometries with a fixed kernel.
+/// words has room for N * chunkWords words
+static unsigned EncodeStripsFixed(
+    FixedMulAddKernel kernel,
+    ByteReader* readers,
+    WordWriter* writers,
+    const uint64_t* coefficients,
+    unsigned N,
+    unsigned M,
+    unsigned maxWords,
+    uint64_t* words,
+    uint64_t* sums,
+    unsigned chunkWords,
+    EncoderStats* stats)
+{
+    /*
+        All N originals are unpacked for a chunk first, so the kernel can
+        keep the M sums in registers while it runs across the inputs
+        instead of loading and storing them for each input.
+
+        The chunk size is the same as for the MulAddMem() path.  The kernel reads
+        each row of words only once, so it is fine for them to spill from
+        the L1 cache, and smaller chunks cost more in WriteWords() calls.
+    */
+    unsigned counts[kFixedMaxN];
+
+    // Only counted into when FP61_ENABLE_STATS is defined
+    (void)stats;
+
+    unsigned wordCount = 0;
+    while (wordCount < maxWords)
+    {
+        unsigned request = maxWords - wordCount;
+        if (request > chunkWords) {
+            request = chunkWords;
+        }
+
+        unsigned maxCount = 0;
+        for (unsigned i = 0; i < N; ++i)
+        {
+            FP61_STATS(const unsigned bytesBefore = readers[i].Bytes;)
+            counts[i] = readers[i].ReadWords(&words[i * chunkWords], request);
+            FP61_STATS(CountReadStats(stats, bytesBefore - readers[i].Bytes, &words[i * chunkWords], counts[i]);)
+            if (maxCount < counts[i]) {
+                maxCount = counts[i];
+            }
+        }
+
+        if (maxCount == 0) {
+            break;
+        }
+
+        // Missing words are zeros, as in EncodeStrips()
+        for (unsigned i = 0; i < N; ++i)
+        {
+            if (counts[i] < maxCount) {
+                memset(&words[i * chunkWords + counts[i]], 0, (maxCount - counts[i]) * sizeof(uint64_t));
+            }
+        }
+
+        kernel(words, chunkWords, coefficients, sums, chunkWords, maxCount);
+        FP61_STATS(if (stats) { stats->Reductions += M * maxCount; })
+
+        for (unsigned r = 0; r < M; ++r) {
+            writers[r].WriteWords(&sums[r * chunkWords], maxCount);
+        }
+
+        wordCount += maxCount;
+    }
+
+    return wordCount;
+}
+
+/// Encode up to maxWords words from each of the N readers into the M writers.
+/// words has room for GetStripWordRows() * chunkWords words and sums has room
+/// for M * chunkWords.  Counts the work into stats unless it is nullptr
+static unsigned EncodeStrips(
+    ByteReader* readers,
+    WordWriter* writers,
+    const uint64_t* coefficients,
+    unsigned N,
+    unsigned M,
+    unsigned maxWords,
+    uint64_t* words,
+    uint64_t* sums,
+    unsigned chunkWords,
+    EncoderStats* stats)
+{
+    /*
+        Each chunk of words from all of the originals is multiplied into
+        the sums before moving on to the next chunk, so the working set stays
+        in cache regardless of the packet size.  Unpacking the bytes into
+        words is the expensive part, so each chunk is unpacked once and then
+        accumulated into all M sums.
+
+        The originals can produce slightly different numbers of words.
+        Missing words are treated as zeros, so the recovery packets have as
+        many words as the longest original.
+    */
+    const FixedMulAddKernel fixed = GetFixedMulAddKernel(N, M);
+    if (fixed)
+    {
+        return EncodeStripsFixed(
+            fixed, readers, writers, coefficients, N, M, maxWords, words, sums, chunkWords, stats);
+    }
+
+    unsigned wordCount = 0;
+    while (wordCount < maxWords)
+    {
+        unsigned request = maxWords - wordCount;
+        if (request > chunkWords) {
+            request = chunkWords;
+        }
+
+        // Only clear the part of each row that this chunk can produce,
+        // so that small packets do not pay for clearing the whole chunk
+        for (unsigned r = 0; r < M; ++r) {
+            memset(&sums[r * chunkWords], 0, request * sizeof(uint64_t));
+        }
+
+        unsigned maxCount = 0;
+        for (unsigned i = 0; i < N; ++i)
+        {
+            FP61_STATS(const unsigned bytesBefore = readers[i].Bytes;)
+            const unsigned count = readers[i].ReadWords(words, request);
+            FP61_STATS(CountReadStats(stats, bytesBefore - readers[i].Bytes, words, count);)
+            if (count == 0) {
+                continue;
+            }
+
+            for (unsigned r = 0; r < M; ++r) {
+                MulAddMem(&sums[r * chunkWords], words, coefficients[r * N + i], count);
+            }
+
+            if (maxCount < count) {
+                maxCount = count;
+            }
+        }
+
+        if (maxCount == 0) {
+            break;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            uint64_t* row = &sums[r * chunkWords];
+            for (unsigned j = 0; j < maxCount; ++j) {
+                row[j] = Finalize(row[j]);
+            }
+
+            writers[r].WriteWords(row, maxCount);
+        }
+        FP61_STATS(if (stats) { stats->Reductions += M * maxCount; })
+
+        wordCount += maxCount;
+    }
+
+    return wordCount;
+}
+
+unsigned Encoder::EncodeWords(
+    const uint64_t* coefficients,
+    unsigned N,
+    unsigned M,
+    unsigned maxWords)
+{
+    const unsigned chunkWords = GetCodecChunkWords(M);
+    Words.resize(GetStripWordRows(N, M) * chunkWords);
+    Sums.resize(M * chunkWords);
+
+    return EncodeStrips(
+        Readers.data(),
+        Writers.data(),
+        coefficients,
+        N,
+        M,
+        maxWords,
+        &Words[0],
+        &Sums[0],
+        chunkWords,
+        &Stats);
+}
+
+
+//------------------------------------------------------------------------------
+// Zero-Allocation Encoder
+
+// Alignment of the arrays in the scratch memory
+static const unsigned kScratchAlignBytes = 64;
+
+/// Byte offsets of the arrays in the scratch memory
+struct ScratchLayout
+{
+    unsigned ChunkWords;
+    unsigned ReadersOffset;
+    unsigned WritersOffset;
+    unsigned CoefficientsOffset;
+    unsigned WordsOffset;
+    unsigned SumsOffset;
+    unsigned TotalBytes;
+};
+
+static FP61_FORCE_INLINE unsigned AlignScratchOffset(unsigned offset)
+{
+    return (offset + kScratchAlignBytes - 1) & ~(kScratchAlignBytes - 1);
+}
+
+static void GetScratchLayout(unsigned N, unsigned bytes, unsigned M, ScratchLayout& layout)
+{
+    // Small packets do not need a full chunk of words, but the chunk is kept
+    // a multiple of 64 words for the fast WriteWords() path
+    unsigned chunkWords = GetCodecChunkWords(M);
+    const unsigned neededWords = (ByteReader::MaxWords(bytes) + 63) & ~63u;
+    if (chunkWords > neededWords && neededWords > 0) {
+        chunkWords = neededWords;
+    }
+    layout.ChunkWords = chunkWords;
+
+    unsigned offset = 0;
+    layout.ReadersOffset = offset;
+    offset = AlignScratchOffset(offset + N * sizeof(ByteReader));
+    layout.WritersOffset = offset;
+    offset = AlignScratchOffset(offset + M * sizeof(WordWriter));
+    layout.CoefficientsOffset = offset;
+    offset = AlignScratchOffset(offset + M * N * sizeof(uint64_t));
+    layout.WordsOffset = offset;
+    offset = AlignScratchOffset(offset + GetStripWordRows(N, M) * chunkWords * sizeof(uint64_t));
+    layout.SumsOffset = offset;
+    offset += M * chunkWords * sizeof(uint64_t);
+
+    // Leave room to align the start of the scratch memory
+    layout.TotalBytes = offset + kScratchAlignBytes - 1;
+}
+
+unsigned QueryScratchBytes(unsigned N, unsigned bytes, unsigned M)
+{
+    ScratchLayout layout;
+    GetScratchLayout(N, bytes, M, layout);
+    return layout.TotalBytes;
+}
+
+/// Returns the aligned start of the scratch memory,
+/// or nullptr if the scratch buffer is too small
+static uint8_t* GetScratchBase(
+    void* scratch,
+    unsigned scratchBytes,
+    const ScratchLayout& layout)
+{
+    if (!scratch || scratchBytes < layout.TotalBytes) {
+        return nullptr;
+    }
+    const uintptr_t address = reinterpret_cast<uintptr_t>(scratch);
+    const uintptr_t mask = kScratchAlignBytes - 1;
+    return reinterpret_cast<uint8_t*>((address + mask) & ~mask);
+}
+
+/// Encode from the readers and writers that were set up in the scratch memory
+static unsigned EncodeScratch(
+    uint8_t* base,
+    const ScratchLayout& layout,
+    unsigned N,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    const uint64_t* coefficients)
+{
+    ByteReader* readers = reinterpret_cast<ByteReader*>(base + layout.ReadersOffset);
+    WordWriter* writers = reinterpret_cast<WordWriter*>(base + layout.WritersOffset);
+
+    if (!coefficients)
+    {
+        uint64_t* matrix = reinterpret_cast<uint64_t*>(base + layout.CoefficientsOffset);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            const uint64_t rowSeed = GetRowSeed(seed, firstRecoveryIndex + r);
+            for (unsigned i = 0; i < N; ++i) {
+                matrix[r * N + i] = GetRowCoefficient(rowSeed, i);
+            }
+        }
+        coefficients = matrix;
+    }
+
+    EncodeStrips(
+        readers,
+        writers,
+        coefficients,
+        N,
+        M,
+        ~0u,
+        reinterpret_cast<uint64_t*>(base + layout.WordsOffset),
+        reinterpret_cast<uint64_t*>(base + layout.SumsOffset),
+        layout.ChunkWords,
+        nullptr);
+
+    unsigned recoveryBytes = 0;
+    for (unsigned r = 0; r < M; ++r) {
+        recoveryBytes = writers[r].Flush();
+    }
+    return recoveryBytes;
+}
+
+unsigned EncodeWithScratch(
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* const* recovery,
+    const uint64_t* coefficients,
+    void* scratch,
+    unsigned scratchBytes)
+{
+    if (M == 0) {
+        return 0;
+    }
+
+    ScratchLayout layout;
+    GetScratchLayout(N, bytes, M, layout);
+    uint8_t* base = GetScratchBase(scratch, scratchBytes, layout);
+    if (!base) {
+        return 0;
+    }
+
+    ByteReader* readers = reinterpret_cast<ByteReader*>(base + layout.ReadersOffset);
+    for (unsigned i = 0; i < N; ++i) {
+        readers[i].BeginRead(originals[i], bytes);
+    }
+
+    WordWriter* writers = reinterpret_cast<WordWriter*>(base + layout.WritersOffset);
+    for (unsigned r = 0; r < M; ++r) {
+        writers[r].BeginWrite(recovery[r]);
+    }
+
+    return EncodeScratch(base, layout, N, seed, firstRecoveryIndex, M, coefficients);
+}
+
+unsigned EncodeStridedWithScratch(
+    const uint8_t* originals,
+    unsigned originalStride,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* recovery,
+    unsigned recoveryStride,
+    const uint64_t* coefficients,
+    void* scratch,
+    unsigned scratchBytes)
+{
+    if (M == 0) {
+        return 0;
+    }
+
+    ScratchLayout layout;
+    GetScratchLayout(N, bytes, M, layout);
+    uint8_t* base = GetScratchBase(scratch, scratchBytes, layout);
+    if (!base) {
+        return 0;
+    }
+
+    ByteReader* readers = reinterpret_cast<ByteReader*>(base + layout.ReadersOffset);
+    for (unsigned i = 0; i < N; ++i) {
+        readers[i].BeginRead(originals + static_cast<size_t>(i) * originalStride, bytes);
+    }
+
+    WordWriter* writers = reinterpret_cast<WordWriter*>(base + layout.WritersOffset);
+    for (unsigned r = 0; r < M; ++r) {
+        writers[r].BeginWrite(recovery + static_cast<size_t>(r) * recoveryStride);
+    }
+
+    return EncodeScratch(base, layout, N, seed, firstRecoveryIndex, M, coefficients);
+}
+
+
+//------------------------------------------------------------------------------
+// Streaming Encoder
+
+CodecResult EncoderStream::Begin(
+    unsigned n,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned m,
+    uint8_t* const* recovery,
+    unsigned windowWords)
+{
+    if (n == 0 || m == 0 || !recovery) {
+        return CodecResult::InvalidInput;
+    }
+
+    N = n;
+    Bytes = bytes;
+    M = m;
+
+    const unsigned maxWords = ByteReader::MaxWords(bytes);
+    if (windowWords == 0 || windowWords > maxWords) {
+        windowWords = maxWords;
+    }
+    if (windowWords == 0) {
+        windowWords = 1;
+    }
+    WindowWords = windowWords;
+
+    EmittedWords = 0;
+    FinishedColumns = 0;
+    RecoveryBytes = 0;
+    Complete = false;
+
+    Matrix = Coefficients.Get(seed, firstRecoveryIndex, n, m);
+
+    Columns.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        EncoderStreamColumn& column = Columns[i];
+        column.Reader.BeginRead(nullptr, 0);
+        column.PendingBytes = 0;
+        column.ReceivedBytes = 0;
+        column.WordCount = 0;
+        column.Finished = (bytes == 0);
+    }
+    if (bytes == 0) {
+        FinishedColumns = n;
+    }
+
+    Writers.resize(m);
+    for (unsigned r = 0; r < m; ++r) {
+        Writers[r].BeginWrite(recovery[r]);
+    }
+
+    Words.resize(kStreamChunkWords);
+    Sums.assign(m * windowWords, 0);
+
+    // Empty originals are already complete
+    EmitWords();
+
+    return CodecResult::Success;
+}
+
+void EncoderStream::ReadColumn(EncoderStreamColumn& column, unsigned index, bool final)
+{
+    uint64_t* words = &Words[0];
+
+    for (;;)
+    {
+        // Do not run past the end of the window
+        unsigned limit = EmittedWords + WindowWords - column.WordCount;
+        if (limit == 0) {
+            return;
+        }
+        if (limit > kStreamChunkWords) {
+            limit = kStreamChunkWords;
+        }
+
+        // Unless this is the end of the column, leave the last partial word
+        // to be completed by the next fragment
+        const unsigned count = final ?
+            column.Reader.ReadWords(words, limit) :
+            column.Reader.ReadWordsPartial(words, limit);
+
+        // Accumulate into the ring of sums, which may wrap around
+        const unsigned offset = column.WordCount % WindowWords;
+        unsigned first = WindowWords - offset;
+        if (first > count) {
+            first = count;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            const uint64_t coeff = Matrix[r * N + index];
+            uint64_t* sums = &Sums[r * WindowWords];
+
+            if (first > 0) {
+                MulAddMem(sums + offset, words, coeff, first);
+            }
+            if (count > first) {
+                MulAddMem(sums, words + first, coeff, count - first);
+            }
+        }
+
+        column.WordCount += count;
+
+        if (count < limit)
+        {
+            if (final)
+            {
+                column.Finished = true;
+                ++FinishedColumns;
+            }
+            return;
+        }
+    }
+}
+
+void EncoderStream::ReadPending(EncoderStreamColumn& column, unsigned index)
+{
+    const bool final = (column.ReceivedBytes == Bytes);
+
+    column.Reader.ResumeRead(column.Pending, column.PendingBytes);
+    ReadColumn(column, index, final);
+
+    // Keep any bytes that were not read at the front of the buffer
+    const unsigned unread = column.Reader.Bytes;
+    if (unread > 0 && unread < column.PendingBytes) {
+        memmove(column.Pending, column.Reader.Data, unread);
+    }
+    column.PendingBytes = unread;
+}
+
+/// Finalize and write out a run of sums, and clear them for reuse
+static void WriteStreamSums(WordWriter& writer, uint64_t* sums, unsigned count)
+{
+    for (unsigned j = 0; j < count; ++j) {
+        sums[j] = Finalize(sums[j]);
+    }
+    writer.WriteWords(sums, count);
+    memset(sums, 0, count * sizeof(uint64_t));
+}
+
+bool EncoderStream::EmitWords()
+{
+    if (Complete) {
+        return false;
+    }
+
+    // Find the first word that some unfinished column has not reached yet.
+    // Finished columns contribute zeros past their last word
+    unsigned target = ~0u, maxCount = 0;
+    for (unsigned i = 0; i < N; ++i)
+    {
+        const EncoderStreamColumn& column = Columns[i];
+        if (!column.Finished && target > column.WordCount) {
+            target = column.WordCount;
+        }
+        if (maxCount < column.WordCount) {
+            maxCount = column.WordCount;
+        }
+    }
+
+    const bool allFinished = (FinishedColumns == N);
+    if (allFinished) {
+        target = maxCount;
+    }
+
+    const bool emitted = (target > EmittedWords);
+    if (emitted)
+    {
+        const unsigned count = target - EmittedWords;
+        const unsigned offset = EmittedWords % WindowWords;
+        unsigned first = WindowWords - offset;
+        if (first > count) {
+            first = count;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            uint64_t* sums = &Sums[r * WindowWords];
+
+            WriteStreamSums(Writers[r], sums + offset, first);
+            if (count > first) {
+                WriteStreamSums(Writers[r], sums, count - first);
+            }
+        }
+
+        EmittedWords = target;
+    }
+
+    if (allFinished)
+    {
+        for (unsigned r = 0; r < M; ++r) {
+            RecoveryBytes = Writers[r].Flush();
+        }
+        Complete = true;
+    }
+
+    return emitted;
+}
+
+unsigned EncoderStream::Append(unsigned index, const uint8_t* data, unsigned bytes)
+{
+    if (index >= N || Complete) {
+        return 0;
+    }
+
+    EncoderStreamColumn& column = Columns[index];
+
+    // Ignore data past the end of the original
+    const unsigned remaining = Bytes - column.ReceivedBytes;
+    if (bytes > remaining) {
+        bytes = remaining;
+    }
+
+    unsigned accepted = 0;
+
+    // Complete the pending bytes from the last fragment first
+    if (column.PendingBytes > 0 && bytes > 0)
+    {
+        unsigned copyBytes = 8 - column.PendingBytes;
+        if (copyBytes > bytes) {
+            copyBytes = bytes;
+        }
+
+        memcpy(column.Pending + column.PendingBytes, data, copyBytes);
+        column.PendingBytes += copyBytes;
+        column.ReceivedBytes += copyBytes;
+        accepted += copyBytes;
+        data += copyBytes;
+        bytes -= copyBytes;
+
+        ReadPending(column, index);
+    }
+
+    // Read the rest of the fragment in place
+    if (column.PendingBytes == 0 && bytes > 0)
+    {
+        const bool final = (column.ReceivedBytes + bytes == Bytes);
+
+        column.Reader.ResumeRead(data, bytes);
+        ReadColumn(column, index, final);
+
+        // Keep a partial load at the end, or give back the rest of the data
+        // if the window is full
+        unsigned unread = column.Reader.Bytes;
+        if (unread < 8)
+        {
+            memcpy(column.Pending, column.Reader.Data, unread);
+            column.PendingBytes = unread;
+            unread = 0;
+        }
+
+        column.ReceivedBytes += bytes - unread;
+        accepted += bytes - unread;
+    }
+
+    // Finish the tail if the fragment completed the original
+    if (!column.Finished && column.ReceivedBytes == Bytes) {
+        ReadPending(column, index);
+    }
+
+    // Write out completed words, and let columns that were waiting on the
+    // window continue from their pending bytes
+    while (EmitWords())
+    {
+        for (unsigned i = 0; i < N; ++i)
+        {
+            if (!Columns[i].Finished) {
+                ReadPending(Columns[i], i);
+            }
+        }
+    }
+
+    return accepted;
+}
+
+unsigned EncoderStream::GetCompletedBytes() const
+{
+    if (Complete) {
+        return RecoveryBytes;
+    }
+    return Writers.empty() ? 0 : Writers[0].GetCompletedBytes();
+}
+
+
+//------------------------------------------------------------------------------
+// Transform Encoder
+
+unsigned GetTransformCodeSize(unsigned N)
+{
+    if (N == 0 || N > (1u << kTransformCodeMaxLog2)) {
+        return 0;
+    }
+    unsigned n = 1;
+    while (n < N) {
+        n *= 2;
+    }
+    return n;
+}
+
+static unsigned GetLog2(unsigned n)
+{
+    unsigned log2n = 0;
+    while ((1u << log2n) < n) {
+        ++log2n;
+    }
+    return log2n;
+}
+
+// x^e with both parts in Fp, by square-and-multiply
+static Fp2 Fp2Pow(Fp2 x, unsigned e)
+{
+    Fp2 r;
+    r.Re = 1;
+    r.Im = 0;
+    for (; e != 0; e >>= 1)
+    {
+        if (e & 1) {
+            r = Fp2Finalize(Fp2Multiply(r, x));
+        }
+        x = Fp2Finalize(Fp2Square(x));
+    }
+    return r;
+}
+
+Fp2 GetTransformCoefficient(unsigned N, unsigned recoveryIndex, unsigned column)
+{
+    const unsigned n = GetTransformCodeSize(N);
+    const unsigned log2n = GetLog2(n);
+
+    // z_r * w^-i = w2^(2(r - i) + 1)
+    const unsigned e = (2 * (recoveryIndex - column) + 1) & (2 * n - 1);
+    Fp2 d = Fp2Pow(GetFp2RootOfUnity(log2n + 1), e);
+    d.Re = Finalize(d.Re + kPrime - 1);
+
+    // -2/n = -2^(62 - log2n)
+    const uint64_t scale = Negate(Finalize(PartialReduce((uint64_t)1 << (62 - log2n))));
+    Fp2 r = Fp2Inverse(d);
+    r.Re = Finalize(Multiply(r.Re, scale));
+    r.Im = Finalize(Multiply(r.Im, scale));
+    return r;
+}
+
+void TransformEncoder::Initialize(unsigned log2n)
+{
+    const unsigned n = 1u << log2n;
+
+    Plan.Initialize(log2n);
+    GetBitReversal(log2n, BitReversal);
+
+    // Shift[rev(k)] = w2^k / n, where 1/n = 2^(61 - log2n)
+    const Fp2 w2 = GetFp2RootOfUnity(log2n + 1);
+    const uint64_t scale = (uint64_t)1 << (61 - log2n);
+    Fp2 s;
+    s.Re = scale;
+    s.Im = 0;
+    Shift.resize(n);
+    for (unsigned k = 0; k < n; ++k)
+    {
+        Shift[BitReversal[k]] = s;
+        s = Fp2Finalize(Fp2Multiply(s, w2));
+    }
+
+    Data.resize(n);
+    Initialized = true;
+}
+
+unsigned TransformEncoder::Encode(
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* const* recovery)
+{
+    const unsigned n = GetTransformCodeSize(N);
+    if (M == 0 || n == 0 || firstRecoveryIndex >= n || M > n - firstRecoveryIndex) {
+        return 0;
+    }
+
+    const unsigned log2n = GetLog2(n);
+    if (!Initialized || Plan.Log2n != log2n) {
+        Initialize(log2n);
+    }
+
+    Readers.resize(N);
+    for (unsigned i = 0; i < N; ++i) {
+        Readers[i].BeginRead(originals[i], bytes);
+    }
+
+    Writers.resize(M);
+    for (unsigned r = 0; r < M; ++r) {
+        Writers[r].BeginWrite(recovery[r]);
+    }
+
+    const unsigned chunkWords = GetCodecChunkWords(N + M);
+    Words.resize(N * chunkWords);
+    Outputs.resize(M * chunkWords);
+
+    Fp2* data = Data.data();
+
+    /*
+        Each chunk of words is unpacked from all of the originals first, and
+        then each pair of words across the originals goes through the
+        transforms.  As in the matrix-vector encoder, missing words at the
+        end of shorter originals are treated as zeros.
+    */
+    for (;;)
+    {
+        unsigned maxCount = 0;
+        for (unsigned i = 0; i < N; ++i)
+        {
+            uint64_t* row = &Words[i * chunkWords];
+            const unsigned count = Readers[i].ReadWords(row, chunkWords);
+            memset(row + count, 0, (chunkWords - count) * sizeof(uint64_t));
+
+            if (maxCount < count) {
+                maxCount = count;
+            }
+        }
+
+        if (maxCount == 0) {
+            break;
+        }
+
+        // Words are produced in pairs, so round up to an even count
+        const unsigned outputWords = maxCount + (maxCount & 1);
+
+        for (unsigned q = 0; q < outputWords; q += 2)
+        {
+            for (unsigned i = 0; i < N; ++i)
+            {
+                const uint64_t* pair = &Words[i * chunkWords + q];
+                data[i].Re = pair[0];
+                data[i].Im = pair[1];
+            }
+            for (unsigned i = N; i < n; ++i) {
+                data[i].Re = 0;
+                data[i].Im = 0;
+            }
+
+            // Coefficients of f times n in bit-reversed order
+            Plan.TransformDIF(data, true);
+
+            // Coefficients of f(w2 * x), in bit-reversed order
+            Fp2MulMem(data, Shift.data(), n);
+
+            // f(w2 * w^r) in natural order
+            Plan.TransformDIT(data, false);
+
+            for (unsigned r = 0; r < M; ++r)
+            {
+                const Fp2 v = Fp2Finalize(data[firstRecoveryIndex + r]);
+                uint64_t* out = &Outputs[r * chunkWords + q];
+                out[0] = v.Re;
+                out[1] = v.Im;
+            }
+        }
+
+        for (unsigned r = 0; r < M; ++r) {
+            Writers[r].WriteWords(&Outputs[r * chunkWords], outputWords);
+        }
+
+        if (maxCount < chunkWords) {
+            break;
+        }
+    }
+
+    unsigned recoveryBytes = 0;
+    for (unsigned r = 0; r < M; ++r) {
+        recoveryBytes = Writers[r].Flush();
+    }
+    return recoveryBytes;
+}
+
+
+//------------------------------------------------------------------------------
+// Decoder
+
+bool Decoder::Solve(
+    uint64_t seed,
+    const RecoveryPacket* recovery,
+    unsigned recoveryCount)
+{
+    const unsigned k = static_cast<unsigned>(Lost.size());
+    const unsigned rows = recoveryCount;
+
+    // The first k recovery rows are almost always independent,
+    // so try inverting their coefficient matrix before selecting rows
+    Matrix.resize(k * k);
+    Solution.resize(k * k);
+
+    for (unsigned r = 0; r < k; ++r)
+    {
+        const uint64_t rowSeed = GetRowSeed(seed, recovery[r].Index);
+        for (unsigned j = 0; j < k; ++j) {
+            Matrix[r * k + j] = GetRowCoefficient(rowSeed, Lost[j]);
+        }
+    }
+
+    if (InvertMatrix(&Matrix[0], &Solution[0], k))
+    {
+        Rows.resize(k);
+        for (unsigned m = 0; m < k; ++m) {
+            Rows[m] = m;
+        }
+        return true;
+    }
+    if (rows == k) {
+        return false;
+    }
+
+    /*
+        Each row is [ coefficients for the lost columns | identity ].
+        After elimination, the first k rows of the identity half hold E,
+        which expresses each lost original as a combination of the selected
+        recovery rows.  Row swaps are tracked in Rows so that E can be read
+        back out.
+    */
+    Matrix.resize(rows * k);
+    Solution.resize(rows * rows);
+    Rows.resize(rows);
+
+    for (unsigned r = 0; r < rows; ++r)
+    {
+        Rows[r] = r;
+
+        const uint64_t rowSeed = GetRowSeed(seed, recovery[r].Index);
+        for (unsigned j = 0; j < k; ++j) {
+            Matrix[r * k + j] = GetRowCoefficient(rowSeed, Lost[j]);
+        }
+        for (unsigned q = 0; q < rows; ++q) {
+            Solution[r * rows + q] = (q == r) ? 1 : 0;
+        }
+    }
+
+    if (!EliminateRows(&Matrix[0], &Solution[0], rows, k, rows, &Rows[0])) {
+        return false;
+    }
+
+    // Pivot rows only ever receive multiples of other pivot rows,
+    // so E is nonzero only in the columns of the selected recovery rows
+    Matrix.resize(k * k);
+    for (unsigned j = 0; j < k; ++j) {
+        for (unsigned m = 0; m < k; ++m) {
+            Matrix[j * k + m] = Solution[j * rows + Rows[m]];
+        }
+    }
+    Matrix.swap(Solution);
+    Rows.resize(k);
+
+    return true;
+}
+
+// Copy completed bytes from a staging buffer to the output,
+// and rewind the writer to the start of the staging buffer
+static void DrainStaging(
+    ByteWriter& writer,
+    unsigned stagedBytes,
+    uint8_t* dest,
+    unsigned& offset,
+    unsigned bytes)
+{
+    unsigned copyBytes = bytes - offset;
+    if (copyBytes > stagedBytes) {
+        copyBytes = stagedBytes;
+    }
+
+    memcpy(dest + offset, writer.Writer.Data, copyBytes);
+    offset += copyBytes;
+
+    writer.Writer.DataWritePtr = writer.Writer.Data;
+}
+
+CodecResult Decoder::Decode(
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    const RecoveryPacket* recovery,
+    unsigned recoveryCount,
+    uint8_t* const* recovered)
+{
+    if (N == 0 || !originals) {
+        return CodecResult::InvalidInput;
+    }
+
+    Lost.clear();
+    for (unsigned i = 0; i < N; ++i) {
+        if (!originals[i]) {
+            Lost.push_back(i);
+        }
+    }
+
+    const unsigned k = static_cast<unsigned>(Lost.size());
+    if (k == 0) {
+        return CodecResult::Success;
+    }
+    if (k > recoveryCount) {
+        return CodecResult::NeedMoreData;
+    }
+    if (!recovery || !recovered) {
+        return CodecResult::InvalidInput;
+    }
+
+    const unsigned maxRecoveryBytes = GetRecoveryBytes(bytes);
+    for (unsigned r = 0; r < recoveryCount; ++r) {
+        if (!recovery[r].Data || recovery[r].Bytes > maxRecoveryBytes) {
+            return CodecResult::InvalidInput;
+        }
+    }
+    for (unsigned j = 0; j < k; ++j) {
+        if (!recovered[Lost[j]]) {
+            return CodecResult::InvalidInput;
+        }
+    }
+
+    // Elimination only touches the small coefficient matrix
+    if (!Solve(seed, recovery, recoveryCount)) {
+        return CodecResult::NeedMoreData;
+    }
+
+    // All recovery packets for the same originals have the same size
+    const unsigned recoveryBytes = recovery[Rows[0]].Bytes;
+    for (unsigned m = 1; m < k; ++m) {
+        if (recovery[Rows[m]].Bytes != recoveryBytes) {
+            return CodecResult::InvalidInput;
+        }
+    }
+    const unsigned totalWords = WordReader::WordCount(recoveryBytes);
+
+    Readers.resize(N);
+    for (unsigned i = 0; i < N; ++i) {
+        if (originals[i]) {
+            Readers[i].BeginRead(originals[i], bytes);
+        }
+    }
+
+    RecoveryReaders.resize(k);
+    RowSeeds.resize(k);
+    for (unsigned m = 0; m < k; ++m)
+    {
+        RecoveryReaders[m].BeginRead(recovery[Rows[m]].Data, recoveryBytes);
+        RowSeeds[m] = GetRowSeed(seed, recovery[Rows[m]].Index);
+    }
+
+    // Recovered words are written a chunk at a time to a small staging buffer
+    // because ByteWriter can write a little past the end of the original size
+    const unsigned chunkWords = GetCodecChunkWords(k + 1);
+    const unsigned stagingBytes = ByteWriter::MaxBytesNeeded(chunkWords) + 8;
+    Staging.resize(k * stagingBytes);
+    Writers.resize(k);
+    Offsets.resize(k);
+    for (unsigned j = 0; j < k; ++j)
+    {
+        Writers[j].BeginWrite(&Staging[j * stagingBytes]);
+        Offsets[j] = 0;
+    }
+
+    Sums.resize(k * chunkWords);
+    Outputs.resize(chunkWords);
+    Words.resize(chunkWords);
+    uint64_t* words = &Words[0];
+    uint64_t* outputs = &Outputs[0];
+
+    for (unsigned start = 0; start < totalWords; start += chunkWords)
+    {
+        unsigned count = totalWords - start;
+        if (count > chunkWords) {
+            count = chunkWords;
+        }
+
+        // S_m = R_m - sum(c_mi * f_i) over the received originals
+        for (unsigned m = 0; m < k; ++m) {
+            RecoveryReaders[m].ReadWords(&Sums[m * chunkWords], count);
+        }
+
+        for (unsigned i = 0; i < N; ++i)
+        {
+            if (!originals[i]) {
+                continue;
+            }
+
+            const unsigned n = Readers[i].ReadWords(words, count);
+            if (n == 0) {
+                continue;
+            }
+
+            for (unsigned m = 0; m < k; ++m)
+            {
+                const uint64_t coeff = Negate(GetRowCoefficient(RowSeeds[m], i));
+                MulAddMem(&Sums[m * chunkWords], words, coeff, n);
+            }
+        }
+
+        // f_j = sum(E_jm * S_m)
+        for (unsigned j = 0; j < k; ++j)
+        {
+            memset(outputs, 0, count * sizeof(uint64_t));
+
+            for (unsigned m = 0; m < k; ++m) {
+                MulAddMem(outputs, &Sums[m * chunkWords], Solution[j * k + m], count);
+            }
+
+            for (unsigned t = 0; t < count; ++t) {
+                outputs[t] = Finalize(outputs[t]);
+            }
+
+            ByteWriter& writer = Writers[j];
+            writer.WriteWords(outputs, count);
+
+            const unsigned stagedBytes = static_cast<unsigned>(writer.Writer.DataWritePtr - writer.Writer.Data);
+            DrainStaging(writer, stagedBytes, recovered[Lost[j]], Offsets[j], bytes);
+        }
+    }
+
+    for (unsigned j = 0; j < k; ++j)
+    {
+        const unsigned stagedBytes = Writers[j].Flush();
+        DrainStaging(Writers[j], stagedBytes, recovered[Lost[j]], Offsets[j], bytes);
+    }
+
+    return CodecResult::Success;
+}
+
+
+} // namespace fp61
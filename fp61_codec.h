@@ -0,0 +1,680 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAT_FP61_CODEC_H
+#define CAT_FP61_CODEC_H
+
+#include "fp61.h"
+#include "fp61_poly.h"
+
+#include <vector>
+
+/** \file
+    Fp61 Erasure Code
+
+    The encoder produces M recovery packets from N equal-sized original
+    packets.  Each recovery packet is a random linear combination of the
+    original data, treated as Fp words by ByteReader:
+
+        R_r = sum(GetCoefficient(seed, r, i) * f_i) (mod 2^61-1)
+
+    Any k lost originals can be recovered from any k recovery packets
+    (with high probability), so this is an MDS-like code for practical use.
+
+    The decoder solves for the lost originals by Gaussian elimination on the
+    small k x k matrix of coefficients, which touches no packet data.  Then
+    the packet data is processed with a bulk matrix-vector pass, which has
+    about the same cost per byte as the encoder.
+
+    For large N and M the matrix-vector product costs O(N * M) per word.
+    A second code, fp61::TransformEncoder, is a Reed-Solomon code over
+    Fp^2 whose encoder costs O(n log n) per pair of words with two Fp^2
+    transforms of size n >= N, however many recovery packets are produced.
+*/
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Code Parameters
+
+/// Get the seed for the generator matrix row of a recovery packet
+FP61_FORCE_INLINE uint64_t GetRowSeed(uint64_t seed, unsigned recoveryIndex)
+{
+    return HashU64(seed + recoveryIndex);
+}
+
+/// Get the generator matrix coefficient for an original column,
+/// given the row seed from GetRowSeed().  Returns a value from 1..p-1
+FP61_FORCE_INLINE uint64_t GetRowCoefficient(uint64_t rowSeed, unsigned column)
+{
+    // HashToNonzeroFp() is nearly affine over a run of consecutive inputs,
+    // which makes the generator matrix close to rank 2.  Mixing the column
+    // with HashU64() first breaks up that structure
+    return HashToNonzeroFp(HashU64(rowSeed + column));
+}
+
+/// Get the generator matrix coefficient for a recovery row and original column.
+/// Returns a value from 1..p-1
+FP61_FORCE_INLINE uint64_t GetCoefficient(
+    uint64_t seed,
+    unsigned recoveryIndex,
+    unsigned column)
+{
+    return GetRowCoefficient(GetRowSeed(seed, recoveryIndex), column);
+}
+
+/// Get the maximum number of bytes needed for a recovery packet
+/// for original packets of the given size
+FP61_FORCE_INLINE unsigned GetRecoveryBytes(unsigned originalBytes)
+{
+    const unsigned maxWords = ByteReader::MaxWords(originalBytes);
+    return WordWriter::BytesNeeded(maxWords);
+}
+
+/// Limits on the number of Fp words processed at a time by the codec.
+/// Chunks are a multiple of 64 words to use the fast WriteWords() path
+static const unsigned kCodecMinChunkWords = 64;
+static const unsigned kCodecMaxChunkWords = 4096;
+
+/// Get the number of Fp words to process at a time by the encoder and decoder
+/// while accumulating `rows` sums of words.  This is tuned from the detected
+/// cache size (see fp61::GetKernelInfo()) so that the sums and the unpacked
+/// input words stay resident in cache while the original data streams through
+unsigned GetCodecChunkWords(unsigned rows);
+
+/// Result of a decoder operation
+enum class CodecResult
+{
+    Success,        ///< All lost originals were recovered
+    InvalidInput,   ///< Parameters are out of range or inconsistent
+    NeedMoreData    ///< Not enough independent recovery packets were provided
+};
+
+
+//------------------------------------------------------------------------------
+// Generator Matrix
+
+/// Maximum number of generator matrix rows kept by a CoefficientSet
+static const unsigned kCodecMaxCachedRows = 256;
+
+/**
+    CoefficientSet
+
+    Caches the rows of the generator matrix for a seed, a number of
+    originals N, and a range of M recovery indices, stored as an M x N
+    row-major matrix of GetCoefficient() values.
+
+    Call Get() to return the coefficients for a set of parameters.
+    Only the rows that are not already cached are hashed, so encoding many
+    stripes with the same geometry pays for the hashing once.  Requests with
+    the same seed and N extend the cached range of recovery indices, up to
+    kCodecMaxCachedRows rows, so producing the recovery packets one index at
+    a time also reuses the rows.
+
+    The returned pointer is valid until the next call to Get().
+*/
+struct CoefficientSet
+{
+    std::vector<uint64_t> Matrix;
+    uint64_t Seed = 0;
+    unsigned FirstRecoveryIndex = 0;
+    unsigned N = 0;
+    unsigned M = 0;
+
+
+    /// Get the M x N row-major coefficients for recovery indices
+    /// firstRecoveryIndex .. firstRecoveryIndex + M - 1
+    const uint64_t* Get(
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        unsigned N,
+        unsigned M);
+
+    /// Hash `count` rows of the Matrix starting from the given cached row
+    void HashRows(unsigned firstRow, unsigned count);
+};
+
+
+//------------------------------------------------------------------------------
+// Encoder Statistics
+
+/**
+    EncoderStats
+
+    Counters for the work done by an Encoder, to relate its throughput to
+    the input data.  Escapes are the ambiguous words (see IsU64Ambiguous())
+    that cost an extra bit and a slower ByteReader path, so a high rate of
+    escapes per word points at long runs of 0xff bytes in the input.
+
+    The counters are only updated when the library is built with
+    FP61_ENABLE_STATS defined (the CMake option of the same name).
+    Otherwise the encoder never touches them and they stay 0, so they
+    cost nothing.  EncodeWithScratch() and the other zero-allocation
+    encoders have no Encoder object, so they are not counted.
+*/
+struct EncoderStats
+{
+    /// Bytes of the originals consumed by the ByteReaders
+    uint64_t Bytes = 0;
+
+    /// Words unpacked from the originals
+    uint64_t Words = 0;
+
+    /// Unpacked words that were ambiguous and needed an extra bit
+    uint64_t Escapes = 0;
+
+    /// Sums reduced to Fp for the recovery packets, one per recovery word
+    uint64_t Reductions = 0;
+
+    /// WordWriter::Flush() calls at the end of the recovery packets
+    uint64_t Flushes = 0;
+
+
+    /// Add the counters from another EncoderStats
+    void Add(const EncoderStats& other);
+};
+
+/// Evaluates to its argument only when counting EncoderStats
+#if defined(FP61_ENABLE_STATS)
+# define FP61_STATS(x) x
+#else
+# define FP61_STATS(x)
+#endif
+
+
+//------------------------------------------------------------------------------
+// Encoder
+
+/**
+    Encoder
+
+    Produces recovery packets for a set of N original packets,
+    each `bytes` in size.  Original packet pointers are provided as an array.
+
+    Call Encode() to produce the recovery packet for the given recoveryIndex.
+    The recovery buffer must have room for GetRecoveryBytes(bytes) bytes.
+    Returns the number of bytes written to the recovery buffer.
+
+    Call EncodeMultiple() to produce M recovery packets at once, which is
+    faster than calling Encode() M times.  Each original is unpacked only
+    once and each chunk of its words is accumulated into all M sums while
+    it is still in the L1 cache.
+
+    The generator matrix rows are cached in a CoefficientSet, so repeated
+    calls with the same seed and N do not hash the coefficients again.
+
+    When IsFixedGeometry(N, M) is true, the originals are unpacked for a
+    chunk together and encoded by the unrolled fp61::GetFixedMulAddKernel()
+    kernel for that geometry.  Other geometries use fp61::MulAddMem().
+    Both produce the same recovery packets.
+
+    The Encoder keeps its working memory between calls,
+    so reuse the same object to avoid reallocating.
+
+    Stats accumulates over all calls when built with FP61_ENABLE_STATS.
+*/
+struct Encoder
+{
+    std::vector<ByteReader> Readers;
+    std::vector<WordWriter> Writers;
+    CoefficientSet Coefficients;
+    std::vector<uint64_t> Words;
+    std::vector<uint64_t> Sums;
+    EncoderStats Stats;
+
+
+    unsigned Encode(
+        const uint8_t* const* originals,
+        unsigned N,
+        unsigned bytes,
+        uint64_t seed,
+        unsigned recoveryIndex,
+        uint8_t* recovery);
+
+    /// Produce recovery packets for recovery indices
+    /// firstRecoveryIndex .. firstRecoveryIndex + M - 1.
+    /// Each recovery[r] buffer must have room for GetRecoveryBytes(bytes).
+    /// All of the packets are the same size.
+    /// Returns the number of bytes written to each recovery buffer.
+    unsigned EncodeMultiple(
+        const uint8_t* const* originals,
+        unsigned N,
+        unsigned bytes,
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        unsigned M,
+        uint8_t* const* recovery);
+
+    /// Encode up to maxWords words from each of the N Readers into the M
+    /// Writers, using an M x N row-major matrix of coefficients.
+    /// This is the inner loop of EncodeMultiple(), which is also used to
+    /// encode ranges of words that start from saved ByteReader states.
+    /// Returns the number of words written to each of the Writers.
+    unsigned EncodeWords(
+        const uint64_t* coefficients,
+        unsigned N,
+        unsigned M,
+        unsigned maxWords);
+};
+
+/**
+    FixedEncoder<N, M>
+
+    Encoder for a geometry that is known at compile time, which checks that
+    it has a fixed geometry kernel (see fp61::IsFixedGeometry()).  Encoder
+    picks the same kernel at runtime, so this only documents and enforces
+    that the fast path is taken.
+*/
+template<unsigned N, unsigned M>
+struct FixedEncoder
+{
+    static_assert(IsFixedGeometry(N, M), "No fixed geometry kernel for N x M");
+
+    Encoder Base;
+
+
+    /// Same as Encoder::EncodeMultiple() for N originals and M recovery packets
+    unsigned EncodeMultiple(
+        const uint8_t* const* originals,
+        unsigned bytes,
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        uint8_t* const* recovery)
+    {
+        return Base.EncodeMultiple(originals, N, bytes, seed, firstRecoveryIndex, M, recovery);
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// Zero-Allocation Encoder
+
+/**
+    fp61::QueryScratchBytes(N, bytes, M)
+
+    Returns the number of bytes of scratch memory needed by
+    EncodeWithScratch() and EncodeStridedWithScratch() to produce M recovery
+    packets from N originals of `bytes` bytes each.
+
+    The scratch memory does not need to be aligned.
+*/
+unsigned QueryScratchBytes(unsigned N, unsigned bytes, unsigned M = 1);
+
+/**
+    fp61::EncodeWithScratch(originals, N, bytes, seed, firstRecoveryIndex,
+                            M, recovery, coefficients, scratch, scratchBytes)
+
+    Produces the same recovery packets as Encoder::EncodeMultiple(), using
+    only the caller-provided scratch memory, so it does no heap allocations.
+    This is useful when the packets live in a pre-registered buffer pool and
+    tail latency matters.
+
+    The scratch buffer must have at least QueryScratchBytes(N, bytes, M)
+    bytes.  It can be reused between calls, but not by two calls at once.
+
+    If coefficients is not nullptr, it is used as the M x N row-major
+    generator matrix for the recovery indices, for example as returned by
+    CoefficientSet::Get(), which avoids hashing the coefficients every call.
+    Otherwise the coefficients are hashed into the scratch memory.
+
+    Returns the number of bytes written to each recovery buffer,
+    or 0 if M is 0 or the scratch buffer is too small.
+*/
+unsigned EncodeWithScratch(
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* const* recovery,
+    const uint64_t* coefficients,
+    void* scratch,
+    unsigned scratchBytes);
+
+/**
+    Same as EncodeWithScratch() for packets laid out at a fixed stride:
+    original i starts at originals + i * originalStride, and recovery packet
+    r is written to recovery + r * recoveryStride.  The recovery stride must
+    be at least GetRecoveryBytes(bytes).
+*/
+unsigned EncodeStridedWithScratch(
+    const uint8_t* originals,
+    unsigned originalStride,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* recovery,
+    unsigned recoveryStride,
+    const uint64_t* coefficients,
+    void* scratch,
+    unsigned scratchBytes);
+
+
+//------------------------------------------------------------------------------
+// Streaming Encoder
+
+/// Words unpacked from a column at a time by EncoderStream::Append()
+static const unsigned kStreamChunkWords = 256;
+
+/// State of one original packet being streamed into an EncoderStream
+struct EncoderStreamColumn
+{
+    /// Reader state that is resumed on each fragment
+    ByteReader Reader;
+
+    /// Bytes from the end of the last fragment that were not read yet,
+    /// because they are not a whole 8-byte load
+    uint8_t Pending[8];
+    unsigned PendingBytes;
+
+    /// Bytes accepted so far
+    unsigned ReceivedBytes;
+
+    /// Words accumulated into the sums so far
+    unsigned WordCount;
+
+    /// All of the words of the column were accumulated
+    bool Finished;
+};
+
+/**
+    EncoderStream
+
+    Produces the same recovery packets as Encoder::EncodeMultiple() from
+    original packets that arrive in fragments of any size and in any order,
+    without copying the originals into contiguous buffers.
+
+    Call Begin() with the code parameters and the recovery buffers, which
+    must each have room for GetRecoveryBytes(bytes) bytes.
+
+    Call Append() with the next fragment of an original packet.  Fragments of
+    each original must be provided in order, but fragments of different
+    originals can be interleaved.  The partial word at the end of each
+    fragment is kept in the column state, and the data is not buffered.
+
+    As soon as every original has reached a word, the recovery words up to
+    it are written out, so the recovery packets are produced progressively.
+    GetCompletedBytes() returns how many bytes at the front of each recovery
+    buffer are final.  When all of the originals are complete, IsComplete()
+    returns true and GetCompletedBytes() returns the recovery packet size.
+
+    Memory use is M sums per word of the window plus a few bytes per
+    original.  By default the window covers the whole packet, so Append()
+    always accepts all of the data.  With a smaller window, an original that
+    runs more than windowWords words ahead of the slowest original is not
+    accepted past that point, and Append() returns fewer bytes than provided.
+    The rest of that fragment should be appended again after the other
+    originals catch up.
+*/
+struct EncoderStream
+{
+    unsigned N = 0;
+    unsigned Bytes = 0;
+    unsigned M = 0;
+    unsigned WindowWords = 0;
+
+    /// Words written to the recovery packets so far
+    unsigned EmittedWords = 0;
+
+    unsigned FinishedColumns = 0;
+    unsigned RecoveryBytes = 0;
+    bool Complete = false;
+
+    const uint64_t* Matrix = nullptr;
+    CoefficientSet Coefficients;
+    std::vector<EncoderStreamColumn> Columns;
+    std::vector<WordWriter> Writers;
+    std::vector<uint64_t> Words;
+
+    /// M rows of WindowWords sums used as ring buffers
+    std::vector<uint64_t> Sums;
+
+
+    /// Start encoding recovery packets for recovery indices
+    /// firstRecoveryIndex .. firstRecoveryIndex + M - 1 from N originals of
+    /// `bytes` bytes each.  windowWords = 0 covers the whole packet.
+    CodecResult Begin(
+        unsigned N,
+        unsigned bytes,
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        unsigned M,
+        uint8_t* const* recovery,
+        unsigned windowWords = 0);
+
+    /// Append the next fragment of the given original.
+    /// Data past the end of the original packet is ignored.
+    /// Returns the number of bytes accepted.
+    unsigned Append(unsigned column, const uint8_t* data, unsigned bytes);
+
+    /// Returns true when all of the recovery packets have been written
+    bool IsComplete() const
+    {
+        return Complete;
+    }
+
+    /// Returns the number of bytes at the front of each recovery buffer
+    /// that are final
+    unsigned GetCompletedBytes() const;
+
+    /// Read words from a column into the sums until the data runs out or the
+    /// window is full.  If `final` the end of the data is the end of the column
+    void ReadColumn(EncoderStreamColumn& column, unsigned index, bool final);
+
+    /// Read the Pending bytes of a column, if any can be read
+    void ReadPending(EncoderStreamColumn& column, unsigned index);
+
+    /// Write out the recovery words that all of the columns have reached.
+    /// Returns true if any were written
+    bool EmitWords();
+};
+
+
+//------------------------------------------------------------------------------
+// Transform Encoder
+
+/// Largest transform used by TransformEncoder, which limits N and M
+static const unsigned kTransformCodeMaxLog2 = 16;
+
+/**
+    fp61::GetTransformCodeSize(N)
+
+    Returns the transform size n used by TransformEncoder for N originals:
+    The smallest power of two that is at least N.  Up to n recovery packets
+    can be produced, with recovery indices 0..n-1.
+
+    Returns 0 if N is 0 or more than 2^kTransformCodeMaxLog2.
+*/
+unsigned GetTransformCodeSize(unsigned N);
+
+/// Get the maximum number of bytes needed for a TransformEncoder recovery
+/// packet for original packets of the given size.  This can be one word
+/// more than GetRecoveryBytes() since the words are produced in pairs
+FP61_FORCE_INLINE unsigned GetTransformRecoveryBytes(unsigned originalBytes)
+{
+    const unsigned maxWords = ByteReader::MaxWords(originalBytes);
+    return WordWriter::BytesNeeded(maxWords + (maxWords & 1));
+}
+
+/**
+    fp61::GetTransformCoefficient(N, recoveryIndex, column)
+
+    Returns the Fp^2 generator matrix coefficient of the transform code for
+    a recovery packet and an original column, with both parts in Fp:
+
+        L_i(z_r) = (-2/n) / (w2^(2r - 2i + 1) - 1)
+
+    where n = GetTransformCodeSize(N) and w2 is a primitive 2n-th root of
+    unity.  These are the Lagrange basis polynomials for the n-th roots of
+    unity, evaluated at the odd powers z_r = w2^(2r + 1) of w2.
+
+    This is a Cauchy matrix up to row and column scaling, so every square
+    submatrix of it is invertible, which makes the code MDS over Fp^2.
+*/
+Fp2 GetTransformCoefficient(unsigned N, unsigned recoveryIndex, unsigned column);
+
+/**
+    TransformEncoder
+
+    Produces recovery packets for N originals with a systematic Reed-Solomon
+    code over Fp^2, using fp61::Fp2TransformPlan instead of a matrix-vector
+    product.
+
+    Each pair of words (2q, 2q + 1) read from original i is treated as one
+    Fp^2 element d_i.  The originals are the values at the n-th roots of
+    unity w^i of the polynomial f of degree less than n with f(w^i) = d_i,
+    where d_i = 0 for i >= N.  Recovery packet r holds f(z_r) at the points
+    z_r = w2^(2r + 1) of GetTransformCoefficient(), so each pair of its
+    words is sum(GetTransformCoefficient(N, r, i) * d_i).
+
+    Since the z_r are the coset w2 * w^r of the roots of unity, f at all of
+    them is found by one inverse transform to get the coefficients of f,
+    one pointwise product by the powers of w2, and one forward transform:
+    About n log n Fp^2 butterflies per pair of words for all M recovery
+    packets at once, rather than N * M multiply-adds per word.
+    So it is faster than Encoder::EncodeMultiple() when M is large.
+
+    fp61::Decoder does not decode this code, whose coefficients are in Fp^2
+    rather than Fp.  GetTransformCoefficient() gives the generator matrix
+    for solving for lost originals.
+
+    Call Encode() to produce the recovery packets with recovery indices
+    firstRecoveryIndex .. firstRecoveryIndex + M - 1, which must be less
+    than GetTransformCodeSize(N).  Each recovery buffer must have room for
+    GetTransformRecoveryBytes(bytes) bytes, and all of the packets are the
+    same size.  Returns the number of bytes written to each recovery buffer,
+    or 0 if M is 0 or the parameters are out of range.
+
+    The TransformEncoder keeps its working memory and the transform tables
+    between calls, so reuse the same object to avoid recomputing them.
+*/
+struct TransformEncoder
+{
+    Fp2TransformPlan Plan;
+    std::vector<unsigned> BitReversal;
+
+    /// w2^k / n for k = 0..n-1, in bit-reversed order
+    std::vector<Fp2> Shift;
+
+    std::vector<ByteReader> Readers;
+    std::vector<WordWriter> Writers;
+    std::vector<uint64_t> Words;
+    std::vector<uint64_t> Outputs;
+    std::vector<Fp2> Data;
+    bool Initialized = false;
+
+
+    unsigned Encode(
+        const uint8_t* const* originals,
+        unsigned N,
+        unsigned bytes,
+        unsigned firstRecoveryIndex,
+        unsigned M,
+        uint8_t* const* recovery);
+
+    /// Prepare the transform tables for a transform of size 2^log2n
+    void Initialize(unsigned log2n);
+};
+
+
+//------------------------------------------------------------------------------
+// Decoder
+
+/// Recovery packet description provided to the Decoder
+struct RecoveryPacket
+{
+    /// Recovery index passed to Encoder::Encode()
+    unsigned Index;
+
+    /// Recovery packet data and the number of bytes returned by Encode()
+    const uint8_t* Data;
+    unsigned Bytes;
+};
+
+/**
+    Decoder
+
+    Recovers lost original packets from the received originals and
+    at least as many recovery packets as there are losses.
+
+    Call Decode() with the array of N original packet pointers, where the
+    lost packets are set to nullptr.  For each lost packet i, the data is
+    written to recovered[i], which must have room for `bytes` bytes.
+    Entries of `recovered` for received originals are not used.
+
+    If more recovery packets are provided than needed, the decoder picks
+    an independent subset of them.
+
+    The Decoder keeps its working memory between calls,
+    so reuse the same object to avoid reallocating.
+*/
+struct Decoder
+{
+    std::vector<unsigned> Lost;
+    std::vector<unsigned> Rows;
+    std::vector<uint64_t> RowSeeds;
+    std::vector<uint64_t> Matrix;
+    std::vector<uint64_t> Solution;
+    std::vector<ByteReader> Readers;
+    std::vector<WordReader> RecoveryReaders;
+    std::vector<ByteWriter> Writers;
+    std::vector<uint64_t> Sums;
+    std::vector<uint64_t> Outputs;
+    std::vector<uint64_t> Words;
+    std::vector<uint8_t> Staging;
+    std::vector<unsigned> Offsets;
+
+
+    CodecResult Decode(
+        const uint8_t* const* originals,
+        unsigned N,
+        unsigned bytes,
+        uint64_t seed,
+        const RecoveryPacket* recovery,
+        unsigned recoveryCount,
+        uint8_t* const* recovered);
+
+    /// Solve for the lost columns by inverting the coefficient matrix of the
+    /// first recovery packets with fp61::InvertMatrix(), or if that is
+    /// singular, by selecting rows from all of the packets with EliminateRows().
+    /// On success, Rows holds the selected recovery packets and Solution
+    /// holds the inverse of their coefficient matrix.
+    /// Returns false if not enough of the rows are independent.
+    bool Solve(uint64_t seed, const RecoveryPacket* recovery, unsigned recoveryCount);
+};
+
+
+} // namespace fp61
+
+
+#endif // CAT_FP61_CODEC_H
@@ -0,0 +1,513 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "fp61_file.h"
+
+#include <memory>
+
+#ifdef _WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+# include <xmmintrin.h>
+# define FP61_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+# define FP61_PREFETCH(p) __builtin_prefetch(p)
+#endif
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// MappedFile
+
+#ifdef _WIN32
+
+bool MappedFile::OpenRead(const char* path)
+{
+    Close();
+
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    File = file;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size)) {
+        Close();
+        return false;
+    }
+    Size = (uint64_t)size.QuadPart;
+    if (Size == 0) {
+        return true;
+    }
+
+    Mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!Mapping) {
+        Close();
+        return false;
+    }
+    Data = (uint8_t*)::MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!Data) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::Create(const char* path, uint64_t bytes)
+{
+    Close();
+
+    HANDLE file = ::CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    File = file;
+    Writable = true;
+    Size = bytes;
+    if (Size == 0) {
+        return true;
+    }
+
+    // Creating the mapping extends the file to the mapped size
+    Mapping = ::CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        (DWORD)(bytes >> 32), (DWORD)bytes, nullptr);
+    if (!Mapping) {
+        Close();
+        return false;
+    }
+    Data = (uint8_t*)::MapViewOfFile(Mapping, FILE_MAP_WRITE, 0, 0, 0);
+    if (!Data) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::Close(uint64_t finalBytes)
+{
+    bool success = true;
+    if (Data) {
+        ::UnmapViewOfFile(Data);
+    }
+    if (Mapping) {
+        ::CloseHandle(Mapping);
+    }
+    if (File)
+    {
+        if (Writable && finalBytes < Size)
+        {
+            LARGE_INTEGER position;
+            position.QuadPart = (LONGLONG)finalBytes;
+            success = ::SetFilePointerEx(File, position, nullptr, FILE_BEGIN) &&
+                ::SetEndOfFile(File);
+        }
+        ::CloseHandle(File);
+    }
+    Data = nullptr;
+    Mapping = nullptr;
+    File = nullptr;
+    Size = 0;
+    Writable = false;
+    return success;
+}
+
+// FILE_FLAG_SEQUENTIAL_SCAN already tunes the read-ahead for the file
+void MappedFile::AdviseSequential()
+{
+}
+
+void MappedFile::AdviseWillNeed(uint64_t /*offset*/, uint64_t /*bytes*/)
+{
+}
+
+void MappedFile::AdviseDone(uint64_t /*offset*/, uint64_t /*bytes*/)
+{
+}
+
+#else // _WIN32
+
+bool MappedFile::OpenRead(const char* path)
+{
+    Close();
+
+    File = ::open(path, O_RDONLY);
+    if (File < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(File, &info) != 0) {
+        Close();
+        return false;
+    }
+    Size = (uint64_t)info.st_size;
+    if (Size == 0) {
+        return true;
+    }
+
+    void* data = ::mmap(nullptr, (size_t)Size, PROT_READ, MAP_SHARED, File, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    Data = (uint8_t*)data;
+    return true;
+}
+
+bool MappedFile::Create(const char* path, uint64_t bytes)
+{
+    Close();
+
+    File = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (File < 0) {
+        return false;
+    }
+    Writable = true;
+
+    if (::ftruncate(File, (off_t)bytes) != 0) {
+        Close();
+        return false;
+    }
+    Size = bytes;
+    if (Size == 0) {
+        return true;
+    }
+
+    void* data = ::mmap(nullptr, (size_t)Size, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    Data = (uint8_t*)data;
+    return true;
+}
+
+bool MappedFile::Close(uint64_t finalBytes)
+{
+    bool success = true;
+    if (Data) {
+        ::munmap(Data, (size_t)Size);
+    }
+    if (File >= 0)
+    {
+        if (Writable && finalBytes < Size) {
+            success = ::ftruncate(File, (off_t)finalBytes) == 0;
+        }
+        ::close(File);
+    }
+    Data = nullptr;
+    File = -1;
+    Size = 0;
+    Writable = false;
+    return success;
+}
+
+// Returns the range rounded out to whole pages, clipped to the mapping
+static bool GetPageRange(
+    uint64_t size,
+    uint64_t offset,
+    uint64_t bytes,
+    uint64_t& start,
+    uint64_t& length)
+{
+    static const uint64_t pageBytes = (uint64_t)::sysconf(_SC_PAGESIZE);
+
+    if (offset >= size) {
+        return false;
+    }
+    if (bytes > size - offset) {
+        bytes = size - offset;
+    }
+    start = offset - offset % pageBytes;
+    length = offset + bytes - start;
+    return length > 0;
+}
+
+void MappedFile::AdviseSequential()
+{
+    if (Data) {
+        ::madvise(Data, (size_t)Size, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::AdviseWillNeed(uint64_t offset, uint64_t bytes)
+{
+    uint64_t start, length;
+    if (Data && GetPageRange(Size, offset, bytes, start, length)) {
+        ::madvise(Data + start, (size_t)length, MADV_WILLNEED);
+    }
+}
+
+void MappedFile::AdviseDone(uint64_t offset, uint64_t bytes)
+{
+    // Dropping pages from a writable mapping could lose data
+    uint64_t start, length;
+    if (Data && !Writable && GetPageRange(Size, offset, bytes, start, length)) {
+        ::madvise(Data + start, (size_t)length, MADV_DONTNEED);
+    }
+}
+
+#endif // _WIN32
+
+
+//------------------------------------------------------------------------------
+// FileEncoder
+
+/// Encode N mapped inputs of the given sizes into the M recovery files.
+/// inputFiles[i] is the mapping that contains originals[i]
+static FileResult EncodeMapped(
+    Encoder& encoder,
+    MappedFile* const* inputFiles,
+    const uint8_t* const* originals,
+    const unsigned* bytes,
+    unsigned N,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    const char* const* recoveryPaths,
+    unsigned* recoveryBytes)
+{
+    unsigned maxBytes = 0;
+    for (unsigned i = 0; i < N; ++i)
+    {
+        if (maxBytes < bytes[i]) {
+            maxBytes = bytes[i];
+        }
+    }
+
+    const unsigned outputBytes = GetRecoveryBytes(maxBytes);
+    std::unique_ptr<MappedFile[]> outputs(new MappedFile[M]);
+    for (unsigned r = 0; r < M; ++r)
+    {
+        if (!outputs[r].Create(recoveryPaths[r], outputBytes)) {
+            return FileResult::IoError;
+        }
+    }
+
+    // Advise the first window of each input so its reads start right away
+    std::vector<uint64_t> nextWindow(N), doneOffset(N);
+    for (unsigned i = 0; i < N; ++i)
+    {
+        const uint64_t offset = originals[i] - inputFiles[i]->GetData();
+        inputFiles[i]->AdviseWillNeed(offset, kFileWindowBytes);
+        nextWindow[i] = offset + kFileWindowBytes;
+        doneOffset[i] = offset;
+    }
+
+    encoder.Readers.resize(N);
+    for (unsigned i = 0; i < N; ++i) {
+        encoder.Readers[i].BeginRead(originals[i], bytes[i]);
+    }
+    encoder.Writers.resize(M);
+    for (unsigned r = 0; r < M; ++r) {
+        encoder.Writers[r].BeginWrite(outputs[r].GetData());
+    }
+
+    const uint64_t* coefficients = encoder.Coefficients.Get(seed, firstRecoveryIndex, N, M);
+
+    // Each chunk reads at most this many bytes from each input
+    const unsigned chunkWords = GetCodecChunkWords(M);
+    const unsigned chunkBytes = chunkWords * 8;
+
+    for (;;)
+    {
+        for (unsigned i = 0; i < N; ++i)
+        {
+            const ByteReader& reader = encoder.Readers[i];
+            MappedFile* file = inputFiles[i];
+            const uint64_t offset = reader.Data - file->GetData();
+
+            // Keep the OS one window ahead, and release the pages that
+            // were read in the window before the last one
+            if (offset + kFileWindowBytes >= nextWindow[i])
+            {
+                file->AdviseWillNeed(nextWindow[i], kFileWindowBytes);
+                nextWindow[i] += kFileWindowBytes;
+
+                if (offset > doneOffset[i] + kFileWindowBytes)
+                {
+                    const uint64_t doneBytes = offset - kFileWindowBytes - doneOffset[i];
+                    file->AdviseDone(doneOffset[i], doneBytes);
+                    doneOffset[i] += doneBytes;
+                }
+            }
+
+            // Prefetch the start of the next chunk, which the hardware
+            // prefetcher would otherwise only pick up after a few misses
+            if (reader.Bytes > chunkBytes)
+            {
+                unsigned prefetchBytes = reader.Bytes - chunkBytes;
+                if (prefetchBytes > kFilePrefetchBytes) {
+                    prefetchBytes = kFilePrefetchBytes;
+                }
+                const uint8_t* next = reader.Data + chunkBytes;
+                for (unsigned j = 0; j < prefetchBytes; j += 64) {
+                    FP61_PREFETCH(next + j);
+                }
+            }
+        }
+
+        const unsigned count = encoder.EncodeWords(coefficients, N, M, chunkWords);
+        if (count < chunkWords) {
+            break;
+        }
+    }
+
+    FileResult result = FileResult::Success;
+    unsigned finalBytes = 0;
+    for (unsigned r = 0; r < M; ++r)
+    {
+        finalBytes = encoder.Writers[r].Flush();
+        if (!outputs[r].Close(finalBytes)) {
+            result = FileResult::IoError;
+        }
+    }
+    FP61_STATS(encoder.Stats.Flushes += M;)
+    if (recoveryBytes) {
+        *recoveryBytes = finalBytes;
+    }
+    return result;
+}
+
+FileResult FileEncoder::EncodeFiles(
+    const char* const* originalPaths,
+    unsigned N,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    const char* const* recoveryPaths,
+    unsigned* recoveryBytes)
+{
+    if (N == 0 || M == 0) {
+        return FileResult::InvalidInput;
+    }
+
+    std::unique_ptr<MappedFile[]> inputs(new MappedFile[N]);
+    std::vector<MappedFile*> inputFiles(N);
+    std::vector<const uint8_t*> originals(N);
+    std::vector<unsigned> bytes(N);
+
+    for (unsigned i = 0; i < N; ++i)
+    {
+        MappedFile& file = inputs[i];
+        if (!file.OpenRead(originalPaths[i])) {
+            return FileResult::IoError;
+        }
+        if (file.GetSize() > kFileMaxShardBytes) {
+            return FileResult::InvalidInput;
+        }
+        file.AdviseSequential();
+
+        inputFiles[i] = &file;
+        originals[i] = file.GetData();
+        bytes[i] = (unsigned)file.GetSize();
+    }
+
+    return EncodeMapped(
+        Coder,
+        &inputFiles[0],
+        &originals[0],
+        &bytes[0],
+        N,
+        seed,
+        firstRecoveryIndex,
+        M,
+        recoveryPaths,
+        recoveryBytes);
+}
+
+FileResult FileEncoder::EncodeStripes(
+    const char* originalPath,
+    unsigned N,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    const char* const* recoveryPaths,
+    unsigned* recoveryBytes)
+{
+    if (N == 0 || M == 0) {
+        return FileResult::InvalidInput;
+    }
+
+    MappedFile file;
+    if (!file.OpenRead(originalPath)) {
+        return FileResult::IoError;
+    }
+
+    const uint64_t fileBytes = file.GetSize();
+    const uint64_t stripeBytes = GetStripeBytes(fileBytes, N);
+    if (stripeBytes > kFileMaxShardBytes) {
+        return FileResult::InvalidInput;
+    }
+    file.AdviseSequential();
+
+    // The last stripes can be short or empty, which the encoder treats
+    // the same as zero padding
+    std::vector<MappedFile*> inputFiles(N, &file);
+    std::vector<const uint8_t*> originals(N);
+    std::vector<unsigned> bytes(N);
+    for (unsigned i = 0; i < N; ++i)
+    {
+        const uint64_t start = i * stripeBytes;
+        uint64_t stripeEnd = start + stripeBytes;
+        if (stripeEnd > fileBytes) {
+            stripeEnd = fileBytes;
+        }
+        originals[i] = file.GetData() + (start < fileBytes ? start : fileBytes);
+        bytes[i] = start < fileBytes ? (unsigned)(stripeEnd - start) : 0;
+    }
+
+    return EncodeMapped(
+        Coder,
+        &inputFiles[0],
+        &originals[0],
+        &bytes[0],
+        N,
+        seed,
+        firstRecoveryIndex,
+        M,
+        recoveryPaths,
+        recoveryBytes);
+}
+
+
+} // namespace fp61
@@ -0,0 +1,216 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_FP61_FILE_H
+#define CAT_FP61_FILE_H
+
+#include "fp61_codec.h"
+
+/** \file
+    Fp61 File Encoder
+
+    Produces recovery files for large on-disk data without first reading
+    the originals into heap buffers.  The originals are memory-mapped
+    read-only and the encoder's ByteReaders run straight over the mapped
+    pages, and the recovery files are mapped writable so the WordWriters
+    write into the page cache.  This avoids a copy of all of the data and
+    keeps the resident set small for large files.
+
+    The originals can be N separate shard files (EncodeFiles), or N equal
+    stripes of a single file (EncodeStripes).  The recovery files are the
+    same as the packets produced by Encoder::EncodeMultiple() for the
+    original data, so fp61::Decoder works unmodified.
+
+    The mappings are advised as sequential.  While encoding, each input is
+    also advised as needed one window ahead of its reader, the pages behind
+    the reader are released from the mapping, and the start of the next
+    chunk of each input is prefetched into cache before the current chunk
+    is accumulated.
+*/
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Parameters
+
+/// Largest original shard in bytes.  Keeps the word and byte counts of a
+/// shard and its recovery data in 32 bits
+static const unsigned kFileMaxShardBytes = (1u << 29) - 64;
+
+/// Bytes of each input prefetched ahead of its reader for the next chunk
+static const unsigned kFilePrefetchBytes = 2048;
+
+/// Bytes of each input advised to the OS at a time ahead of its reader
+static const unsigned kFileWindowBytes = 4 * 1024 * 1024;
+
+/// Result of a file operation
+enum class FileResult
+{
+    Success,        ///< All recovery files were written
+    InvalidInput,   ///< Parameters are out of range or the shards are too large
+    IoError         ///< A file could not be opened, mapped, or resized
+};
+
+
+//------------------------------------------------------------------------------
+// MappedFile
+
+/**
+    MappedFile
+
+    A whole file mapped into memory.
+
+    Call OpenRead() to map an existing file read-only, or Create() to
+    create (or truncate) a file of the given size and map it writable.
+    Empty files are not mapped, and GetData() returns nullptr for them.
+
+    Call Close() to unmap and close the file.  A writable file can be
+    truncated to its final size on close.  The destructor calls Close().
+
+    The data is not flushed to disk; the OS writes back the dirty pages.
+*/
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    /// Map an existing file read-only.  Returns false on failure
+    bool OpenRead(const char* path);
+
+    /// Create a file of `bytes` bytes and map it writable.
+    /// Returns false on failure
+    bool Create(const char* path, uint64_t bytes);
+
+    /// Unmap and close the file.  If the file is writable and finalBytes is
+    /// less than its size, it is truncated to finalBytes.
+    /// Returns false if the file could not be truncated
+    bool Close(uint64_t finalBytes = ~(uint64_t)0);
+
+    uint8_t* GetData() const
+    {
+        return Data;
+    }
+    uint64_t GetSize() const
+    {
+        return Size;
+    }
+
+    /// Advise the OS that the mapping will be read sequentially
+    void AdviseSequential();
+
+    /// Advise the OS that a range of the mapping will be needed soon,
+    /// so it can start reading it in
+    void AdviseWillNeed(uint64_t offset, uint64_t bytes);
+
+    /// Release the pages of a range of a read-only mapping that will not
+    /// be read again.  The file is not changed
+    void AdviseDone(uint64_t offset, uint64_t bytes);
+
+private:
+    uint8_t* Data = nullptr;
+    uint64_t Size = 0;
+    bool Writable = false;
+
+#ifdef _WIN32
+    void* File = nullptr;
+    void* Mapping = nullptr;
+#else
+    int File = -1;
+#endif
+};
+
+
+//------------------------------------------------------------------------------
+// FileEncoder
+
+/**
+    FileEncoder
+
+    Produces M recovery files for recovery indices
+    firstRecoveryIndex .. firstRecoveryIndex + M - 1.
+
+    Call EncodeFiles() to protect N shard files.  Shards of different sizes
+    are encoded as if the shorter ones were padded with zeros up to the
+    size of the longest, which is the `bytes` a decoder should use.
+
+    Call EncodeStripes() to protect one file split into N stripes of
+    GetStripeBytes(fileBytes, N) bytes each.  The last stripes are padded
+    with zeros as needed.
+
+    Each recovery file is written with GetRecoveryBytes(bytes) bytes and
+    then truncated to the encoded size, which is written to recoveryBytes
+    if it is not nullptr.  Existing recovery files are overwritten.
+
+    Each shard or stripe can be at most kFileMaxShardBytes bytes.
+
+    The FileEncoder keeps its working memory between calls,
+    so reuse the same object to avoid reallocating.
+*/
+struct FileEncoder
+{
+    Encoder Coder;
+
+
+    /// Get the bytes per stripe when splitting a file into N stripes
+    static FP61_FORCE_INLINE uint64_t GetStripeBytes(uint64_t fileBytes, unsigned N)
+    {
+        return N == 0 ? 0 : (fileBytes + N - 1) / N;
+    }
+
+    FileResult EncodeFiles(
+        const char* const* originalPaths,
+        unsigned N,
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        unsigned M,
+        const char* const* recoveryPaths,
+        unsigned* recoveryBytes = nullptr);
+
+    FileResult EncodeStripes(
+        const char* originalPath,
+        unsigned N,
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        unsigned M,
+        const char* const* recoveryPaths,
+        unsigned* recoveryBytes = nullptr);
+};
+
+
+} // namespace fp61
+
+
+#endif // CAT_FP61_FILE_H
@@ -0,0 +1,314 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "fp61_matrix.h"
+
+#include <string.h> // memcpy, memset
+#include <vector>
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Matrix Products
+
+// Rows of C in each tile of the micro-kernel
+static const unsigned kMatMulTileRows = kFixedMaxM;
+
+/// Returns the inner dimension of the next block of products: The largest
+/// fixed geometry N that fits in the remaining rows of B, or 4 with zero
+/// padding when fewer than 4 rows are left
+static unsigned GetMatMulBlockSize(unsigned remaining)
+{
+    static const unsigned kSizes[] = { 32, 16, 10, 8 };
+    for (unsigned size : kSizes)
+    {
+        if (remaining >= size) {
+            return size;
+        }
+    }
+    return 4;
+}
+
+void MatMul(
+    const uint64_t* A,
+    const uint64_t* B,
+    uint64_t* C,
+    unsigned m,
+    unsigned n,
+    unsigned k)
+{
+    if (m == 0 || n == 0) {
+        return;
+    }
+    if (k == 0)
+    {
+        memset(C, 0, (size_t)m * n * sizeof(uint64_t));
+        return;
+    }
+
+    /*
+        The inner dimension is split into blocks of up to 32 products, and
+        the rows of A and C into tiles of 4 rows.  For each block, the
+        kernel computes a tile of 4 rows of C across a panel of columns
+        with the sums held in registers, so the loads of each row of B are
+        shared by 4 rows of A.
+
+        A is packed so that the coefficients for each tile and block are a
+        contiguous 4 x N matrix, zero padded past the last row and column.
+        The kernel reads each panel of B in place, since its rows are
+        already contiguous, and reuses it from cache for every tile of rows.
+        Only the last block, when it is shorter than its kernel, is packed
+        into a buffer with zero rows after the end of B.
+
+        The kernels return fully reduced sums, so each block after the first
+        is added to C with a single Finalize() per word, rather than one
+        reduction per product.
+    */
+    const unsigned tiles = (m + kMatMulTileRows - 1) / kMatMulTileRows;
+    const unsigned lastTileRows = m - (tiles - 1) * kMatMulTileRows;
+
+    std::vector<unsigned> blockSizes;
+    size_t packedWords = 0;
+    unsigned paddedK = 0;
+    while (paddedK < k)
+    {
+        const unsigned N = GetMatMulBlockSize(k - paddedK);
+        blockSizes.push_back(N);
+        packedWords += (size_t)tiles * kMatMulTileRows * N;
+        paddedK += N;
+    }
+
+    std::vector<uint64_t> packedA(packedWords, 0);
+    size_t offset = 0;
+    unsigned k0 = 0;
+    for (unsigned N : blockSizes)
+    {
+        const unsigned blockRows = (k - k0 < N) ? k - k0 : N;
+
+        for (unsigned t = 0; t < tiles; ++t)
+        {
+            const unsigned tileRows = (t + 1 < tiles) ? kMatMulTileRows : lastTileRows;
+
+            for (unsigned r = 0; r < tileRows; ++r)
+            {
+                const uint64_t* row = A + (size_t)(t * kMatMulTileRows + r) * k + k0;
+                memcpy(&packedA[offset + r * N], row, blockRows * sizeof(uint64_t));
+            }
+            offset += kMatMulTileRows * N;
+        }
+        k0 += N;
+    }
+
+    const unsigned maxWidth = (n < kMatMulPanelColumns) ? n : kMatMulPanelColumns;
+
+    std::vector<uint64_t> padded, sums;
+    if (paddedK > k) {
+        padded.resize(blockSizes.back() * maxWidth);
+    }
+    if (blockSizes.size() > 1) {
+        sums.resize(kMatMulTileRows * maxWidth);
+    }
+
+    for (unsigned j0 = 0; j0 < n; j0 += kMatMulPanelColumns)
+    {
+        const unsigned width = (n - j0 < kMatMulPanelColumns) ? n - j0 : kMatMulPanelColumns;
+
+        offset = 0;
+        k0 = 0;
+        for (size_t b = 0; b < blockSizes.size(); ++b)
+        {
+            const unsigned N = blockSizes[b];
+            const unsigned blockRows = (k - k0 < N) ? k - k0 : N;
+
+            const uint64_t* panel = B + (size_t)k0 * n + j0;
+            unsigned panelStride = n;
+
+            // Pack a short last block, with zero rows past the end of B
+            if (blockRows < N)
+            {
+                for (unsigned i = 0; i < blockRows; ++i) {
+                    memcpy(&padded[i * width], panel + (size_t)i * n, width * sizeof(uint64_t));
+                }
+                memset(&padded[blockRows * width], 0, (N - blockRows) * width * sizeof(uint64_t));
+                panel = &padded[0];
+                panelStride = width;
+            }
+
+            const FixedMulAddKernel fullKernel = GetFixedMulAddKernel(N, kMatMulTileRows);
+            const FixedMulAddKernel lastKernel = GetFixedMulAddKernel(N, lastTileRows);
+
+            for (unsigned t = 0; t < tiles; ++t)
+            {
+                const bool last = (t + 1 == tiles);
+                const FixedMulAddKernel kernel = last ? lastKernel : fullKernel;
+                const unsigned tileRows = last ? lastTileRows : kMatMulTileRows;
+                const uint64_t* coeffs = &packedA[offset + t * kMatMulTileRows * N];
+                uint64_t* tileC = C + (size_t)t * kMatMulTileRows * n + j0;
+
+                if (b == 0)
+                {
+                    kernel(panel, panelStride, coeffs, tileC, n, width);
+                    continue;
+                }
+
+                kernel(panel, panelStride, coeffs, &sums[0], width, width);
+
+                for (unsigned r = 0; r < tileRows; ++r)
+                {
+                    uint64_t* row = tileC + (size_t)r * n;
+                    const uint64_t* sum = &sums[r * width];
+                    for (unsigned j = 0; j < width; ++j) {
+                        row[j] = Finalize(row[j] + sum[j]);
+                    }
+                }
+            }
+
+            offset += (size_t)tiles * kMatMulTileRows * N;
+            k0 += N;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Linear Systems
+
+/*
+    The entries of both halves are kept below 2^62 as required by
+    MulAddMem(), rather than being finalized after every update.  Only the
+    words of the pivot column must be exact, to check for zero and to form
+    the row factors, so those are finalized one at a time as they are read.
+    Columns of A left of the pivot are never read again and are not updated.
+*/
+bool EliminateRows(
+    uint64_t* A,
+    uint64_t* B,
+    unsigned rows,
+    unsigned n,
+    unsigned count,
+    unsigned* order)
+{
+    for (unsigned col = 0; col < n; ++col)
+    {
+        // Find a pivot row with a nonzero entry in this column
+        unsigned pivot = col;
+        uint64_t pivotValue = 0;
+        for (; pivot < rows; ++pivot)
+        {
+            pivotValue = Finalize(A[(size_t)pivot * n + col]);
+            if (pivotValue != 0) {
+                break;
+            }
+        }
+        if (pivot >= rows) {
+            return false;
+        }
+
+        uint64_t* pivotRow = A + (size_t)col * n;
+        uint64_t* pivotB = B + (size_t)col * count;
+
+        if (pivot != col)
+        {
+            uint64_t* other = A + (size_t)pivot * n;
+            for (unsigned c = col; c < n; ++c)
+            {
+                const uint64_t t = pivotRow[c];
+                pivotRow[c] = other[c];
+                other[c] = t;
+            }
+
+            uint64_t* otherB = B + (size_t)pivot * count;
+            for (unsigned c = 0; c < count; ++c)
+            {
+                const uint64_t t = pivotB[c];
+                pivotB[c] = otherB[c];
+                otherB[c] = t;
+            }
+
+            if (order)
+            {
+                const unsigned t = order[col];
+                order[col] = order[pivot];
+                order[pivot] = t;
+            }
+        }
+
+        // Scale the pivot row so the pivot is 1
+        const uint64_t inv = Inverse(pivotValue);
+        for (unsigned c = col + 1; c < n; ++c) {
+            pivotRow[c] = Multiply(pivotRow[c], inv);
+        }
+        for (unsigned c = 0; c < count; ++c) {
+            pivotB[c] = Multiply(pivotB[c], inv);
+        }
+
+        // Eliminate this column from all other rows
+        for (unsigned r = 0; r < rows; ++r)
+        {
+            if (r == col) {
+                continue;
+            }
+
+            uint64_t* row = A + (size_t)r * n;
+            const uint64_t value = Finalize(row[col]);
+            if (value == 0) {
+                continue;
+            }
+
+            const uint64_t factor = Negate(value);
+            MulAddMem(row + col + 1, pivotRow + col + 1, factor, n - col - 1);
+            MulAddMem(B + (size_t)r * count, pivotB, factor, count);
+        }
+    }
+
+    const size_t words = (size_t)n * count;
+    for (size_t i = 0; i < words; ++i) {
+        B[i] = Finalize(B[i]);
+    }
+
+    return true;
+}
+
+bool InvertMatrix(uint64_t* A, uint64_t* inverse, unsigned n)
+{
+    memset(inverse, 0, (size_t)n * n * sizeof(uint64_t));
+    for (unsigned i = 0; i < n; ++i) {
+        inverse[(size_t)i * n + i] = 1;
+    }
+
+    return EliminateRows(A, inverse, n, n, n, nullptr);
+}
+
+bool SolveLinear(uint64_t* A, uint64_t* B, unsigned n, unsigned count)
+{
+    return EliminateRows(A, B, n, n, count, nullptr);
+}
+
+
+} // namespace fp61
@@ -0,0 +1,145 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAT_FP61_MATRIX_H
+#define CAT_FP61_MATRIX_H
+
+#include "fp61.h"
+
+/** \file
+    Fp61 Matrices
+
+    Dense matrices over Fp, stored row-major as arrays of words.
+    All inputs must be in Fp (less than p), for example from
+    fp61::Finalize(), and all outputs are fully reduced.
+
+    Matrix products are built like a BLAS micro-kernel: The fixed geometry
+    kernels from fp61::GetFixedMulAddKernel() hold a tile of up to 4 rows
+    of C in vector registers (or 128-bit sums for the scalar kernels) while
+    they run across a block of up to 32 of the inner products, and the
+    blocks of A and B are packed so that each panel of B is reused from
+    cache by every tile of rows.
+
+    Inversion and linear solves use Gauss-Jordan elimination with
+    fp61::MulAddMem() for the row updates.  The rows are only partially
+    reduced between steps: Each update costs one Multiply() and one
+    PartialReduce() per word, and only the entries of the pivot column are
+    finalized as they are needed to pick a pivot and its row factors.
+*/
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Matrix Products
+
+/// Columns of B packed into one panel by MatMul(), so that a block of 32
+/// rows of the panel (64 KB) stays in the L2 cache for all the rows of A
+static const unsigned kMatMulPanelColumns = 256;
+
+/**
+    fp61::MatMul(A, B, C, m, n, k)
+
+    C = A * B, where A is m x k, B is k x n, and C is m x n.
+
+    C must not overlap A or B.  Does nothing if m or n is 0, and sets C to
+    zero if k is 0.
+*/
+void MatMul(
+    const uint64_t* A,
+    const uint64_t* B,
+    uint64_t* C,
+    unsigned m,
+    unsigned n,
+    unsigned k);
+
+
+//------------------------------------------------------------------------------
+// Linear Systems
+
+/**
+    fp61::InvertMatrix(A, inverse, n)
+
+    inverse = A^-1 for an n x n matrix A.
+
+    A is used as working memory, so its contents are overwritten.
+    The inverse must not overlap A.
+
+    Costs one fp61::Inverse() per row and about 2 * n^3 products.
+
+    Returns false as soon as elimination finds a column without a pivot,
+    meaning that A is singular.  The contents of A and the inverse are
+    undefined in that case.
+*/
+bool InvertMatrix(uint64_t* A, uint64_t* inverse, unsigned n);
+
+/**
+    fp61::SolveLinear(A, B, n, count)
+
+    Solve A * X = B for X, where A is n x n and B is n x count.
+    B is overwritten with X, and A is used as working memory.
+
+    This is cheaper than InvertMatrix() followed by MatMul() when
+    count is small compared to n.
+
+    Returns false if A is singular, in which case A and B are undefined.
+*/
+bool SolveLinear(uint64_t* A, uint64_t* B, unsigned n, unsigned count);
+
+/**
+    fp61::EliminateRows(A, B, rows, n, count, order)
+
+    Gauss-Jordan elimination on [ A | B ], where A is rows x n with
+    rows >= n, and B is rows x count.  Rows are swapped to find a pivot for
+    each column of A, so on success the first n rows of B hold the
+    solution for the first n rows after swapping, and are finalized.
+    A is used as working memory, and the remaining rows of B are left
+    partially reduced.
+
+    InvertMatrix() and SolveLinear() use it with rows = n.  With more rows
+    it selects n independent rows, for example from extra recovery packets.
+    If order is not nullptr it has one entry per row, and its entries are
+    swapped along with the rows so the caller can tell which rows were used.
+
+    Returns false if A has fewer than n independent rows, in which case
+    A, B and order are undefined.
+*/
+bool EliminateRows(
+    uint64_t* A,
+    uint64_t* B,
+    unsigned rows,
+    unsigned n,
+    unsigned count,
+    unsigned* order);
+
+
+} // namespace fp61
+
+
+#endif // CAT_FP61_MATRIX_H
@@ -0,0 +1,263 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "fp61_parallel.h"
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// ThreadPool
+
+void ThreadPool::Start(unsigned threadCount)
+{
+    Stop();
+
+    if (threadCount == ~0u)
+    {
+        const unsigned hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = (hardwareThreads > 1) ? hardwareThreads - 1 : 0;
+    }
+
+    Terminated = false;
+
+    // Select the kernels before the workers can race to do it
+    GetKernelInfo();
+
+    // The thread calling Run() is worker 0
+    Threads.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        Threads.emplace_back(&ThreadPool::WorkerLoop, this, i + 1);
+    }
+}
+
+void ThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> locker(Lock);
+        Terminated = true;
+    }
+    StartCondition.notify_all();
+
+    for (std::thread& thread : Threads) {
+        thread.join();
+    }
+    Threads.clear();
+}
+
+void ThreadPool::Run(unsigned count, const LoopFunction& fn)
+{
+    if (count == 0) {
+        return;
+    }
+
+    if (Threads.empty())
+    {
+        for (unsigned i = 0; i < count; ++i) {
+            fn(i, 0);
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> locker(Lock);
+
+    Function = &fn;
+    Count = count;
+    NextIndex = 0;
+    Remaining = count;
+    ++Generation;
+
+    StartCondition.notify_all();
+
+    RunIndices(locker, 0);
+
+    DoneCondition.wait(locker, [this]() { return Remaining == 0; });
+
+    Function = nullptr;
+}
+
+void ThreadPool::WorkerLoop(unsigned worker)
+{
+    std::unique_lock<std::mutex> locker(Lock);
+    unsigned generation = Generation;
+
+    for (;;)
+    {
+        StartCondition.wait(locker, [this, generation]() {
+            return Terminated || Generation != generation;
+        });
+
+        if (Terminated) {
+            return;
+        }
+
+        generation = Generation;
+        RunIndices(locker, worker);
+    }
+}
+
+void ThreadPool::RunIndices(std::unique_lock<std::mutex>& locker, unsigned worker)
+{
+    while (NextIndex < Count)
+    {
+        const unsigned index = NextIndex++;
+        const LoopFunction& fn = *Function;
+
+        locker.unlock();
+        fn(index, worker);
+        locker.lock();
+
+        if (--Remaining == 0) {
+            DoneCondition.notify_all();
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// ParallelEncoder
+
+unsigned ParallelEncoder::EncodeMultiple(
+    ThreadPool& pool,
+    const uint8_t* const* originals,
+    unsigned N,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    unsigned M,
+    uint8_t* const* recovery)
+{
+    if (M == 0) {
+        return 0;
+    }
+
+    const unsigned workerCount = pool.GetWorkerCount();
+    const unsigned maxWords = ByteReader::MaxWords(bytes);
+
+    // Ranges must hold a multiple of 64 words to start on byte boundaries
+    unsigned rangeWords = (RangeWords + 63) & ~63u;
+
+    // Aim for a few ranges per worker so that uneven progress balances out
+    if (rangeWords == 0)
+    {
+        rangeWords = (maxWords + workerCount * 4 - 1) / (workerCount * 4);
+        rangeWords = (rangeWords + 63) & ~63u;
+        if (rangeWords < kParallelMinRangeWords) {
+            rangeWords = kParallelMinRangeWords;
+        }
+
+        if (workerCount <= 1 || maxWords < rangeWords * 2)
+        {
+            Workers.resize(1);
+            return Workers[0].EncodeMultiple(originals, N, bytes, seed, firstRecoveryIndex, M, recovery);
+        }
+    }
+
+    const unsigned rangeCount = (maxWords + rangeWords - 1) / rangeWords;
+
+    Workers.resize(workerCount);
+    Checkpoints.resize(N * rangeCount);
+    WordCounts.resize(N);
+
+    const uint64_t* coefficients = Coefficients.Get(seed, firstRecoveryIndex, N, M);
+
+    // Pre-scan: Save the ByteReader state at the start of each range
+    pool.Run(N, [&](unsigned i, unsigned /*worker*/)
+    {
+        ByteReader* checkpoints = &Checkpoints[i * rangeCount];
+
+        ByteReader reader;
+        reader.BeginRead(originals[i], bytes);
+
+        unsigned wordCount = 0;
+        for (unsigned g = 0; g < rangeCount; ++g)
+        {
+            checkpoints[g] = reader;
+            wordCount += reader.SkipWords(rangeWords);
+        }
+
+        WordCounts[i] = wordCount;
+    });
+
+    // The recovery packets have as many words as the longest original
+    unsigned totalWords = 0;
+    for (unsigned i = 0; i < N; ++i) {
+        if (totalWords < WordCounts[i]) {
+            totalWords = WordCounts[i];
+        }
+    }
+
+    const unsigned usedRanges = (totalWords + rangeWords - 1) / rangeWords;
+
+    // Each range of 64*k words is 61*8*k bytes, so ranges start on byte boundaries
+    const unsigned rangeBytes = rangeWords / 64 * 61 * 8;
+
+    pool.Run(usedRanges, [&](unsigned g, unsigned worker)
+    {
+        Encoder& encoder = Workers[worker];
+
+        encoder.Readers.resize(N);
+        for (unsigned i = 0; i < N; ++i) {
+            encoder.Readers[i] = Checkpoints[i * rangeCount + g];
+        }
+
+        encoder.Writers.resize(M);
+        for (unsigned r = 0; r < M; ++r) {
+            encoder.Writers[r].BeginWrite(recovery[r] + g * rangeBytes);
+        }
+
+        const unsigned start = g * rangeWords;
+        unsigned words = totalWords - start;
+        if (words > rangeWords) {
+            words = rangeWords;
+        }
+
+        encoder.EncodeWords(coefficients, N, M, words);
+
+        // Only the last range has a partial word to flush
+        for (unsigned r = 0; r < M; ++r) {
+            encoder.Writers[r].Flush();
+        }
+        FP61_STATS(encoder.Stats.Flushes += M;)
+    });
+
+    return WordWriter::BytesNeeded(totalWords);
+}
+
+EncoderStats ParallelEncoder::GetStats() const
+{
+    EncoderStats stats;
+    for (const Encoder& worker : Workers) {
+        stats.Add(worker.Stats);
+    }
+    return stats;
+}
+
+
+} // namespace fp61
@@ -0,0 +1,186 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAT_FP61_PARALLEL_H
+#define CAT_FP61_PARALLEL_H
+
+#include "fp61_codec.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** \file
+    Fp61 Parallel Encoder
+
+    The recovery packets are split into independent ranges of words that are
+    encoded on a reusable pool of worker threads.
+
+    The words of each recovery packet only depend on the words at the same
+    position in the originals, so any range of words can be encoded on its
+    own.  Ranges start on multiples of 64 words, which is 61 * 64 bits =
+    488 bytes, so each range of recovery bytes starts on a byte boundary
+    and can be written by a fresh WordWriter.
+
+    The difficulty is the input side: ByteReader inserts extra bits for
+    ambiguous words, so the byte offset of word j in an original depends on
+    all the data before it.  A pre-scan pass over each original (run in
+    parallel across originals) saves the ByteReader state at the start of
+    each range.  The pre-scan uses ByteReader::SkipWords(), which only
+    unpacks the parts of the data that might contain ambiguous words.
+    Then the ranges are encoded in parallel starting from the saved states.
+
+    The output is the same as Encoder::EncodeMultiple(), so fp61::Decoder
+    works unmodified.
+*/
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// ThreadPool
+
+/**
+    ThreadPool
+
+    A fixed set of worker threads that run parallel loops.
+    The thread calling Run() also works on the loop.
+
+    Call Start() to create the worker threads.
+    Call Run() to call fn(index, worker) for index in [0, count).
+    Run() returns once all calls have completed.
+    Call Stop() to join the worker threads.  The destructor calls Stop().
+
+    `worker` is from 0 .. GetWorkerCount() - 1 and can be used to index
+    per-thread state.  Only one Run() may be in progress at a time.
+*/
+class ThreadPool
+{
+public:
+    typedef std::function<void(unsigned index, unsigned worker)> LoopFunction;
+
+    ~ThreadPool()
+    {
+        Stop();
+    }
+
+    /// Start the given number of worker threads in addition to the caller.
+    /// By default it starts one less than the number of hardware threads.
+    void Start(unsigned threadCount = ~0u);
+
+    /// Stop and join the worker threads
+    void Stop();
+
+    /// Returns the number of threads that work on Run() loops,
+    /// including the calling thread
+    unsigned GetWorkerCount() const
+    {
+        return static_cast<unsigned>(Threads.size()) + 1;
+    }
+
+    /// Run fn(index, worker) for each index in [0, count) and wait for it
+    void Run(unsigned count, const LoopFunction& fn);
+
+private:
+    std::vector<std::thread> Threads;
+
+    std::mutex Lock;
+    std::condition_variable StartCondition;
+    std::condition_variable DoneCondition;
+
+    // Protected by Lock
+    const LoopFunction* Function = nullptr;
+    unsigned Count = 0;
+    unsigned NextIndex = 0;
+    unsigned Remaining = 0;
+    unsigned Generation = 0;
+    bool Terminated = false;
+
+    void WorkerLoop(unsigned worker);
+
+    // Claim and run indices from the current loop until none are left
+    void RunIndices(std::unique_lock<std::mutex>& locker, unsigned worker);
+};
+
+
+//------------------------------------------------------------------------------
+// ParallelEncoder
+
+/// Smallest range of words assigned to one task by ParallelEncoder
+static const unsigned kParallelMinRangeWords = 2048;
+
+/**
+    ParallelEncoder
+
+    Produces the same recovery packets as Encoder::EncodeMultiple()
+    using the threads of a ThreadPool.
+
+    Packets that are too small to split into at least two ranges of
+    kParallelMinRangeWords words are encoded on the calling thread.
+
+    Set RangeWords to override the automatic range size, for example to test
+    with small packets.  It is rounded up to a multiple of 64 words, so that
+    each range starts on a byte boundary of the recovery packets.
+
+    The ParallelEncoder keeps its working memory between calls,
+    so reuse the same object to avoid reallocating.
+*/
+struct ParallelEncoder
+{
+    /// Words per range, or 0 to pick automatically
+    unsigned RangeWords = 0;
+
+    std::vector<Encoder> Workers;
+    std::vector<ByteReader> Checkpoints;
+    std::vector<unsigned> WordCounts;
+    CoefficientSet Coefficients;
+
+
+    /// Same parameters and result as Encoder::EncodeMultiple()
+    unsigned EncodeMultiple(
+        ThreadPool& pool,
+        const uint8_t* const* originals,
+        unsigned N,
+        unsigned bytes,
+        uint64_t seed,
+        unsigned firstRecoveryIndex,
+        unsigned M,
+        uint8_t* const* recovery);
+
+    /// Sum of the Stats of the Workers (see EncoderStats)
+    EncoderStats GetStats() const;
+};
+
+
+} // namespace fp61
+
+
+#endif // CAT_FP61_PARALLEL_H
@@ -0,0 +1,510 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "fp61_pipeline.h"
+
+#include <chrono>
+
+#if defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+# include <sys/eventfd.h>
+# include <unistd.h>
+#endif
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// JobQueue
+
+void JobQueue::Push(EncodeJob* job)
+{
+    job->Next.store(nullptr, std::memory_order_relaxed);
+    EncodeJob* prev = Head.exchange(job, std::memory_order_acq_rel);
+
+    // Until this store the consumer cannot see the job
+    prev->Next.store(job, std::memory_order_release);
+}
+
+EncodeJob* JobQueue::Pop()
+{
+    EncodeJob* tail = Tail;
+    EncodeJob* next = tail->Next.load(std::memory_order_acquire);
+
+    // Skip over the stub
+    if (tail == &Stub)
+    {
+        if (!next) {
+            return nullptr;
+        }
+        Tail = next;
+        tail = next;
+        next = next->Next.load(std::memory_order_acquire);
+    }
+
+    if (next)
+    {
+        Tail = next;
+        return tail;
+    }
+
+    // The tail is the last job unless a push is in progress
+    if (tail != Head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // Put the stub back behind the last job so it can be removed
+    Push(&Stub);
+
+    next = tail->Next.load(std::memory_order_acquire);
+    if (next)
+    {
+        Tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+
+//------------------------------------------------------------------------------
+// PipelineStageCounters
+
+static uint64_t GetPipelineNsec()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PipelineStageCounters::Add(uint64_t nsec)
+{
+    // Only one thread writes the counters, so they do not need RMW operations
+    Count.store(Count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    TotalNsec.store(TotalNsec.load(std::memory_order_relaxed) + nsec, std::memory_order_relaxed);
+    if (MaxNsec.load(std::memory_order_relaxed) < nsec) {
+        MaxNsec.store(nsec, std::memory_order_relaxed);
+    }
+}
+
+void PipelineStageCounters::AddTo(PipelineStageStats& stats) const
+{
+    stats.Count += Count.load(std::memory_order_relaxed);
+    stats.TotalNsec += TotalNsec.load(std::memory_order_relaxed);
+    const uint64_t maxNsec = MaxNsec.load(std::memory_order_relaxed);
+    if (stats.MaxNsec < maxNsec) {
+        stats.MaxNsec = maxNsec;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// PipelineWorker
+
+struct PipelineWorker
+{
+    EncodePipeline* Pipeline = nullptr;
+    std::thread Thread;
+
+    JobQueue Jobs;
+
+    /// Jobs submitted to this worker that it has not popped yet.
+    /// Incremented before the push, so it is never behind the queue
+    std::atomic<unsigned> Pending;
+
+    /// Set while the worker waits on Wake
+    std::atomic<bool> Sleeping;
+    std::atomic<bool> Terminated;
+    std::mutex Lock;
+    std::condition_variable Wake;
+
+    // Per-thread arena: Reused between jobs so steady state does not allocate
+    CoefficientSet Coefficients;
+    std::vector<uint8_t> Scratch;
+
+    PipelineStageCounters QueueWait;
+    PipelineStageCounters Encode;
+    PipelineStageCounters Completion;
+
+    PipelineWorker()
+    {
+        Pending.store(0, std::memory_order_relaxed);
+        Sleeping.store(false, std::memory_order_relaxed);
+        Terminated.store(false, std::memory_order_relaxed);
+    }
+
+    void Loop();
+    void Run(EncodeJob* job);
+};
+
+void PipelineWorker::Loop()
+{
+    for (;;)
+    {
+        EncodeJob* job = Jobs.Pop();
+        if (job)
+        {
+            Pending.fetch_sub(1);
+            Pipeline->QueueDepth.fetch_sub(1);
+            Run(job);
+            continue;
+        }
+
+        // A job is being pushed
+        if (Pending.load() > 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Only exit once the queue is empty
+        if (Terminated.load()) {
+            return;
+        }
+
+        // The submitter increments Pending before checking Sleeping, and the
+        // wait checks Pending after setting Sleeping, so no wakeup is lost
+        std::unique_lock<std::mutex> locker(Lock);
+        Sleeping.store(true);
+        Wake.wait(locker, [this]() {
+            return Pending.load() > 0 || Terminated.load();
+        });
+        Sleeping.store(false);
+    }
+}
+
+void PipelineWorker::Run(EncodeJob* job)
+{
+    const uint64_t start = GetPipelineNsec();
+    QueueWait.Add(start - job->SubmitNsec);
+
+    job->RecoveryBytes = 0;
+    if (job->M > 0)
+    {
+        const uint64_t* coefficients = Coefficients.Get(
+            job->Seed, job->FirstRecoveryIndex, job->N, job->M);
+
+        const unsigned scratchBytes = QueryScratchBytes(job->N, job->Bytes, job->M);
+        if (Scratch.size() < scratchBytes) {
+            Scratch.resize(scratchBytes);
+        }
+
+        job->RecoveryBytes = EncodeWithScratch(
+            job->Originals,
+            job->N,
+            job->Bytes,
+            job->Seed,
+            job->FirstRecoveryIndex,
+            job->M,
+            job->Recovery,
+            coefficients,
+            &Scratch[0],
+            scratchBytes);
+    }
+
+    const uint64_t done = GetPipelineNsec();
+    Encode.Add(done - start);
+    job->DoneNsec = done;
+
+    Pipeline->Complete(job, *this);
+}
+
+
+//------------------------------------------------------------------------------
+// EncodePipeline
+
+// Number of times WaitCompleted() yields before blocking
+static const unsigned kPipelineSpinCount = 64;
+
+EncodePipeline::EncodePipeline()
+{
+    Running.store(false, std::memory_order_relaxed);
+    Submitted.store(0, std::memory_order_relaxed);
+    QueueDepth.store(0, std::memory_order_relaxed);
+    MaxQueueDepth.store(0, std::memory_order_relaxed);
+    CompletedCount.store(0, std::memory_order_relaxed);
+    CompletedWaiting.store(false, std::memory_order_relaxed);
+
+#if defined(__linux__)
+    EventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+}
+
+EncodePipeline::~EncodePipeline()
+{
+    Stop();
+
+#if defined(__linux__)
+    if (EventFd >= 0) {
+        ::close(EventFd);
+    }
+#endif
+}
+
+#if defined(__linux__)
+
+// Bind a thread to the index-th CPU that the process is allowed to use
+static void PinThread(std::thread& thread, unsigned index)
+{
+    cpu_set_t allowed;
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+    const int count = CPU_COUNT(&allowed);
+    if (count <= 0) {
+        return;
+    }
+
+    int target = (int)(index % (unsigned)count);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        if (target-- == 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            ::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+#else // __linux__
+
+static void PinThread(std::thread& /*thread*/, unsigned /*index*/)
+{
+}
+
+#endif // __linux__
+
+void EncodePipeline::Start(
+    unsigned threadCount,
+    const CompletionFunction& onComplete,
+    bool pinThreads)
+{
+    Stop();
+
+    if (threadCount == ~0u) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+
+    // Select the kernels before the workers can race to do it
+    GetKernelInfo();
+
+    OnComplete = onComplete;
+    WorkerCount = threadCount;
+    Workers.reset(new PipelineWorker[threadCount]);
+    Running.store(true);
+
+    for (unsigned i = 0; i < threadCount; ++i)
+    {
+        PipelineWorker& worker = Workers[i];
+        worker.Pipeline = this;
+        worker.Thread = std::thread(&PipelineWorker::Loop, &worker);
+        if (pinThreads) {
+            PinThread(worker.Thread, i);
+        }
+    }
+}
+
+void EncodePipeline::Stop()
+{
+    if (!Running.exchange(false)) {
+        return;
+    }
+
+    for (unsigned i = 0; i < WorkerCount; ++i)
+    {
+        PipelineWorker& worker = Workers[i];
+        {
+            std::lock_guard<std::mutex> locker(worker.Lock);
+            worker.Terminated.store(true);
+        }
+        worker.Wake.notify_one();
+    }
+    for (unsigned i = 0; i < WorkerCount; ++i) {
+        Workers[i].Thread.join();
+    }
+
+    // Keep the workers for GetStats() until the next Start()
+}
+
+bool EncodePipeline::Submit(EncodeJob* job)
+{
+    if (!Running.load()) {
+        return false;
+    }
+
+    job->SubmitNsec = GetPipelineNsec();
+
+    // Pick the worker with the fewest queued jobs, starting from a rotating
+    // index so that ties are spread over the workers
+    const uint64_t sequence = Submitted.fetch_add(1);
+    unsigned best = (unsigned)(sequence % WorkerCount);
+    unsigned bestPending = Workers[best].Pending.load();
+    for (unsigned i = 1; i < WorkerCount && bestPending > 0; ++i)
+    {
+        const unsigned index = (unsigned)((sequence + i) % WorkerCount);
+        const unsigned pending = Workers[index].Pending.load();
+        if (pending < bestPending)
+        {
+            best = index;
+            bestPending = pending;
+        }
+    }
+
+    const unsigned depth = QueueDepth.fetch_add(1) + 1;
+    unsigned maxDepth = MaxQueueDepth.load();
+    while (maxDepth < depth && !MaxQueueDepth.compare_exchange_weak(maxDepth, depth)) {
+    }
+
+    PipelineWorker& worker = Workers[best];
+    worker.Pending.fetch_add(1);
+    worker.Jobs.Push(job);
+
+    if (worker.Sleeping.load())
+    {
+        std::lock_guard<std::mutex> locker(worker.Lock);
+        worker.Wake.notify_one();
+    }
+
+    return true;
+}
+
+void EncodePipeline::Complete(EncodeJob* job, PipelineWorker& worker)
+{
+    if (OnComplete)
+    {
+        // The callback may free the job
+        const uint64_t doneNsec = job->DoneNsec;
+        OnComplete(*job);
+        worker.Completion.Add(GetPipelineNsec() - doneNsec);
+        CompletedCount.fetch_add(1);
+        return;
+    }
+
+    Completed.Push(job);
+    CompletedCount.fetch_add(1);
+
+#if defined(__linux__)
+    if (EventFd >= 0)
+    {
+        const uint64_t one = 1;
+        if (::write(EventFd, &one, sizeof(one)) < 0) {
+            // The counter only fails to increase if it is about to overflow,
+            // and then it is already readable
+        }
+    }
+#endif
+
+    if (CompletedWaiting.load())
+    {
+        std::lock_guard<std::mutex> locker(CompletedLock);
+        CompletedCondition.notify_all();
+    }
+}
+
+EncodeJob* EncodePipeline::PopCompleted()
+{
+    EncodeJob* job = Completed.Pop();
+    if (job)
+    {
+        ++PoppedCount;
+        PopLatency.Add(GetPipelineNsec() - job->DoneNsec);
+    }
+    return job;
+}
+
+EncodeJob* EncodePipeline::WaitCompleted()
+{
+    if (OnComplete) {
+        return nullptr;
+    }
+
+    for (;;)
+    {
+        EncodeJob* job = PopCompleted();
+        if (job) {
+            return job;
+        }
+
+        // No jobs in flight
+        if (Submitted.load() == PoppedCount) {
+            return nullptr;
+        }
+
+        // Yield for a while first: Blocking makes each completion wake this
+        // thread, which costs a context switch per job when the pipeline is full
+        bool ready = false;
+        for (unsigned i = 0; i < kPipelineSpinCount && !ready; ++i)
+        {
+            std::this_thread::yield();
+            ready = CompletedCount.load() > PoppedCount;
+        }
+        if (ready) {
+            continue;
+        }
+
+        // A completion that is being pushed shows up in the count after it
+        // can be popped, so only wait if the count says none are ready
+        std::unique_lock<std::mutex> locker(CompletedLock);
+        CompletedWaiting.store(true);
+        CompletedCondition.wait(locker, [this]() {
+            return CompletedCount.load() > PoppedCount;
+        });
+        CompletedWaiting.store(false);
+    }
+}
+
+PipelineStats EncodePipeline::GetStats() const
+{
+    PipelineStats stats;
+    stats.Submitted = Submitted.load();
+    stats.Completed = CompletedCount.load();
+    stats.QueueDepth = QueueDepth.load();
+    stats.MaxQueueDepth = MaxQueueDepth.load();
+
+    for (unsigned i = 0; i < WorkerCount; ++i)
+    {
+        const PipelineWorker& worker = Workers[i];
+        worker.QueueWait.AddTo(stats.QueueWait);
+        worker.Encode.AddTo(stats.Encode);
+        worker.Completion.AddTo(stats.Completion);
+    }
+    PopLatency.AddTo(stats.Completion);
+
+    return stats;
+}
+
+
+} // namespace fp61
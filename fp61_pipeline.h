@@ -0,0 +1,298 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_FP61_PIPELINE_H
+#define CAT_FP61_PIPELINE_H
+
+#include "fp61_codec.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** \file
+    Fp61 Encode Pipeline
+
+    An asynchronous encode service: The application submits stripe jobs and
+    keeps doing I/O while worker threads encode them, and collects the
+    finished jobs from a callback or a completion queue.
+
+    Each worker has its own job queue, which is a lock-free intrusive
+    multi-producer single-consumer (MPSC) queue, so submitting a job never
+    takes a lock or allocates unless the worker is asleep.  Jobs go to the
+    worker with the fewest queued jobs.  Workers can be pinned to a CPU.
+
+    Each worker keeps a CoefficientSet and a scratch arena for
+    fp61::EncodeWithScratch(), so after the first job of a geometry the
+    per-stripe setup is only a lookup: no allocations and no hashing of the
+    generator matrix.
+
+    The packet buffers are owned by the application, so they can come from
+    a registered buffer pool (for example io_uring fixed buffers) and be
+    handed straight to the next read or write.  Inside a job, the encoder
+    already overlaps the stages at the cache level: each chunk of words is
+    unpacked, accumulated into all M sums, and packed while it is still in
+    L1 (see GetCodecChunkWords()), so a double buffer per stage would only
+    move the same work between threads.  The overlap that the pipeline
+    adds is between the encoding and the application's I/O.
+
+    On Linux, GetEventFd() returns an eventfd that becomes readable when
+    jobs complete, so completions can be waited for in an epoll or io_uring
+    loop next to the I/O.
+
+    GetStats() reports the queue depth and the latency of each stage: from
+    Submit() to the start of encoding, the encoding itself, and from the
+    end of encoding to the completion being handled.
+*/
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// EncodeJob
+
+/**
+    EncodeJob
+
+    One stripe to encode, with the same parameters as
+    fp61::Encoder::EncodeMultiple().  The job and all of the buffers it
+    points to must stay valid until it completes.
+
+    Context is not used by the pipeline, and can identify the job.
+*/
+struct EncodeJob
+{
+    const uint8_t* const* Originals = nullptr;
+    unsigned N = 0;
+    unsigned Bytes = 0;
+    uint64_t Seed = 0;
+    unsigned FirstRecoveryIndex = 0;
+    unsigned M = 0;
+    uint8_t* const* Recovery = nullptr;
+    void* Context = nullptr;
+
+    /// Set when the job completes: Bytes written to each recovery buffer
+    unsigned RecoveryBytes = 0;
+
+    // Used by the pipeline
+    std::atomic<EncodeJob*> Next;
+    uint64_t SubmitNsec = 0;
+    uint64_t DoneNsec = 0;
+
+    EncodeJob()
+    {
+        Next.store(nullptr, std::memory_order_relaxed);
+    }
+};
+
+
+//------------------------------------------------------------------------------
+// JobQueue
+
+/**
+    JobQueue
+
+    Lock-free intrusive MPSC queue of jobs, after Dmitry Vyukov's design.
+
+    Push() can be called from any thread.  Pop() must only be called from
+    one thread at a time.  Pop() can return nullptr while a Push() on
+    another thread is half done, so the consumer should use its own count
+    of pushed jobs to know whether to retry.
+*/
+class JobQueue
+{
+public:
+    JobQueue()
+    {
+        Head.store(&Stub, std::memory_order_relaxed);
+        Tail = &Stub;
+    }
+
+    void Push(EncodeJob* job);
+
+    /// Returns the oldest job, or nullptr if none is ready
+    EncodeJob* Pop();
+
+private:
+    EncodeJob Stub;
+
+    // Producers swap in new jobs at the head
+    std::atomic<EncodeJob*> Head;
+
+    // The consumer removes jobs from the tail
+    EncodeJob* Tail;
+};
+
+
+//------------------------------------------------------------------------------
+// EncodePipeline
+
+/// Latency of one stage of the pipeline, in nanoseconds
+struct PipelineStageStats
+{
+    uint64_t Count = 0;
+    uint64_t TotalNsec = 0;
+    uint64_t MaxNsec = 0;
+};
+
+/// Atomic version of PipelineStageStats, updated by one thread at a time
+/// and read by any thread
+struct PipelineStageCounters
+{
+    std::atomic<uint64_t> Count;
+    std::atomic<uint64_t> TotalNsec;
+    std::atomic<uint64_t> MaxNsec;
+
+    PipelineStageCounters()
+    {
+        Count.store(0, std::memory_order_relaxed);
+        TotalNsec.store(0, std::memory_order_relaxed);
+        MaxNsec.store(0, std::memory_order_relaxed);
+    }
+
+    void Add(uint64_t nsec);
+    void AddTo(PipelineStageStats& stats) const;
+};
+
+/// Counters returned by EncodePipeline::GetStats()
+struct PipelineStats
+{
+    uint64_t Submitted = 0;
+    uint64_t Completed = 0;
+
+    /// Jobs submitted but not yet encoded, now and at most
+    unsigned QueueDepth = 0;
+    unsigned MaxQueueDepth = 0;
+
+    /// Submit to the start of encoding
+    PipelineStageStats QueueWait;
+
+    /// Encoding, on the worker
+    PipelineStageStats Encode;
+
+    /// End of encoding to the return of the callback, or to PopCompleted()
+    PipelineStageStats Completion;
+};
+
+struct PipelineWorker;
+
+/**
+    EncodePipeline
+
+    Call Start() to create the worker threads.  If a callback is given it
+    is called on the worker thread for each completed job, otherwise the
+    completed jobs are queued for PopCompleted() and WaitCompleted().
+
+    Call Submit() from any thread to queue a job.
+
+    Call Stop() to finish the submitted jobs and join the workers.
+    The destructor calls Stop().
+*/
+class EncodePipeline
+{
+public:
+    typedef std::function<void(EncodeJob& job)> CompletionFunction;
+
+    EncodePipeline();
+    ~EncodePipeline();
+
+    /// Start the given number of worker threads.  By default one per
+    /// hardware thread.  Pinning binds worker i to CPU i (mod the CPU count)
+    /// where the platform supports it
+    void Start(
+        unsigned threadCount = ~0u,
+        const CompletionFunction& onComplete = CompletionFunction(),
+        bool pinThreads = true);
+
+    /// Encode the submitted jobs and join the workers
+    void Stop();
+
+    /// Queue a job.  Returns false if the pipeline is not running
+    bool Submit(EncodeJob* job);
+
+    /// Returns a completed job, or nullptr if none is ready.
+    /// Only used without a callback, and only from one thread at a time
+    EncodeJob* PopCompleted();
+
+    /// Same as PopCompleted(), but waits for a job to complete.
+    /// Returns nullptr if no jobs are in flight
+    EncodeJob* WaitCompleted();
+
+    /// Returns an eventfd that is written when a job is queued for
+    /// PopCompleted(), or -1 if it is not supported.  When it is readable,
+    /// read it to reset it and then call PopCompleted() until it returns
+    /// nullptr.  It can be readable with no jobs left, which is harmless
+    int GetEventFd() const
+    {
+        return EventFd;
+    }
+
+    /// Get the counters, summed over the workers
+    PipelineStats GetStats() const;
+
+    unsigned GetWorkerCount() const
+    {
+        return WorkerCount;
+    }
+
+private:
+    friend struct PipelineWorker;
+
+    std::unique_ptr<PipelineWorker[]> Workers;
+    unsigned WorkerCount = 0;
+    std::atomic<bool> Running;
+    CompletionFunction OnComplete;
+
+    std::atomic<uint64_t> Submitted;
+    std::atomic<unsigned> QueueDepth;
+    std::atomic<unsigned> MaxQueueDepth;
+
+    // Completion queue, without a callback
+    JobQueue Completed;
+    std::atomic<uint64_t> CompletedCount;
+    uint64_t PoppedCount = 0;
+    std::mutex CompletedLock;
+    std::condition_variable CompletedCondition;
+    std::atomic<bool> CompletedWaiting;
+    int EventFd = -1;
+
+    // Updated by PopCompleted() on the consumer thread
+    PipelineStageCounters PopLatency;
+
+    void Complete(EncodeJob* job, PipelineWorker& worker);
+};
+
+
+} // namespace fp61
+
+
+#endif // CAT_FP61_PIPELINE_H
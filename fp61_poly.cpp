@@ -0,0 +1,880 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "fp61_poly.h"
+
+#include <string.h> // memcpy, memset
+#include <vector>
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Fp^2 Transforms
+
+// Generator of the norm 1 subgroup of Fp^2, which has order 2^61.
+// This is conj(w) / w for w = 1 + 4i
+static const uint64_t kFp2RootRe = 0x1696969696969695ULL;
+static const uint64_t kFp2RootIm = 0x05a5a5a5a5a5a5a5ULL;
+
+// 2p, added before subtracting a word that is at most p + 7
+static const uint64_t kPrime2 = kPrime * 2;
+
+Fp2 GetFp2RootOfUnity(unsigned log2n)
+{
+    Fp2 w;
+    w.Re = kFp2RootRe;
+    w.Im = kFp2RootIm;
+    for (unsigned i = log2n; i < kFp2RootLog2; ++i) {
+        w = Fp2Finalize(Fp2Square(w));
+    }
+    return w;
+}
+
+void GetBitReversal(unsigned log2n, std::vector<unsigned>& rev)
+{
+    const unsigned n = 1u << log2n;
+    rev.resize(n);
+    rev[0] = 0;
+    for (unsigned i = 1; i < n; ++i) {
+        rev[i] = (rev[i >> 1] >> 1) | ((i & 1) << (log2n - 1));
+    }
+}
+
+// Get the twiddle factors for each stage of a transform of size n = 2^log2n.
+// The stage that combines blocks of `half` elements uses the `half` powers
+// of a primitive (2 * half)-th root of unity, stored at twiddles[half...]
+static void GetTwiddles(unsigned log2n, const Fp2& w, std::vector<Fp2>& twiddles)
+{
+    const unsigned n = 1u << log2n;
+    const unsigned top = n / 2;
+    twiddles.resize(n);
+
+    twiddles[top].Re = 1;
+    twiddles[top].Im = 0;
+    for (unsigned j = 1; j < top; ++j) {
+        twiddles[top + j] = Fp2Finalize(Fp2Multiply(twiddles[top + j - 1], w));
+    }
+
+    // Each smaller stage uses every other root of the next larger stage
+    for (unsigned half = top / 2; half > 0; half /= 2) {
+        for (unsigned j = 0; j < half; ++j) {
+            twiddles[half + j] = twiddles[half * 2 + j * 2];
+        }
+    }
+}
+
+void Fp2TransformPlan::Initialize(unsigned log2n)
+{
+    Log2n = log2n;
+
+    // For the inverse transform w^-1 = conj(w) is used instead
+    const Fp2 w = GetFp2RootOfUnity(log2n);
+    GetTwiddles(log2n, w, Twiddles);
+    GetTwiddles(log2n, Fp2Finalize(Fp2Conjugate(w)), InverseTwiddles);
+}
+
+/// Smallest block for which the transforms multiply by twiddles in bulk
+static const unsigned kTransformBulkHalf = 4;
+
+// hi[j] *= tw[j] for j = 0..half-1, with the vector kernel for larger blocks
+static FP61_FORCE_INLINE void MultiplyTwiddles(Fp2* hi, const Fp2* tw, unsigned half)
+{
+    if (half >= kTransformBulkHalf) {
+        Fp2MulMem(hi, tw, half);
+    }
+    else {
+        for (unsigned j = 0; j < half; ++j) {
+            hi[j] = Fp2Multiply(hi[j], tw[j]);
+        }
+    }
+}
+
+/*
+    The butterflies below work on the Re and Im words of a block as one
+    array of 2 * half words, which the compiler can vectorize.
+
+    Decimation in time keeps each word below 3p + 8 between stages:
+    The twiddle product t is at most p + 7, and only the other input u is
+    partially reduced before forming u + t and u + 2p - t.  Products by
+    the fully reduced twiddles accept inputs up to 2^63.  So each butterfly
+    does one PartialReduce() per word rather than two.
+
+    Decimation in frequency keeps each word at most p + 7 between stages:
+    The difference a + 2p - b < 2^63 goes straight into the twiddle product,
+    and only the sum a + b is partially reduced.
+
+    The first stage of decimation in time and the last stage of decimation
+    in frequency only multiply by 1, so they skip the twiddle products.
+*/
+
+void Fp2TransformPlan::TransformDIT(Fp2* data, bool inverse) const
+{
+    const unsigned n = 1u << Log2n;
+    const Fp2* twiddles = inverse ? InverseTwiddles.data() : Twiddles.data();
+
+    for (unsigned half = 1; half < n; half *= 2)
+    {
+        const Fp2* tw = twiddles + half;
+        const bool last = (half * 2 == n);
+
+        for (unsigned k = 0; k < n; k += half * 2)
+        {
+            Fp2* lo = data + k;
+            Fp2* hi = lo + half;
+
+            if (half > 1) {
+                MultiplyTwiddles(hi, tw, half);
+            }
+
+            uint64_t* lw = reinterpret_cast<uint64_t*>(lo);
+            uint64_t* hw = reinterpret_cast<uint64_t*>(hi);
+            const unsigned words = half * 2;
+
+            if (last)
+            {
+                // Partially reduce the outputs
+                for (unsigned j = 0; j < words; ++j)
+                {
+                    const uint64_t u = PartialReduce(lw[j]);
+                    const uint64_t t = hw[j];
+                    lw[j] = PartialReduce(u + t);
+                    hw[j] = PartialReduce(u + kPrime2 - t);
+                }
+            }
+            else
+            {
+                for (unsigned j = 0; j < words; ++j)
+                {
+                    const uint64_t u = PartialReduce(lw[j]);
+                    const uint64_t t = hw[j];
+                    lw[j] = u + t;
+                    hw[j] = u + kPrime2 - t;
+                }
+            }
+        }
+    }
+}
+
+void Fp2TransformPlan::TransformDIF(Fp2* data, bool inverse) const
+{
+    const unsigned n = 1u << Log2n;
+    const Fp2* twiddles = inverse ? InverseTwiddles.data() : Twiddles.data();
+
+    for (unsigned half = n / 2; half > 0; half /= 2)
+    {
+        const Fp2* tw = twiddles + half;
+
+        for (unsigned k = 0; k < n; k += half * 2)
+        {
+            Fp2* lo = data + k;
+            Fp2* hi = lo + half;
+
+            uint64_t* lw = reinterpret_cast<uint64_t*>(lo);
+            uint64_t* hw = reinterpret_cast<uint64_t*>(hi);
+            const unsigned words = half * 2;
+
+            if (half == 1)
+            {
+                // Partially reduce the outputs
+                for (unsigned j = 0; j < words; ++j)
+                {
+                    const uint64_t a = lw[j];
+                    const uint64_t b = hw[j];
+                    lw[j] = PartialReduce(a + b);
+                    hw[j] = PartialReduce(a + kPrime2 - b);
+                }
+            }
+            else
+            {
+                for (unsigned j = 0; j < words; ++j)
+                {
+                    const uint64_t a = lw[j];
+                    const uint64_t b = hw[j];
+                    lw[j] = PartialReduce(a + b);
+                    hw[j] = a + kPrime2 - b;
+                }
+
+                MultiplyTwiddles(hi, tw, half);
+            }
+        }
+    }
+}
+
+// product = a * b using two Fp^2 transforms of the smallest power-of-two
+// size that holds the product
+static void MultiplyTransform(
+    const uint64_t* a,
+    unsigned aCount,
+    const uint64_t* b,
+    unsigned bCount,
+    uint64_t* product)
+{
+    const unsigned productCount = aCount + bCount - 1;
+
+    unsigned log2n = 1;
+    while ((1u << log2n) < productCount) {
+        ++log2n;
+    }
+    const unsigned n = 1u << log2n;
+
+    std::vector<unsigned> rev;
+    GetBitReversal(log2n, rev);
+
+    // Pack F = a + b*i in bit-reversed order
+    std::vector<Fp2> data(n);
+    for (unsigned j = 0; j < n; ++j)
+    {
+        Fp2& e = data[rev[j]];
+        e.Re = (j < aCount) ? a[j] : 0;
+        e.Im = (j < bCount) ? b[j] : 0;
+    }
+
+    Fp2TransformPlan plan;
+    plan.Initialize(log2n);
+    plan.TransformDIT(data.data(), false);
+
+    /*
+        With G[k] = conj(F[n - k]):
+
+            A[k] = (F[k] + G[k]) / 2
+            B[k] = (F[k] - G[k]) / 2i
+
+        So the transform of the product is:
+
+            C[k] = A[k] * B[k] = (F[k]^2 - G[k]^2) / 4i
+                 = -i * (F[k]^2 - conj(F[n - k]^2)) / 4
+
+        The divide by 4 is folded into the final scale.
+        Each pair (k, n - k) is handled together so the transformed values
+        are written back in bit-reversed order for the inverse transform.
+    */
+    std::vector<Fp2> spectrum(n);
+    for (unsigned k = 0; k <= n / 2; ++k)
+    {
+        const unsigned k2 = (n - k) & (n - 1);
+        const Fp2 s = Fp2Square(data[k]);
+        const Fp2 s2 = Fp2Square(data[k2]);
+
+        // -i * (x + y*i) = y - x*i
+        Fp2& c = spectrum[rev[k]];
+        c.Re = PartialReduce(s.Im + s2.Im);
+        c.Im = PartialReduce(s2.Re + kPrime4 - s.Re);
+
+        Fp2& c2 = spectrum[rev[k2]];
+        c2.Re = c.Re;
+        c2.Im = PartialReduce(s.Re + kPrime4 - s2.Re);
+    }
+
+    plan.TransformDIT(spectrum.data(), true);
+
+    // Scale by 1 / 4n = 2^-(log2n + 2) = 2^(61 - log2n - 2).
+    // The imaginary parts are all zero since the product is in Fp
+    const uint64_t scale = (uint64_t)1 << (61 - log2n - 2);
+    for (unsigned j = 0; j < productCount; ++j) {
+        product[j] = Finalize(Multiply(spectrum[j].Re, scale));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Schoolbook and Karatsuba
+
+// product = a * b with one MulAddMem() pass per coefficient of the shorter
+static void MultiplySchoolbook(
+    const uint64_t* a,
+    unsigned aCount,
+    const uint64_t* b,
+    unsigned bCount,
+    uint64_t* product)
+{
+    if (aCount > bCount)
+    {
+        const uint64_t* t = a;
+        a = b, b = t;
+        const unsigned c = aCount;
+        aCount = bCount, bCount = c;
+    }
+
+    const unsigned productCount = aCount + bCount - 1;
+    memset(product, 0, productCount * sizeof(uint64_t));
+
+    for (unsigned i = 0; i < aCount; ++i) {
+        MulAddMem(product + i, b, a[i], bCount);
+    }
+
+    for (unsigned i = 0; i < productCount; ++i) {
+        product[i] = Finalize(product[i]);
+    }
+}
+
+// Scratch words needed by MultiplyKaratsuba() for inputs of n coefficients
+static unsigned GetKaratsubaScratchWords(unsigned n)
+{
+    unsigned words = 0;
+    while (n >= kPolyKaratsubaThreshold)
+    {
+        const unsigned hi = n - n / 2;
+        words += hi * 4;
+        n = hi;
+    }
+    return words;
+}
+
+// product = a * b for two inputs of n coefficients each.
+// The product has 2n - 1 coefficients
+static void MultiplyKaratsuba(
+    const uint64_t* a,
+    const uint64_t* b,
+    unsigned n,
+    uint64_t* product,
+    uint64_t* scratch)
+{
+    if (n < kPolyKaratsubaThreshold)
+    {
+        MultiplySchoolbook(a, n, b, n, product);
+        return;
+    }
+
+    // a = a0 + a1 * x^lo, where a1 has hi >= lo coefficients
+    const unsigned lo = n / 2;
+    const unsigned hi = n - lo;
+    const uint64_t* a1 = a + lo;
+    const uint64_t* b1 = b + lo;
+
+    uint64_t* sumA = scratch;
+    uint64_t* sumB = sumA + hi;
+    uint64_t* z1 = sumB + hi;
+    uint64_t* next = z1 + hi * 2;
+
+    // z0 = a0 * b0 in product[0, 2lo-1) and z2 = a1 * b1 in product[2lo, 2n-1)
+    MultiplyKaratsuba(a, b, lo, product, next);
+    product[lo * 2 - 1] = 0;
+    MultiplyKaratsuba(a1, b1, hi, product + lo * 2, next);
+
+    // Sums of two values in Fp are less than 2^62, so they can be finalized
+    for (unsigned i = 0; i < lo; ++i)
+    {
+        sumA[i] = Finalize(a[i] + a1[i]);
+        sumB[i] = Finalize(b[i] + b1[i]);
+    }
+    if (hi > lo)
+    {
+        sumA[lo] = a1[lo];
+        sumB[lo] = b1[lo];
+    }
+
+    // z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    MultiplyKaratsuba(sumA, sumB, hi, z1, next);
+
+    const uint64_t* z0 = product;
+    const uint64_t* z2 = product + lo * 2;
+    const unsigned z0Count = lo * 2 - 1;
+    const unsigned z1Count = hi * 2 - 1;
+
+    for (unsigned i = 0; i < z1Count; ++i)
+    {
+        uint64_t sub = z2[i];
+        if (i < z0Count) {
+            sub += z0[i];
+        }
+        // z1 + 2p - (z0 + z2) < 3p
+        z1[i] = Finalize(PartialReduce(z1[i] + kPrime * 2 - sub));
+    }
+
+    for (unsigned i = 0; i < z1Count; ++i) {
+        product[lo + i] = Finalize(product[lo + i] + z1[i]);
+    }
+}
+
+// product = a * b with Karatsuba on bCount-sized blocks of a.
+// Preconditions: aCount >= bCount
+static void MultiplyBlocked(
+    const uint64_t* a,
+    unsigned aCount,
+    const uint64_t* b,
+    unsigned bCount,
+    uint64_t* product)
+{
+    const unsigned productCount = aCount + bCount - 1;
+    const unsigned blockProductCount = bCount * 2 - 1;
+
+    std::vector<uint64_t> scratch(GetKaratsubaScratchWords(bCount));
+    std::vector<uint64_t> block(blockProductCount);
+    std::vector<uint64_t> padded;
+
+    memset(product, 0, productCount * sizeof(uint64_t));
+
+    for (unsigned offset = 0; offset < aCount; offset += bCount)
+    {
+        const uint64_t* aBlock = a + offset;
+        if (aCount - offset < bCount)
+        {
+            // Zero-pad the last partial block
+            padded.assign(bCount, 0);
+            memcpy(padded.data(), aBlock, (aCount - offset) * sizeof(uint64_t));
+            aBlock = padded.data();
+        }
+
+        MultiplyKaratsuba(aBlock, b, bCount, block.data(), scratch.data());
+
+        const unsigned count = (productCount - offset < blockProductCount) ?
+            productCount - offset : blockProductCount;
+        uint64_t* dest = product + offset;
+        for (unsigned i = 0; i < count; ++i) {
+            dest[i] = Finalize(dest[i] + block[i]);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Polynomial API
+
+void PolyMultiply(
+    const uint64_t* a,
+    unsigned aCount,
+    const uint64_t* b,
+    unsigned bCount,
+    uint64_t* product)
+{
+    if (aCount == 0 || bCount == 0) {
+        return;
+    }
+
+    if (aCount < bCount)
+    {
+        const uint64_t* t = a;
+        a = b, b = t;
+        const unsigned c = aCount;
+        aCount = bCount, bCount = c;
+    }
+
+    if (bCount < kPolyKaratsubaThreshold) {
+        MultiplySchoolbook(a, aCount, b, bCount, product);
+    }
+    else if (bCount >= kPolyTransformThreshold) {
+        MultiplyTransform(a, aCount, b, bCount, product);
+    }
+    else {
+        MultiplyBlocked(a, aCount, b, bCount, product);
+    }
+}
+
+uint64_t PolyEvaluate(const uint64_t* poly, unsigned count, uint64_t x)
+{
+    // Multiply() returns at most p + 7, so adding a coefficient keeps r
+    // under 2^62 and it does not need to be reduced before the next one
+    uint64_t r = 0;
+    while (count > 0) {
+        r = Multiply(r, x) + poly[--count];
+    }
+    return Finalize(PartialReduce(r));
+}
+
+// Evaluate poly at each point with Horner's rule, four points at a time
+// so the Multiply() latency chains overlap
+static void EvaluateHorner(
+    const uint64_t* poly,
+    unsigned count,
+    const uint64_t* x,
+    unsigned xCount,
+    uint64_t* y)
+{
+    unsigned i = 0;
+    for (; i + 4 <= xCount; i += 4)
+    {
+        const uint64_t x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+        uint64_t r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+
+        for (unsigned j = count; j > 0; --j)
+        {
+            const uint64_t c = poly[j - 1];
+            r0 = Multiply(r0, x0) + c;
+            r1 = Multiply(r1, x1) + c;
+            r2 = Multiply(r2, x2) + c;
+            r3 = Multiply(r3, x3) + c;
+        }
+
+        y[i] = Finalize(PartialReduce(r0));
+        y[i + 1] = Finalize(PartialReduce(r1));
+        y[i + 2] = Finalize(PartialReduce(r2));
+        y[i + 3] = Finalize(PartialReduce(r3));
+    }
+    for (; i < xCount; ++i) {
+        y[i] = PolyEvaluate(poly, count, x[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Remainders
+
+/// Quotient length above which remainders use Newton iteration
+static const unsigned kPolyNewtonThreshold = 256;
+
+// Get the first `count` coefficients of 1 / f as a power series.
+// Preconditions: f[0] = 1
+static void SeriesInverse(const uint64_t* f, unsigned fCount, unsigned count, std::vector<uint64_t>& g)
+{
+    g.assign(1, 1);
+
+    std::vector<uint64_t> t;
+
+    // g = g * (2 - f * g) mod x^k doubles the number of correct terms
+    for (unsigned k = 1; k < count; )
+    {
+        k = (k * 2 < count) ? k * 2 : count;
+
+        const unsigned gCount = static_cast<unsigned>(g.size());
+        const unsigned fk = (fCount < k) ? fCount : k;
+
+        t.resize(fk + gCount - 1);
+        PolyMultiply(f, fk, g.data(), gCount, t.data());
+        t.resize(k, 0);
+
+        for (unsigned i = 0; i < k; ++i) {
+            t[i] = Finalize(Negate(t[i]));
+        }
+        t[0] = Finalize(t[0] + 2);
+
+        std::vector<uint64_t> next(gCount + k - 1);
+        PolyMultiply(g.data(), gCount, t.data(), k, next.data());
+        next.resize(k);
+        g.swap(next);
+    }
+}
+
+// remainder = a mod m, which has mCount - 1 coefficients.
+// Preconditions: m is monic (m[mCount - 1] = 1) and mCount >= 2
+static void PolyRemainderMonic(
+    const uint64_t* a,
+    unsigned aCount,
+    const uint64_t* m,
+    unsigned mCount,
+    uint64_t* remainder)
+{
+    const unsigned rCount = mCount - 1;
+
+    if (aCount <= rCount)
+    {
+        memcpy(remainder, a, aCount * sizeof(uint64_t));
+        memset(remainder + aCount, 0, (rCount - aCount) * sizeof(uint64_t));
+        return;
+    }
+
+    const unsigned qCount = aCount - rCount;
+
+    if (qCount < kPolyNewtonThreshold || rCount < kPolyKaratsubaThreshold)
+    {
+        // Long division: Cancel the top coefficient with a multiple of m
+        std::vector<uint64_t> r(a, a + aCount);
+        for (unsigned i = aCount; i > rCount; --i)
+        {
+            const uint64_t q = Finalize(r[i - 1]);
+            if (q != 0) {
+                MulAddMem(r.data() + i - mCount, m, Negate(q), rCount);
+            }
+        }
+        for (unsigned i = 0; i < rCount; ++i) {
+            remainder[i] = Finalize(r[i]);
+        }
+        return;
+    }
+
+    // rev(q) = rev(a) / rev(m) mod x^qCount
+    std::vector<uint64_t> revM(mCount);
+    for (unsigned i = 0; i < mCount; ++i) {
+        revM[i] = m[mCount - 1 - i];
+    }
+    std::vector<uint64_t> inv;
+    SeriesInverse(revM.data(), mCount, qCount, inv);
+
+    std::vector<uint64_t> revA(qCount);
+    for (unsigned i = 0; i < qCount; ++i) {
+        revA[i] = a[aCount - 1 - i];
+    }
+
+    std::vector<uint64_t> t(qCount * 2 - 1);
+    PolyMultiply(revA.data(), qCount, inv.data(), qCount, t.data());
+
+    std::vector<uint64_t> q(qCount);
+    for (unsigned i = 0; i < qCount; ++i) {
+        q[i] = t[qCount - 1 - i];
+    }
+
+    // remainder = a - q * m, which only needs the low rCount terms of q * m
+    const unsigned qLow = (qCount < rCount) ? qCount : rCount;
+    t.resize(qLow + rCount - 1);
+    PolyMultiply(q.data(), qLow, m, rCount, t.data());
+
+    for (unsigned i = 0; i < rCount; ++i) {
+        remainder[i] = Finalize(PartialReduce(a[i] + Negate(t[i])));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Subproduct Tree
+
+/// Most points in a leaf of the subproduct tree
+static const unsigned kPolyTreeLeafPoints = 16;
+
+// Binary tree over a range of points, where each node holds the product
+// M(x) = (x - x_First) * ... * (x - x_{First+Count-1}), with Count + 1
+// coefficients.  Nodes with at most kPolyTreeLeafPoints points are leaves
+struct SubproductTree
+{
+    struct Node
+    {
+        unsigned First = 0;
+        unsigned Count = 0;
+        unsigned Left = 0;
+        unsigned Right = 0;
+        std::vector<uint64_t> M;
+    };
+
+    const uint64_t* X = nullptr;
+    std::vector<Node> Nodes;
+
+    // Build the tree and return the root index
+    unsigned Build(const uint64_t* x, unsigned count)
+    {
+        X = x;
+        Nodes.clear();
+        Nodes.reserve(count / kPolyTreeLeafPoints * 2 + 2);
+        return BuildNode(0, count);
+    }
+
+    bool IsLeaf(const Node& node) const
+    {
+        return node.Count <= kPolyTreeLeafPoints;
+    }
+
+    unsigned BuildNode(unsigned first, unsigned count);
+
+    // Evaluate r at each point under the node
+    void Evaluate(unsigned index, const uint64_t* r, unsigned rCount, uint64_t* y) const;
+
+    // Get sum(w_i * M(x) / (x - x_i)) over the points under the node,
+    // which has Count coefficients
+    void Combine(unsigned index, const uint64_t* w, std::vector<uint64_t>& f) const;
+};
+
+unsigned SubproductTree::BuildNode(unsigned first, unsigned count)
+{
+    const unsigned index = static_cast<unsigned>(Nodes.size());
+    Nodes.emplace_back();
+    Nodes[index].First = first;
+    Nodes[index].Count = count;
+
+    std::vector<uint64_t> m;
+
+    if (count <= kPolyTreeLeafPoints)
+    {
+        // Multiply in one (x - x_i) factor at a time
+        m.assign(count + 1, 0);
+        m[0] = 1;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            const uint64_t negX = Negate(X[first + i]);
+            for (unsigned j = i + 1; j > 0; --j) {
+                m[j] = Finalize(PartialReduce(m[j - 1] + Multiply(m[j], negX)));
+            }
+            m[0] = Finalize(Multiply(m[0], negX));
+        }
+    }
+    else
+    {
+        const unsigned leftCount = count / 2;
+        const unsigned left = BuildNode(first, leftCount);
+        const unsigned right = BuildNode(first + leftCount, count - leftCount);
+        Nodes[index].Left = left;
+        Nodes[index].Right = right;
+
+        const std::vector<uint64_t>& ml = Nodes[left].M;
+        const std::vector<uint64_t>& mr = Nodes[right].M;
+        m.resize(count + 1);
+        PolyMultiply(ml.data(), static_cast<unsigned>(ml.size()),
+            mr.data(), static_cast<unsigned>(mr.size()), m.data());
+    }
+
+    Nodes[index].M.swap(m);
+    return index;
+}
+
+void SubproductTree::Evaluate(unsigned index, const uint64_t* r, unsigned rCount, uint64_t* y) const
+{
+    const Node& node = Nodes[index];
+
+    if (IsLeaf(node))
+    {
+        EvaluateHorner(r, rCount, X + node.First, node.Count, y + node.First);
+        return;
+    }
+
+    const unsigned children[2] = { node.Left, node.Right };
+    std::vector<uint64_t> rem;
+
+    for (unsigned child : children)
+    {
+        const Node& c = Nodes[child];
+        const unsigned mCount = static_cast<unsigned>(c.M.size());
+
+        rem.resize(mCount - 1);
+        PolyRemainderMonic(r, rCount, c.M.data(), mCount, rem.data());
+        Evaluate(child, rem.data(), mCount - 1, y);
+    }
+}
+
+void SubproductTree::Combine(unsigned index, const uint64_t* w, std::vector<uint64_t>& f) const
+{
+    const Node& node = Nodes[index];
+
+    if (IsLeaf(node))
+    {
+        f.assign(node.Count, 0);
+
+        // Synthetic division of M(x) by (x - x_i) gives each Lagrange basis
+        // polynomial in the leaf, with O(Count) work per point
+        const uint64_t* m = node.M.data();
+        for (unsigned i = 0; i < node.Count; ++i)
+        {
+            const uint64_t xi = X[node.First + i];
+            const uint64_t wi = w[node.First + i];
+
+            uint64_t q = 1; // Leading coefficient of M
+            for (unsigned j = node.Count; j > 0; --j)
+            {
+                f[j - 1] = PartialReduce(f[j - 1] + Multiply(q, wi));
+                q = Finalize(PartialReduce(m[j - 1] + Multiply(q, xi)));
+            }
+        }
+
+        for (unsigned j = 0; j < node.Count; ++j) {
+            f[j] = Finalize(f[j]);
+        }
+        return;
+    }
+
+    // f = f_left * M_right + f_right * M_left
+    std::vector<uint64_t> fl, fr;
+    Combine(node.Left, w, fl);
+    Combine(node.Right, w, fr);
+
+    const std::vector<uint64_t>& ml = Nodes[node.Left].M;
+    const std::vector<uint64_t>& mr = Nodes[node.Right].M;
+
+    // Both products have Count coefficients
+    std::vector<uint64_t> t(node.Count);
+    f.resize(node.Count);
+    PolyMultiply(fl.data(), static_cast<unsigned>(fl.size()),
+        mr.data(), static_cast<unsigned>(mr.size()), f.data());
+    PolyMultiply(fr.data(), static_cast<unsigned>(fr.size()),
+        ml.data(), static_cast<unsigned>(ml.size()), t.data());
+
+    for (unsigned j = 0; j < node.Count; ++j) {
+        f[j] = Finalize(f[j] + t[j]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Multipoint Evaluation and Interpolation
+
+void PolyEvaluateMany(
+    const uint64_t* poly,
+    unsigned count,
+    const uint64_t* x,
+    unsigned xCount,
+    uint64_t* y)
+{
+    if (xCount < kPolyTreeMinPoints || count < kPolyTreeMinPoints)
+    {
+        EvaluateHorner(poly, count, x, xCount, y);
+        return;
+    }
+
+    SubproductTree tree;
+    const unsigned root = tree.Build(x, xCount);
+    const std::vector<uint64_t>& m = tree.Nodes[root].M;
+
+    // Reduce the polynomial modulo the root first if it is larger
+    if (count >= m.size())
+    {
+        std::vector<uint64_t> rem(m.size() - 1);
+        PolyRemainderMonic(poly, count, m.data(), static_cast<unsigned>(m.size()), rem.data());
+        tree.Evaluate(root, rem.data(), static_cast<unsigned>(rem.size()), y);
+    }
+    else {
+        tree.Evaluate(root, poly, count, y);
+    }
+}
+
+bool PolyInterpolate(
+    const uint64_t* x,
+    const uint64_t* y,
+    unsigned count,
+    uint64_t* poly)
+{
+    if (count == 0) {
+        return true;
+    }
+
+    SubproductTree tree;
+    const unsigned root = tree.Build(x, count);
+    const std::vector<uint64_t>& m = tree.Nodes[root].M;
+
+    // P'(x) has count coefficients
+    std::vector<uint64_t> derivative(count);
+    for (unsigned i = 0; i < count; ++i) {
+        derivative[i] = Finalize(Multiply(m[i + 1], i + 1));
+    }
+
+    std::vector<uint64_t> d(count);
+    tree.Evaluate(root, derivative.data(), count, d.data());
+
+    // P'(x_i) = 0 only if x_i is repeated
+    std::vector<uint64_t> w(count);
+    InverseBatch(d.data(), w.data(), count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (w[i] == 0) {
+            return false;
+        }
+        w[i] = Finalize(Multiply(w[i], y[i]));
+    }
+
+    std::vector<uint64_t> f;
+    tree.Combine(root, w.data(), f);
+    memcpy(poly, f.data(), count * sizeof(uint64_t));
+    return true;
+}
+
+
+} // namespace fp61
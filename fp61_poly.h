@@ -0,0 +1,227 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAT_FP61_POLY_H
+#define CAT_FP61_POLY_H
+
+#include "fp61.h"
+
+#include <vector>
+
+/** \file
+    Fp61 Polynomials
+
+    Polynomials with coefficients in Fp, stored as arrays of words from the
+    constant term up: poly[0] + poly[1]*x + ... + poly[count-1]*x^(count-1).
+
+    All coefficient and point inputs must be in Fp (less than p), for example
+    from fp61::Finalize(), and all outputs are fully reduced.
+
+    Multiplication picks one of three algorithms by size:
+
+    (1) Schoolbook: One fp61::MulAddMem() pass per coefficient.
+    (2) Karatsuba: Splits both inputs in half and recurses on three products
+        instead of four, down to the schoolbook threshold.
+    (3) Transform: A number-theoretic transform (NTT) over Fp^2 = Fp[i]/(i^2+1),
+        using fp61::Fp2 and the fp61::Fp2MulMem() bulk kernel.
+
+    Fp itself is a poor fit for an NTT because p - 1 = 2 * 3^2 * 5^2 * 7 * 11
+    * 13 * 31 * 41 * 61 * 151 * 331 * 1321 has only one factor of two.
+    But p = 3 (mod 4), so i^2 = -1 has no root in Fp and Fp^2 is a field
+    with p^2 - 1 = (p - 1) * 2^61 elements, and its subgroup of norm 1
+    elements is cyclic of order p + 1 = 2^61.  So Fp^2 has roots of unity
+    for every power-of-two transform size that fits in memory.
+
+    Coefficients of both inputs are packed into one transform as a + b*i.
+    Since conj(w) = w^-1 for roots of norm 1, the transforms of a and b can be
+    separated from each other using conj(F[n - k]), so a product costs two
+    transforms of size n rather than three.
+
+    The transforms are also available directly through fp61::Fp2TransformPlan,
+    for example for the transform code in fp61_codec.h.
+
+    Multipoint evaluation and interpolation use a subproduct tree of the
+    (x - x_i) factors, so they cost O(M(n) log n) for n points, where M(n) is
+    the cost of a product above.  Polynomial remainders use schoolbook long
+    division for small quotients and Newton iteration for large ones.
+    Below kPolyTreeMinPoints points, multipoint evaluation runs Horner's rule
+    on several points at a time instead.
+*/
+
+namespace fp61 {
+
+
+//------------------------------------------------------------------------------
+// Thresholds
+
+/// Shortest input (in coefficients) that PolyMultiply() splits
+/// with Karatsuba rather than using schoolbook multiplication
+static const unsigned kPolyKaratsubaThreshold = 32;
+
+/// Shortest input (in coefficients) that PolyMultiply() multiplies with
+/// the Fp^2 transform.  Longer inputs multiplied by shorter ones are split
+/// into blocks the size of the shorter input for Karatsuba instead
+static const unsigned kPolyTransformThreshold = 768;
+
+/// Fewest points that PolyEvaluateMany() evaluates with a subproduct tree
+static const unsigned kPolyTreeMinPoints = 256;
+
+
+//------------------------------------------------------------------------------
+// Polynomial API
+
+/**
+    fp61::PolyMultiply(a, aCount, b, bCount, product)
+
+    product = a * b
+
+    The product array must have room for aCount + bCount - 1 coefficients,
+    and must not overlap the inputs.  Does nothing if either count is 0.
+*/
+void PolyMultiply(
+    const uint64_t* a,
+    unsigned aCount,
+    const uint64_t* b,
+    unsigned bCount,
+    uint64_t* product);
+
+/**
+    r = fp61::PolyEvaluate(poly, count, x)
+
+    r = poly(x), by Horner's rule.
+
+    Returns 0 if count is 0.
+*/
+uint64_t PolyEvaluate(const uint64_t* poly, unsigned count, uint64_t x);
+
+/**
+    fp61::PolyEvaluateMany(poly, count, x, xCount, y)
+
+    y[i] = poly(x[i]) for i = 0..xCount-1
+
+    For large inputs this builds a subproduct tree over the points, reduces
+    the polynomial modulo each node on the way down, and evaluates the small
+    remainders at the leaves.
+*/
+void PolyEvaluateMany(
+    const uint64_t* poly,
+    unsigned count,
+    const uint64_t* x,
+    unsigned xCount,
+    uint64_t* y);
+
+/**
+    fp61::PolyInterpolate(x, y, count, poly)
+
+    Find the unique polynomial with `count` coefficients that passes
+    through the points (x[i], y[i]) for i = 0..count-1.
+
+    The weights y[i] / P'(x[i]) of the Lagrange form are found by evaluating
+    the derivative of P(x) = (x - x_0) * ... * (x - x_{count-1}) at all
+    the points with one fp61::InverseBatch() call, and are combined back up
+    the subproduct tree.
+
+    Returns false if two of the x values are the same, in which case there
+    is no unique polynomial and `poly` is not written.
+*/
+bool PolyInterpolate(
+    const uint64_t* x,
+    const uint64_t* y,
+    unsigned count,
+    uint64_t* poly);
+
+
+//------------------------------------------------------------------------------
+// Fp^2 Transforms
+
+/// Transforms of size up to 2^kFp2RootLog2 have roots of unity in Fp^2
+static const unsigned kFp2RootLog2 = 61;
+
+/**
+    w = fp61::GetFp2RootOfUnity(log2n)
+
+    Returns a primitive (2^log2n)-th root of unity in Fp^2 with both parts
+    in Fp, for log2n = 0..kFp2RootLog2.  It has norm 1, so w^-1 = conj(w).
+    The root for log2n - 1 is w^2.
+*/
+Fp2 GetFp2RootOfUnity(unsigned log2n);
+
+/// Get (rev[i]) = i with the low `log2n` bits reversed, for i < 2^log2n
+void GetBitReversal(unsigned log2n, std::vector<unsigned>& rev);
+
+/**
+    Fp2TransformPlan
+
+    Twiddle factors for radix-2 transforms of size n = 2^Log2n over Fp^2:
+
+        X[k] = sum(x[j] * w^(j*k)) for j = 0..n-1
+
+    where w = GetFp2RootOfUnity(Log2n), or w^-1 for the inverse transform.
+    The transforms are not scaled, so the inverse of a forward transform
+    leaves every element multiplied by n.
+
+    Call Initialize() once for a size and reuse the plan.
+
+    TransformDIT() takes its input in bit-reversed order and writes the
+    output in natural order.  TransformDIF() is the other way around.
+    So a DIF pass followed by pointwise products and a DIT pass never
+    needs to permute the data.
+
+    The butterflies use lazy reduction: Only one word of each butterfly is
+    partially reduced per stage rather than both outputs, and the stages
+    that multiply by 1 skip the twiddle products.  Input parts must be
+    partially reduced (at most p + 7, as returned by fp61::PartialReduce()
+    or fp61::Multiply()), and the output parts are partially reduced.
+*/
+struct Fp2TransformPlan
+{
+    unsigned Log2n = 0;
+
+    /// Powers of w for each stage, and of w^-1 for the inverse transform.
+    /// The stage that combines blocks of `half` elements uses the powers
+    /// of a primitive (2 * half)-th root of unity, stored at [half...]
+    std::vector<Fp2> Twiddles;
+    std::vector<Fp2> InverseTwiddles;
+
+
+    /// Compute the twiddle factors for transforms of size 2^log2n
+    void Initialize(unsigned log2n);
+
+    /// Decimation in time: Bit-reversed input, natural order output
+    void TransformDIT(Fp2* data, bool inverse) const;
+
+    /// Decimation in frequency: Natural order input, bit-reversed output
+    void TransformDIF(Fp2* data, bool inverse) const;
+};
+
+
+} // namespace fp61
+
+
+#endif // CAT_FP61_POLY_H
@@ -27,6 +27,12 @@
 */
 
 #include "../fp61.h"
+#include "../fp61_codec.h"
+#include "../fp61_file.h"
+#include "../fp61_matrix.h"
+#include "../fp61_parallel.h"
+#include "../fp61_pipeline.h"
+#include "../fp61_poly.h"
 #include "gf256.h"
 
 #define FP61_ENABLE_GF256_COMPARE
@@ -145,12 +151,25 @@
     inputs to 62 bits.  But in trade, no 128-bit operations are needed.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <string>
+#include <string.h> // memset, strcmp
 #include <vector>
 using namespace std;
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h> // __rdtsc
+    #define FP61_HAS_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h> // __rdtsc
+    #define FP61_HAS_RDTSC
+#endif
+
 
 #ifdef _WIN32
     #ifndef NOMINMAX
@@ -221,121 +240,25 @@ uint64_t GetTimeUsec()
 #endif
 }
 
-
-//------------------------------------------------------------------------------
-// Fp61 Erasure Code Encoder
-
-// Get maximum number of bytes needed for a recovery packet
-static unsigned GetRecoveryBytes(unsigned originalBytes)
+static uint64_t GetTimeNsec()
 {
-    const unsigned maxWords = fp61::ByteReader::MaxWords(originalBytes);
-    const unsigned maxBytes = fp61::WordWriter::BytesNeeded(maxWords);
-    return maxBytes;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
 }
 
-/**
-    Encode()
-
-    This function implements the encoder for an erasure code.
-    It accepts a set of equal-sized data packets and outputs one recovery packet
-    that can repair one lost original packet.
-
-    The recovery packet must be GetRecoveryBytes() in size.
-
-    Returns the number of bytes written.
-*/
-unsigned Encode(
-    const std::vector<std::vector<uint8_t>>& originals,
-    unsigned N,
-    unsigned bytes,
-    uint64_t seed,
-    uint8_t* recovery)
+// Timestamp counter, which runs at a fixed reference frequency on most CPUs
+static uint64_t GetCycles()
 {
-    uint64_t seedMix = fp61::HashU64(seed);
-
-    std::vector<fp61::ByteReader> readers;
-    readers.resize(N);
-    for (unsigned i = 0; i < N; ++i) {
-        readers[i].BeginRead(&originals[i][0], bytes);
-    }
-
-    fp61::WordWriter writer;
-    writer.BeginWrite(recovery);
-
-    const unsigned minWords = fp61::WordReader::WordCount(bytes);
-    for (unsigned i = 0; i < minWords; ++i)
-    {
-        uint64_t fpword;
-        readers[0].Read(fpword);
-        uint64_t coeff = fp61::HashToNonzeroFp(seedMix + 0);
-        uint64_t sum = fp61::Multiply(coeff, fpword);
-
-        unsigned column = 1;
-        unsigned columnsRemaining = N - 1;
-        while (columnsRemaining >= 3)
-        {
-            uint64_t coeff0 = fp61::HashToNonzeroFp(seedMix + column);
-            uint64_t coeff1 = fp61::HashToNonzeroFp(seedMix + column + 1);
-            uint64_t coeff2 = fp61::HashToNonzeroFp(seedMix + column + 2);
-
-            uint64_t fpword0, fpword1, fpword2;
-            readers[column].Read(fpword0);
-            readers[column + 1].Read(fpword1);
-            readers[column + 2].Read(fpword2);
-
-            sum += fp61::Multiply(coeff0, fpword0);
-            sum += fp61::Multiply(coeff1, fpword1);
-            sum += fp61::Multiply(coeff2, fpword2);
-            sum = fp61::PartialReduce(sum);
-
-            column += 3;
-            columnsRemaining -= 3;
-        }
-
-        while (columnsRemaining > 0)
-        {
-            uint64_t temp;
-            readers[column].Read(temp);
-            sum += fp61::Multiply(coeff, temp);
-
-            column++;
-            columnsRemaining--;
-        }
-        sum = fp61::PartialReduce(sum);
-        sum = fp61::Finalize(sum);
-        writer.Write(sum);
-    }
-
-    for (;;)
-    {
-        bool more_data = false;
-
-        uint64_t sum = 0;
-
-        for (unsigned i = 0; i < N; ++i)
-        {
-            uint64_t coeff = fp61::HashToNonzeroFp(seedMix + i);
-
-            uint64_t fpword;
-            if (readers[i].Read(fpword) == fp61::ReadResult::Success)
-            {
-                more_data = true;
-
-                sum += fp61::Multiply(coeff, fpword);
-                sum = fp61::PartialReduce(sum);
-            }
-        }
-
-        if (!more_data) {
-            break;
-        }
+#ifdef FP61_HAS_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
 
-        sum = fp61::Finalize(sum);
-        writer.Write(sum);
-    }
 
-    return writer.Flush();
-}
+//------------------------------------------------------------------------------
+// GF(2^8) Comparison Encoder
 
 void EncodeGF256(
     const std::vector<std::vector<uint8_t>>& originals,
@@ -380,6 +303,9 @@ static const unsigned kFileNCount = static_cast<unsigned>(sizeof(kFileN) / sizeo
 
 static const unsigned kTrials = 1000;
 
+// Number of recovery packets produced at once by the EncodeMultiple() row
+static const unsigned kMultiM = 4;
+
 void RunBenchmarks()
 {
     fp61::Random prng;
@@ -388,6 +314,11 @@ void RunBenchmarks()
     std::vector<std::vector<uint8_t>> original_data;
     std::vector<uint8_t> recovery_data;
 
+    fp61::Encoder encoder;
+    std::vector<const uint8_t*> originals;
+    std::vector<std::vector<uint8_t>> multi_data(kMultiM);
+    std::vector<uint8_t*> multi_recovery(kMultiM);
+
     for (unsigned i = 0; i < kFileSizesCount; ++i)
     {
         unsigned fileSizeBytes = kFileSizes[i];
@@ -402,6 +333,42 @@ void RunBenchmarks()
 
             uint64_t sizeSum = 0, timeSum = 0;
             uint64_t timeSum_gf256 = 0;
+            uint64_t timeSum_multi = 0;
+            encoder.Stats = fp61::EncoderStats();
+
+            // Generate the data once, outside of the trials
+            original_data.resize(N);
+            for (unsigned s = 0; s < N; ++s)
+            {
+                // Add 8 bytes padding to simplify tester
+                original_data[s].resize(fileSizeBytes + 8);
+
+                // Fill the data with random words, about 4% of them all ones
+                for (unsigned r = 0; r < fileSizeBytes; r += 8)
+                {
+                    uint64_t w;
+                    if (prng.Next() % 100 <= 3) {
+                        w = ~(uint64_t)0;
+                    }
+                    else {
+                        w = prng.Next();
+                    }
+                    fp61::WriteU64_LE(&original_data[s][r], w);
+                }
+            }
+
+            const unsigned maxRecoveryBytes = fp61::GetRecoveryBytes(fileSizeBytes);
+            recovery_data.resize(maxRecoveryBytes);
+
+            originals.resize(N);
+            for (unsigned s = 0; s < N; ++s) {
+                originals[s] = &original_data[s][0];
+            }
+            for (unsigned r = 0; r < kMultiM; ++r)
+            {
+                multi_data[r].resize(maxRecoveryBytes);
+                multi_recovery[r] = &multi_data[r][0];
+            }
 
             for (unsigned k = 0; k < kTrials; ++k)
             {
@@ -413,19 +380,18 @@ void RunBenchmarks()
 
                     R = sum(m_i * f_i) (mod 2^61-1)
 
-                    To compute the recovery packet R we process the calculations
-                    for the first word from all of the file pieces to produce a
-                    single word of output.  This is a matrix-vector product
+                    To compute the recovery packet R, fp61::Encoder processes
+                    a strip of words from all of the file pieces to produce a
+                    strip of output.  This is a matrix-vector product
                     between file data f_i (treated as Fp words) and randomly
                     chosen generator matrix coefficients m_i.
 
                     Lazy reduction can be used to simplify the add steps.
 
-                    Then we continue to the next word for all the file pieces,
-                    producing the next word of output.
-
-                    It is possible to interleave the calculations for output
-                    words, and for input words to achieve higher throughput.
+                    Then it continues to the next strip for all the file pieces,
+                    producing the next strip of output.  The strip size is
+                    tuned so the working set stays in the L1 cache when the
+                    file pieces are much larger than the cache.
 
                     The number of words for each file piece can vary slightly
                     based on the data (if the data bytes do not fit evenly into
@@ -435,45 +401,32 @@ void RunBenchmarks()
                     The result is a set of 61-bit Fp words serialized to bytes,
                     that is about 8 bytes more than the original file sizes.
 
-                    The erasure code decoder (not implemented) would be able
-                    to take these recovery packets and fix lost data.
-                    The decoder performance would be fairly similar to the
+                    fp61::Decoder takes these recovery packets and fixes lost
+                    data.  The decoder performance is fairly similar to the
                     encoder performance for this type of erasure code, since
                     the runtime is dominated by this matrix-vector product.
                 */
 
-                original_data.resize(N);
-                for (unsigned s = 0; s < N; ++s)
+
                 {
-                    // Add 8 bytes padding to simplify tester
-                    original_data[s].resize(fileSizeBytes + 8);
+                    uint64_t t0 = GetTimeUsec();
 
-                    // Fill the data with random bytes
-                    for (unsigned r = 0; r < i; r += 8)
-                    {
-                        uint64_t w;
-                        if (prng.Next() % 100 <= 3) {
-                            w = ~(uint64_t)0;
-                        }
-                        else {
-                            w = prng.Next();
-                        }
-                        fp61::WriteU64_LE(&original_data[s][r], w);
-                    }
-                }
+                    unsigned recoveryBytes = encoder.Encode(&originals[0], N, fileSizeBytes, k, 0, &recovery_data[0]);
+
+                    uint64_t t1 = GetTimeUsec();
 
-                const unsigned maxRecoveryBytes = GetRecoveryBytes(fileSizeBytes);
-                recovery_data.resize(maxRecoveryBytes);
+                    sizeSum += recoveryBytes;
+                    timeSum += t1 - t0;
+                }
 
                 {
                     uint64_t t0 = GetTimeUsec();
 
-                    unsigned recoveryBytes = Encode(original_data, N, fileSizeBytes, k, &recovery_data[0]);
+                    encoder.EncodeMultiple(&originals[0], N, fileSizeBytes, k, 0, kMultiM, &multi_recovery[0]);
 
                     uint64_t t1 = GetTimeUsec();
 
-                    sizeSum += recoveryBytes;
-                    timeSum += t1 - t0;
+                    timeSum_multi += t1 - t0;
                 }
 
 #ifdef FP61_ENABLE_GF256_COMPARE
@@ -493,7 +446,12 @@ void RunBenchmarks()
             cout << " gf256_MBPS=" << (uint64_t)fileSizeBytes * N * kTrials / timeSum_gf256;
 #endif // FP61_ENABLE_GF256_COMPARE
             cout << " Fp61_MBPS=" << (uint64_t)fileSizeBytes * N * kTrials / timeSum;
+            cout << " Fp61x" << kMultiM << "_MBPS=" << (uint64_t)fileSizeBytes * N * kMultiM * kTrials / (timeSum_multi + (timeSum_multi == 0));
             cout << " Fp61_OutputBytes=" << sizeSum / (float)kTrials;
+#ifdef FP61_ENABLE_STATS
+            // Escapes per 1000 words relate the speed to the input data
+            cout << " Escapes_PerKWord=" << encoder.Stats.Escapes * 1000.0 / (encoder.Stats.Words + (encoder.Stats.Words == 0));
+#endif // FP61_ENABLE_STATS
             cout << endl;
         }
     }
@@ -501,14 +459,1251 @@ void RunBenchmarks()
 
 
 //------------------------------------------------------------------------------
-// Entrypoint
+// Data Pattern Benchmarks
+
+static const unsigned kPatternN = 16;
+static const unsigned kPatternM = 4;
 
-int main()
+static const unsigned kPatternBytes[] = {
+    1300, 65536
+};
+static const unsigned kPatternBytesCount = static_cast<unsigned>(sizeof(kPatternBytes) / sizeof(kPatternBytes[0]));
+
+// Timed runs for each case, after kPatternWarmupRuns untimed runs
+static const unsigned kPatternWarmRuns = 200;
+static const unsigned kPatternColdRuns = 30;
+static const unsigned kPatternWarmupRuns = 5;
+
+// Bytes written between cold runs to evict the data from all cache levels
+static const unsigned kEvictBytes = 64 * 1024 * 1024;
+static volatile uint8_t EvictSink = 0;
+
+/// Data to encode: Random words with a percentage of them all ones, which
+/// need an extra bit in ByteReader, or the contents of a file
+struct DataPattern
 {
-    cout << "Benchmarks for Fp61 erasure codes.  Before running the benchmarks please run the tests to make sure everything's working on your PC.  It's going to run quite a bit faster with 64-bit builds because it takes advantage of the speed of 64-bit multiplications." << endl;
+    std::string Name;
+    unsigned OnesPercent;
+    std::vector<uint8_t> FileData;
+};
+
+static void FillPattern(
+    const DataPattern& pattern,
+    fp61::Random& prng,
+    std::vector<std::vector<uint8_t>>& data,
+    unsigned bytes)
+{
+    for (unsigned s = 0; s < data.size(); ++s)
+    {
+        // Add 8 bytes padding for the 8-byte fills
+        data[s].resize(bytes + 8);
+
+        if (!pattern.FileData.empty())
+        {
+            // Consecutive pieces of the file, wrapping around at the end
+            const size_t fileBytes = pattern.FileData.size();
+            for (unsigned r = 0; r < bytes; ++r) {
+                data[s][r] = pattern.FileData[((size_t)s * bytes + r) % fileBytes];
+            }
+            continue;
+        }
+
+        for (unsigned r = 0; r < bytes; r += 8)
+        {
+            uint64_t w;
+            if (prng.Next() % 100 < pattern.OnesPercent) {
+                w = ~(uint64_t)0;
+            }
+            else {
+                w = prng.Next();
+            }
+            fp61::WriteU64_LE(&data[s][r], w);
+        }
+    }
+}
+
+// Returns the ambiguous words per 1000 words that ByteReader produces
+static double CountEscapesPerKWord(const std::vector<std::vector<uint8_t>>& data, unsigned bytes)
+{
+    std::vector<uint64_t> words(fp61::ByteReader::MaxWords(bytes));
+    uint64_t escapes = 0, total = 0;
+
+    for (const std::vector<uint8_t>& original : data)
+    {
+        fp61::ByteReader reader;
+        reader.BeginRead(&original[0], bytes);
+        const unsigned count = reader.ReadWords(&words[0], static_cast<unsigned>(words.size()));
+        for (unsigned j = 0; j < count; ++j) {
+            escapes += fp61::IsFpAmbiguous(words[j]) ? 1 : 0;
+        }
+        total += count;
+    }
+
+    return escapes * 1000.0 / (total + (total == 0));
+}
+
+/// Time and cycles of each timed run of one case
+struct PatternTimes
+{
+    std::vector<uint64_t> Nsec;
+    std::vector<uint64_t> Cycles;
+
+    /// Time the runs of fn(), calling evict() before each one if not null
+    template<typename Function, typename Evict>
+    void Measure(unsigned runs, Function fn, Evict evict)
+    {
+        Nsec.clear();
+        Cycles.clear();
+
+        for (unsigned run = 0; run < kPatternWarmupRuns + runs; ++run)
+        {
+            evict();
+
+            const uint64_t t0 = GetTimeNsec();
+            const uint64_t c0 = GetCycles();
+
+            fn();
+
+            const uint64_t c1 = GetCycles();
+            const uint64_t t1 = GetTimeNsec();
+
+            if (run >= kPatternWarmupRuns)
+            {
+                Nsec.push_back(t1 - t0);
+                Cycles.push_back(c1 - c0);
+            }
+        }
+
+        std::sort(Nsec.begin(), Nsec.end());
+        std::sort(Cycles.begin(), Cycles.end());
+    }
+
+    /// Returns the given percentile of the sorted run times
+    static uint64_t Percentile(const std::vector<uint64_t>& sorted, unsigned percent)
+    {
+        return sorted[(sorted.size() - 1) * percent / 100];
+    }
+
+    /// Print the median speed and cycles per byte, and the run percentiles
+    void Print(const char* name, uint64_t bytes) const
+    {
+        const uint64_t median = Percentile(Nsec, 50);
+        cout << " " << name << "_MBPS=" << bytes * 1000 / (median + (median == 0));
+        cout << " " << name << "_usec(p50/p90/p99)=" << fixed << setprecision(1)
+            << Percentile(Nsec, 50) / 1000.0 << "/" << Percentile(Nsec, 90) / 1000.0 << "/"
+            << Percentile(Nsec, 99) / 1000.0;
+#ifdef FP61_HAS_RDTSC
+        cout << " " << name << "_CyclesPerByte=" << setprecision(3) << Percentile(Cycles, 50) / (double)bytes;
+#endif
+        cout << defaultfloat;
+    }
+};
+
+/**
+    Encode kPatternN originals into kPatternM recovery packets for each data
+    pattern, warm and cold:
+
+    + warm: The same packets are encoded over and over, so they stay in cache.
+    + cold: A large buffer is written before each run, so the originals and
+      recovery packets come from memory, as for packets that just arrived.
+
+    Each run is timed, and the median, 90th and 99th percentiles are printed.
+    Cycles per byte are counted per byte of original data, using the
+    timestamp counter.  The data is generated before timing.
+*/
+void RunPatternBenchmarks(const std::vector<std::string>& filePaths)
+{
+    fp61::Random prng;
+    prng.Seed(8);
+
+    std::vector<DataPattern> patterns;
+    static const unsigned kOnesPercents[] = { 0, 1, 4, 10, 50, 100 };
+    for (unsigned onesPercent : kOnesPercents)
+    {
+        DataPattern pattern;
+        pattern.OnesPercent = onesPercent;
+        if (onesPercent == 0) {
+            pattern.Name = "random";
+        }
+        else if (onesPercent == 100) {
+            pattern.Name = "all-0xFF";
+        }
+        else {
+            pattern.Name = "ones-" + std::to_string(onesPercent) + "%";
+        }
+        patterns.push_back(pattern);
+    }
+    for (const std::string& path : filePaths)
+    {
+        DataPattern pattern;
+        pattern.Name = path;
+        pattern.OnesPercent = 0;
+
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file)
+        {
+            uint8_t buffer[65536];
+            size_t readBytes;
+            while ((readBytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+                pattern.FileData.insert(pattern.FileData.end(), buffer, buffer + readBytes);
+            }
+            fclose(file);
+        }
+        if (pattern.FileData.empty())
+        {
+            cout << "Could not read " << path << endl;
+            continue;
+        }
+        patterns.push_back(pattern);
+    }
+
+    fp61::Encoder encoder;
+    std::vector<std::vector<uint8_t>> original_data(kPatternN);
+    std::vector<const uint8_t*> originals(kPatternN);
+    std::vector<std::vector<uint8_t>> recovery_data(kPatternM);
+    std::vector<uint8_t*> recovery(kPatternM);
+    std::vector<uint8_t> evictBuffer(kEvictBytes);
+
+    cout << "Encode by data pattern with N = " << kPatternN << " and M = " << kPatternM << " :" << endl;
+
+    for (unsigned i = 0; i < kPatternBytesCount; ++i)
+    {
+        const unsigned bytes = kPatternBytes[i];
+
+        cout << "Testing file size = " << bytes << " bytes" << endl;
+
+        for (unsigned r = 0; r < kPatternM; ++r)
+        {
+            recovery_data[r].resize(fp61::GetRecoveryBytes(bytes));
+            recovery[r] = &recovery_data[r][0];
+        }
+
+        for (const DataPattern& pattern : patterns)
+        {
+            FillPattern(pattern, prng, original_data, bytes);
+            for (unsigned s = 0; s < kPatternN; ++s) {
+                originals[s] = &original_data[s][0];
+            }
+
+            auto encode = [&]() {
+                encoder.EncodeMultiple(&originals[0], kPatternN, bytes, 1, 0, kPatternM, &recovery[0]);
+            };
+#ifdef FP61_ENABLE_GF256_COMPARE
+            auto encodeGF256 = [&]() {
+                for (unsigned r = 0; r < kPatternM; ++r) {
+                    EncodeGF256(original_data, kPatternN, bytes, r, recovery[r]);
+                }
+            };
+#endif // FP61_ENABLE_GF256_COMPARE
+
+            auto noEvict = []() {};
+            uint8_t evictValue = 0;
+            auto evict = [&]() {
+                memset(&evictBuffer[0], ++evictValue, kEvictBytes);
+            };
+
+            const uint64_t totalBytes = (uint64_t)bytes * kPatternN;
+            PatternTimes times;
+
+            for (unsigned cold = 0; cold < 2; ++cold)
+            {
+                cout << pattern.Name << (cold ? " cold :" : " warm :");
+
+                const unsigned runs = cold ? kPatternColdRuns : kPatternWarmRuns;
+                if (cold) {
+                    times.Measure(runs, encode, evict);
+                }
+                else {
+                    times.Measure(runs, encode, noEvict);
+                }
+                times.Print("Fp61", totalBytes);
+
+#ifdef FP61_ENABLE_GF256_COMPARE
+                if (cold) {
+                    times.Measure(runs, encodeGF256, evict);
+                }
+                else {
+                    times.Measure(runs, encodeGF256, noEvict);
+                }
+                times.Print("gf256", totalBytes);
+#endif // FP61_ENABLE_GF256_COMPARE
+
+                cout << " Escapes_PerKWord=" << fixed << setprecision(1)
+                    << CountEscapesPerKWord(original_data, bytes) << defaultfloat << endl;
+            }
+        }
+    }
+
+    // Keep the evicting writes from being optimized away
+    EvictSink = evictBuffer[kEvictBytes / 2];
+}
+
+
+//------------------------------------------------------------------------------
+// ByteReader Benchmarks
+
+static const unsigned kReaderTrials = 100;
+
+// Compare the speed of ByteReader::Read() and ByteReader::ReadWords()
+void RunReaderBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(1);
+
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> words;
+
+    cout << "ByteReader Read() vs ReadWords() :" << endl;
+
+    for (unsigned i = 0; i < kFileSizesCount; ++i)
+    {
+        const unsigned fileSizeBytes = kFileSizes[i];
+        const unsigned maxWords = fp61::ByteReader::MaxWords(fileSizeBytes);
+
+        // Add 8 bytes padding to simplify tester
+        data.resize(fileSizeBytes + 8);
+        words.resize(maxWords);
+
+        // Fill the data with random bytes
+        for (unsigned r = 0; r < fileSizeBytes; r += 8)
+        {
+            uint64_t w;
+            if (prng.Next() % 100 <= 3) {
+                w = ~(uint64_t)0;
+            }
+            else {
+                w = prng.Next();
+            }
+            fp61::WriteU64_LE(&data[r], w);
+        }
+
+        // Repeat small reads enough to be measurable
+        const unsigned repeats = 1 + 1000000 / fileSizeBytes;
+
+        uint64_t timeSum_read = 0, timeSum_bulk = 0;
+        uint64_t check_read = 0, check_bulk = 0;
+
+        for (unsigned k = 0; k < kReaderTrials; ++k)
+        {
+            fp61::ByteReader reader;
+
+            uint64_t t0 = GetTimeUsec();
+
+            for (unsigned j = 0; j < repeats; ++j)
+            {
+                reader.BeginRead(&data[0], fileSizeBytes);
+
+                unsigned count = 0;
+                while (reader.Read(words[count]) == fp61::ReadResult::Success) {
+                    ++count;
+                }
+                check_read += words[count - 1];
+            }
+
+            uint64_t t1 = GetTimeUsec();
+
+            for (unsigned j = 0; j < repeats; ++j)
+            {
+                reader.BeginRead(&data[0], fileSizeBytes);
+
+                const unsigned count = reader.ReadWords(&words[0], maxWords);
+                check_bulk += words[count - 1];
+            }
+
+            uint64_t t2 = GetTimeUsec();
+
+            timeSum_read += t1 - t0;
+            timeSum_bulk += t2 - t1;
+        }
+
+        if (check_read != check_bulk) {
+            cout << "*** ReadWords() output mismatch!" << endl;
+        }
+
+        // Avoid divide by zero
+        timeSum_read += (timeSum_read == 0);
+        timeSum_bulk += (timeSum_bulk == 0);
+
+        const uint64_t totalBytes = (uint64_t)fileSizeBytes * repeats * kReaderTrials;
+
+        cout << "File size = " << fileSizeBytes << " bytes : ";
+        cout << " Read_MBPS=" << totalBytes / timeSum_read;
+        cout << " ReadWords_MBPS=" << totalBytes / timeSum_bulk;
+        cout << " Speedup=" << timeSum_read / (float)timeSum_bulk << "x";
+        cout << endl;
+    }
+
     cout << endl;
+}
 
-    gf256_init();
+
+//------------------------------------------------------------------------------
+// MulAddMem Benchmarks
+
+// Compare the speed of fp61::MulAddMem() to a Multiply() loop and gf256
+void RunMulAddBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(2);
+
+    cout << "MulAddMem vs Multiply() loop vs gf256_muladd_mem :" << endl;
+
+    for (unsigned i = 0; i < kFileSizesCount; ++i)
+    {
+        const unsigned fileSizeBytes = kFileSizes[i];
+        const unsigned words = (fileSizeBytes + 7) / 8;
+
+        std::vector<uint64_t> acc(words, 0), data(words);
+        for (unsigned j = 0; j < words; ++j) {
+            data[j] = prng.NextFp();
+        }
+
+        const unsigned repeats = 1 + 1000000 / fileSizeBytes;
+
+        uint64_t timeSum_loop = 0, timeSum_bulk = 0, timeSum_gf256 = 0;
+
+        for (unsigned k = 0; k < kReaderTrials; ++k)
+        {
+            const uint64_t coeff = prng.NextNonzeroFp();
+
+            uint64_t t0 = GetTimeUsec();
+
+            for (unsigned j = 0; j < repeats; ++j) {
+                for (unsigned w = 0; w < words; ++w) {
+                    acc[w] = fp61::PartialReduce(acc[w] + fp61::Multiply(coeff, data[w]));
+                }
+            }
+
+            uint64_t t1 = GetTimeUsec();
+
+            for (unsigned j = 0; j < repeats; ++j) {
+                fp61::MulAddMem(&acc[0], &data[0], coeff, words);
+            }
+
+            uint64_t t2 = GetTimeUsec();
+
+            for (unsigned j = 0; j < repeats; ++j) {
+                gf256_muladd_mem(&acc[0], (uint8_t)coeff | 1, &data[0], words * 8);
+            }
+
+            uint64_t t3 = GetTimeUsec();
+
+            timeSum_loop += t1 - t0;
+            timeSum_bulk += t2 - t1;
+            timeSum_gf256 += t3 - t2;
+        }
+
+        // Avoid divide by zero
+        timeSum_loop += (timeSum_loop == 0);
+        timeSum_bulk += (timeSum_bulk == 0);
+        timeSum_gf256 += (timeSum_gf256 == 0);
+
+        const uint64_t totalBytes = (uint64_t)words * 8 * repeats * kReaderTrials;
+
+        cout << "File size = " << fileSizeBytes << " bytes : ";
+        cout << " Multiply_MBPS=" << totalBytes / timeSum_loop;
+        cout << " MulAddMem_MBPS=" << totalBytes / timeSum_bulk;
+        cout << " gf256_MBPS=" << totalBytes / timeSum_gf256;
+        cout << endl;
+    }
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Polynomial Benchmarks
+
+static const unsigned kPolyDegrees[] = {
+    64, 256, 1024, 4096, 16384
+};
+static const unsigned kPolyDegreesCount = static_cast<unsigned>(sizeof(kPolyDegrees) / sizeof(kPolyDegrees[0]));
+
+// Time fp61_poly.h operations on polynomials with n coefficients and n points
+void RunPolyBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(4);
+
+    cout << "Polynomial operations by degree (microseconds per call) :" << endl;
+
+    for (unsigned i = 0; i < kPolyDegreesCount; ++i)
+    {
+        const unsigned n = kPolyDegrees[i];
+
+        std::vector<uint64_t> a(n), b(n), x(n), y(n), product(n * 2 - 1), poly(n);
+        prng.FillFp(&a[0], n);
+        prng.FillFp(&b[0], n);
+        prng.FillFp(&x[0], n);
+
+        // Keep the total work per row about the same
+        const unsigned repeats = 1 + 4000000 / (n * n);
+
+        uint64_t t0 = GetTimeUsec();
+
+        for (unsigned j = 0; j < repeats; ++j) {
+            fp61::PolyMultiply(&a[0], n, &b[0], n, &product[0]);
+        }
+
+        uint64_t t1 = GetTimeUsec();
+
+        for (unsigned j = 0; j < repeats; ++j) {
+            for (unsigned k = 0; k < n; ++k) {
+                y[k] = fp61::PolyEvaluate(&a[0], n, x[k]);
+            }
+        }
+
+        uint64_t t2 = GetTimeUsec();
+
+        for (unsigned j = 0; j < repeats; ++j) {
+            fp61::PolyEvaluateMany(&a[0], n, &x[0], n, &y[0]);
+        }
+
+        uint64_t t3 = GetTimeUsec();
+
+        bool success = true;
+        for (unsigned j = 0; j < repeats; ++j) {
+            success &= fp61::PolyInterpolate(&x[0], &y[0], n, &poly[0]);
+        }
+
+        uint64_t t4 = GetTimeUsec();
+
+        if (!success || poly != a)
+        {
+            cout << "Interpolation failed" << endl;
+            return;
+        }
+
+        cout << "n = " << n << " : ";
+        cout << " Multiply=" << (t1 - t0) / (double)repeats;
+        cout << " HornerEach=" << (t2 - t1) / (double)repeats;
+        cout << " EvaluateMany=" << (t3 - t2) / (double)repeats;
+        cout << " Interpolate=" << (t4 - t3) / (double)repeats;
+        cout << endl;
+    }
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Matrix Benchmarks
+
+static const unsigned kMatrixSizes[] = {
+    16, 64, 256
+};
+static const unsigned kMatrixSizesCount = static_cast<unsigned>(sizeof(kMatrixSizes) / sizeof(kMatrixSizes[0]));
+
+// Compare fp61::MatMul() to a DotProductStrided() for each entry of C,
+// and time InvertMatrix() and SolveLinear() with one column
+void RunMatrixBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(9);
+
+    cout << "Square matrix products (microseconds per call) :" << endl;
+
+    for (unsigned i = 0; i < kMatrixSizesCount; ++i)
+    {
+        const unsigned n = kMatrixSizes[i];
+
+        std::vector<uint64_t> A(n * n), B(n * n), C(n * n), D(n * n);
+        prng.FillFp(&A[0], n * n);
+        prng.FillFp(&B[0], n * n);
+
+        // Keep the total work per row about the same
+        const unsigned repeats = 1 + 50000000 / (n * n * n);
+
+        uint64_t t0 = GetTimeUsec();
+
+        for (unsigned j = 0; j < repeats; ++j) {
+            fp61::MatMul(&A[0], &B[0], &C[0], n, n, n);
+        }
+
+        uint64_t t1 = GetTimeUsec();
+
+        for (unsigned j = 0; j < repeats; ++j) {
+            for (unsigned r = 0; r < n; ++r) {
+                for (unsigned c = 0; c < n; ++c) {
+                    D[r * n + c] = fp61::DotProductStrided(&A[r * n], 1, &B[c], n, n);
+                }
+            }
+        }
+
+        uint64_t t2 = GetTimeUsec();
+
+        if (C != D)
+        {
+            cout << "MatMul mismatch" << endl;
+            return;
+        }
+
+        // Inversion overwrites its input, so each repeat starts from a copy
+        uint64_t invertUsec = 0, solveUsec = 0;
+
+        for (unsigned j = 0; j < repeats; ++j)
+        {
+            D = A;
+            uint64_t t3 = GetTimeUsec();
+            if (!fp61::InvertMatrix(&D[0], &C[0], n))
+            {
+                cout << "InvertMatrix failed" << endl;
+                return;
+            }
+            uint64_t t4 = GetTimeUsec();
+            invertUsec += t4 - t3;
+
+            D = A;
+            std::vector<uint64_t> x(&B[0], &B[0] + n);
+            uint64_t t5 = GetTimeUsec();
+            fp61::SolveLinear(&D[0], &x[0], n, 1);
+            uint64_t t6 = GetTimeUsec();
+            solveUsec += t6 - t5;
+        }
+
+        cout << "n = " << n << " : ";
+        cout << " MatMul=" << (t1 - t0) / (double)repeats;
+        cout << " DotProducts=" << (t2 - t1) / (double)repeats;
+        cout << " MatMul_NsPerProduct=" << (t1 - t0) * 1000.0 / ((double)repeats * n * n * n);
+        cout << " Invert=" << invertUsec / (double)repeats;
+        cout << " Solve=" << solveUsec / (double)repeats;
+        cout << endl;
+    }
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Codec Benchmarks
+
+static const unsigned kCodecN[] = {
+    8, 32, 128
+};
+static const unsigned kCodecNCount = static_cast<unsigned>(sizeof(kCodecN) / sizeof(kCodecN[0]));
+
+static const unsigned kCodecM = 4;
+static const unsigned kCodecTrials = 20;
+
+// Compare the speed of fp61::Encoder and fp61::Decoder with kCodecM losses
+void RunCodecBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(3);
+
+    fp61::Encoder encoder;
+    fp61::Decoder decoder;
+    fp61::CoefficientSet coefficientSet;
+
+    cout << "Encoder vs Decoder with M = " << kCodecM << " recovery packets and losses :" << endl;
+
+    for (unsigned i = 1; i < kFileSizesCount; ++i)
+    {
+        const unsigned fileSizeBytes = kFileSizes[i];
+
+        cout << "Testing file size = " << fileSizeBytes << " bytes" << endl;
+
+        for (unsigned j = 0; j < kCodecNCount; ++j)
+        {
+            const unsigned N = kCodecN[j];
+
+            std::vector<std::vector<uint8_t>> original_data(N), recovered_data(N);
+            std::vector<std::vector<uint8_t>> recovery_data(kCodecM);
+            std::vector<const uint8_t*> originals(N);
+            std::vector<uint8_t*> recovered(N);
+            std::vector<fp61::RecoveryPacket> packets(kCodecM);
+
+            for (unsigned s = 0; s < N; ++s)
+            {
+                original_data[s].resize(fileSizeBytes);
+                for (unsigned r = 0; r < fileSizeBytes; ++r) {
+                    original_data[s][r] = (uint8_t)prng.Next();
+                }
+                recovered_data[s].resize(fileSizeBytes);
+                recovered[s] = &recovered_data[s][0];
+            }
+            for (unsigned r = 0; r < kCodecM; ++r) {
+                recovery_data[r].resize(fp61::GetRecoveryBytes(fileSizeBytes));
+            }
+
+            // Repeat small packets enough to be measurable
+            const unsigned repeats = 1 + 100000 / (fileSizeBytes * N);
+
+            uint64_t timeSum_encode = 0, timeSum_multi = 0, timeSum_scratch = 0, timeSum_decode = 0;
+
+            const unsigned scratchBytes = fp61::QueryScratchBytes(N, fileSizeBytes, kCodecM);
+            std::vector<uint8_t> scratch(scratchBytes);
+            std::vector<uint8_t*> recovery(kCodecM);
+            for (unsigned r = 0; r < kCodecM; ++r) {
+                recovery[r] = &recovery_data[r][0];
+            }
+
+            for (unsigned k = 0; k < kCodecTrials; ++k)
+            {
+                for (unsigned s = 0; s < N; ++s) {
+                    originals[s] = &original_data[s][0];
+                }
+
+                uint64_t t0 = GetTimeUsec();
+
+                for (unsigned rep = 0; rep < repeats; ++rep)
+                {
+                    for (unsigned r = 0; r < kCodecM; ++r)
+                    {
+                        packets[r].Index = r;
+                        packets[r].Data = &recovery_data[r][0];
+                        packets[r].Bytes = encoder.Encode(&originals[0], N, fileSizeBytes, k, r, &recovery_data[r][0]);
+                    }
+                }
+
+                uint64_t t1 = GetTimeUsec();
+
+                for (unsigned rep = 0; rep < repeats; ++rep) {
+                    encoder.EncodeMultiple(&originals[0], N, fileSizeBytes, k, 0, kCodecM, &recovery[0]);
+                }
+
+                uint64_t t1m = GetTimeUsec();
+
+                const uint64_t* coefficients = coefficientSet.Get(k, 0, N, kCodecM);
+                for (unsigned rep = 0; rep < repeats; ++rep)
+                {
+                    fp61::EncodeWithScratch(
+                        &originals[0], N, fileSizeBytes, k, 0, kCodecM, &recovery[0],
+                        coefficients, &scratch[0], scratchBytes);
+                }
+
+                uint64_t t1s = GetTimeUsec();
+
+                // Lose the first kCodecM originals
+                for (unsigned s = 0; s < kCodecM && s < N; ++s) {
+                    originals[s] = nullptr;
+                }
+
+                uint64_t t2 = GetTimeUsec();
+
+                for (unsigned rep = 0; rep < repeats; ++rep)
+                {
+                    const fp61::CodecResult result = decoder.Decode(
+                        &originals[0], N, fileSizeBytes, k, &packets[0], kCodecM, &recovered[0]);
+
+                    if (result != fp61::CodecResult::Success)
+                    {
+                        cout << "Decoder failed" << endl;
+                        return;
+                    }
+                }
+
+                uint64_t t3 = GetTimeUsec();
+
+                timeSum_encode += t1 - t0;
+                timeSum_multi += t1m - t1;
+                timeSum_scratch += t1s - t1m;
+                timeSum_decode += t3 - t2;
+            }
+
+            if (recovered_data[0] != original_data[0]) {
+                cout << "Decoder produced the wrong data" << endl;
+                return;
+            }
+
+            // Avoid divide by zero
+            timeSum_encode += (timeSum_encode == 0);
+            timeSum_multi += (timeSum_multi == 0);
+            timeSum_scratch += (timeSum_scratch == 0);
+            timeSum_decode += (timeSum_decode == 0);
+
+            // Both sides process N packets for each of the kCodecM rows
+            const uint64_t totalBytes = (uint64_t)fileSizeBytes * N * kCodecM * repeats * kCodecTrials;
+
+            cout << "N = " << N << " : ";
+            cout << " Encode_MBPS=" << totalBytes / timeSum_encode;
+            cout << " EncodeMultiple_MBPS=" << totalBytes / timeSum_multi;
+            cout << " EncodeWithScratch_MBPS=" << totalBytes / timeSum_scratch;
+            cout << " Decode_MBPS=" << totalBytes / timeSum_decode;
+            cout << endl;
+        }
+    }
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Transform Encoder Benchmarks
+
+static const unsigned kTransformFileSizes[] = {
+    1000, 10000
+};
+static const unsigned kTransformFileSizesCount = static_cast<unsigned>(sizeof(kTransformFileSizes) / sizeof(kTransformFileSizes[0]));
+
+static const unsigned kTransformTrials = 3;
+
+// Compare fp61::TransformEncoder with Encoder::EncodeMultiple() over the
+// same N sweep as RunBenchmarks(), for kMultiM recovery packets and for
+// M = N recovery packets (rate 1/2).  Speeds are in bytes of original data
+// encoded per microsecond
+void RunTransformBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(5);
+
+    fp61::Encoder encoder;
+    fp61::TransformEncoder transform;
+
+    cout << "EncodeMultiple vs TransformEncoder (original MB/s) :" << endl;
+
+    for (unsigned i = 0; i < kTransformFileSizesCount; ++i)
+    {
+        const unsigned fileSizeBytes = kTransformFileSizes[i];
+
+        cout << "Testing file size = " << fileSizeBytes << " bytes" << endl;
+
+        for (unsigned j = 0; j < kFileNCount; ++j)
+        {
+            const unsigned N = kFileN[j];
+
+            std::vector<std::vector<uint8_t>> original_data(N), recovery_data(N);
+            std::vector<const uint8_t*> originals(N);
+            std::vector<uint8_t*> recovery(N);
+
+            for (unsigned s = 0; s < N; ++s)
+            {
+                original_data[s].resize(fileSizeBytes);
+                for (unsigned r = 0; r < fileSizeBytes; ++r) {
+                    original_data[s][r] = (uint8_t)prng.Next();
+                }
+                originals[s] = &original_data[s][0];
+
+                recovery_data[s].resize(fp61::GetTransformRecoveryBytes(fileSizeBytes));
+                recovery[s] = &recovery_data[s][0];
+            }
+
+            cout << "N = " << N << " :";
+
+            const unsigned ms[2] = { kMultiM < N ? kMultiM : N, N };
+            for (unsigned m = 0; m < 2; ++m)
+            {
+                const unsigned M = ms[m];
+
+                // Run the matrix-vector encoder for about the same time for each row
+                const unsigned repeats = 1 + 50000000 / (N * M * fileSizeBytes / 8);
+
+                uint64_t timeSum_multi = 0, timeSum_transform = 0;
+
+                for (unsigned k = 0; k < kTransformTrials; ++k)
+                {
+                    uint64_t t0 = GetTimeUsec();
+
+                    for (unsigned rep = 0; rep < repeats; ++rep) {
+                        encoder.EncodeMultiple(&originals[0], N, fileSizeBytes, k, 0, M, &recovery[0]);
+                    }
+
+                    uint64_t t1 = GetTimeUsec();
+
+                    for (unsigned rep = 0; rep < repeats; ++rep) {
+                        transform.Encode(&originals[0], N, fileSizeBytes, 0, M, &recovery[0]);
+                    }
+
+                    uint64_t t2 = GetTimeUsec();
+
+                    timeSum_multi += t1 - t0;
+                    timeSum_transform += t2 - t1;
+                }
+
+                // Avoid divide by zero
+                timeSum_multi += (timeSum_multi == 0);
+                timeSum_transform += (timeSum_transform == 0);
+
+                const uint64_t totalBytes = (uint64_t)fileSizeBytes * N * repeats * kTransformTrials;
+
+                cout << " M=" << M << ": Multiple_MBPS=" << totalBytes / timeSum_multi;
+                cout << " Transform_MBPS=" << totalBytes / timeSum_transform;
+            }
+            cout << endl;
+        }
+    }
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Parallel Encoder Benchmarks
+
+static const unsigned kParallelSizes[] = {
+    100000, 1000000
+};
+static const unsigned kParallelSizesCount = static_cast<unsigned>(sizeof(kParallelSizes) / sizeof(kParallelSizes[0]));
+
+static const unsigned kParallelN = 32;
+static const unsigned kParallelM = 4;
+static const unsigned kParallelTrials = 10;
+
+// Compare Encoder::EncodeMultiple() to ParallelEncoder on all hardware threads
+void RunParallelBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(4);
+
+    fp61::ThreadPool pool;
+    pool.Start();
+
+    fp61::Encoder encoder;
+    fp61::ParallelEncoder parallel;
+
+    cout << "Encoder vs ParallelEncoder with " << pool.GetWorkerCount() << " threads, N = "
+        << kParallelN << ", M = " << kParallelM << " :" << endl;
+
+    for (unsigned i = 0; i < kParallelSizesCount; ++i)
+    {
+        const unsigned fileSizeBytes = kParallelSizes[i];
+
+        std::vector<std::vector<uint8_t>> original_data(kParallelN);
+        std::vector<const uint8_t*> originals(kParallelN);
+        for (unsigned s = 0; s < kParallelN; ++s)
+        {
+            original_data[s].resize(fileSizeBytes);
+            for (unsigned r = 0; r < fileSizeBytes; ++r) {
+                original_data[s][r] = (uint8_t)prng.Next();
+            }
+            originals[s] = &original_data[s][0];
+        }
+
+        std::vector<std::vector<uint8_t>> recovery_data(kParallelM);
+        std::vector<uint8_t*> recovery(kParallelM);
+        for (unsigned r = 0; r < kParallelM; ++r)
+        {
+            recovery_data[r].resize(fp61::GetRecoveryBytes(fileSizeBytes));
+            recovery[r] = &recovery_data[r][0];
+        }
+
+        uint64_t timeSum_serial = 0, timeSum_parallel = 0;
+
+        for (unsigned k = 0; k < kParallelTrials; ++k)
+        {
+            uint64_t t0 = GetTimeUsec();
+
+            encoder.EncodeMultiple(&originals[0], kParallelN, fileSizeBytes, k, 0, kParallelM, &recovery[0]);
+
+            uint64_t t1 = GetTimeUsec();
+
+            parallel.EncodeMultiple(pool, &originals[0], kParallelN, fileSizeBytes, k, 0, kParallelM, &recovery[0]);
+
+            uint64_t t2 = GetTimeUsec();
+
+            timeSum_serial += t1 - t0;
+            timeSum_parallel += t2 - t1;
+        }
+
+        // Avoid divide by zero
+        timeSum_serial += (timeSum_serial == 0);
+        timeSum_parallel += (timeSum_parallel == 0);
+
+        const uint64_t totalBytes = (uint64_t)fileSizeBytes * kParallelN * kParallelM * kParallelTrials;
+
+        cout << "File size = " << fileSizeBytes << " bytes : ";
+        cout << " Serial_MBPS=" << totalBytes / timeSum_serial;
+        cout << " Parallel_MBPS=" << totalBytes / timeSum_parallel;
+        cout << endl;
+    }
+
+    pool.Stop();
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// File Encoder Benchmarks
+
+static const unsigned kFileBenchN = 16;
+static const unsigned kFileBenchM = 4;
+static const unsigned kFileBenchBytes = 4 * 1000 * 1000;
+static const unsigned kFileBenchTrials = 3;
+
+// Compare reading whole files into heap buffers for Encoder::EncodeMultiple()
+// to FileEncoder::EncodeFiles() over the mapped files.  The files are in the
+// page cache after the first trial, so this measures the copies, not the disk
+void RunFileBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(5);
+
+    std::vector<std::string> shardPaths(kFileBenchN), recoveryPaths(kFileBenchM);
+    std::vector<const char*> shardNames(kFileBenchN), recoveryNames(kFileBenchM);
+
+    std::vector<uint8_t> data(kFileBenchBytes);
+    for (unsigned i = 0; i < kFileBenchN; ++i)
+    {
+        for (unsigned r = 0; r < kFileBenchBytes; ++r) {
+            data[r] = (uint8_t)prng.Next();
+        }
+        shardPaths[i] = "fp61_bench_shard_" + std::to_string(i) + ".bin";
+        shardNames[i] = shardPaths[i].c_str();
+
+        FILE* file = fopen(shardNames[i], "wb");
+        if (!file || fwrite(&data[0], 1, kFileBenchBytes, file) != kFileBenchBytes)
+        {
+            cout << "Could not write benchmark files" << endl;
+            if (file) {
+                fclose(file);
+            }
+            return;
+        }
+        fclose(file);
+    }
+    for (unsigned r = 0; r < kFileBenchM; ++r)
+    {
+        recoveryPaths[r] = "fp61_bench_recovery_" + std::to_string(r) + ".bin";
+        recoveryNames[r] = recoveryPaths[r].c_str();
+    }
+
+    fp61::Encoder encoder;
+    fp61::FileEncoder fileEncoder;
+
+    uint64_t timeSum_heap = 0, timeSum_mapped = 0;
+
+    for (unsigned k = 0; k < kFileBenchTrials; ++k)
+    {
+        uint64_t t0 = GetTimeUsec();
+
+        {
+            std::vector<std::vector<uint8_t>> original_data(kFileBenchN);
+            std::vector<const uint8_t*> originals(kFileBenchN);
+            for (unsigned i = 0; i < kFileBenchN; ++i)
+            {
+                original_data[i].resize(kFileBenchBytes);
+                FILE* file = fopen(shardNames[i], "rb");
+                if (file)
+                {
+                    if (fread(&original_data[i][0], 1, kFileBenchBytes, file) != kFileBenchBytes) {
+                        cout << "Short read" << endl;
+                    }
+                    fclose(file);
+                }
+                originals[i] = &original_data[i][0];
+            }
+
+            std::vector<std::vector<uint8_t>> recovery_data(kFileBenchM);
+            std::vector<uint8_t*> recovery(kFileBenchM);
+            for (unsigned r = 0; r < kFileBenchM; ++r)
+            {
+                recovery_data[r].resize(fp61::GetRecoveryBytes(kFileBenchBytes));
+                recovery[r] = &recovery_data[r][0];
+            }
+
+            const unsigned recoveryBytes = encoder.EncodeMultiple(
+                &originals[0], kFileBenchN, kFileBenchBytes, k, 0, kFileBenchM, &recovery[0]);
+
+            for (unsigned r = 0; r < kFileBenchM; ++r)
+            {
+                FILE* file = fopen(recoveryNames[r], "wb");
+                if (file)
+                {
+                    fwrite(recovery[r], 1, recoveryBytes, file);
+                    fclose(file);
+                }
+            }
+        }
+
+        uint64_t t1 = GetTimeUsec();
+
+        if (fileEncoder.EncodeFiles(&shardNames[0], kFileBenchN, k, 0, kFileBenchM, &recoveryNames[0]) != fp61::FileResult::Success) {
+            cout << "FileEncoder failed" << endl;
+        }
+
+        uint64_t t2 = GetTimeUsec();
+
+        timeSum_heap += t1 - t0;
+        timeSum_mapped += t2 - t1;
+    }
+
+    // Avoid divide by zero
+    timeSum_heap += (timeSum_heap == 0);
+    timeSum_mapped += (timeSum_mapped == 0);
+
+    const uint64_t totalBytes = (uint64_t)kFileBenchBytes * kFileBenchN * kFileBenchTrials;
+
+    cout << "Heap buffers vs FileEncoder, N = " << kFileBenchN << " files of " << kFileBenchBytes
+        << " bytes, M = " << kFileBenchM << " :" << endl;
+    cout << " Heap_MBPS=" << totalBytes / timeSum_heap;
+    cout << " Mapped_MBPS=" << totalBytes / timeSum_mapped;
+    cout << " Heap_BufferBytes=" << (uint64_t)kFileBenchBytes * kFileBenchN + (uint64_t)fp61::GetRecoveryBytes(kFileBenchBytes) * kFileBenchM;
+    cout << endl;
+
+    for (unsigned i = 0; i < kFileBenchN; ++i) {
+        remove(shardNames[i]);
+    }
+    for (unsigned r = 0; r < kFileBenchM; ++r) {
+        remove(recoveryNames[r]);
+    }
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Encode Pipeline Benchmarks
+
+static const unsigned kPipelineBenchN = 8;
+static const unsigned kPipelineBenchM = 2;
+static const unsigned kPipelineBenchBytes = 1200;
+static const unsigned kPipelineBenchStripes = 2000;
+static const unsigned kPipelineBenchTrials = 5;
+
+// Small packets, where the per-stripe setup matters: A loop over a new
+// Encoder per stripe (reallocating and hashing the coefficients each time),
+// and the EncodePipeline with one worker per hardware thread
+void RunPipelineBenchmarks()
+{
+    fp61::Random prng;
+    prng.Seed(6);
+
+    std::vector<std::vector<uint8_t>> original_data(kPipelineBenchN, std::vector<uint8_t>(kPipelineBenchBytes));
+    std::vector<const uint8_t*> originals(kPipelineBenchN);
+    for (unsigned i = 0; i < kPipelineBenchN; ++i)
+    {
+        for (unsigned r = 0; r < kPipelineBenchBytes; ++r) {
+            original_data[i][r] = (uint8_t)prng.Next();
+        }
+        originals[i] = &original_data[i][0];
+    }
+
+    // Each stripe gets its own recovery buffers, as if they were queued for I/O
+    const unsigned recoveryBytes = fp61::GetRecoveryBytes(kPipelineBenchBytes);
+    std::vector<uint8_t> recovery_data((size_t)kPipelineBenchStripes * kPipelineBenchM * recoveryBytes);
+    std::vector<uint8_t*> recovery(kPipelineBenchStripes * kPipelineBenchM);
+    for (unsigned j = 0; j < kPipelineBenchStripes * kPipelineBenchM; ++j) {
+        recovery[j] = &recovery_data[(size_t)j * recoveryBytes];
+    }
+
+    std::vector<fp61::EncodeJob> jobs(kPipelineBenchStripes);
+    for (unsigned j = 0; j < kPipelineBenchStripes; ++j)
+    {
+        fp61::EncodeJob& job = jobs[j];
+        job.Originals = &originals[0];
+        job.N = kPipelineBenchN;
+        job.Bytes = kPipelineBenchBytes;
+        job.Seed = 1;
+        job.M = kPipelineBenchM;
+        job.Recovery = &recovery[j * kPipelineBenchM];
+    }
+
+    fp61::EncodePipeline pipeline;
+    pipeline.Start();
+
+    uint64_t timeSum_serial = 0, timeSum_pipeline = 0;
+
+    for (unsigned k = 0; k < kPipelineBenchTrials; ++k)
+    {
+        uint64_t t0 = GetTimeUsec();
+
+        for (unsigned j = 0; j < kPipelineBenchStripes; ++j)
+        {
+            fp61::Encoder encoder;
+            encoder.EncodeMultiple(&originals[0], kPipelineBenchN, kPipelineBenchBytes,
+                1, 0, kPipelineBenchM, &recovery[j * kPipelineBenchM]);
+        }
+
+        uint64_t t1 = GetTimeUsec();
+
+        for (unsigned j = 0; j < kPipelineBenchStripes; ++j) {
+            pipeline.Submit(&jobs[j]);
+        }
+        while (pipeline.WaitCompleted()) {
+        }
+
+        uint64_t t2 = GetTimeUsec();
+
+        timeSum_serial += t1 - t0;
+        timeSum_pipeline += t2 - t1;
+    }
+
+    // Avoid divide by zero
+    timeSum_serial += (timeSum_serial == 0);
+    timeSum_pipeline += (timeSum_pipeline == 0);
+
+    const fp61::PipelineStats stats = pipeline.GetStats();
+    pipeline.Stop();
+
+    const uint64_t totalBytes = (uint64_t)kPipelineBenchBytes * kPipelineBenchN * kPipelineBenchStripes * kPipelineBenchTrials;
+    const uint64_t count = stats.Encode.Count + (stats.Encode.Count == 0);
+
+    cout << "Encoder per stripe vs EncodePipeline with " << pipeline.GetWorkerCount() << " workers, N = "
+        << kPipelineBenchN << ", M = " << kPipelineBenchM << ", " << kPipelineBenchBytes << " bytes :" << endl;
+    cout << " Serial_MBPS=" << totalBytes / timeSum_serial;
+    cout << " Pipeline_MBPS=" << totalBytes / timeSum_pipeline;
+    cout << " MaxQueueDepth=" << stats.MaxQueueDepth;
+    cout << " QueueWait_usec=" << stats.QueueWait.TotalNsec / count / 1000;
+    cout << " Encode_usec=" << (double)stats.Encode.TotalNsec / count / 1000.;
+    cout << " Completion_usec=" << (double)stats.Completion.TotalNsec / count / 1000.;
+    cout << endl;
+
+    cout << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main(int argc, char** argv)
+{
+    // --patterns runs only the data pattern benchmarks, and each
+    // --file <path> adds the contents of a file as a data pattern
+    bool patternsOnly = false;
+    std::vector<std::string> filePaths;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], "--patterns")) {
+            patternsOnly = true;
+        }
+        else if (0 == strcmp(argv[i], "--file") && i + 1 < argc) {
+            filePaths.push_back(argv[++i]);
+        }
+        else
+        {
+            cout << "Usage: " << argv[0] << " [--patterns] [--file <path>]..." << endl;
+            return 1;
+        }
+    }
+
+    cout << "Benchmarks for Fp61 erasure codes.  Before running the benchmarks please run the tests to make sure everything's working on your PC.  It's going to run quite a bit faster with 64-bit builds because it takes advantage of the speed of 64-bit multiplications." << endl;
+    cout << endl;
+
+    gf256_init();
+    fp61::Init();
+
+    const fp61::KernelInfo& info = fp61::GetKernelInfo();
+    cout << "Fp61 kernels: MulAdd=" << info.MulAdd << " Read=" << info.Read
+        << " Write=" << info.Write
+        << " Random=" << info.Random << " Fp2=" << info.Fp2 << endl;
+    cout << endl;
+
+    if (patternsOnly)
+    {
+        RunPatternBenchmarks(filePaths);
+        return 0;
+    }
+
+    RunReaderBenchmarks();
+
+    RunMulAddBenchmarks();
+
+    RunPolyBenchmarks();
+
+    RunMatrixBenchmarks();
+
+    RunCodecBenchmarks();
+
+    RunTransformBenchmarks();
+
+    RunParallelBenchmarks();
+
+    RunFileBenchmarks();
+
+    RunPipelineBenchmarks();
+
+    RunPatternBenchmarks(filePaths);
 
     RunBenchmarks();
 
@@ -0,0 +1,695 @@
+/*
+    Copyright (c) 2018 Christopher A. Taylor.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+    * Neither the name of Fp61 nor the names of its contributors may be
+      used to endorse or promote products derived from this software without
+      specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../fp61.h"
+
+/**
+    Fp61 Microbenchmarks
+
+    Measures the cost of the individual primitives, to see where the time
+    goes in the erasure code benchmarks.
+
+    Arithmetic is measured two ways:
+
+    + latency: Each operation depends on the result of the previous one,
+      so this is the time from input to output.
+    + throughput: 8 independent chains are interleaved, so the CPU can
+      overlap them.  This is the cost when there is plenty of parallel work.
+
+    Streaming operations (reading/writing words, random numbers, bulk math)
+    are measured per word in a loop as they would be used.
+
+    Cycles are read with RDTSC on x86 where available.  Note that on most
+    modern CPUs the timestamp counter runs at a fixed reference frequency
+    rather than the current core clock, so treat it as a rough measure.
+
+    Run with --json to print the results as JSON for tracking regressions.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string.h> // memset, strcmp
+#include <vector>
+using namespace std;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h> // __rdtsc
+    #define FP61_HAS_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h> // __rdtsc
+    #define FP61_HAS_RDTSC
+#endif
+
+
+//------------------------------------------------------------------------------
+// Timing
+
+static uint64_t GetTimeNsec()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64_t GetCycles()
+{
+#ifdef FP61_HAS_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Results are folded into this to keep the compiler from removing the work
+static volatile uint64_t Sink = 0;
+
+struct BenchResult
+{
+    const char* Name;
+    const char* Mode;
+    double NsPerOp;
+    double CyclesPerOp;
+};
+
+static std::vector<BenchResult> Results;
+
+// Number of timed runs for each benchmark.  The fastest run is reported
+static const unsigned kRuns = 15;
+
+/**
+    Measure()
+
+    Calls fn() once to warm up and then kRuns times, recording the fastest
+    run.  fn() performs `ops` operations and returns a value that depends on
+    all of them.
+*/
+template<typename Function>
+static void Measure(const char* name, const char* mode, unsigned ops, Function fn)
+{
+    Sink = Sink + fn();
+
+    uint64_t bestNsec = ~(uint64_t)0, bestCycles = ~(uint64_t)0;
+
+    for (unsigned run = 0; run < kRuns; ++run)
+    {
+        const uint64_t t0 = GetTimeNsec();
+        const uint64_t c0 = GetCycles();
+
+        const uint64_t result = fn();
+
+        const uint64_t c1 = GetCycles();
+        const uint64_t t1 = GetTimeNsec();
+
+        Sink = Sink + result;
+
+        if (bestNsec > t1 - t0) {
+            bestNsec = t1 - t0;
+        }
+        if (bestCycles > c1 - c0) {
+            bestCycles = c1 - c0;
+        }
+    }
+
+    BenchResult result;
+    result.Name = name;
+    result.Mode = mode;
+    result.NsPerOp = bestNsec / (double)ops;
+#ifdef FP61_HAS_RDTSC
+    result.CyclesPerOp = bestCycles / (double)ops;
+#else
+    result.CyclesPerOp = -1.;
+#endif
+    Results.push_back(result);
+}
+
+
+//------------------------------------------------------------------------------
+// Arithmetic
+
+// Operations per timed run for the arithmetic benchmarks
+static const unsigned kArithOps = 1 << 20;
+
+// Operations per timed run for the slower Inverse() benchmarks
+static const unsigned kInverseOps = 1 << 14;
+
+// Batch size and batches per timed run for the InverseBatch() benchmark
+static const unsigned kInverseBatch = 256;
+static const unsigned kInverseBatchRuns = 64;
+
+// Independent chains per throughput benchmark
+static const unsigned kChains = 8;
+
+// Arbitrary constants that keep the values from settling
+static const uint64_t kOddMul = 0x1d8e4e27c47d124fULL & fp61::kPrime;
+static const uint64_t kOddAdd = 0x0b5ad4eceda1ce2aULL & fp61::kPrime;
+
+static void RunArithmeticBenchmarks(fp61::Random& prng)
+{
+    uint64_t seeds[kChains];
+    for (unsigned j = 0; j < kChains; ++j) {
+        seeds[j] = prng.NextFp();
+    }
+
+    // Multiply(): 62-bit result times 61-bit constant stays within 124 bits
+    Measure("Multiply", "latency", kArithOps, [&]() {
+        uint64_t x = seeds[0];
+        for (unsigned i = 0; i < kArithOps; ++i) {
+            x = fp61::Multiply(x, kOddMul);
+        }
+        return x;
+    });
+    Measure("Multiply", "throughput", kArithOps, [&]() {
+        uint64_t x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j] = seeds[j];
+        }
+        for (unsigned i = 0; i < kArithOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = fp61::Multiply(x[j], kOddMul);
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j];
+        }
+        return sum;
+    });
+
+    // ConstMultiplier: Same chains as Multiply(), with the quotient precomputed
+    fp61::ConstMultiplier constMul;
+    constMul.Initialize(kOddMul);
+
+    Measure("ConstMultiplier", "latency", kArithOps, [&]() {
+        uint64_t x = seeds[0];
+        for (unsigned i = 0; i < kArithOps; ++i) {
+            x = constMul.Multiply(x);
+        }
+        return x;
+    });
+    Measure("ConstMultiplier", "throughput", kArithOps, [&]() {
+        uint64_t x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j] = seeds[j];
+        }
+        for (unsigned i = 0; i < kArithOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = constMul.Multiply(x[j]);
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j];
+        }
+        return sum;
+    });
+
+    // PartialReduce(): 62-bit value plus a 61-bit constant fits in 64 bits
+    Measure("PartialReduce", "latency", kArithOps, [&]() {
+        uint64_t x = seeds[0];
+        for (unsigned i = 0; i < kArithOps; ++i) {
+            x = fp61::PartialReduce(x + kOddAdd);
+        }
+        return x;
+    });
+    Measure("PartialReduce", "throughput", kArithOps, [&]() {
+        uint64_t x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j] = seeds[j];
+        }
+        for (unsigned i = 0; i < kArithOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = fp61::PartialReduce(x[j] + kOddAdd);
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j];
+        }
+        return sum;
+    });
+
+    // Finalize(): Value < p plus a constant < p is below 0x3ffffffffffffffe
+    Measure("Finalize", "latency", kArithOps, [&]() {
+        uint64_t x = seeds[0];
+        for (unsigned i = 0; i < kArithOps; ++i) {
+            x = fp61::Finalize(x + kOddAdd);
+        }
+        return x;
+    });
+    Measure("Finalize", "throughput", kArithOps, [&]() {
+        uint64_t x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j] = seeds[j];
+        }
+        for (unsigned i = 0; i < kArithOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = fp61::Finalize(x[j] + kOddAdd);
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j];
+        }
+        return sum;
+    });
+
+    // Inverse(): Add 1 to the result so the chain does not repeat.
+    // If it hits p it continues from Inverse(p) = 0
+    Measure("Inverse", "latency", kInverseOps, [&]() {
+        uint64_t x = seeds[0] | 1;
+        for (unsigned i = 0; i < kInverseOps; ++i) {
+            x = fp61::Inverse(x) + 1;
+        }
+        return x;
+    });
+    Measure("Inverse", "throughput", kInverseOps, [&]() {
+        uint64_t x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j] = seeds[j] | 1;
+        }
+        for (unsigned i = 0; i < kInverseOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = fp61::Inverse(x[j]) + 1;
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j];
+        }
+        return sum;
+    });
+
+    // InverseCT(): Same chain as Inverse() for comparison
+    Measure("InverseCT", "latency", kInverseOps, [&]() {
+        uint64_t x = seeds[0] | 1;
+        for (unsigned i = 0; i < kInverseOps; ++i) {
+            x = fp61::InverseCT(x) + 1;
+        }
+        return x;
+    });
+    Measure("InverseCT", "throughput", kInverseOps, [&]() {
+        uint64_t x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j] = seeds[j] | 1;
+        }
+        for (unsigned i = 0; i < kInverseOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = fp61::InverseCT(x[j]) + 1;
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j];
+        }
+        return sum;
+    });
+
+    // Pow(): Random full 64-bit exponent
+    const uint64_t exponent = prng.Next() | (1ULL << 63);
+    Measure("Pow", "latency", kInverseOps, [&]() {
+        uint64_t x = seeds[0] | 1;
+        for (unsigned i = 0; i < kInverseOps; ++i) {
+            x = fp61::Pow(x, exponent) + 1;
+        }
+        return x;
+    });
+
+    // InverseBatch(): Per element of a batch of random values
+    std::vector<uint64_t> batchIn(kInverseBatch), batchOut(kInverseBatch);
+    for (unsigned i = 0; i < kInverseBatch; ++i) {
+        batchIn[i] = prng.NextFp();
+    }
+    Measure("InverseBatch", "throughput", kInverseBatch * kInverseBatchRuns, [&]() {
+        for (unsigned i = 0; i < kInverseBatchRuns; ++i) {
+            fp61::InverseBatch(&batchIn[0], &batchOut[0], kInverseBatch);
+        }
+        return batchOut[0];
+    });
+
+    // Fp2Multiply(): Partially reduced parts times a constant in Fp
+    fp61::Fp2 fp2Constant;
+    fp2Constant.Re = kOddMul;
+    fp2Constant.Im = seeds[1];
+    Measure("Fp2Multiply", "latency", kArithOps, [&]() {
+        fp61::Fp2 x;
+        x.Re = seeds[0], x.Im = seeds[2];
+        for (unsigned i = 0; i < kArithOps; ++i) {
+            x = fp61::Fp2Multiply(x, fp2Constant);
+        }
+        return x.Re + x.Im;
+    });
+    Measure("Fp2Multiply", "throughput", kArithOps, [&]() {
+        fp61::Fp2 x[kChains];
+        for (unsigned j = 0; j < kChains; ++j) {
+            x[j].Re = seeds[j], x[j].Im = seeds[kChains - 1 - j];
+        }
+        for (unsigned i = 0; i < kArithOps; i += kChains) {
+            for (unsigned j = 0; j < kChains; ++j) {
+                x[j] = fp61::Fp2Multiply(x[j], fp2Constant);
+            }
+        }
+        uint64_t sum = 0;
+        for (unsigned j = 0; j < kChains; ++j) {
+            sum += x[j].Re + x[j].Im;
+        }
+        return sum;
+    });
+}
+
+
+//------------------------------------------------------------------------------
+// Streaming
+
+// Bytes of input for the ByteReader benchmarks
+static const unsigned kStreamBytes = 64 * 1024;
+
+static void RunStreamingBenchmarks(fp61::Random& prng)
+{
+    std::vector<uint8_t> data(kStreamBytes);
+    for (unsigned i = 0; i < kStreamBytes; ++i) {
+        data[i] = (uint8_t)prng.Next();
+    }
+
+    const unsigned maxWords = fp61::ByteReader::MaxWords(kStreamBytes);
+    std::vector<uint64_t> words(maxWords);
+
+    // Count the words once so the ops are per word
+    fp61::ByteReader reader;
+    reader.BeginRead(&data[0], kStreamBytes);
+    const unsigned wordCount = reader.ReadWords(&words[0], maxWords);
+
+    Measure("ByteReader::Read", "stream", wordCount, [&]() {
+        fp61::ByteReader r;
+        r.BeginRead(&data[0], kStreamBytes);
+        uint64_t sum = 0, w;
+        while (r.Read(w) == fp61::ReadResult::Success) {
+            sum += w;
+        }
+        return sum;
+    });
+    Measure("ByteReader::ReadWords", "stream", wordCount, [&]() {
+        fp61::ByteReader r;
+        r.BeginRead(&data[0], kStreamBytes);
+        return (uint64_t)r.ReadWords(&words[0], maxWords) + words[0];
+    });
+
+    // Same bytes split into one quarter per lane
+    static const unsigned kLanes = fp61::kMultiReaderLanes;
+    const unsigned laneBytes = kStreamBytes / kLanes;
+    const unsigned laneMaxWords = fp61::ByteReader::MaxWords(laneBytes);
+    std::vector<uint64_t> laneWords(laneMaxWords * kLanes);
+    uint64_t* laneOut[kLanes];
+    for (unsigned lane = 0; lane < kLanes; ++lane) {
+        laneOut[lane] = &laneWords[lane * laneMaxWords];
+    }
+
+    Measure("MultiByteReader::ReadWords", "stream", wordCount, [&]() {
+        fp61::MultiByteReader r;
+        for (unsigned lane = 0; lane < kLanes; ++lane) {
+            r.BeginRead(lane, &data[lane * laneBytes], laneBytes);
+        }
+        unsigned counts[kLanes];
+        r.ReadWords(laneOut, laneMaxWords, counts);
+        return (uint64_t)counts[0] + laneWords[0];
+    });
+
+    std::vector<uint8_t> output(fp61::WordWriter::BytesNeeded(wordCount));
+
+    Measure("WordWriter::Write", "stream", wordCount, [&]() {
+        fp61::WordWriter writer;
+        writer.BeginWrite(&output[0]);
+        for (unsigned i = 0; i < wordCount; ++i) {
+            writer.Write(words[i]);
+        }
+        return (uint64_t)writer.Flush() + output[0];
+    });
+    Measure("WordWriter::WriteWords", "stream", wordCount, [&]() {
+        fp61::WordWriter writer;
+        writer.BeginWrite(&output[0]);
+        writer.WriteWords(&words[0], wordCount);
+        return (uint64_t)writer.Flush() + output[0];
+    });
+
+    // Fixed layout: Same data, with a word count that depends only on the size
+    const unsigned fixedWords = fp61::FixedByteReader::WordCount(kStreamBytes);
+    std::vector<uint64_t> fixed(fixedWords);
+
+    Measure("FixedByteReader::ReadWords", "stream", fixedWords, [&]() {
+        fp61::FixedByteReader r;
+        r.BeginRead(&data[0], kStreamBytes);
+        return (uint64_t)r.ReadWords(&fixed[0], fixedWords) + fixed[0];
+    });
+    Measure("FixedByteWriter::WriteWords", "stream", fixedWords, [&]() {
+        fp61::FixedByteWriter writer;
+        writer.BeginWrite(&output[0], kStreamBytes);
+        writer.WriteWords(&fixed[0], fixedWords);
+        return (uint64_t)writer.Flush() + output[0];
+    });
+
+    std::vector<uint64_t> acc(wordCount, 0);
+    const uint64_t coeff = prng.NextNonzeroFp();
+
+    Measure("MulAddMem", "stream", wordCount, [&]() {
+        fp61::MulAddMem(&acc[0], &words[0], coeff, wordCount);
+        return acc[0];
+    });
+
+    Measure("DotProduct", "stream", fixedWords, [&]() {
+        return fp61::DotProduct(&words[0], &fixed[0], fixedWords);
+    });
+    Measure("DotProductStrided", "stream", fixedWords / 2, [&]() {
+        return fp61::DotProductStrided(&words[0], 2, &fixed[0], 2, fixedWords / 2);
+    });
+
+    // Encoder inner loop for a 10 x 4 geometry over one chunk of words,
+    // per product: Unrolled kernel versus a MulAddMem() per input and output
+    static const unsigned kGeoN = 10, kGeoM = 4, kGeoWords = 512;
+    std::vector<uint64_t> geoCoeffs(kGeoN * kGeoM), geoSums(kGeoM * kGeoWords);
+    for (unsigned i = 0; i < kGeoN * kGeoM; ++i) {
+        geoCoeffs[i] = prng.NextNonzeroFp();
+    }
+    const fp61::FixedMulAddKernel geoKernel = fp61::GetFixedMulAddKernel(kGeoN, kGeoM);
+
+    Measure("FixedMulAdd 10x4", "stream", kGeoN * kGeoM * kGeoWords, [&]() {
+        geoKernel(&words[0], kGeoWords, &geoCoeffs[0], &geoSums[0], kGeoWords, kGeoWords);
+        return geoSums[0];
+    });
+    Measure("MulAddMem 10x4", "stream", kGeoN * kGeoM * kGeoWords, [&]() {
+        memset(&geoSums[0], 0, geoSums.size() * sizeof(uint64_t));
+        for (unsigned i = 0; i < kGeoN; ++i) {
+            for (unsigned r = 0; r < kGeoM; ++r) {
+                fp61::MulAddMem(&geoSums[r * kGeoWords], &words[i * kGeoWords], geoCoeffs[r * kGeoN + i], kGeoWords);
+            }
+        }
+        for (unsigned j = 0; j < kGeoM * kGeoWords; ++j) {
+            geoSums[j] = fp61::Finalize(geoSums[j]);
+        }
+        return geoSums[0];
+    });
+
+    // The same loop in scalar code, with Multiply() against ConstMultiplier
+    std::vector<fp61::ConstMultiplier> geoMuls(kGeoN * kGeoM);
+    for (unsigned i = 0; i < kGeoN * kGeoM; ++i) {
+        geoMuls[i].Initialize(geoCoeffs[i]);
+    }
+
+    Measure("Multiply 10x4", "stream", kGeoN * kGeoM * kGeoWords, [&]() {
+        memset(&geoSums[0], 0, geoSums.size() * sizeof(uint64_t));
+        for (unsigned i = 0; i < kGeoN; ++i) {
+            for (unsigned r = 0; r < kGeoM; ++r) {
+                const uint64_t* in = &words[i * kGeoWords];
+                uint64_t* sum = &geoSums[r * kGeoWords];
+                const uint64_t c = geoCoeffs[r * kGeoN + i];
+                for (unsigned j = 0; j < kGeoWords; ++j) {
+                    sum[j] = fp61::PartialReduce(sum[j] + fp61::Multiply(c, in[j]));
+                }
+            }
+        }
+        return geoSums[0];
+    });
+    Measure("ConstMultiplier 10x4", "stream", kGeoN * kGeoM * kGeoWords, [&]() {
+        memset(&geoSums[0], 0, geoSums.size() * sizeof(uint64_t));
+        for (unsigned i = 0; i < kGeoN; ++i) {
+            for (unsigned r = 0; r < kGeoM; ++r) {
+                const uint64_t* in = &words[i * kGeoWords];
+                uint64_t* sum = &geoSums[r * kGeoWords];
+                const fp61::ConstMultiplier cm = geoMuls[r * kGeoN + i];
+                for (unsigned j = 0; j < kGeoWords; ++j) {
+                    sum[j] = fp61::PartialReduce(sum[j] + cm.Multiply(in[j]));
+                }
+            }
+        }
+        return geoSums[0];
+    });
+
+    // Fp2 elements: Two words each, so half as many elements as words
+    const unsigned fp2Count = wordCount / 2;
+    std::vector<fp61::Fp2> fp2Acc(fp2Count), fp2Words(fp2Count);
+    for (unsigned i = 0; i < fp2Count; ++i)
+    {
+        fp2Acc[i].Re = fp2Acc[i].Im = 0;
+        fp2Words[i].Re = words[i * 2];
+        fp2Words[i].Im = words[i * 2 + 1];
+    }
+    fp61::Fp2 fp2Coeff;
+    fp2Coeff.Re = prng.NextNonzeroFp();
+    fp2Coeff.Im = prng.NextNonzeroFp();
+
+    Measure("Fp2MulMem", "stream", fp2Count, [&]() {
+        fp61::Fp2MulMem(&fp2Acc[0], &fp2Words[0], fp2Count);
+        return fp2Acc[0].Re;
+    });
+    Measure("Fp2MulAddMem", "stream", fp2Count, [&]() {
+        fp61::Fp2MulAddMem(&fp2Acc[0], &fp2Words[0], fp2Coeff, fp2Count);
+        return fp2Acc[0].Re;
+    });
+
+    Measure("Random::NextFp", "stream", kArithOps, [&]() {
+        fp61::Random r;
+        r.Seed(1);
+        uint64_t sum = 0;
+        for (unsigned i = 0; i < kArithOps; ++i) {
+            sum += r.NextFp();
+        }
+        return sum;
+    });
+
+    // Fill a buffer that fits in cache so the generator is measured
+    std::vector<uint64_t> randomWords(wordCount);
+
+    Measure("Random::FillFp", "stream", wordCount, [&]() {
+        fp61::Random r;
+        r.Seed(1);
+        r.FillFp(&randomWords[0], wordCount);
+        return randomWords[0];
+    });
+    Measure("Random::FillNonzeroFp", "stream", wordCount, [&]() {
+        fp61::Random r;
+        r.Seed(1);
+        r.FillNonzeroFp(&randomWords[0], wordCount);
+        return randomWords[0];
+    });
+}
+
+
+//------------------------------------------------------------------------------
+// Output
+
+static void PrintText()
+{
+    cout << left << setw(28) << "Primitive" << setw(12) << "Mode"
+        << right << setw(12) << "ns/op" << setw(14) << "cycles/op" << endl;
+
+    for (const BenchResult& result : Results)
+    {
+        cout << left << setw(28) << result.Name << setw(12) << result.Mode
+            << right << fixed << setprecision(3) << setw(12) << result.NsPerOp;
+        if (result.CyclesPerOp >= 0.) {
+            cout << setw(14) << result.CyclesPerOp;
+        }
+        else {
+            cout << setw(14) << "n/a";
+        }
+        cout << endl;
+    }
+}
+
+static void PrintJson()
+{
+    const fp61::KernelInfo& info = fp61::GetKernelInfo();
+
+    cout << "{" << endl;
+    cout << "  \"kernels\": { \"MulAdd\": \"" << info.MulAdd << "\", \"Read\": \""
+        << info.Read << "\", \"Write\": \""
+        << info.Write << "\", \"Random\": \"" << info.Random << "\", \"Fp2\": \"" << info.Fp2 << "\" }," << endl;
+    cout << "  \"results\": [" << endl;
+
+    for (size_t i = 0; i < Results.size(); ++i)
+    {
+        const BenchResult& result = Results[i];
+
+        cout << "    { \"name\": \"" << result.Name << "\", \"mode\": \"" << result.Mode
+            << "\", \"ns_per_op\": " << fixed << setprecision(3) << result.NsPerOp
+            << ", \"cycles_per_op\": ";
+        if (result.CyclesPerOp >= 0.) {
+            cout << result.CyclesPerOp;
+        }
+        else {
+            cout << "null";
+        }
+        cout << " }" << (i + 1 < Results.size() ? "," : "") << endl;
+    }
+
+    cout << "  ]" << endl;
+    cout << "}" << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Entrypoint
+
+int main(int argc, char** argv)
+{
+    bool json = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], "--json")) {
+            json = true;
+        }
+        else
+        {
+            cout << "Usage: " << argv[0] << " [--json]" << endl;
+            return 1;
+        }
+    }
+
+    fp61::Init();
+
+    fp61::Random prng;
+    prng.Seed(5);
+
+    RunArithmeticBenchmarks(prng);
+    RunStreamingBenchmarks(prng);
+
+    if (json) {
+        PrintJson();
+    }
+    else
+    {
+        const fp61::KernelInfo& info = fp61::GetKernelInfo();
+        cout << "Microbenchmarks for Fp61 primitives.  Fastest of " << kRuns << " runs." << endl;
+        cout << "Fp61 kernels: MulAdd=" << info.MulAdd << " Read=" << info.Read
+            << " Write=" << info.Write
+            << " Random=" << info.Random << " Fp2=" << info.Fp2 << endl;
+        cout << endl;
+        PrintText();
+    }
+
+    return 0;
+}
@@ -27,11 +27,21 @@
 */
 
 #include "../fp61.h"
-
+#include "../fp61_codec.h"
+#include "../fp61_file.h"
+#include "../fp61_matrix.h"
+#include "../fp61_parallel.h"
+#include "../fp61_pipeline.h"
+#include "../fp61_poly.h"
+
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <string>
 #include <vector>
+#include <string.h> // memcmp
+#include <algorithm> // std::swap, std::swap_ranges
 using namespace std;
 
 
@@ -89,6 +99,36 @@ static std::string HexString(uint64_t x)
     return ss.str();
 }
 
+/// Fill `bytes` bytes with random data, where each byte is 0xff with odds
+/// of ffOdds in 100.  Runs of 0xff bytes exercise the ambiguous words
+static void FillTestBytes(fp61::Random& prng, uint8_t* data, unsigned bytes, unsigned ffOdds)
+{
+    for (unsigned j = 0; j < bytes; ++j) {
+        data[j] = (prng.Next() % 100 < ffOdds) ? 0xff : static_cast<uint8_t>(prng.Next());
+    }
+}
+
+/// Fill N originals of `bytes` bytes with FillTestBytes() and point
+/// originals at them.  Each buffer has `padding` extra bytes after the data
+static void FillOriginals(
+    fp61::Random& prng,
+    unsigned N,
+    unsigned bytes,
+    unsigned ffOdds,
+    unsigned padding,
+    std::vector<std::vector<uint8_t>>& data,
+    std::vector<const uint8_t*>& originals)
+{
+    data.resize(N);
+    originals.resize(N);
+    for (unsigned i = 0; i < N; ++i)
+    {
+        data[i].resize(bytes + padding);
+        FillTestBytes(prng, data[i].data(), bytes, ffOdds);
+        originals[i] = data[i].data();
+    }
+}
+
 
 //------------------------------------------------------------------------------
 // Tests: Negate
@@ -518,6 +558,141 @@ static bool TestMultiply()
     return true;
 }
 
+static bool test_const_mul(const fp61::ConstMultiplier& cm, uint64_t x)
+{
+    const uint64_t r = cm.Multiply(x);
+    const uint64_t expected = fp61::Finalize(fp61::Multiply(fp61::PartialReduce(x), cm.Value));
+
+    if (r != expected) {
+        cout << "Failed (mismatch) for x=" << HexString(x) << ", c=" << HexString(cm.Value) << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    return true;
+}
+
+static bool TestConstMultiplier()
+{
+    cout << "TestConstMultiplier...";
+
+    fp61::Random prng;
+    prng.Seed(43);
+
+    static const unsigned kConstCount = 64;
+    uint64_t constants[kConstCount] = {
+        0, 1, 2, fp61::kPrime - 1, fp61::kPrime - 2, fp61::kPrime / 8, fp61::kPrime / 8 + 1
+    };
+    for (unsigned i = 7; i < kConstCount; ++i) {
+        constants[i] = prng.NextFp();
+    }
+
+    for (unsigned i = 0; i < kConstCount; ++i)
+    {
+        fp61::ConstMultiplier cm;
+        cm.Initialize(constants[i]);
+
+        // Any 64-bit input is allowed, including values above p
+        for (uint64_t x = 0; x < 1000; ++x) {
+            if (!test_const_mul(cm, x) ||
+                !test_const_mul(cm, fp61::kPrime - x) ||
+                !test_const_mul(cm, fp61::kPrime + x) ||
+                !test_const_mul(cm, MASK62 - x) ||
+                !test_const_mul(cm, MASK63 - x) ||
+                !test_const_mul(cm, MASK64 - x))
+            {
+                return false;
+            }
+        }
+
+        for (unsigned j = 0; j < kRandomTestLoops / 16; ++j) {
+            if (!test_const_mul(cm, prng.Next())) {
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: Compile-Time Arithmetic
+
+// Inputs that the compiler cannot see through, for the run-time results
+static volatile uint64_t ConstexprInputs[] = {
+    ~(uint64_t)0, fp61::kPrime - 1, 1, 12345
+};
+
+// Table computed at compile time by the constexpr arithmetic
+static constexpr uint64_t kConstexprTable[] = {
+    fp61::Finalize(fp61::PartialReduce(~(uint64_t)0)),
+    fp61::Finalize(fp61::Add4(fp61::kPrime - 1, 2, 0, 0)),
+    fp61::Negate(1),
+};
+static_assert(kConstexprTable[0] == 7, "2^64 - 1 = 8p + 7");
+static_assert(kConstexprTable[1] == 1, "(p - 1) + 2 = 1 (mod p)");
+static_assert(kConstexprTable[2] == fp61::kPrime - 1, "-1 = p - 1 (mod p)");
+
+#if defined(FP61_HAS_CONSTEXPR_MULTIPLY)
+
+static constexpr uint64_t ConstMultiplyAtCompileTime(uint64_t c, uint64_t x)
+{
+    fp61::ConstMultiplier cm;
+    cm.Initialize(c);
+    return cm.Multiply(x);
+}
+
+static constexpr uint64_t kConstexprProducts[] = {
+    fp61::Finalize(fp61::Multiply(fp61::kPrime - 1, fp61::kPrime - 1)),
+    ConstMultiplyAtCompileTime(fp61::kPrime - 1, 12345),
+    fp61::HashToNonzeroFp(12345),
+};
+static_assert(kConstexprProducts[0] == 1, "(-1)^2 = 1 (mod p)");
+static_assert(kConstexprProducts[1] == fp61::kPrime - 12345, "-12345 (mod p)");
+
+#endif // FP61_HAS_CONSTEXPR_MULTIPLY
+
+static bool TestConstexpr()
+{
+    cout << "TestConstexpr...";
+
+    const uint64_t ones = ConstexprInputs[0];
+    const uint64_t minusOne = ConstexprInputs[1];
+    const uint64_t one = ConstexprInputs[2];
+
+    if (kConstexprTable[0] != fp61::Finalize(fp61::PartialReduce(ones)) ||
+        kConstexprTable[1] != fp61::Finalize(fp61::Add4(minusOne, one + one, 0, 0)) ||
+        kConstexprTable[2] != fp61::Negate(one))
+    {
+        cout << "Failed (compile-time arithmetic mismatch)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+#if defined(FP61_HAS_CONSTEXPR_MULTIPLY)
+    const uint64_t x = ConstexprInputs[3];
+
+    fp61::ConstMultiplier cm;
+    cm.Initialize(minusOne);
+
+    if (kConstexprProducts[0] != fp61::Finalize(fp61::Multiply(minusOne, minusOne)) ||
+        kConstexprProducts[1] != cm.Multiply(x) ||
+        kConstexprProducts[2] != fp61::HashToNonzeroFp(x))
+    {
+        cout << "Failed (compile-time products mismatch)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+#endif // FP61_HAS_CONSTEXPR_MULTIPLY
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
 
 //------------------------------------------------------------------------------
 // Tests: Inverse
@@ -602,213 +777,399 @@ static bool TestMulInverse()
     return true;
 }
 
+static const unsigned kInverseBatchMax = 300;
 
-//------------------------------------------------------------------------------
-// Tests: ByteReader
-
-bool test_byte_reader(const uint8_t* data, unsigned bytes)
+static bool TestInverseBatch()
 {
-    fp61::ByteReader reader;
+    cout << "TestInverseBatch...";
 
-    reader.BeginRead(data, bytes);
+    fp61::Random prng;
+    prng.Seed(21);
 
-    // Round up to the next 61 bits
-    uint64_t expandedBits = bytes * 8;
-    unsigned actualReads = 0;
-    unsigned bits = 0;
-    bool packed = false;
-    unsigned packedBit = 0;
+    std::vector<uint64_t> in(kInverseBatchMax), out(kInverseBatchMax);
 
-    uint64_t fp;
-    while (fp61::ReadResult::Success == reader.Read(fp))
+    for (unsigned count = 0; count <= kInverseBatchMax; ++count)
     {
-        unsigned readStart = bits / 8;
-        if (readStart >= bytes)
+        // Vary the odds of inputs without an inverse
+        const unsigned zeroOdds = count % 4 * 10;
+
+        for (unsigned i = 0; i < count; ++i)
         {
-            // We can read one extra bit if the packing is the last thing
-            if (!packed || readStart != bytes)
+            const unsigned r = static_cast<unsigned>(prng.Next() % 100);
+            if (r < zeroOdds) {
+                in[i] = (r % 2 == 0) ? 0 : fp61::kPrime * (1 + r % 3);
+            }
+            else if (r < zeroOdds + 10) {
+                in[i] = prng.Next(); // Full 64-bit value
+            }
+            else {
+                in[i] = prng.NextFp();
+            }
+        }
+
+        fp61::InverseBatch(count > 0 ? &in[0] : nullptr, count > 0 ? &out[0] : nullptr, count);
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            if (out[i] != fp61::Inverse(in[i]))
             {
+                cout << "Failed (mismatch) for count=" << count << " i=" << i << " x=" << HexString(in[i]) << endl;
                 FP61_DEBUG_BREAK();
-                cout << "Failed (too many reads) for bytes=" << bytes << " actualReads=" << actualReads << endl;
                 return false;
             }
         }
+    }
 
-        int readBytes = (int)bytes - (int)readStart;
-        if (readBytes < 0) {
-            readBytes = 0;
-        }
-        else if (readBytes > 8) {
-            readBytes = 8;
-        }
+    cout << "Passed" << endl;
 
-        uint64_t x = fp61::ReadBytes_LE(data + readStart, readBytes) >> (bits % 8);
+    return true;
+}
 
-        int readBits = (readBytes * 8) - (bits % 8);
-        if (readBytes >= 8 && readBits > 0 && readBits < 61 && readStart + readBytes < bytes)
-        {
-            // Need to read one more byte sometimes
-            uint64_t high = data[readStart + readBytes];
-            high <<= readBits;
-            x |= high;
-        }
+static const unsigned kPowTrials = 10000;
 
-        // Test packing
-        if (packed)
-        {
-            x <<= 1;
-            x |= packedBit;
-            bits += 60;
-            ++expandedBits;
-        }
-        else
+static bool TestPow()
+{
+    cout << "TestPow...";
+
+    fp61::Random prng;
+    prng.Seed(22);
+
+    // Small exponents against repeated multiplication
+    for (unsigned i = 0; i < 100; ++i)
+    {
+        const uint64_t x = (i < 4) ? i * fp61::kPrime : prng.Next();
+
+        uint64_t expected = 1;
+        for (uint64_t e = 0; e < 70; ++e)
         {
-            bits += 61;
+            const uint64_t r = fp61::Pow(x, e);
+            if (r != expected)
+            {
+                cout << "Failed (small) for x = " << HexString(x) << " e = " << e << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+            expected = fp61::Finalize(fp61::Multiply(expected, fp61::PartialReduce(x)));
         }
+    }
 
-        x &= fp61::kPrime;
+    for (unsigned i = 0; i < kPowTrials; ++i)
+    {
+        const uint64_t x = prng.NextNonzeroFp();
+        const uint64_t e1 = prng.Next() >> 1;
+        const uint64_t e2 = prng.Next() >> 1;
 
-        packed = fp61::IsU64Ambiguous(x);
-        if (packed)
+        // x^e1 * x^e2 = x^(e1 + e2)
+        const uint64_t lhs = fp61::Finalize(fp61::Multiply(fp61::Pow(x, e1), fp61::Pow(x, e2)));
+        if (lhs != fp61::Pow(x, e1 + e2))
         {
-            packedBit = (x == fp61::kPrime);
-            x = fp61::kAmbiguityMask;
+            cout << "Failed (sum) for x = " << HexString(x) << endl;
+            FP61_DEBUG_BREAK();
+            return false;
         }
 
-        if (fp != x)
+        // Fermat: x^(p-1) = 1
+        if (fp61::Pow(x, fp61::kPrime - 1) != 1)
         {
+            cout << "Failed (Fermat) for x = " << HexString(x) << endl;
             FP61_DEBUG_BREAK();
-            cout << "Failed (wrong value) for bytes=" << bytes << " actualReads=" << actualReads << endl;
             return false;
         }
-        ++actualReads;
     }
 
-    const unsigned expectedReads = (unsigned)((expandedBits + 60) / 61);
-    if (actualReads != expectedReads)
-    {
-        FP61_DEBUG_BREAK();
-        cout << "Failed (read count wrong) for bytes=" << bytes << endl;
-        return false;
-    }
+    cout << "Passed" << endl;
 
-    const unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
-    if (maxWords < actualReads)
+    return true;
+}
+
+static const unsigned kInverseCTTrials = 100000;
+
+static bool TestInverseCT()
+{
+    cout << "TestInverseCT...";
+
+    fp61::Random prng;
+    prng.Seed(23);
+
+    for (unsigned i = 0; i < kInverseCTTrials; ++i)
     {
-        FP61_DEBUG_BREAK();
-        cout << "Failed (MaxWords wrong) for bytes=" << bytes << endl;
-        return false;
+        uint64_t x;
+        if (i < 8) {
+            x = i * fp61::kPrime; // Includes 0 and values above p
+        }
+        else if (i < 16) {
+            x = ~static_cast<uint64_t>(i - 8); // Near 2^64
+        }
+        else if (i % 2 == 0) {
+            x = prng.Next();
+        }
+        else {
+            x = prng.NextFp();
+        }
+
+        const uint64_t r = fp61::InverseCT(x);
+        if (r != fp61::Inverse(x))
+        {
+            cout << "Failed (mismatch) for x = " << HexString(x) << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+        if (r != fp61::Pow(x, fp61::kPrime - 2))
+        {
+            cout << "Failed (Pow) for x = " << HexString(x) << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
     }
 
+    cout << "Passed" << endl;
+
     return true;
 }
 
-bool TestByteReader()
+
+//------------------------------------------------------------------------------
+// Tests: MulAddMem
+
+static bool test_muladd_mem(
+    const std::vector<uint64_t>& acc,
+    const std::vector<uint64_t>& words,
+    uint64_t coeff,
+    unsigned count)
 {
-    cout << "TestByteReader...";
+    std::vector<uint64_t> actual = acc;
 
-    uint8_t data[10 + 8] = {
-        1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
-        0, 0, 0, 0, 0, 0, 0, 0 // Padding to simplify test
-    };
+    fp61::MulAddMem(&actual[0], &words[0], coeff, count);
 
-    uint64_t w = fp61::ReadU64_LE(data);
-    if (w != 0x0807060504030201ULL) {
-        cout << "Failed (ReadU64_LE)" << endl;
-        FP61_DEBUG_BREAK();
-        return false;
-    }
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if ((actual[i] >> 62) != 0)
+        {
+            cout << "Failed (high bit overflow) for count=" << count << " i=" << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
 
-    uint32_t u = fp61::ReadU32_LE(data);
-    if (u != 0x04030201UL) {
-        cout << "Failed (ReadU32_LE)" << endl;
-        FP61_DEBUG_BREAK();
-        return false;
-    }
+        const uint64_t expected = fp61::Finalize(
+            fp61::PartialReduce(acc[i] + fp61::Multiply(coeff, words[i])));
 
-    uint64_t z = fp61::ReadBytes_LE(data, 0);
-    if (z != 0) {
-        cout << "Failed (ReadBytes_LE 0)" << endl;
-        FP61_DEBUG_BREAK();
-        return false;
+        if (fp61::Finalize(actual[i]) != expected)
+        {
+            cout << "Failed (wrong result) for count=" << count << " i=" << i
+                << " coeff=" << HexString(coeff) << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
     }
 
-    for (unsigned i = 1; i <= 8; ++i)
+    // Words past the end must not be modified
+    for (unsigned i = count; i < acc.size(); ++i)
     {
-        uint64_t v = fp61::ReadBytes_LE(data, i);
-        uint64_t d = v ^ w;
-        d <<= 8 * (8 - i);
-        if (d != 0) {
-            cout << "Failed (ReadBytes_LE) for i = " << i << endl;
+        if (actual[i] != acc[i])
+        {
+            cout << "Failed (overwrite) for count=" << count << endl;
             FP61_DEBUG_BREAK();
             return false;
         }
     }
 
-    uint8_t simpledata[16 + 8] = {
-        0, 1, 2, 3, 4, 5, 6, 7,
-        8, 9, 10, 11, 12, 13, 14, 15,
-        0
-    };
+    return true;
+}
 
-    for (unsigned i = 0; i <= 16; ++i)
+static bool TestMulAddMem()
+{
+    cout << "TestMulAddMem...";
+
+    const unsigned kMaxCount = 100;
+
+    std::vector<uint64_t> acc(kMaxCount + 1), words(kMaxCount + 1);
+
+    // Largest inputs allowed by the preconditions
+    for (unsigned i = 0; i <= kMaxCount; ++i)
     {
-        if (!test_byte_reader(simpledata, i)) {
+        acc[i] = MASK62;
+        words[i] = MASK62;
+    }
+    for (unsigned count = 0; count <= kMaxCount; ++count)
+    {
+        if (!test_muladd_mem(acc, words, MASK61, count)) {
             return false;
         }
     }
 
-    uint8_t allones[16 + 8] = {
-        254,255,255,255,255,255,255,255,
-        255,255,255,255,255,255,255,255,
-        0
-    };
+    fp61::Random prng;
+    prng.Seed(17);
 
-    for (unsigned i = 0; i <= 16; ++i)
+    for (unsigned loop = 0; loop < kRandomTestLoops / 1000; ++loop)
     {
-        if (!test_byte_reader(allones, i)) {
+        const unsigned count = static_cast<unsigned>(prng.Next() % (kMaxCount + 1));
+
+        for (unsigned i = 0; i <= kMaxCount; ++i)
+        {
+            acc[i] = prng.Next() & MASK62;
+            words[i] = prng.Next() & MASK62;
+        }
+        const uint64_t coeff = prng.Next() & MASK61;
+
+        if (!test_muladd_mem(acc, words, coeff, count)) {
             return false;
         }
     }
 
-    uint8_t mixed[20 + 8] = {
-        254,255,255,255,255,255,255,255,0, // Inject a non-overflowing bit in the middle
-        255,255,255,255,255,255,255,
-        255,255,255,255,
-        0
-    };
+    // Accumulate a long sum of products without other reductions
+    fp61::Random coeff_prng;
+    coeff_prng.Seed(18);
 
-    for (unsigned i = 0; i <= 16; ++i)
+    std::vector<uint64_t> expected(kMaxCount, 0);
+    for (unsigned i = 0; i < kMaxCount; ++i) {
+        acc[i] = 0;
+    }
+    for (unsigned row = 0; row < 1000; ++row)
     {
-        if (!test_byte_reader(allones, i)) {
+        const uint64_t coeff = coeff_prng.NextNonzeroFp();
+        for (unsigned i = 0; i < kMaxCount; ++i)
+        {
+            words[i] = prng.NextFp();
+            expected[i] = fp61::PartialReduce(expected[i] + fp61::Multiply(coeff, words[i]));
+        }
+
+        fp61::MulAddMem(&acc[0], &words[0], coeff, kMaxCount);
+    }
+    for (unsigned i = 0; i < kMaxCount; ++i)
+    {
+        if (fp61::Finalize(acc[i]) != fp61::Finalize(expected[i]))
+        {
+            cout << "Failed (long sum) at i=" << i << endl;
+            FP61_DEBUG_BREAK();
             return false;
         }
     }
 
-    vector<uint8_t> randBytes(kMaxDataLength + 8, 0); // +8 to avoid bounds checking
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static bool TestDotProduct()
+{
+    cout << "TestDotProduct...";
+
+    const unsigned kMaxTerms = 300;
+    const unsigned kMaxStride = 4;
 
     fp61::Random prng;
-    prng.Seed(10);
+    prng.Seed(33);
 
-    for (unsigned i = 0; i < kMaxDataLength; ++i)
+    std::vector<uint64_t> a(kMaxTerms * kMaxStride), b(kMaxTerms * kMaxStride);
+
+    for (unsigned loop = 0; loop < 2000; ++loop)
     {
-        for (unsigned j = 0; j < 1; ++j)
+        const unsigned n = (loop < kMaxTerms) ? loop : static_cast<unsigned>(prng.Next() % (kMaxTerms + 1));
+        const unsigned aStride = 1 + static_cast<unsigned>(prng.Next() % kMaxStride);
+        const unsigned bStride = 1 + static_cast<unsigned>(prng.Next() % kMaxStride);
+
+        // Largest inputs allowed by the preconditions on every other loop,
+        // which fill the 128-bit sums the most
+        for (size_t i = 0; i < a.size(); ++i)
         {
-            // Fill the data with random bytes
-            for (unsigned k = 0; k < i; k += 8)
+            a[i] = (loop % 2 == 0) ? MASK61 : (prng.Next() & MASK61);
+            b[i] = (loop % 2 == 0) ? MASK61 - (i % 3) : (prng.Next() & MASK61);
+        }
+
+        uint64_t expected = 0, expectedStrided = 0;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            expected = fp61::Finalize(fp61::PartialReduce(expected + fp61::Multiply(a[i], b[i])));
+            expectedStrided = fp61::Finalize(fp61::PartialReduce(
+                expectedStrided + fp61::Multiply(a[i * aStride], b[i * bStride])));
+        }
+
+        if (fp61::DotProduct(&a[0], &b[0], n) != expected)
+        {
+            cout << "Failed (DotProduct) for n = " << n << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+        if (fp61::DotProductStrided(&a[0], aStride, &b[0], bStride, n) != expectedStrided)
+        {
+            cout << "Failed (DotProductStrided) for n = " << n << " strides " << aStride << ", " << bStride << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static bool TestFixedMulAdd()
+{
+    cout << "TestFixedMulAdd...";
+
+    static const unsigned kFixedN[] = { 4, 8, 10, 16, 32 };
+    const unsigned kMaxCount = 40;
+    const unsigned kStride = kMaxCount + 3;
+
+    fp61::Random prng;
+    prng.Seed(37);
+
+    std::vector<uint64_t> words(fp61::kFixedMaxN * kStride), coeffs(fp61::kFixedMaxN * fp61::kFixedMaxM);
+    std::vector<uint64_t> out(fp61::kFixedMaxM * kStride);
+
+    for (unsigned N : kFixedN)
+    {
+        for (unsigned M = 1; M <= fp61::kFixedMaxM; ++M)
+        {
+            const fp61::FixedMulAddKernel kernel = fp61::GetFixedMulAddKernel(N, M);
+            if (!kernel || fp61::GetFixedMulAddKernel(N + 1, M) || fp61::GetFixedMulAddKernel(N, fp61::kFixedMaxM + 1))
             {
-                uint64_t w;
-                if (prng.Next() % 100 <= 3) {
-                    w = ~(uint64_t)0;
+                cout << "Failed (lookup) for N = " << N << " M = " << M << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+
+            for (unsigned loop = 0; loop < 20; ++loop)
+            {
+                const unsigned count = (loop == 0) ? kMaxCount : static_cast<unsigned>(prng.Next() % (kMaxCount + 1));
+
+                // Largest inputs allowed by the preconditions on the first
+                // loops, which fill the lazy sums the most
+                for (size_t i = 0; i < words.size(); ++i) {
+                    words[i] = (loop < 2) ? MASK61 : (prng.Next() & MASK61);
                 }
-                else {
-                    w = prng.Next();
+                for (size_t i = 0; i < coeffs.size(); ++i) {
+                    coeffs[i] = (loop < 2) ? fp61::kPrime - 1 - loop * (i % 2) : prng.NextFp();
+                }
+                for (size_t i = 0; i < out.size(); ++i) {
+                    out[i] = 0xfeedface;
                 }
-                fp61::WriteU64_LE(&randBytes[k], w);
-            }
 
-            if (!test_byte_reader(&randBytes[0], i)) {
-                return false;
+                kernel(&words[0], kStride, &coeffs[0], &out[0], kStride, count);
+
+                for (unsigned r = 0; r < fp61::kFixedMaxM; ++r)
+                {
+                    for (unsigned j = 0; j < kStride; ++j)
+                    {
+                        uint64_t expected = 0xfeedface;
+                        if (r < M && j < count)
+                        {
+                            expected = 0;
+                            for (unsigned i = 0; i < N; ++i) {
+                                expected = fp61::Finalize(fp61::PartialReduce(
+                                    expected + fp61::Multiply(words[i * kStride + j], coeffs[r * N + i])));
+                            }
+                        }
+
+                        if (out[r * kStride + j] != expected)
+                        {
+                            cout << "Failed for N = " << N << " M = " << M << " count = " << count
+                                << " at r = " << r << " j = " << j << endl;
+                            FP61_DEBUG_BREAK();
+                            return false;
+                        }
+                    }
+                }
             }
         }
     }
@@ -820,110 +1181,193 @@ bool TestByteReader()
 
 
 //------------------------------------------------------------------------------
-// Tests: Random
+// Tests: Fp2
 
-static bool TestRandom()
+// Reference product with the four-multiply formula and full reductions
+static fp61::Fp2 Fp2MultiplyRef(const fp61::Fp2& x, const fp61::Fp2& y)
 {
-    cout << "TestRandom...";
+    const uint64_t a = fp61::Finalize(x.Re), b = fp61::Finalize(x.Im);
+    const uint64_t c = fp61::Finalize(y.Re), d = fp61::Finalize(y.Im);
+
+    fp61::Fp2 r;
+    r.Re = fp61::Finalize(fp61::PartialReduce(fp61::Multiply(a, c) +
+        fp61::Negate(fp61::Finalize(fp61::Multiply(b, d)))));
+    r.Im = fp61::Finalize(fp61::PartialReduce(fp61::Multiply(a, d) + fp61::Multiply(b, c)));
+    return r;
+}
 
-    for (int i = -1000; i < 1000; ++i)
+static bool Fp2Equal(const fp61::Fp2& x, const fp61::Fp2& y)
+{
+    const fp61::Fp2 fx = fp61::Fp2Finalize(x), fy = fp61::Fp2Finalize(y);
+    return fx.Re == fy.Re && fx.Im == fy.Im;
+}
+
+static bool Fp2PartsBelow(const fp61::Fp2& x, unsigned bits)
+{
+    return (x.Re >> bits) == 0 && (x.Im >> bits) == 0;
+}
+
+static bool TestFp2()
+{
+    cout << "TestFp2...";
+
+    fp61::Random prng;
+    prng.Seed(30);
+
+    // Each loop runs an Fp2Inverse(), so this runs fewer loops than the others
+    for (unsigned i = 0; i < kRandomTestLoops / 100; ++i)
     {
-        uint64_t loWord = static_cast<int64_t>(i);
-        loWord <<= 3; // Put it in the high bits
-        uint64_t loResult = fp61::Random::ConvertRandToFp(loWord);
+        // Largest inputs allowed by the preconditions, then random 62-bit parts
+        fp61::Fp2 x, y;
+        if (i == 0) {
+            x.Re = x.Im = y.Re = y.Im = MASK62;
+        }
+        else {
+            x.Re = prng.Next() & MASK62, x.Im = prng.Next() & MASK62;
+            y.Re = prng.Next() & MASK62, y.Im = prng.Next() & MASK62;
+        }
 
-        if (loResult >= fp61::kPrime)
+        const fp61::Fp2 product = fp61::Fp2Multiply(x, y);
+        const fp61::Fp2 square = fp61::Fp2Square(x);
+        const fp61::Fp2 sum = fp61::Fp2Add(x, y);
+        const fp61::Fp2 diff = fp61::Fp2Sub(sum, y);
+        const fp61::Fp2 conj = fp61::Fp2Conjugate(x);
+
+        if (!Fp2PartsBelow(product, 62) || !Fp2PartsBelow(square, 62) ||
+            !Fp2PartsBelow(sum, 62) || !Fp2PartsBelow(diff, 62) ||
+            !Fp2PartsBelow(conj, 62))
         {
-            cout << "Failed (RandToFp low) at i = " << i << endl;
+            cout << "Failed (overflow) at i = " << i << endl;
             FP61_DEBUG_BREAK();
             return false;
         }
 
-        uint64_t hiWord = fp61::kPrime + static_cast<int64_t>(i);
-        hiWord <<= 3; // Put it in the high bits
-        uint64_t hiResult = fp61::Random::ConvertRandToFp(hiWord);
-
-        if (hiResult >= fp61::kPrime)
+        if (!Fp2Equal(product, Fp2MultiplyRef(x, y)) ||
+            !Fp2Equal(square, Fp2MultiplyRef(x, x)) ||
+            !Fp2Equal(diff, x))
         {
-            cout << "Failed (RandToFp high) at i = " << i << endl;
+            cout << "Failed (arithmetic) at i = " << i << endl;
             FP61_DEBUG_BREAK();
             return false;
         }
-    }
 
-    for (int i = -1000; i < 1000; ++i)
-    {
-        uint64_t loWord = static_cast<int64_t>(i);
-        loWord <<= 3; // Put it in the high bits
-        uint64_t loResult = fp61::Random::ConvertRandToNonzeroFp(loWord);
-
-        if (loResult <= 0 || loResult >= fp61::kPrime)
+        // x + conj(x) = 2 * Re(x), and x * conj(x) is the norm in Fp
+        const fp61::Fp2 twiceRe = fp61::Fp2Finalize(fp61::Fp2Add(x, conj));
+        const fp61::Fp2 norm = fp61::Fp2Finalize(fp61::Fp2Multiply(x, conj));
+        if (twiceRe.Im != 0 || twiceRe.Re != fp61::Finalize(fp61::PartialReduce(x.Re * 2)) ||
+            norm.Im != 0)
         {
-            cout << "Failed (RandToNonzeroFp low) at i = " << i << endl;
+            cout << "Failed (conjugate) at i = " << i << endl;
             FP61_DEBUG_BREAK();
             return false;
         }
 
-        uint64_t hiWord = fp61::kPrime + static_cast<int64_t>(i);
-        hiWord <<= 3; // Put it in the high bits
-        uint64_t hiResult = fp61::Random::ConvertRandToNonzeroFp(hiWord);
-
-        if (hiResult <= 0 || hiResult >= fp61::kPrime)
+        const fp61::Fp2 inv = fp61::Fp2Inverse(x);
+        const fp61::Fp2 one = fp61::Fp2Finalize(fp61::Fp2Multiply(x, inv));
+        if (inv.Re >= fp61::kPrime || inv.Im >= fp61::kPrime ||
+            one.Re != 1 || one.Im != 0)
         {
-            cout << "Failed (RandToNonzeroFp high) at i = " << i << endl;
+            cout << "Failed (inverse) at i = " << i << endl;
             FP61_DEBUG_BREAK();
             return false;
         }
     }
 
+    // Zero has no inverse, and the inverse of a real value is in Fp
+    fp61::Fp2 zero, real;
+    zero.Re = zero.Im = 0;
+    real.Re = 12345, real.Im = fp61::kPrime;
+    const fp61::Fp2 zeroInv = fp61::Fp2Inverse(zero);
+    const fp61::Fp2 realInv = fp61::Fp2Inverse(real);
+    if (zeroInv.Re != 0 || zeroInv.Im != 0 ||
+        realInv.Re != fp61::Inverse(12345) || realInv.Im != 0)
+    {
+        cout << "Failed (special inverses)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
     cout << "Passed" << endl;
 
     return true;
 }
 
-
-//------------------------------------------------------------------------------
-// Tests: WordReader/WordWriter
-
-static bool TestWordSerialization()
+// Bulk kernels are compared to Fp2Multiply() with each set of kernels
+static bool TestFp2Mem()
 {
-    cout << "TestWordSerialization...";
+    cout << "TestFp2Mem...";
 
-    fp61::WordWriter writer;
-    fp61::WordReader reader;
+    const unsigned kMaxCount = 40;
 
     fp61::Random prng;
-    prng.Seed(11);
+    prng.Seed(31);
 
-    std::vector<uint8_t> data;
-    std::vector<uint64_t> wordData;
+    std::vector<fp61::Fp2> x(kMaxCount), y(kMaxCount), acc(kMaxCount), actual;
+    std::vector<fp61::Fp2> wide(kMaxCount), reduced(kMaxCount);
 
-    for (unsigned i = 1; i < kMaxDataLength; ++i)
+    for (unsigned loop = 0; loop < 200; ++loop)
     {
-        unsigned words = i;
-        unsigned bytesNeeded = fp61::WordWriter::BytesNeeded(words);
+        const unsigned count = loop % (kMaxCount + 1);
 
-        data.resize(bytesNeeded);
-        wordData.resize(words);
+        // Largest inputs allowed by the preconditions on the first loops
+        const uint64_t mask62 = (loop <= kMaxCount) ? 0 : MASK62;
+        const uint64_t mask61 = (loop <= kMaxCount) ? 0 : MASK61;
+        const uint64_t mask63 = (loop <= kMaxCount) ? 0 : MASK63;
+        for (unsigned i = 0; i < kMaxCount; ++i)
+        {
+            wide[i].Re = mask63 ? (prng.Next() & mask63) : MASK63;
+            wide[i].Im = mask63 ? (prng.Next() & mask63) : MASK63;
+            reduced[i].Re = fp61::PartialReduce(wide[i].Re);
+            reduced[i].Im = fp61::PartialReduce(wide[i].Im);
+            x[i].Re = mask62 ? (prng.Next() & mask62) : MASK62;
+            x[i].Im = mask62 ? (prng.Next() & mask62) : MASK62;
+            acc[i].Re = mask62 ? (prng.Next() & mask62) : MASK62;
+            acc[i].Im = mask62 ? (prng.Next() & mask62) : MASK62;
+            y[i].Re = mask61 ? (prng.Next() & mask61) : MASK61;
+            y[i].Im = mask61 ? (prng.Next() & mask61) : MASK61;
+        }
+        const fp61::Fp2 coeff = y[kMaxCount - 1];
 
-        writer.BeginWrite(&data[0]);
-        reader.BeginRead(&data[0], bytesNeeded);
+        actual = x;
+        fp61::Fp2MulMem(actual.data(), y.data(), count);
+        for (unsigned i = 0; i < kMaxCount; ++i)
+        {
+            const bool touched = i < count;
+            if ((touched && (!Fp2PartsBelow(actual[i], 62) ||
+                    !Fp2Equal(actual[i], fp61::Fp2Multiply(x[i], y[i])))) ||
+                (!touched && (actual[i].Re != x[i].Re || actual[i].Im != x[i].Im)))
+            {
+                cout << "Failed (Fp2MulMem) for count = " << count << " i = " << i << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
 
-        for (unsigned j = 0; j < words; ++j)
+        // Fp2MulMem() also accepts x parts up to 2^63
+        actual = wide;
+        fp61::Fp2MulMem(actual.data(), y.data(), count);
+        for (unsigned i = 0; i < count; ++i)
         {
-            // Generate a value from 0..p because the writer technically does not care about staying within the field
-            uint64_t w = prng.Next() & MASK61;
-            wordData[j] = w;
-            writer.Write(w);
+            if (!Fp2PartsBelow(actual[i], 62) ||
+                !Fp2Equal(actual[i], fp61::Fp2Multiply(reduced[i], y[i])) ||
+                !Fp2Equal(actual[i], fp61::Fp2Multiply(wide[i], y[i])))
+            {
+                cout << "Failed (Fp2MulMem wide) for count = " << count << " i = " << i << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
         }
-        writer.Flush();
 
-        for (unsigned j = 0; j < words; ++j)
+        actual = acc;
+        fp61::Fp2MulAddMem(actual.data(), x.data(), coeff, count);
+        for (unsigned i = 0; i < kMaxCount; ++i)
         {
-            uint64_t u = reader.Read();
-            if (u != wordData[j])
+            const bool touched = i < count;
+            const fp61::Fp2 expected = fp61::Fp2Add(acc[i], fp61::Fp2Multiply(x[i], coeff));
+            if ((touched && (!Fp2PartsBelow(actual[i], 62) || !Fp2Equal(actual[i], expected))) ||
+                (!touched && (actual[i].Re != acc[i].Re || actual[i].Im != acc[i].Im)))
             {
-                cout << "Failed (readback failed) at i = " << i << " j = " << j << endl;
+                cout << "Failed (Fp2MulAddMem) for count = " << count << " i = " << i << endl;
                 FP61_DEBUG_BREAK();
                 return false;
             }
@@ -937,76 +1381,2645 @@ static bool TestWordSerialization()
 
 
 //------------------------------------------------------------------------------
-// Tests: ByteWriter
+// Tests: ByteReader
 
-bool TestByteWriter()
+bool test_byte_reader(const uint8_t* data, unsigned bytes)
 {
-    cout << "TestByteWriter...";
-
     fp61::ByteReader reader;
-    fp61::ByteWriter writer;
 
-    fp61::Random prng;
-    prng.Seed(14);
+    reader.BeginRead(data, bytes);
 
-    std::vector<uint8_t> original, recovered;
+    // Round up to the next 61 bits
+    uint64_t expandedBits = bytes * 8;
+    unsigned actualReads = 0;
+    unsigned bits = 0;
+    bool packed = false;
+    unsigned packedBit = 0;
 
-    for (unsigned i = 1; i < kMaxDataLength; ++i)
+    uint64_t fp;
+    while (fp61::ReadResult::Success == reader.Read(fp))
     {
-        unsigned bytes = i;
-
-        for (unsigned j = 0; j < 10; ++j)
+        unsigned readStart = bits / 8;
+        if (readStart >= bytes)
         {
-            // Padding to simplify tester
-            original.resize(bytes + 8);
-
-            // Fill the data with random bytes
-            for (unsigned k = 0; k < i; k += 8)
+            // We can read one extra bit if the packing is the last thing
+            if (!packed || readStart != bytes)
             {
-                uint64_t w;
-                if (prng.Next() % 100 <= 3) {
-                    w = ~(uint64_t)0;
-                }
-                else {
-                    w = prng.Next();
-                }
-                fp61::WriteU64_LE(&original[k], w);
+                FP61_DEBUG_BREAK();
+                cout << "Failed (too many reads) for bytes=" << bytes << " actualReads=" << actualReads << endl;
+                return false;
             }
+        }
+
+        int readBytes = (int)bytes - (int)readStart;
+        if (readBytes < 0) {
+            readBytes = 0;
+        }
+        else if (readBytes > 8) {
+            readBytes = 8;
+        }
+
+        uint64_t x = fp61::ReadBytes_LE(data + readStart, readBytes) >> (bits % 8);
+
+        int readBits = (readBytes * 8) - (bits % 8);
+        if (readBytes >= 8 && readBits > 0 && readBits < 61 && readStart + readBytes < bytes)
+        {
+            // Need to read one more byte sometimes
+            uint64_t high = data[readStart + readBytes];
+            high <<= readBits;
+            x |= high;
+        }
+
+        // Test packing
+        if (packed)
+        {
+            x <<= 1;
+            x |= packedBit;
+            bits += 60;
+            ++expandedBits;
+        }
+        else
+        {
+            bits += 61;
+        }
+
+        x &= fp61::kPrime;
+
+        packed = fp61::IsU64Ambiguous(x);
+        if (packed)
+        {
+            packedBit = (x == fp61::kPrime);
+            x = fp61::kAmbiguityMask;
+        }
+
+        if (fp != x)
+        {
+            FP61_DEBUG_BREAK();
+            cout << "Failed (wrong value) for bytes=" << bytes << " actualReads=" << actualReads << endl;
+            return false;
+        }
+        ++actualReads;
+    }
+
+    const unsigned expectedReads = (unsigned)((expandedBits + 60) / 61);
+    if (actualReads != expectedReads)
+    {
+        FP61_DEBUG_BREAK();
+        cout << "Failed (read count wrong) for bytes=" << bytes << endl;
+        return false;
+    }
+
+    const unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
+    if (maxWords < actualReads)
+    {
+        FP61_DEBUG_BREAK();
+        cout << "Failed (MaxWords wrong) for bytes=" << bytes << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TestByteReader()
+{
+    cout << "TestByteReader...";
+
+    uint8_t data[10 + 8] = {
+        1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+        0, 0, 0, 0, 0, 0, 0, 0 // Padding to simplify test
+    };
+
+    uint64_t w = fp61::ReadU64_LE(data);
+    if (w != 0x0807060504030201ULL) {
+        cout << "Failed (ReadU64_LE)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    uint32_t u = fp61::ReadU32_LE(data);
+    if (u != 0x04030201UL) {
+        cout << "Failed (ReadU32_LE)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    uint64_t z = fp61::ReadBytes_LE(data, 0);
+    if (z != 0) {
+        cout << "Failed (ReadBytes_LE 0)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    for (unsigned i = 1; i <= 8; ++i)
+    {
+        uint64_t v = fp61::ReadBytes_LE(data, i);
+        uint64_t d = v ^ w;
+        d <<= 8 * (8 - i);
+        if (d != 0) {
+            cout << "Failed (ReadBytes_LE) for i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    uint8_t simpledata[16 + 8] = {
+        0, 1, 2, 3, 4, 5, 6, 7,
+        8, 9, 10, 11, 12, 13, 14, 15,
+        0
+    };
+
+    for (unsigned i = 0; i <= 16; ++i)
+    {
+        if (!test_byte_reader(simpledata, i)) {
+            return false;
+        }
+    }
+
+    uint8_t allones[16 + 8] = {
+        254,255,255,255,255,255,255,255,
+        255,255,255,255,255,255,255,255,
+        0
+    };
+
+    for (unsigned i = 0; i <= 16; ++i)
+    {
+        if (!test_byte_reader(allones, i)) {
+            return false;
+        }
+    }
+
+    uint8_t mixed[20 + 8] = {
+        254,255,255,255,255,255,255,255,0, // Inject a non-overflowing bit in the middle
+        255,255,255,255,255,255,255,
+        255,255,255,255,
+        0
+    };
+
+    for (unsigned i = 0; i <= 16; ++i)
+    {
+        if (!test_byte_reader(allones, i)) {
+            return false;
+        }
+    }
+
+    vector<uint8_t> randBytes(kMaxDataLength + 8, 0); // +8 to avoid bounds checking
+
+    fp61::Random prng;
+    prng.Seed(10);
+
+    for (unsigned i = 0; i < kMaxDataLength; ++i)
+    {
+        for (unsigned j = 0; j < 1; ++j)
+        {
+            // Fill the data with random bytes
+            for (unsigned k = 0; k < i; k += 8)
+            {
+                uint64_t w;
+                if (prng.Next() % 100 <= 3) {
+                    w = ~(uint64_t)0;
+                }
+                else {
+                    w = prng.Next();
+                }
+                fp61::WriteU64_LE(&randBytes[k], w);
+            }
+
+            if (!test_byte_reader(&randBytes[0], i)) {
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: ByteReader::ReadWords
+
+static bool test_read_words(const uint8_t* data, unsigned bytes, fp61::Random& prng)
+{
+    const unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
+
+    std::vector<uint64_t> expected(maxWords + 1), actual(maxWords + 1);
+
+    fp61::ByteReader reader;
+    reader.BeginRead(data, bytes);
+
+    unsigned expectedCount = 0;
+    while (reader.Read(expected[expectedCount]) == fp61::ReadResult::Success) {
+        ++expectedCount;
+    }
+
+    // Read it all in one call
+    reader.BeginRead(data, bytes);
+    unsigned actualCount = reader.ReadWords(&actual[0], maxWords + 1);
+
+    if (actualCount != expectedCount ||
+        0 != memcmp(&actual[0], &expected[0], expectedCount * sizeof(uint64_t)))
+    {
+        cout << "Failed (bulk read mismatch) for bytes=" << bytes << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    // Read it in random pieces, mixing in calls to Read()
+    reader.BeginRead(data, bytes);
+    actualCount = 0;
+    for (;;)
+    {
+        if (prng.Next() % 4 == 0)
+        {
+            if (reader.Read(actual[actualCount]) != fp61::ReadResult::Success) {
+                break;
+            }
+            ++actualCount;
+        }
+        else
+        {
+            const unsigned request = static_cast<unsigned>(prng.Next() % 40);
+            const unsigned count = reader.ReadWords(&actual[actualCount], request);
+            actualCount += count;
+            if (count < request) {
+                break;
+            }
+        }
+    }
+
+    if (actualCount != expectedCount ||
+        0 != memcmp(&actual[0], &expected[0], expectedCount * sizeof(uint64_t)))
+    {
+        cout << "Failed (mixed read mismatch) for bytes=" << bytes << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    // Read it in random fragments with ResumeRead(), copying each fragment
+    // after some unrelated bytes so that nothing can be read from before it
+    reader.BeginRead(nullptr, 0);
+    actualCount = 0;
+    std::vector<uint8_t> fragment;
+    unsigned offset = 0, leftover = 0;
+    uint8_t leftoverBytes[8];
+    for (;;)
+    {
+        unsigned fragmentBytes = 1 + static_cast<unsigned>(prng.Next() % ((prng.Next() % 2) ? 20 : 500));
+        if (fragmentBytes > bytes - offset) {
+            fragmentBytes = bytes - offset;
+        }
+        const bool final = (offset + fragmentBytes == bytes);
+
+        fragment.assign(8 + leftover + fragmentBytes, 0xa5);
+        if (leftover > 0) {
+            memcpy(&fragment[8], leftoverBytes, leftover);
+        }
+        if (fragmentBytes > 0) {
+            memcpy(&fragment[8 + leftover], data + offset, fragmentBytes);
+        }
+        offset += fragmentBytes;
+
+        reader.ResumeRead(&fragment[8], leftover + fragmentBytes);
+        if (final)
+        {
+            actualCount += reader.ReadWords(&actual[actualCount], maxWords + 1 - actualCount);
+            break;
+        }
+
+        const unsigned request = maxWords + 1 - actualCount;
+        const unsigned count = reader.ReadWordsPartial(&actual[actualCount], request);
+        actualCount += count;
+        leftover = reader.Bytes;
+        if (count >= request || leftover >= 8)
+        {
+            cout << "Failed (partial read stopped early) for bytes=" << bytes << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+        memcpy(leftoverBytes, reader.Data, leftover);
+    }
+
+    if (actualCount != expectedCount ||
+        0 != memcmp(&actual[0], &expected[0], expectedCount * sizeof(uint64_t)))
+    {
+        cout << "Failed (fragmented read mismatch) for bytes=" << bytes << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    // Skip random pieces, checking the words read after each skip
+    reader.BeginRead(data, bytes);
+    actualCount = 0;
+    for (;;)
+    {
+        const unsigned request = static_cast<unsigned>(prng.Next() % ((prng.Next() % 2) ? 40 : 1000));
+        const unsigned skipped = reader.SkipWords(request);
+        actualCount += skipped;
+        if (skipped < request) {
+            break;
+        }
+
+        uint64_t word;
+        if (reader.Read(word) != fp61::ReadResult::Success) {
+            break;
+        }
+        if (actualCount >= expectedCount || word != expected[actualCount])
+        {
+            cout << "Failed (skip mismatch) for bytes=" << bytes << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+        ++actualCount;
+    }
+
+    if (actualCount != expectedCount)
+    {
+        cout << "Failed (skip count mismatch) for bytes=" << bytes << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    return true;
+}
+
+static bool TestByteReaderReadWords()
+{
+    cout << "TestByteReaderReadWords...";
+
+    vector<uint8_t> randBytes(kMaxDataLength + 8, 0);
+
+    fp61::Random prng;
+    prng.Seed(15);
+
+    for (unsigned i = 0; i < kMaxDataLength; ++i)
+    {
+        // Vary the odds of an ambiguous word from none to all
+        const unsigned ffOdds = (i % 5) * 25;
+
+        // Fill the data with random bytes
+        for (unsigned k = 0; k < i; k += 8)
+        {
+            uint64_t w;
+            if (prng.Next() % 100 < ffOdds) {
+                w = ~(uint64_t)0;
+            }
+            else {
+                w = prng.Next();
+            }
+            fp61::WriteU64_LE(&randBytes[k], w);
+        }
+
+        if (!test_read_words(&randBytes[0], i, prng)) {
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+static bool TestMultiByteReader()
+{
+    cout << "TestMultiByteReader...";
+
+    static const unsigned kLanes = fp61::kMultiReaderLanes;
+
+    fp61::Random prng;
+    prng.Seed(34);
+
+    vector<uint8_t> laneBytes[kLanes];
+    vector<uint64_t> expected[kLanes], actual[kLanes];
+
+    for (unsigned trial = 0; trial < 400; ++trial)
+    {
+        // Mix long lanes with short and empty ones
+        unsigned bytes[kLanes];
+        for (unsigned lane = 0; lane < kLanes; ++lane)
+        {
+            const unsigned kind = (unsigned)(prng.Next() % 8);
+            if (kind == 0) {
+                bytes[lane] = 0;
+            }
+            else if (kind < 3) {
+                bytes[lane] = (unsigned)(prng.Next() % 64);
+            }
+            else {
+                bytes[lane] = 1000 + (unsigned)(prng.Next() % 1000);
+            }
+
+            // Vary the odds of an ambiguous word from none to all
+            const unsigned ffOdds = (trial % 5) * 25;
+
+            laneBytes[lane].resize(bytes[lane] + 8);
+            for (unsigned k = 0; k < bytes[lane]; k += 8)
+            {
+                uint64_t w;
+                if (prng.Next() % 100 < ffOdds) {
+                    w = ~(uint64_t)0;
+                }
+                else {
+                    w = prng.Next();
+                }
+                fp61::WriteU64_LE(&laneBytes[lane][k], w);
+            }
+
+            // Reference: Each lane read by its own ByteReader
+            fp61::ByteReader reader;
+            reader.BeginRead(&laneBytes[lane][0], bytes[lane]);
+            const unsigned maxWords = fp61::ByteReader::MaxWords(bytes[lane]);
+            expected[lane].resize(maxWords);
+            expected[lane].resize(reader.ReadWords(expected[lane].data(), maxWords));
+        }
+
+        fp61::MultiByteReader multi;
+        for (unsigned lane = 0; lane < kLanes; ++lane) {
+            multi.BeginRead(lane, &laneBytes[lane][0], bytes[lane]);
+        }
+
+        // Alternate between ReadWords() in varying amounts and Read()
+        unsigned counts[kLanes] = {};
+        uint64_t* outs[kLanes];
+        for (unsigned lane = 0; lane < kLanes; ++lane) {
+            actual[lane].resize(expected[lane].size() + 64);
+        }
+
+        for (unsigned round = 0; round < 1000; ++round)
+        {
+            unsigned done = 0;
+            for (unsigned lane = 0; lane < kLanes; ++lane) {
+                done += counts[lane] >= expected[lane].size() ? 1 : 0;
+            }
+            if (done == kLanes) {
+                break;
+            }
+
+            if (prng.Next() % 4 == 0)
+            {
+                uint64_t words[kLanes];
+                const unsigned mask = multi.Read(words);
+                for (unsigned lane = 0; lane < kLanes; ++lane)
+                {
+                    if (mask & (1u << lane)) {
+                        actual[lane][counts[lane]++] = words[lane];
+                    }
+                    else if (words[lane] != 0 || counts[lane] < expected[lane].size())
+                    {
+                        cout << "Failed (Read lane mask) for trial=" << trial << endl;
+                        FP61_DEBUG_BREAK();
+                        return false;
+                    }
+                }
+            }
+            else
+            {
+                const unsigned maxWords = 1 + (unsigned)(prng.Next() % 40);
+                for (unsigned lane = 0; lane < kLanes; ++lane) {
+                    outs[lane] = &actual[lane][counts[lane]];
+                }
+                unsigned readCounts[kLanes];
+                multi.ReadWords(outs, maxWords, readCounts);
+                for (unsigned lane = 0; lane < kLanes; ++lane)
+                {
+                    if (readCounts[lane] > maxWords ||
+                        (readCounts[lane] < maxWords &&
+                            counts[lane] + readCounts[lane] != expected[lane].size()))
+                    {
+                        cout << "Failed (ReadWords count) for trial=" << trial << endl;
+                        FP61_DEBUG_BREAK();
+                        return false;
+                    }
+                    counts[lane] += readCounts[lane];
+                }
+            }
+        }
+
+        for (unsigned lane = 0; lane < kLanes; ++lane)
+        {
+            if (counts[lane] != expected[lane].size())
+            {
+                cout << "Failed (word count) for trial=" << trial << " lane=" << lane << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+            for (unsigned j = 0; j < counts[lane]; ++j)
+            {
+                if (actual[lane][j] != expected[lane][j])
+                {
+                    cout << "Failed (word mismatch) for trial=" << trial << " lane=" << lane << endl;
+                    FP61_DEBUG_BREAK();
+                    return false;
+                }
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: Random
+
+static bool TestRandom()
+{
+    cout << "TestRandom...";
+
+    for (int i = -1000; i < 1000; ++i)
+    {
+        uint64_t loWord = static_cast<int64_t>(i);
+        loWord <<= 3; // Put it in the high bits
+        uint64_t loResult = fp61::Random::ConvertRandToFp(loWord);
+
+        if (loResult >= fp61::kPrime)
+        {
+            cout << "Failed (RandToFp low) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        uint64_t hiWord = fp61::kPrime + static_cast<int64_t>(i);
+        hiWord <<= 3; // Put it in the high bits
+        uint64_t hiResult = fp61::Random::ConvertRandToFp(hiWord);
+
+        if (hiResult >= fp61::kPrime)
+        {
+            cout << "Failed (RandToFp high) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    for (int i = -1000; i < 1000; ++i)
+    {
+        uint64_t loWord = static_cast<int64_t>(i);
+        loWord <<= 3; // Put it in the high bits
+        uint64_t loResult = fp61::Random::ConvertRandToNonzeroFp(loWord);
+
+        if (loResult <= 0 || loResult >= fp61::kPrime)
+        {
+            cout << "Failed (RandToNonzeroFp low) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        uint64_t hiWord = fp61::kPrime + static_cast<int64_t>(i);
+        hiWord <<= 3; // Put it in the high bits
+        uint64_t hiResult = fp61::Random::ConvertRandToNonzeroFp(hiWord);
+
+        if (hiResult <= 0 || hiResult >= fp61::kPrime)
+        {
+            cout << "Failed (RandToNonzeroFp high) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static bool TestRandomFill()
+{
+    cout << "TestRandomFill...";
+
+    fp61::Random prng;
+    prng.Seed(28);
+
+    std::vector<uint64_t> filled, expected;
+
+    for (unsigned count = 0; count < 1000; count += (count < 40) ? 1 : 97)
+    {
+        for (unsigned nonzero = 0; nonzero < 2; ++nonzero)
+        {
+            fp61::Random model = prng;
+
+            // Reference: one Next() seeds the interleaved xoshiro256+ lanes
+            fp61::Random lanes[fp61::kRandomFillLanes];
+            const uint64_t base = model.Next();
+            for (unsigned l = 0; l < fp61::kRandomFillLanes; ++l) {
+                for (unsigned k = 0; k < 4; ++k) {
+                    lanes[l].State[k] = fp61::HashU64(base + k * fp61::kRandomFillLanes + l);
+                }
+            }
+
+            expected.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+            {
+                fp61::Random& lane = lanes[i % fp61::kRandomFillLanes];
+                expected[i] = nonzero ? lane.NextNonzeroFp() : lane.NextFp();
+            }
+
+            // Guard words catch writes past the end
+            filled.assign(count + 1, ~(uint64_t)0);
+            if (nonzero) {
+                prng.FillNonzeroFp(filled.data(), count);
+            }
+            else {
+                prng.FillFp(filled.data(), count);
+            }
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                if (filled[i] != expected[i] ||
+                    filled[i] >= fp61::kPrime ||
+                    (nonzero && filled[i] == 0))
+                {
+                    cout << "Failed (value) at count = " << count << " i = " << i << endl;
+                    FP61_DEBUG_BREAK();
+                    return false;
+                }
+            }
+
+            if (filled[count] != ~(uint64_t)0)
+            {
+                cout << "Failed (overrun) at count = " << count << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+
+            // The main generator advances by exactly one Next()
+            for (unsigned k = 0; k < 4; ++k)
+            {
+                if (prng.State[k] != model.State[k])
+                {
+                    cout << "Failed (state) at count = " << count << endl;
+                    FP61_DEBUG_BREAK();
+                    return false;
+                }
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: WordReader/WordWriter
+
+static bool TestWordSerialization()
+{
+    cout << "TestWordSerialization...";
+
+    fp61::WordWriter writer;
+    fp61::WordReader reader;
+
+    fp61::Random prng;
+    prng.Seed(11);
+
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> wordData;
+
+    for (unsigned i = 1; i < kMaxDataLength; ++i)
+    {
+        unsigned words = i;
+        unsigned bytesNeeded = fp61::WordWriter::BytesNeeded(words);
+
+        data.resize(bytesNeeded);
+        wordData.resize(words);
+
+        writer.BeginWrite(&data[0]);
+        reader.BeginRead(&data[0], bytesNeeded);
+
+        for (unsigned j = 0; j < words; ++j)
+        {
+            // Generate a value from 0..p because the writer technically does not care about staying within the field
+            uint64_t w = prng.Next() & MASK61;
+            wordData[j] = w;
+            writer.Write(w);
+        }
+        writer.Flush();
+
+        for (unsigned j = 0; j < words; ++j)
+        {
+            uint64_t u = reader.Read();
+            if (u != wordData[j])
+            {
+                cout << "Failed (readback failed) at i = " << i << " j = " << j << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+
+        // Read it back again in pieces with ReadWords()
+        std::vector<uint64_t> readback(words);
+        reader.BeginRead(&data[0], bytesNeeded);
+
+        unsigned readCount = 0;
+        while (readCount < words)
+        {
+            unsigned request = static_cast<unsigned>(prng.Next() % 100);
+            if (request > words - readCount) {
+                request = words - readCount;
+            }
+            if (request == 0) {
+                readback[readCount++] = reader.Read();
+            }
+            else
+            {
+                reader.ReadWords(&readback[readCount], request);
+                readCount += request;
+            }
+        }
+
+        if (readback != wordData)
+        {
+            cout << "Failed (ReadWords readback failed) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static bool TestFixedPacking()
+{
+    cout << "TestFixedPacking...";
+
+    fp61::FixedByteReader reader;
+    fp61::FixedByteWriter writer;
+
+    fp61::Random prng;
+    prng.Seed(27);
+
+    std::vector<uint8_t> data, output;
+    std::vector<uint64_t> expected, actual;
+
+    for (unsigned bytes = 0; bytes < kMaxDataLength; ++bytes)
+    {
+        // Vary the odds of bytes that would be ambiguous for ByteReader
+        const unsigned ffOdds = (bytes % 5) * 25;
+
+        data.resize(bytes + 1);
+        FillTestBytes(prng, data.data(), bytes, ffOdds);
+
+        // The word count depends only on the byte count
+        const unsigned wordCount = fp61::FixedByteReader::WordCount(bytes);
+        if (wordCount != fp61::ByteReader::MaxWords(bytes))
+        {
+            cout << "Failed (word count) for bytes = " << bytes << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        expected.resize(wordCount + 1);
+        actual.resize(wordCount + 1);
+
+        reader.BeginRead(&data[0], bytes);
+        unsigned count = 0;
+        while (reader.Read(expected[count]) == fp61::ReadResult::Success)
+        {
+            // Words fit in 60 bits and can be read in any order
+            if (expected[count] > fp61::kFixedWordMask ||
+                expected[count] != reader.ReadWord(count))
+            {
+                cout << "Failed (word value) for bytes = " << bytes << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+            ++count;
+        }
+        if (count != wordCount)
+        {
+            cout << "Failed (read count) for bytes = " << bytes << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        // Read it back again in pieces with ReadWords()
+        reader.BeginRead(&data[0], bytes);
+        count = 0;
+        for (;;)
+        {
+            const unsigned request = static_cast<unsigned>(prng.Next() % 40);
+            const unsigned readCount = reader.ReadWords(&actual[count], request);
+            count += readCount;
+            if (readCount < request) {
+                break;
+            }
+        }
+        if (count != wordCount ||
+            0 != memcmp(&actual[0], &expected[0], wordCount * sizeof(uint64_t)))
+        {
+            cout << "Failed (ReadWords readback) for bytes = " << bytes << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        // Write the words back, mixing Write() and WriteWords(),
+        // and check that nothing is written past the end
+        output.assign(bytes + 16, 0xa5);
+        writer.BeginWrite(&output[0], bytes);
+        count = 0;
+        while (count < wordCount)
+        {
+            unsigned request = static_cast<unsigned>(prng.Next() % 40);
+            if (request > wordCount - count) {
+                request = wordCount - count;
+            }
+            if (request == 0) {
+                writer.Write(expected[count++]);
+            }
+            else
+            {
+                writer.WriteWords(&expected[count], request);
+                count += request;
+            }
+        }
+        const unsigned writtenBytes = writer.Flush();
+
+        if (writtenBytes != bytes ||
+            (bytes > 0 && 0 != memcmp(&output[0], &data[0], bytes)))
+        {
+            cout << "Failed (write readback) for bytes = " << bytes << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+        for (unsigned i = bytes; i < output.size(); ++i)
+        {
+            if (output[i] != 0xa5)
+            {
+                cout << "Failed (overrun) for bytes = " << bytes << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: WordWriter::WriteWords / ByteWriter::WriteWords
+
+// Write the words in random pieces, mixing in calls to Write()
+template<class WriterT>
+static unsigned write_words_mixed(
+    WriterT& writer,
+    uint8_t* data,
+    const uint64_t* words,
+    unsigned count,
+    fp61::Random& prng)
+{
+    writer.BeginWrite(data);
+
+    unsigned written = 0;
+    while (written < count)
+    {
+        if (prng.Next() % 4 == 0) {
+            writer.Write(words[written++]);
+        }
+        else
+        {
+            unsigned request = static_cast<unsigned>(prng.Next() % 200);
+            if (request > count - written) {
+                request = count - written;
+            }
+            writer.WriteWords(words + written, request);
+            written += request;
+        }
+    }
+
+    return writer.Flush();
+}
+
+static bool TestWriteWords()
+{
+    cout << "TestWriteWords...";
+
+    fp61::Random prng;
+    prng.Seed(16);
+
+    std::vector<uint8_t> expected, actual;
+    std::vector<uint64_t> wordData;
+
+    for (unsigned i = 1; i < kMaxDataLength; ++i)
+    {
+        const unsigned words = i;
+        const unsigned bytesNeeded = fp61::WordWriter::BytesNeeded(words);
+
+        expected.resize(bytesNeeded);
+        actual.resize(bytesNeeded);
+        wordData.resize(words);
+
+        // Sometimes include ambiguous words to exercise the ByteWriter
+        const unsigned ambiguousOdds = (i % 3) * 2;
+
+        for (unsigned j = 0; j < words; ++j)
+        {
+            uint64_t w = prng.Next() & MASK61;
+            if (prng.Next() % 100 < ambiguousOdds) {
+                w = fp61::kAmbiguityMask;
+            }
+            wordData[j] = w;
+        }
+
+        fp61::WordWriter wordWriter;
+        wordWriter.BeginWrite(&expected[0]);
+        for (unsigned j = 0; j < words; ++j) {
+            wordWriter.Write(wordData[j]);
+        }
+        unsigned expectedBytes = wordWriter.Flush();
+
+        unsigned actualBytes = write_words_mixed(wordWriter, &actual[0], &wordData[0], words, prng);
+
+        if (actualBytes != expectedBytes ||
+            0 != memcmp(&actual[0], &expected[0], expectedBytes))
+        {
+            cout << "Failed (WordWriter mismatch) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        fp61::ByteWriter byteWriter;
+        byteWriter.BeginWrite(&expected[0]);
+        for (unsigned j = 0; j < words; ++j) {
+            byteWriter.Write(wordData[j]);
+        }
+        expectedBytes = byteWriter.Flush();
+
+        actualBytes = write_words_mixed(byteWriter, &actual[0], &wordData[0], words, prng);
+
+        if (actualBytes != expectedBytes ||
+            0 != memcmp(&actual[0], &expected[0], expectedBytes))
+        {
+            cout << "Failed (ByteWriter mismatch) at i = " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: ByteWriter
+
+bool TestByteWriter()
+{
+    cout << "TestByteWriter...";
+
+    fp61::ByteReader reader;
+    fp61::ByteWriter writer;
+
+    fp61::Random prng;
+    prng.Seed(14);
+
+    std::vector<uint8_t> original, recovered;
+
+    for (unsigned i = 1; i < kMaxDataLength; ++i)
+    {
+        unsigned bytes = i;
+
+        for (unsigned j = 0; j < 10; ++j)
+        {
+            // Padding to simplify tester
+            original.resize(bytes + 8);
+
+            // Fill the data with random bytes
+            for (unsigned k = 0; k < i; k += 8)
+            {
+                uint64_t w;
+                if (prng.Next() % 100 <= 3) {
+                    w = ~(uint64_t)0;
+                }
+                else {
+                    w = prng.Next();
+                }
+                fp61::WriteU64_LE(&original[k], w);
+            }
+
+            reader.BeginRead(&original[0], bytes);
+
+            unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
+            unsigned maxBytes = fp61::ByteWriter::MaxBytesNeeded(maxWords);
+
+            recovered.resize(maxBytes);
+            writer.BeginWrite(&recovered[0]);
+
+            // Write words we get directly back out
+            uint64_t word;
+            while (reader.Read(word) != fp61::ReadResult::Empty) {
+                writer.Write(word);
+            }
+            unsigned writtenBytes = writer.Flush();
+
+            // TBD: Check if high bits are 0?
+
+            if (writtenBytes > maxBytes ||
+                writtenBytes > bytes + 8)
+            {
+                cout << "Failed (byte count mismatch) at i = " << i << " j = " << j << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+
+            if (0 != memcmp(&recovered[0], &original[0], bytes))
+            {
+                cout << "Failed (data corruption) at i = " << i << " j = " << j << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: Integration
+
+// Tests all of the serialization/deserialization and some math code
+bool TestIntegration()
+{
+    cout << "TestIntegration...";
+
+    std::vector<uint8_t> data, recovery, recovered;
+
+    fp61::Random prng;
+    prng.Seed(13);
+
+    // Test a range of data sizes
+    for (unsigned i = 1; i < kMaxDataLength; ++i)
+    {
+        unsigned bytes = i;
+
+        // Run a few tests for each size
+        for (unsigned j = 0; j < 10; ++j)
+        {
+            // Generate some test data:
+
+            // Allocate padded data to simplify tester
+            data.resize(bytes + 8);
+
+            // Fill the data with random bytes
+            for (unsigned k = 0; k < i; k += 8)
+            {
+                uint64_t w;
+                if (prng.Next() % 100 <= 3) {
+                    w = ~(uint64_t)0;
+                }
+                else {
+                    w = prng.Next();
+                }
+                fp61::WriteU64_LE(&data[k], w);
+            }
+
+            // Read data from the simulated packet,
+            // perform some example Fp operation on it,
+            // and then store it to a simulated recovery packet.
+
+            // Preallocate enough space in recovery packets for the worst case
+            const unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
+            recovery.resize(fp61::WordWriter::BytesNeeded(maxWords));
+
+            fp61::WordWriter recovery_writer;
+            recovery_writer.BeginWrite(&recovery[0]);
+
+            fp61::ByteReader original_reader;
+            original_reader.BeginRead(&data[0], bytes);
+
+            fp61::Random coeff_prng;
+            coeff_prng.Seed(bytes + j * 500000);
+
+            // Start reading words from the original file/packet,
+            // multiplying them by a random coefficient,
+            // and writing them to the recovery file/packet.
+            uint64_t r;
+            while (original_reader.Read(r) == fp61::ReadResult::Success)
+            {
+                // Pick random coefficient to multiply between 1..p-1
+                uint64_t coeff = coeff_prng.NextNonzeroFp();
+
+                // x = r * coeff (62 bits)
+                uint64_t x = fp61::Multiply(r, coeff);
+
+                // Finalize x (61 bits < p)
+                uint64_t f = fp61::Finalize(x);
+
+                // Write to recovery file/packet
+                recovery_writer.Write(f);
+            }
+
+            // Flush the remaining bits to the recovery file/packet
+            unsigned writtenRecoveryBytes = recovery_writer.Flush();
+
+            // Simulate reading data from the recovery file/packet
+            // and recovering the original data:
+
+            fp61::WordReader recovery_reader;
+            recovery_reader.BeginRead(&recovery[0], writtenRecoveryBytes);
+
+            // Allocate space for recovered data (may be up to 1.6% larger than needed)
+            const unsigned recoveryWords = fp61::WordReader::WordCount(writtenRecoveryBytes);
+            const unsigned maxBytes = fp61::ByteWriter::MaxBytesNeeded(recoveryWords);
+            recovered.resize(maxBytes);
+
+            fp61::ByteWriter original_writer;
+            original_writer.BeginWrite(&recovered[0]);
+
+            // Reproduce the same random sequence
+            coeff_prng.Seed(bytes + j * 500000);
+
+            // For each word to read:
+            const unsigned readWords = fp61::WordReader::WordCount(writtenRecoveryBytes);
+            for (unsigned i = 0; i < readWords; ++i)
+            {
+                // Pick random coefficient to multiply between 1..p-1
+                uint64_t coeff = coeff_prng.NextNonzeroFp();
+                uint64_t inv_coeff = fp61::Inverse(coeff);
+
+                // Read the next word (61 bits)
+                uint64_t f = recovery_reader.Read();
+
+                // Invert the multiplication (62 bits)
+                uint64_t x = fp61::Multiply(f, inv_coeff);
+
+                // Finalize x (61 bits < p)
+                x = fp61::Finalize(x);
+
+                // Write to recovered original data buffer
+                original_writer.Write(x);
+            }
+
+            // Flush the remaining bits to the recovered original file/packet
+            unsigned recoveredBytes = original_writer.Flush();
+
+            if (recoveredBytes > maxBytes ||
+                recoveredBytes > bytes + 8)
+            {
+                cout << "Failed (byte count mismatch) at i = " << i << " j = " << j << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+
+            if (0 != memcmp(&recovered[0], &data[0], bytes))
+            {
+                cout << "Failed (data corruption) at i = " << i << " j = " << j << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: Erasure Code
+
+static const unsigned kCoefficientSetTrials = 2000;
+
+static bool TestCoefficientSet()
+{
+    cout << "TestCoefficientSet...";
+
+    fp61::Random prng;
+    prng.Seed(24);
+
+    fp61::CoefficientSet coefficients;
+
+    for (unsigned i = 0; i < kCoefficientSetTrials; ++i)
+    {
+        // Mostly keep the same seed and N so that the cache gets extended
+        const uint64_t seed = prng.Next() % 3;
+        const unsigned N = 1 + static_cast<unsigned>(prng.Next() % 2) * 7;
+        const unsigned M = 1 + static_cast<unsigned>(prng.Next() % 8);
+        unsigned first = static_cast<unsigned>(prng.Next() % 300);
+        if (i % 50 == 0) {
+            first = ~0u - M + 1; // Last indices
+        }
+
+        const uint64_t* matrix = coefficients.Get(seed, first, N, M);
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            for (unsigned c = 0; c < N; ++c)
+            {
+                if (matrix[r * N + c] != fp61::GetCoefficient(seed, first + r, c))
+                {
+                    cout << "Failed (mismatch) at trial " << i << " row " << r << " column " << c << endl;
+                    FP61_DEBUG_BREAK();
+                    return false;
+                }
+            }
+        }
+
+        if (coefficients.M > fp61::kCodecMaxCachedRows && coefficients.M != M)
+        {
+            cout << "Failed (cache size) at trial " << i << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static const unsigned kCodecTrials = 400;
+
+static bool TestCodec()
+{
+    cout << "TestCodec...";
+
+    fp61::Random prng;
+    prng.Seed(19);
+
+    fp61::Encoder encoder;
+    fp61::Decoder decoder;
+
+    std::vector<std::vector<uint8_t>> data, recoveryData, recoveredData, multiData;
+    std::vector<const uint8_t*> originals;
+    std::vector<uint8_t*> recovered, multiPtrs;
+    std::vector<fp61::RecoveryPacket> packets;
+
+    for (unsigned trial = 0; trial < kCodecTrials; ++trial)
+    {
+        const unsigned N = 1 + static_cast<unsigned>(prng.Next() % 20);
+        const unsigned M = 1 + static_cast<unsigned>(prng.Next() % 8);
+        const unsigned bytes = 1 + static_cast<unsigned>(prng.Next() % ((trial % 4 == 0) ? 10000 : 300));
+        const uint64_t seed = prng.Next();
+
+        // Vary the density of ambiguous words between trials
+        const unsigned ffOdds = (trial % 5) * 25;
+
+        FillOriginals(prng, N, bytes, ffOdds, 0, data, originals);
+
+        recoveryData.resize(M);
+        packets.resize(M);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            recoveryData[r].resize(fp61::GetRecoveryBytes(bytes));
+            packets[r].Index = r;
+            packets[r].Data = &recoveryData[r][0];
+            packets[r].Bytes = encoder.Encode(&originals[0], N, bytes, seed, r, &recoveryData[r][0]);
+        }
+
+        // EncodeMultiple() must produce the same packets as Encode()
+        multiData.resize(M);
+        multiPtrs.resize(M);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            multiData[r].resize(fp61::GetRecoveryBytes(bytes));
+            multiPtrs[r] = &multiData[r][0];
+        }
+
+        const unsigned multiBytes = encoder.EncodeMultiple(&originals[0], N, bytes, seed, 0, M, &multiPtrs[0]);
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            if (multiBytes != packets[r].Bytes ||
+                0 != memcmp(&multiData[r][0], &recoveryData[r][0], multiBytes))
+            {
+                cout << "Failed (EncodeMultiple mismatch) at trial = " << trial << " r = " << r << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+
+        // Lose up to M originals
+        unsigned lossCount = 1 + static_cast<unsigned>(prng.Next() % M);
+        if (lossCount > N) {
+            lossCount = N;
+        }
+
+        recoveredData.resize(N);
+        recovered.resize(N);
+        for (unsigned i = 0; i < N; ++i)
+        {
+            recoveredData[i].assign(bytes, 0);
+            recovered[i] = &recoveredData[i][0];
+        }
+
+        for (unsigned lost = 0; lost < lossCount;)
+        {
+            const unsigned i = static_cast<unsigned>(prng.Next() % N);
+            if (originals[i])
+            {
+                originals[i] = nullptr;
+                ++lost;
+            }
+        }
+
+        // Drop some of the extra recovery packets in random positions
+        const unsigned packetCount = lossCount + static_cast<unsigned>(prng.Next() % (M - lossCount + 1));
+        for (unsigned r = 0; r < M; ++r)
+        {
+            const unsigned other = r + static_cast<unsigned>(prng.Next() % (M - r));
+            std::swap(packets[r], packets[other]);
+        }
+
+        if (lossCount > 1)
+        {
+            const fp61::CodecResult shortResult = decoder.Decode(
+                &originals[0], N, bytes, seed, &packets[0], lossCount - 1, &recovered[0]);
+
+            if (shortResult != fp61::CodecResult::NeedMoreData)
+            {
+                cout << "Failed (expected NeedMoreData) at trial = " << trial << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+
+        const fp61::CodecResult result = decoder.Decode(
+            &originals[0], N, bytes, seed, &packets[0], packetCount, &recovered[0]);
+
+        if (result != fp61::CodecResult::Success)
+        {
+            cout << "Failed (decode failed) at trial = " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        for (unsigned i = 0; i < N; ++i)
+        {
+            if (!originals[i] && recoveredData[i] != data[i])
+            {
+                cout << "Failed (data corruption) at trial = " << trial << " i = " << i << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+// Repeat a recovery packet, so that the decoder needs a different subset
+static bool TestDecoderRowSelection()
+{
+    cout << "TestDecoderRowSelection...";
+
+    fp61::Random prng;
+    prng.Seed(42);
+
+    fp61::Encoder encoder;
+    fp61::Decoder decoder;
+
+    static const unsigned N = 10, M = 4, bytes = 1000;
+
+    std::vector<std::vector<uint8_t>> data(N), recoveryData(M), recoveredData(N);
+    std::vector<const uint8_t*> originals(N);
+    std::vector<uint8_t*> recovered(N);
+
+    for (unsigned trial = 0; trial < 20; ++trial)
+    {
+        const uint64_t seed = prng.Next();
+
+        for (unsigned i = 0; i < N; ++i)
+        {
+            data[i].resize(bytes);
+            for (unsigned j = 0; j < bytes; ++j) {
+                data[i][j] = static_cast<uint8_t>(prng.Next());
+            }
+            originals[i] = &data[i][0];
+            recoveredData[i].assign(bytes, 0);
+            recovered[i] = &recoveredData[i][0];
+        }
+
+        fp61::RecoveryPacket packets[M];
+        for (unsigned r = 0; r < M; ++r)
+        {
+            recoveryData[r].resize(fp61::GetRecoveryBytes(bytes));
+            packets[r].Index = r;
+            packets[r].Data = &recoveryData[r][0];
+            packets[r].Bytes = encoder.Encode(&originals[0], N, bytes, seed, r, &recoveryData[r][0]);
+        }
+
+        const unsigned lossCount = 2 + trial % 2;
+        for (unsigned j = 0; j < lossCount; ++j) {
+            originals[(trial + j * 3) % N] = nullptr;
+        }
+
+        // Packets 0, 0, 1, ... : The first lossCount rows are singular
+        fp61::RecoveryPacket selected[M];
+        selected[0] = packets[0];
+        for (unsigned r = 1; r < M; ++r) {
+            selected[r] = packets[r - 1];
+        }
+
+        if (decoder.Decode(&originals[0], N, bytes, seed, selected, lossCount, &recovered[0]) !=
+            fp61::CodecResult::NeedMoreData)
+        {
+            cout << "Failed (expected NeedMoreData) at trial = " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        if (decoder.Decode(&originals[0], N, bytes, seed, selected, lossCount + 1, &recovered[0]) !=
+            fp61::CodecResult::Success)
+        {
+            cout << "Failed (decode failed) at trial = " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        for (unsigned i = 0; i < N; ++i)
+        {
+            if (!originals[i] && recoveredData[i] != data[i])
+            {
+                cout << "Failed (data corruption) at trial = " << trial << " i = " << i << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+static const unsigned kScratchTrials = 300;
+
+static bool TestEncodeWithScratch()
+{
+    cout << "TestEncodeWithScratch...";
+
+    fp61::Random prng;
+    prng.Seed(25);
+
+    fp61::Encoder encoder;
+    fp61::CoefficientSet coefficients;
+
+    std::vector<uint8_t> strided, scratch;
+    std::vector<std::vector<uint8_t>> expectedData;
+    std::vector<const uint8_t*> originals;
+    std::vector<uint8_t*> expectedPtrs, recoveryPtrs;
+    std::vector<uint8_t> recovery, stridedRecovery;
+
+    for (unsigned trial = 0; trial < kScratchTrials; ++trial)
+    {
+        const unsigned N = 1 + static_cast<unsigned>(prng.Next() % 20);
+        const unsigned M = 1 + static_cast<unsigned>(prng.Next() % 8);
+        const unsigned bytes = 1 + static_cast<unsigned>(prng.Next() % ((trial % 4 == 0) ? 10000 : 300));
+        const unsigned stride = bytes + static_cast<unsigned>(prng.Next() % 16);
+        const uint64_t seed = prng.Next();
+        const unsigned ffOdds = (trial % 3) * 40;
+
+        // Originals packed at a stride in one buffer
+        strided.resize(N * stride);
+        originals.resize(N);
+        for (unsigned i = 0; i < N; ++i)
+        {
+            FillTestBytes(prng, &strided[i * stride], bytes, ffOdds);
+            originals[i] = &strided[i * stride];
+        }
+
+        const unsigned recoveryBytes = fp61::GetRecoveryBytes(bytes);
+        expectedData.resize(M);
+        expectedPtrs.resize(M);
+        recoveryPtrs.resize(M);
+        recovery.resize(M * recoveryBytes);
+        stridedRecovery.resize(M * recoveryBytes);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            expectedData[r].resize(recoveryBytes);
+            expectedPtrs[r] = &expectedData[r][0];
+            recoveryPtrs[r] = &recovery[r * recoveryBytes];
+        }
+
+        const unsigned expectedBytes = encoder.EncodeMultiple(
+            &originals[0], N, bytes, seed, trial, M, &expectedPtrs[0]);
+
+        // Use an unaligned scratch buffer
+        const unsigned scratchBytes = fp61::QueryScratchBytes(N, bytes, M);
+        const unsigned misalign = trial % 8;
+        scratch.resize(scratchBytes + misalign);
+
+        // A scratch buffer that is too small is rejected
+        if (0 != fp61::EncodeWithScratch(
+            &originals[0], N, bytes, seed, trial, M, &recoveryPtrs[0],
+            nullptr, &scratch[misalign], scratchBytes - 1))
+        {
+            cout << "Failed (small scratch accepted)" << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        // Pointer array, hashing the coefficients into the scratch memory
+        const unsigned pointerBytes = fp61::EncodeWithScratch(
+            &originals[0], N, bytes, seed, trial, M, &recoveryPtrs[0],
+            nullptr, &scratch[misalign], scratchBytes);
+
+        // Strided, with cached coefficients
+        const uint64_t* matrix = coefficients.Get(seed, trial, N, M);
+        const unsigned stridedBytes = fp61::EncodeStridedWithScratch(
+            &strided[0], stride, N, bytes, seed, trial, M,
+            &stridedRecovery[0], recoveryBytes,
+            matrix, &scratch[misalign], scratchBytes);
+
+        if (pointerBytes != expectedBytes || stridedBytes != expectedBytes)
+        {
+            cout << "Failed (length) at trial " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            if (0 != memcmp(&expectedData[r][0], &recovery[r * recoveryBytes], expectedBytes) ||
+                0 != memcmp(&expectedData[r][0], &stridedRecovery[r * recoveryBytes], expectedBytes))
+            {
+                cout << "Failed (mismatch) at trial " << trial << " row " << r << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static const unsigned kStreamTrials = 200;
+
+static bool TestEncoderStream()
+{
+    cout << "TestEncoderStream...";
+
+    fp61::Random prng;
+    prng.Seed(26);
+
+    fp61::Encoder encoder;
+    fp61::EncoderStream stream;
+
+    std::vector<std::vector<uint8_t>> data, expectedData, recoveryData;
+    std::vector<const uint8_t*> originals;
+    std::vector<uint8_t*> expectedPtrs, recoveryPtrs;
+    std::vector<unsigned> offsets;
+
+    for (unsigned trial = 0; trial < kStreamTrials; ++trial)
+    {
+        const unsigned N = 1 + static_cast<unsigned>(prng.Next() % 12);
+        const unsigned M = 1 + static_cast<unsigned>(prng.Next() % 4);
+        const unsigned bytes = static_cast<unsigned>(prng.Next() % ((trial % 4 == 0) ? 20000 : 400));
+        const uint64_t seed = prng.Next();
+        const unsigned ffOdds = (trial % 3) * 40;
+
+        // Use a small window in some trials so that Append() pushes back
+        const unsigned windowWords = (trial % 2 == 0) ? 0 : 1 + static_cast<unsigned>(prng.Next() % 100);
+
+        // Fragments are small in some trials and network-sized in others
+        const unsigned maxFragment = (trial % 3 == 0) ? 16 : 4096;
+
+        FillOriginals(prng, N, bytes, ffOdds, 1, data, originals);
+        offsets.assign(N, 0);
+
+        const unsigned recoveryBytes = fp61::GetRecoveryBytes(bytes);
+        expectedData.resize(M);
+        recoveryData.resize(M);
+        expectedPtrs.resize(M);
+        recoveryPtrs.resize(M);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            expectedData[r].assign(recoveryBytes + 1, 0);
+            recoveryData[r].assign(recoveryBytes + 1, 0);
+            expectedPtrs[r] = &expectedData[r][0];
+            recoveryPtrs[r] = &recoveryData[r][0];
+        }
+
+        const unsigned expectedBytes = encoder.EncodeMultiple(
+            &originals[0], N, bytes, seed, trial, M, &expectedPtrs[0]);
+
+        if (stream.Begin(N, bytes, seed, trial, M, &recoveryPtrs[0], windowWords) != fp61::CodecResult::Success)
+        {
+            cout << "Failed (begin) at trial " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        unsigned completed = 0;
+        while (!stream.IsComplete())
+        {
+            // Pick an original and append its next fragment
+            const unsigned i = static_cast<unsigned>(prng.Next() % N);
+            unsigned fragmentBytes = 1 + static_cast<unsigned>(prng.Next() % maxFragment);
+            if (fragmentBytes > bytes - offsets[i]) {
+                fragmentBytes = bytes - offsets[i];
+            }
+
+            offsets[i] += stream.Append(i, originals[i] + offsets[i], fragmentBytes);
+
+            // Completed bytes only grow and already match the final output
+            const unsigned nextCompleted = stream.GetCompletedBytes();
+            if (nextCompleted < completed ||
+                nextCompleted > expectedBytes ||
+                0 != memcmp(&expectedData[0][0], &recoveryData[0][0], nextCompleted))
+            {
+                cout << "Failed (progress) at trial " << trial << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+            completed = nextCompleted;
+        }
+
+        if (completed != expectedBytes)
+        {
+            cout << "Failed (length) at trial " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            if (0 != memcmp(&expectedData[r][0], &recoveryData[r][0], expectedBytes))
+            {
+                cout << "Failed (mismatch) at trial " << trial << " row " << r << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+// Check FixedEncoder<N, M> against the MulAddMem() path of EncoderStream
+template<unsigned N, unsigned M>
+static bool TestFixedEncoderGeometry(fp61::Random& prng)
+{
+    fp61::FixedEncoder<N, M> encoder;
+    fp61::EncoderStream stream;
+
+    std::vector<std::vector<uint8_t>> data(N), expectedData(M), recoveryData(M);
+    std::vector<const uint8_t*> originals(N);
+    std::vector<uint8_t*> expectedPtrs(M), recoveryPtrs(M);
+
+    for (unsigned trial = 0; trial < 20; ++trial)
+    {
+        const unsigned bytes = 1 + static_cast<unsigned>(prng.Next() % ((trial % 4 == 0) ? 40000 : 500));
+        const uint64_t seed = prng.Next();
+        const unsigned ffOdds = (trial % 3) * 40;
+
+        FillOriginals(prng, N, bytes, ffOdds, 0, data, originals);
+
+        const unsigned recoveryBytes = fp61::GetRecoveryBytes(bytes);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            expectedData[r].assign(recoveryBytes, 0);
+            recoveryData[r].assign(recoveryBytes, 0);
+            expectedPtrs[r] = &expectedData[r][0];
+            recoveryPtrs[r] = &recoveryData[r][0];
+        }
+
+        if (stream.Begin(N, bytes, seed, trial, M, &expectedPtrs[0]) != fp61::CodecResult::Success)
+        {
+            cout << "Failed (begin) for " << N << " x " << M << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+        for (unsigned i = 0; i < N; ++i) {
+            stream.Append(i, originals[i], bytes);
+        }
+
+        const unsigned written = encoder.EncodeMultiple(&originals[0], bytes, seed, trial, &recoveryPtrs[0]);
+        if (!stream.IsComplete() || written != stream.GetCompletedBytes())
+        {
+            cout << "Failed (length) for " << N << " x " << M << " at trial " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            if (0 != memcmp(&expectedData[r][0], &recoveryData[r][0], written))
+            {
+                cout << "Failed (mismatch) for " << N << " x " << M << " at trial " << trial << " row " << r << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool TestFixedEncoder()
+{
+    cout << "TestFixedEncoder...";
+
+    fp61::Random prng;
+    prng.Seed(38);
+
+    if (!TestFixedEncoderGeometry<4, 1>(prng) ||
+        !TestFixedEncoderGeometry<8, 2>(prng) ||
+        !TestFixedEncoderGeometry<10, 4>(prng) ||
+        !TestFixedEncoderGeometry<16, 3>(prng) ||
+        !TestFixedEncoderGeometry<32, 4>(prng))
+    {
+        return false;
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static bool TestEncoderStats()
+{
+    cout << "TestEncoderStats...";
+
+    fp61::Random prng;
+    prng.Seed(39);
+
+    fp61::Encoder encoder;
+    fp61::EncoderStats expected;
+
+    std::vector<std::vector<uint8_t>> data, recoveryData;
+    std::vector<const uint8_t*> originals;
+    std::vector<uint8_t*> recovery;
+    std::vector<uint64_t> words;
+
+    // Generic and fixed geometry paths, with more escapes in each trial
+    static const unsigned kGeometries[][2] = { { 5, 3 }, { 10, 2 }, { 7, 1 }, { 16, 4 } };
+    unsigned trial = 0;
+    for (const auto& geometry : kGeometries)
+    {
+        const unsigned N = geometry[0], M = geometry[1];
+        const unsigned bytes = 1000 + trial * 37;
+        const unsigned ffOdds = trial * 30;
+        ++trial;
+
+        FillOriginals(prng, N, bytes, ffOdds, 0, data, originals);
+
+        unsigned maxWords = 0;
+        for (unsigned i = 0; i < N; ++i)
+        {
+            // Count the words and escapes with a separate reader
+            fp61::ByteReader reader;
+            reader.BeginRead(originals[i], bytes);
+            words.resize(fp61::ByteReader::MaxWords(bytes));
+            const unsigned count = reader.ReadWords(&words[0], static_cast<unsigned>(words.size()));
+            for (unsigned j = 0; j < count; ++j) {
+                expected.Escapes += fp61::IsFpAmbiguous(words[j]) ? 1 : 0;
+            }
+            expected.Bytes += bytes;
+            expected.Words += count;
+            if (maxWords < count) {
+                maxWords = count;
+            }
+        }
+        expected.Reductions += M * maxWords;
+        expected.Flushes += M;
+
+        recoveryData.resize(M);
+        recovery.resize(M);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            recoveryData[r].resize(fp61::GetRecoveryBytes(bytes));
+            recovery[r] = &recoveryData[r][0];
+        }
+
+        encoder.EncodeMultiple(&originals[0], N, bytes, prng.Next(), 0, M, &recovery[0]);
+    }
+
+#if !defined(FP61_ENABLE_STATS)
+    // Without FP61_ENABLE_STATS nothing is counted
+    expected = fp61::EncoderStats();
+#endif
+
+    const fp61::EncoderStats& stats = encoder.Stats;
+    if (stats.Bytes != expected.Bytes ||
+        stats.Words != expected.Words ||
+        stats.Escapes != expected.Escapes ||
+        stats.Reductions != expected.Reductions ||
+        stats.Flushes != expected.Flushes)
+    {
+        cout << "Failed (counts) escapes " << stats.Escapes << " expected " << expected.Escapes << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static const unsigned kTransformTrials = 100;
+
+static bool TestTransformEncoder()
+{
+    cout << "TestTransformEncoder...";
+
+    fp61::Random prng;
+    prng.Seed(32);
+
+    fp61::TransformEncoder encoder;
+
+    std::vector<std::vector<uint8_t>> data, recoveryData;
+    std::vector<std::vector<uint64_t>> words;
+    std::vector<const uint8_t*> originals;
+    std::vector<uint8_t*> recoveryPtrs;
+    std::vector<fp61::Fp2> coefficients;
+    std::vector<uint64_t> recoveryWords;
+
+    for (unsigned trial = 0; trial < kTransformTrials; ++trial)
+    {
+        // Mostly small codes, with a few that use larger transforms
+        const unsigned N = (trial % 10 == 9) ?
+            100 + static_cast<unsigned>(prng.Next() % 200) :
+            1 + static_cast<unsigned>(prng.Next() % 40);
+        const unsigned n = fp61::GetTransformCodeSize(N);
+        const unsigned M = (trial % 5 == 0) ? n : 1 + static_cast<unsigned>(prng.Next() % (n < 8 ? n : 8));
+        const unsigned firstRecoveryIndex = static_cast<unsigned>(prng.Next() % (n - M + 1));
+        const unsigned bytes = static_cast<unsigned>(prng.Next() % ((trial % 4 == 0) ? 3000 : 200));
+        const unsigned ffOdds = (trial % 3) * 40;
+
+        FillOriginals(prng, N, bytes, ffOdds, 1, data, originals);
+
+        words.resize(N);
+        unsigned maxWords = 0;
+        for (unsigned i = 0; i < N; ++i)
+        {
+            // Words of each original, padded with zeros to an even count
+            words[i].assign(fp61::ByteReader::MaxWords(bytes) + 2, 0);
+            fp61::ByteReader reader;
+            reader.BeginRead(originals[i], bytes);
+            const unsigned count = reader.ReadWords(&words[i][0], fp61::ByteReader::MaxWords(bytes));
+            if (maxWords < count) {
+                maxWords = count;
+            }
+        }
+        const unsigned pairs = (maxWords + 1) / 2;
+
+        const unsigned maxRecoveryBytes = fp61::GetTransformRecoveryBytes(bytes);
+        recoveryData.resize(M);
+        recoveryPtrs.resize(M);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            recoveryData[r].assign(maxRecoveryBytes, 0);
+            recoveryPtrs[r] = &recoveryData[r][0];
+        }
+
+        const unsigned recoveryBytes = encoder.Encode(&originals[0], N, bytes, firstRecoveryIndex, M, &recoveryPtrs[0]);
+
+        if (recoveryBytes > maxRecoveryBytes ||
+            fp61::WordReader::WordCount(recoveryBytes) < pairs * 2)
+        {
+            cout << "Failed (size) at trial " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        // Each pair of recovery words is sum(coefficient * original pair)
+        coefficients.resize(N);
+        recoveryWords.resize(pairs * 2);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            for (unsigned i = 0; i < N; ++i) {
+                coefficients[i] = fp61::GetTransformCoefficient(N, firstRecoveryIndex + r, i);
+            }
+
+            fp61::WordReader reader;
+            reader.BeginRead(recoveryPtrs[r], recoveryBytes);
+            reader.ReadWords(recoveryWords.data(), pairs * 2);
+
+            for (unsigned q = 0; q < pairs; ++q)
+            {
+                fp61::Fp2 sum;
+                sum.Re = 0;
+                sum.Im = 0;
+                for (unsigned i = 0; i < N; ++i)
+                {
+                    fp61::Fp2 d;
+                    d.Re = words[i][q * 2];
+                    d.Im = words[i][q * 2 + 1];
+                    sum = fp61::Fp2Add(sum, fp61::Fp2Multiply(d, coefficients[i]));
+                }
+                sum = fp61::Fp2Finalize(sum);
+
+                if (sum.Re != recoveryWords[q * 2] || sum.Im != recoveryWords[q * 2 + 1])
+                {
+                    cout << "Failed (mismatch) at trial " << trial << " row " << r << " pair " << q << endl;
+                    FP61_DEBUG_BREAK();
+                    return false;
+                }
+            }
+        }
+
+        // Recovery indices past the transform size are rejected
+        if (encoder.Encode(&originals[0], N, bytes, n - M + 1, M, &recoveryPtrs[0]) != 0)
+        {
+            cout << "Failed (range) at trial " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+static const unsigned kParallelTrials = 100;
+
+static bool TestParallelEncoder()
+{
+    cout << "TestParallelEncoder...";
+
+    fp61::Random prng;
+    prng.Seed(20);
+
+    // More threads than cores is fine, and tests the hand-off between them
+    fp61::ThreadPool pool;
+    pool.Start(3);
+
+    fp61::Encoder encoder;
+    fp61::ParallelEncoder parallel;
+
+    std::vector<std::vector<uint8_t>> data, expected, actual;
+    std::vector<const uint8_t*> originals;
+    std::vector<uint8_t*> expectedPtrs, actualPtrs;
+
+    for (unsigned trial = 0; trial < kParallelTrials; ++trial)
+    {
+        const unsigned N = 1 + static_cast<unsigned>(prng.Next() % 12);
+        const unsigned M = 1 + static_cast<unsigned>(prng.Next() % 4);
+        const unsigned bytes = 1 + static_cast<unsigned>(prng.Next() % 20000);
+        const uint64_t seed = prng.Next();
+
+        // Use small ranges so that most packets are split many times,
+        // sometimes not a multiple of 64, and sometimes let it pick the range size
+        if (trial % 4 == 3) {
+            parallel.RangeWords = 0;
+        }
+        else if (trial % 4 == 2) {
+            parallel.RangeWords = 1 + static_cast<unsigned>(prng.Next() % 500);
+        }
+        else {
+            parallel.RangeWords = 64 * (1 + static_cast<unsigned>(prng.Next() % 8));
+        }
+
+        // Vary the density of ambiguous words between trials
+        const unsigned ffOdds = (trial % 5) * 25;
+
+        FillOriginals(prng, N, bytes, ffOdds, 0, data, originals);
+
+        const unsigned recoveryBytes = fp61::GetRecoveryBytes(bytes);
+        expected.resize(M);
+        actual.resize(M);
+        expectedPtrs.resize(M);
+        actualPtrs.resize(M);
+        for (unsigned r = 0; r < M; ++r)
+        {
+            expected[r].assign(recoveryBytes, 0);
+            actual[r].assign(recoveryBytes, 0);
+            expectedPtrs[r] = &expected[r][0];
+            actualPtrs[r] = &actual[r][0];
+        }
+
+        const unsigned expectedBytes = encoder.EncodeMultiple(&originals[0], N, bytes, seed, trial, M, &expectedPtrs[0]);
+        const unsigned actualBytes = parallel.EncodeMultiple(pool, &originals[0], N, bytes, seed, trial, M, &actualPtrs[0]);
+
+        if (actualBytes != expectedBytes)
+        {
+            cout << "Failed (size mismatch) at trial = " << trial << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        for (unsigned r = 0; r < M; ++r)
+        {
+            if (actual[r] != expected[r])
+            {
+                cout << "Failed (data mismatch) at trial = " << trial << " r = " << r << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+        }
+    }
+
+    pool.Stop();
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+// Must run before anything else selects the kernels, so that the worker
+// threads are the first users of the bulk operations
+static bool TestParallelEncoderWithoutInit()
+{
+    cout << "TestParallelEncoderWithoutInit...";
+
+    fp61::Random prng;
+    prng.Seed(44);
+
+    static const unsigned N = 8, M = 4, bytes = 200000;
+
+    fp61::ThreadPool pool;
+    pool.Start(4);
+
+    std::vector<std::vector<uint8_t>> data(N), expected(M), actual(M);
+    std::vector<const uint8_t*> originals(N);
+    std::vector<uint8_t*> expectedPtrs(M), actualPtrs(M);
+
+    FillOriginals(prng, N, bytes, 25, 0, data, originals);
+    for (unsigned r = 0; r < M; ++r)
+    {
+        expected[r].assign(fp61::GetRecoveryBytes(bytes), 0);
+        actual[r].assign(fp61::GetRecoveryBytes(bytes), 0);
+        expectedPtrs[r] = &expected[r][0];
+        actualPtrs[r] = &actual[r][0];
+    }
+
+    fp61::ParallelEncoder parallel;
+    const unsigned actualBytes = parallel.EncodeMultiple(pool, &originals[0], N, bytes, 1, 0, M, &actualPtrs[0]);
+    pool.Stop();
+
+    fp61::Encoder encoder;
+    const unsigned expectedBytes = encoder.EncodeMultiple(&originals[0], N, bytes, 1, 0, M, &expectedPtrs[0]);
+
+    if (actualBytes != expectedBytes || actual != expected)
+    {
+        cout << "Failed (mismatch)" << endl;
+        FP61_DEBUG_BREAK();
+        return false;
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: File Encoder
+
+static bool WriteTestFile(const std::string& path, const vector<uint8_t>& data)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const bool success = data.empty() || fwrite(&data[0], 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && success;
+}
+
+static bool ReadTestFile(const std::string& path, vector<uint8_t>& data)
+{
+    data.clear();
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+static void FillTestData(fp61::Random& prng, vector<uint8_t>& data, unsigned bytes)
+{
+    data.resize(bytes);
+    FillTestBytes(prng, data.data(), bytes, 12);
+}
+
+// Check the recovery files against EncodeMultiple() on zero-padded copies
+static bool CheckRecoveryFiles(
+    vector<vector<uint8_t>> padded,
+    unsigned bytes,
+    uint64_t seed,
+    unsigned firstRecoveryIndex,
+    const vector<std::string>& recoveryPaths,
+    unsigned recoveryBytes)
+{
+    const unsigned N = (unsigned)padded.size();
+    const unsigned M = (unsigned)recoveryPaths.size();
+
+    vector<const uint8_t*> originals(N);
+    for (unsigned i = 0; i < N; ++i)
+    {
+        padded[i].resize(bytes + 8, 0);
+        originals[i] = &padded[i][0];
+    }
+
+    vector<vector<uint8_t>> expected(M, vector<uint8_t>(fp61::GetRecoveryBytes(bytes) + 8));
+    vector<uint8_t*> expectedPtrs(M);
+    for (unsigned r = 0; r < M; ++r) {
+        expectedPtrs[r] = &expected[r][0];
+    }
+
+    fp61::Encoder encoder;
+    const unsigned expectedBytes = encoder.EncodeMultiple(
+        &originals[0], N, bytes, seed, firstRecoveryIndex, M, &expectedPtrs[0]);
+    if (recoveryBytes != expectedBytes) {
+        return false;
+    }
+
+    for (unsigned r = 0; r < M; ++r)
+    {
+        vector<uint8_t> actual;
+        if (!ReadTestFile(recoveryPaths[r], actual) ||
+            actual.size() != expectedBytes ||
+            (expectedBytes > 0 && memcmp(&actual[0], &expected[r][0], expectedBytes) != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool TestFileEncoder()
+{
+    cout << "TestFileEncoder...";
+
+    fp61::Random prng;
+    prng.Seed(35);
+
+    fp61::FileEncoder encoder;
+    bool success = true;
+
+    vector<std::string> shardPaths, recoveryPaths;
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        shardPaths.push_back("fp61_test_shard_" + std::to_string(i) + ".bin");
+        recoveryPaths.push_back("fp61_test_recovery_" + std::to_string(i) + ".bin");
+    }
+    const std::string stripedPath = "fp61_test_striped.bin";
+
+    for (unsigned trial = 0; trial < 40 && success; ++trial)
+    {
+        const unsigned N = 1 + (unsigned)(prng.Next() % 8);
+        const unsigned M = 1 + (unsigned)(prng.Next() % 4);
+        const uint64_t seed = prng.Next();
+        const unsigned firstRecoveryIndex = (unsigned)(prng.Next() % 100);
+
+        // Mostly small files, and some that span several encoder chunks
+        const unsigned maxBytes = (trial % 4 == 0) ? 200000 : 2000;
+
+        vector<std::string> recovery(recoveryPaths.begin(), recoveryPaths.begin() + M);
+        vector<const char*> recoveryNames(M);
+        for (unsigned r = 0; r < M; ++r) {
+            recoveryNames[r] = recovery[r].c_str();
+        }
+
+        // Shard files of different sizes, including empty ones
+        vector<vector<uint8_t>> shards(N);
+        vector<const char*> shardNames(N);
+        unsigned longest = 0;
+        for (unsigned i = 0; i < N; ++i)
+        {
+            const unsigned bytes = (prng.Next() % 5 == 0) ? 0 : (unsigned)(prng.Next() % maxBytes);
+            FillTestData(prng, shards[i], bytes);
+            if (longest < bytes) {
+                longest = bytes;
+            }
+            shardNames[i] = shardPaths[i].c_str();
+            if (!WriteTestFile(shardPaths[i], shards[i])) {
+                cout << "Failed (could not write test file)" << endl;
+                return false;
+            }
+        }
+
+        unsigned recoveryBytes = 0;
+        if (encoder.EncodeFiles(&shardNames[0], N, seed, firstRecoveryIndex, M,
+                &recoveryNames[0], &recoveryBytes) != fp61::FileResult::Success ||
+            !CheckRecoveryFiles(shards, longest, seed, firstRecoveryIndex, recovery, recoveryBytes))
+        {
+            cout << "Failed (shard files) at trial = " << trial << endl;
+            FP61_DEBUG_BREAK();
+            success = false;
+            break;
+        }
+
+        // One file split into N stripes
+        vector<uint8_t> striped;
+        FillTestData(prng, striped, (unsigned)(prng.Next() % (maxBytes * 2)));
+        if (!WriteTestFile(stripedPath, striped)) {
+            cout << "Failed (could not write test file)" << endl;
+            return false;
+        }
+
+        const unsigned stripeBytes = (unsigned)fp61::FileEncoder::GetStripeBytes(striped.size(), N);
+        vector<vector<uint8_t>> stripes(N);
+        for (unsigned i = 0; i < N; ++i)
+        {
+            const size_t start = std::min(striped.size(), (size_t)i * stripeBytes);
+            const size_t end = std::min(striped.size(), start + stripeBytes);
+            stripes[i].assign(striped.begin() + start, striped.begin() + end);
+        }
+
+        if (encoder.EncodeStripes(stripedPath.c_str(), N, seed, firstRecoveryIndex, M,
+                &recoveryNames[0], &recoveryBytes) != fp61::FileResult::Success ||
+            !CheckRecoveryFiles(stripes, stripeBytes, seed, firstRecoveryIndex, recovery, recoveryBytes))
+        {
+            cout << "Failed (striped file) at trial = " << trial << endl;
+            FP61_DEBUG_BREAK();
+            success = false;
+            break;
+        }
+    }
+
+    // Missing inputs are reported
+    if (success)
+    {
+        const char* missing = "fp61_test_missing.bin";
+        const char* recoveryName = recoveryPaths[0].c_str();
+        if (encoder.EncodeFiles(&missing, 1, 0, 0, 1, &recoveryName) != fp61::FileResult::IoError ||
+            encoder.EncodeStripes(missing, 1, 0, 0, 1, &recoveryName) != fp61::FileResult::IoError)
+        {
+            cout << "Failed (missing file not reported)" << endl;
+            FP61_DEBUG_BREAK();
+            success = false;
+        }
+    }
+
+    for (unsigned i = 0; i < shardPaths.size(); ++i)
+    {
+        remove(shardPaths[i].c_str());
+        remove(recoveryPaths[i].c_str());
+    }
+    remove(stripedPath.c_str());
+
+    if (success) {
+        cout << "Passed" << endl;
+    }
+
+    return success;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: Encode Pipeline
+
+// A stripe job with its own buffers and the expected recovery data
+struct PipelineTestStripe
+{
+    fp61::EncodeJob Job;
+    vector<vector<uint8_t>> OriginalData;
+    vector<const uint8_t*> Originals;
+    vector<vector<uint8_t>> RecoveryData;
+    vector<uint8_t*> Recovery;
+    vector<vector<uint8_t>> Expected;
+    unsigned ExpectedBytes = 0;
+};
+
+static void MakePipelineStripe(fp61::Random& prng, PipelineTestStripe& stripe, fp61::Encoder& encoder)
+{
+    // A few fixed geometries, as in a real deployment, plus random ones
+    const unsigned kind = (unsigned)(prng.Next() % 4);
+    const unsigned N = kind == 0 ? 1 + (unsigned)(prng.Next() % 20) : 4 * kind;
+    const unsigned M = kind == 0 ? 1 + (unsigned)(prng.Next() % 6) : kind;
+    const unsigned bytes = (unsigned)(prng.Next() % 3000);
+
+    FillOriginals(prng, N, bytes, 12, 0, stripe.OriginalData, stripe.Originals);
+
+    const unsigned recoveryBytes = fp61::GetRecoveryBytes(bytes) + 8;
+    stripe.RecoveryData.assign(M, vector<uint8_t>(recoveryBytes));
+    stripe.Expected.assign(M, vector<uint8_t>(recoveryBytes));
+    stripe.Recovery.resize(M);
+    vector<uint8_t*> expected(M);
+    for (unsigned r = 0; r < M; ++r)
+    {
+        stripe.Recovery[r] = &stripe.RecoveryData[r][0];
+        expected[r] = &stripe.Expected[r][0];
+    }
+
+    fp61::EncodeJob& job = stripe.Job;
+    job.Originals = stripe.Originals.data();
+    job.N = N;
+    job.Bytes = bytes;
+    job.Seed = prng.Next() % 3;
+    job.FirstRecoveryIndex = (unsigned)(prng.Next() % 10);
+    job.M = M;
+    job.Recovery = &stripe.Recovery[0];
+    job.Context = &stripe;
+
+    stripe.ExpectedBytes = encoder.EncodeMultiple(
+        &stripe.Originals[0], N, bytes, job.Seed, job.FirstRecoveryIndex, M, &expected[0]);
+}
+
+static bool CheckPipelineStripe(const PipelineTestStripe& stripe)
+{
+    if (stripe.Job.RecoveryBytes != stripe.ExpectedBytes) {
+        return false;
+    }
+    for (unsigned r = 0; r < stripe.Job.M; ++r)
+    {
+        if (stripe.ExpectedBytes > 0 &&
+            memcmp(&stripe.RecoveryData[r][0], &stripe.Expected[r][0], stripe.ExpectedBytes) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const unsigned kPipelineStripes = 300;
+static const unsigned kPipelineProducers = 3;
+
+static bool TestEncodePipeline()
+{
+    cout << "TestEncodePipeline...";
+
+    fp61::Random prng;
+    prng.Seed(36);
+
+    fp61::Encoder encoder;
+    vector<PipelineTestStripe> stripes(kPipelineStripes);
+    for (unsigned i = 0; i < kPipelineStripes; ++i) {
+        MakePipelineStripe(prng, stripes[i], encoder);
+    }
+
+    // Completion queue: Several threads submit at once
+    {
+        fp61::EncodePipeline pipeline;
+        pipeline.Start(3);
+
+        vector<std::thread> producers;
+        for (unsigned t = 0; t < kPipelineProducers; ++t)
+        {
+            producers.emplace_back([&stripes, &pipeline, t]() {
+                for (unsigned i = t; i < kPipelineStripes; i += kPipelineProducers) {
+                    pipeline.Submit(&stripes[i].Job);
+                }
+            });
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+
+        vector<bool> seen(kPipelineStripes, false);
+        for (unsigned i = 0; i < kPipelineStripes; ++i)
+        {
+            fp61::EncodeJob* job = pipeline.WaitCompleted();
+            if (!job)
+            {
+                cout << "Failed (missing completion)" << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+            const PipelineTestStripe* stripe = static_cast<const PipelineTestStripe*>(job->Context);
+            const unsigned index = (unsigned)(stripe - &stripes[0]);
+            if (seen[index] || !CheckPipelineStripe(*stripe))
+            {
+                cout << "Failed (completion mismatch) for stripe = " << index << endl;
+                FP61_DEBUG_BREAK();
+                return false;
+            }
+            seen[index] = true;
+        }
+        if (pipeline.WaitCompleted() != nullptr || pipeline.PopCompleted() != nullptr)
+        {
+            cout << "Failed (extra completion)" << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        const fp61::PipelineStats stats = pipeline.GetStats();
+        if (stats.Submitted != kPipelineStripes ||
+            stats.Completed != kPipelineStripes ||
+            stats.QueueDepth != 0 ||
+            stats.MaxQueueDepth == 0 ||
+            stats.QueueWait.Count != kPipelineStripes ||
+            stats.Encode.Count != kPipelineStripes ||
+            stats.Completion.Count != kPipelineStripes)
+        {
+            cout << "Failed (stats)" << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        pipeline.Stop();
+        if (pipeline.Submit(&stripes[0].Job))
+        {
+            cout << "Failed (submit after stop)" << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    // Callback: Stop() waits for the submitted jobs
+    {
+        for (unsigned i = 0; i < kPipelineStripes; ++i)
+        {
+            for (vector<uint8_t>& recovery : stripes[i].RecoveryData) {
+                std::fill(recovery.begin(), recovery.end(), (uint8_t)0);
+            }
+        }
+
+        std::atomic<unsigned> completed(0), failures(0);
+        fp61::EncodePipeline pipeline;
+        pipeline.Start(2, [&completed, &failures](fp61::EncodeJob& job) {
+            if (!CheckPipelineStripe(*static_cast<const PipelineTestStripe*>(job.Context))) {
+                ++failures;
+            }
+            ++completed;
+        });
+
+        for (unsigned i = 0; i < kPipelineStripes; ++i) {
+            pipeline.Submit(&stripes[i].Job);
+        }
+        pipeline.Stop();
+
+        if (completed != kPipelineStripes || failures != 0 ||
+            pipeline.GetStats().Completion.Count != kPipelineStripes)
+        {
+            cout << "Failed (callback completions)" << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
+
+    cout << "Passed" << endl;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests: Polynomials
+
+static void RandomPoly(fp61::Random& prng, std::vector<uint64_t>& poly, unsigned count)
+{
+    poly.resize(count);
+    for (unsigned i = 0; i < count; ++i) {
+        poly[i] = prng.NextFp();
+    }
+
+    // Exercise the largest coefficient as well
+    if (count > 0) {
+        poly[count - 1] = fp61::kPrime - 1;
+    }
+}
+
+static bool TestPolyMultiply(fp61::Random& prng)
+{
+    // Sizes around the Karatsuba and transform thresholds, and unbalanced
+    static const unsigned kSizes[][2] = {
+        { 1, 1 }, { 1, 7 }, { 5, 3 }, { 31, 31 }, { 32, 32 }, { 33, 47 },
+        { 100, 100 }, { 64, 300 }, { 255, 257 }, { 511, 512 }, { 512, 512 },
+        { 700, 1200 }, { 2048, 2048 }, { 3000, 40 }, { 40, 3000 }, { 5000, 600 }
+    };
+
+    std::vector<uint64_t> a, b, product, expected;
+
+    for (const auto& size : kSizes)
+    {
+        const unsigned aCount = size[0], bCount = size[1];
+        RandomPoly(prng, a, aCount);
+        RandomPoly(prng, b, bCount);
+
+        const unsigned productCount = aCount + bCount - 1;
+        expected.assign(productCount, 0);
+        for (unsigned i = 0; i < aCount; ++i) {
+            for (unsigned j = 0; j < bCount; ++j) {
+                expected[i + j] = fp61::Finalize(fp61::PartialReduce(
+                    expected[i + j] + fp61::Multiply(a[i], b[j])));
+            }
+        }
+
+        product.assign(productCount, ~(uint64_t)0);
+        fp61::PolyMultiply(a.data(), aCount, b.data(), bCount, product.data());
+
+        if (product != expected)
+        {
+            cout << "Failed (multiply) for " << aCount << " x " << bCount << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
 
-            reader.BeginRead(&original[0], bytes);
+    return true;
+}
 
-            unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
-            unsigned maxBytes = fp61::ByteWriter::MaxBytesNeeded(maxWords);
+static bool TestPolyEvaluate(fp61::Random& prng)
+{
+    // Counts below and above kPolyTreeMinPoints, with polynomials that are
+    // shorter and longer than the number of points
+    static const unsigned kSizes[][2] = {
+        { 0, 5 }, { 1, 5 }, { 10, 3 }, { 100, 100 }, { 300, 256 },
+        { 256, 1000 }, { 2000, 300 }, { 3000, 3000 }
+    };
 
-            recovered.resize(maxBytes);
-            writer.BeginWrite(&recovered[0]);
+    std::vector<uint64_t> poly, x, y;
 
-            // Write words we get directly back out
-            uint64_t word;
-            while (reader.Read(word) != fp61::ReadResult::Empty) {
-                writer.Write(word);
-            }
-            unsigned writtenBytes = writer.Flush();
+    for (const auto& size : kSizes)
+    {
+        const unsigned count = size[0], xCount = size[1];
+        RandomPoly(prng, poly, count);
+        RandomPoly(prng, x, xCount);
 
-            // TBD: Check if high bits are 0?
+        y.assign(xCount, ~(uint64_t)0);
+        fp61::PolyEvaluateMany(poly.data(), count, x.data(), xCount, y.data());
 
-            if (writtenBytes > maxBytes ||
-                writtenBytes > bytes + 8)
+        for (unsigned i = 0; i < xCount; ++i)
+        {
+            // Reference: Horner's rule with full reduction at each step
+            uint64_t expected = 0;
+            for (unsigned j = count; j > 0; --j) {
+                expected = fp61::Finalize(fp61::PartialReduce(
+                    fp61::Multiply(expected, x[i]) + poly[j - 1]));
+            }
+
+            if (y[i] != expected ||
+                fp61::PolyEvaluate(poly.data(), count, x[i]) != expected)
             {
-                cout << "Failed (byte count mismatch) at i = " << i << " j = " << j << endl;
+                cout << "Failed (evaluate) for count = " << count << " at i = " << i << endl;
                 FP61_DEBUG_BREAK();
                 return false;
             }
+        }
+    }
 
-            if (0 != memcmp(&recovered[0], &original[0], bytes))
+    return true;
+}
+
+static bool TestPolyInterpolate(fp61::Random& prng)
+{
+    static const unsigned kCounts[] = {
+        1, 2, 5, 16, 17, 33, 100, 600, 2500
+    };
+
+    std::vector<uint64_t> poly, x, y, result;
+
+    for (unsigned count : kCounts)
+    {
+        RandomPoly(prng, poly, count);
+
+        // Distinct points: Random values with high probability, plus 0
+        RandomPoly(prng, x, count);
+        x[0] = 0;
+
+        y.resize(count);
+        fp61::PolyEvaluateMany(poly.data(), count, x.data(), count, y.data());
+
+        result.assign(count, ~(uint64_t)0);
+        if (!fp61::PolyInterpolate(x.data(), y.data(), count, result.data()) ||
+            result != poly)
+        {
+            cout << "Failed (interpolate) for count = " << count << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+
+        if (count >= 2)
+        {
+            // Repeating a point must be reported
+            x[count - 1] = x[count / 2 - 1];
+            if (fp61::PolyInterpolate(x.data(), y.data(), count, result.data()))
             {
-                cout << "Failed (data corruption) at i = " << i << " j = " << j << endl;
+                cout << "Failed (duplicate) for count = " << count << endl;
                 FP61_DEBUG_BREAK();
                 return false;
             }
         }
     }
 
+    return true;
+}
+
+static bool TestPoly()
+{
+    cout << "TestPoly...";
+
+    fp61::Random prng;
+    prng.Seed(29);
+
+    if (!TestPolyMultiply(prng) ||
+        !TestPolyEvaluate(prng) ||
+        !TestPolyInterpolate(prng))
+    {
+        return false;
+    }
+
     cout << "Passed" << endl;
 
     return true;
@@ -1014,135 +4027,177 @@ bool TestByteWriter()
 
 
 //------------------------------------------------------------------------------
-// Tests: Integration
+// Tests: Matrices
 
-// Tests all of the serialization/deserialization and some math code
-bool TestIntegration()
+static bool TestMatMul()
 {
-    cout << "TestIntegration...";
-
-    std::vector<uint8_t> data, recovery, recovered;
+    cout << "TestMatMul...";
 
     fp61::Random prng;
-    prng.Seed(13);
+    prng.Seed(40);
 
-    // Test a range of data sizes
-    for (unsigned i = 1; i < kMaxDataLength; ++i)
-    {
-        unsigned bytes = i;
+    std::vector<uint64_t> A, B, C;
 
-        // Run a few tests for each size
-        for (unsigned j = 0; j < 10; ++j)
-        {
-            // Generate some test data:
+    for (unsigned loop = 0; loop < 200; ++loop)
+    {
+        // Cover every inner dimension up to 70, and wider than one panel
+        const unsigned m = 1 + static_cast<unsigned>(prng.Next() % 11);
+        const unsigned n = 1 + static_cast<unsigned>(prng.Next() % ((loop % 8 == 0) ? 600 : 40));
+        const unsigned k = (loop <= 70) ? loop : static_cast<unsigned>(prng.Next() % 100);
+
+        // Largest inputs on some loops, which fill the lazy sums the most
+        const bool largest = (loop % 5 == 0);
+
+        A.resize((size_t)m * k + 1);
+        B.resize((size_t)k * n + 1);
+        C.assign((size_t)m * n + 1, 0xfeedface);
+        for (size_t i = 0; i < A.size(); ++i) {
+            A[i] = largest ? fp61::kPrime - 1 : prng.NextFp();
+        }
+        for (size_t i = 0; i < B.size(); ++i) {
+            B[i] = largest ? fp61::kPrime - 1 : prng.NextFp();
+        }
 
-            // Allocate padded data to simplify tester
-            data.resize(bytes + 8);
+        fp61::MatMul(&A[0], &B[0], &C[0], m, n, k);
 
-            // Fill the data with random bytes
-            for (unsigned k = 0; k < i; k += 8)
+        for (unsigned i = 0; i < m; ++i)
+        {
+            for (unsigned j = 0; j < n; ++j)
             {
-                uint64_t w;
-                if (prng.Next() % 100 <= 3) {
-                    w = ~(uint64_t)0;
-                }
-                else {
-                    w = prng.Next();
+                const uint64_t expected = fp61::DotProductStrided(&A[(size_t)i * k], 1, &B[j], n, k);
+                if (C[(size_t)i * n + j] != expected)
+                {
+                    cout << "Failed for m = " << m << " n = " << n << " k = " << k
+                        << " at " << i << ", " << j << endl;
+                    FP61_DEBUG_BREAK();
+                    return false;
                 }
-                fp61::WriteU64_LE(&data[k], w);
             }
+        }
 
-            // Read data from the simulated packet,
-            // perform some example Fp operation on it,
-            // and then store it to a simulated recovery packet.
+        if (C[(size_t)m * n] != 0xfeedface)
+        {
+            cout << "Failed (overrun) for m = " << m << " n = " << n << " k = " << k << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
+    }
 
-            // Preallocate enough space in recovery packets for the worst case
-            const unsigned maxWords = fp61::ByteReader::MaxWords(bytes);
-            recovery.resize(fp61::WordWriter::BytesNeeded(maxWords));
+    cout << "Passed" << endl;
 
-            fp61::WordWriter recovery_writer;
-            recovery_writer.BeginWrite(&recovery[0]);
+    return true;
+}
 
-            fp61::ByteReader original_reader;
-            original_reader.BeginRead(&data[0], bytes);
+static bool TestInvertMatrix()
+{
+    cout << "TestInvertMatrix...";
 
-            fp61::Random coeff_prng;
-            coeff_prng.Seed(bytes + j * 500000);
+    fp61::Random prng;
+    prng.Seed(41);
 
-            // Start reading words from the original file/packet,
-            // multiplying them by a random coefficient,
-            // and writing them to the recovery file/packet.
-            uint64_t r;
-            while (original_reader.Read(r) == fp61::ReadResult::Success)
-            {
-                // Pick random coefficient to multiply between 1..p-1
-                uint64_t coeff = coeff_prng.NextNonzeroFp();
+    std::vector<uint64_t> A, work, inverse, product, B, X;
 
-                // x = r * coeff (62 bits)
-                uint64_t x = fp61::Multiply(r, coeff);
+    for (unsigned loop = 0; loop < 120; ++loop)
+    {
+        const unsigned n = 1 + ((loop < 64) ? loop : static_cast<unsigned>(prng.Next() % 100));
+        const unsigned count = 1 + static_cast<unsigned>(prng.Next() % 20);
 
-                // Finalize x (61 bits < p)
-                uint64_t f = fp61::Finalize(x);
+        A.resize(n * n);
+        for (unsigned i = 0; i < n * n; ++i) {
+            A[i] = (loop % 5 == 0) ? fp61::kPrime - 1 - (i % 3) : prng.NextFp();
+        }
 
-                // Write to recovery file/packet
-                recovery_writer.Write(f);
+        // Upper triangular with pairs of rows swapped on some loops,
+        // so that half of the pivots need row swaps
+        if (loop % 3 == 0) {
+            for (unsigned i = 0; i < n; ++i) {
+                for (unsigned j = 0; j < i; ++j) {
+                    A[i * n + j] = 0;
+                }
             }
+            for (unsigned i = 0; i + 1 < n; i += 2) {
+                std::swap_ranges(&A[i * n], &A[i * n] + n, &A[(i + 1) * n]);
+            }
+        }
 
-            // Flush the remaining bits to the recovery file/packet
-            unsigned writtenRecoveryBytes = recovery_writer.Flush();
-
-            // Simulate reading data from the recovery file/packet
-            // and recovering the original data:
-
-            fp61::WordReader recovery_reader;
-            recovery_reader.BeginRead(&recovery[0], writtenRecoveryBytes);
-
-            // Allocate space for recovered data (may be up to 1.6% larger than needed)
-            const unsigned recoveryWords = fp61::WordReader::WordCount(writtenRecoveryBytes);
-            const unsigned maxBytes = fp61::ByteWriter::MaxBytesNeeded(recoveryWords);
-            recovered.resize(maxBytes);
-
-            fp61::ByteWriter original_writer;
-            original_writer.BeginWrite(&recovered[0]);
+        work = A;
+        inverse.resize(n * n);
+        const bool invertible = fp61::InvertMatrix(&work[0], &inverse[0], n);
 
-            // Reproduce the same random sequence
-            coeff_prng.Seed(bytes + j * 500000);
+        // Some of the loops with repeated large values are singular
+        if (invertible)
+        {
+            product.resize(n * n);
+            fp61::MatMul(&A[0], &inverse[0], &product[0], n, n, n);
 
-            // For each word to read:
-            const unsigned readWords = fp61::WordReader::WordCount(writtenRecoveryBytes);
-            for (unsigned i = 0; i < readWords; ++i)
+            for (unsigned i = 0; i < n; ++i)
             {
-                // Pick random coefficient to multiply between 1..p-1
-                uint64_t coeff = coeff_prng.NextNonzeroFp();
-                uint64_t inv_coeff = fp61::Inverse(coeff);
-
-                // Read the next word (61 bits)
-                uint64_t f = recovery_reader.Read();
-
-                // Invert the multiplication (62 bits)
-                uint64_t x = fp61::Multiply(f, inv_coeff);
+                for (unsigned j = 0; j < n; ++j)
+                {
+                    if (product[i * n + j] != ((i == j) ? 1u : 0u))
+                    {
+                        cout << "Failed (A * A^-1 != I) for n = " << n << " at loop = " << loop << endl;
+                        FP61_DEBUG_BREAK();
+                        return false;
+                    }
+                }
+            }
+        }
+        else if (loop % 5 != 0)
+        {
+            cout << "Failed (random matrix singular) for n = " << n << " at loop = " << loop << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
 
-                // Finalize x (61 bits < p)
-                x = fp61::Finalize(x);
+        // Solve A*X = B and check that B = A*X
+        B.resize(n * count);
+        prng.FillFp(&B[0], n * count);
+        X = B;
+        work = A;
 
-                // Write to recovered original data buffer
-                original_writer.Write(x);
-            }
+        if (fp61::SolveLinear(&work[0], &X[0], n, count) != invertible)
+        {
+            cout << "Failed (SolveLinear disagrees) for n = " << n << " at loop = " << loop << endl;
+            FP61_DEBUG_BREAK();
+            return false;
+        }
 
-            // Flush the remaining bits to the recovered original file/packet
-            unsigned recoveredBytes = original_writer.Flush();
+        if (invertible)
+        {
+            product.resize(n * count);
+            fp61::MatMul(&A[0], &X[0], &product[0], n, count, n);
 
-            if (recoveredBytes > maxBytes ||
-                recoveredBytes > bytes + 8)
+            if (product != B)
             {
-                cout << "Failed (byte count mismatch) at i = " << i << " j = " << j << endl;
+                cout << "Failed (A * X != B) for n = " << n << " at loop = " << loop << endl;
                 FP61_DEBUG_BREAK();
                 return false;
             }
+        }
 
-            if (0 != memcmp(&recovered[0], &data[0], bytes))
+        // A repeated row (scaled) or a zero column must be reported singular
+        if (n >= 2)
+        {
+            const unsigned a = static_cast<unsigned>(prng.Next() % n);
+            const unsigned b = (a + 1 + static_cast<unsigned>(prng.Next() % (n - 1))) % n;
+            const uint64_t scale = prng.NextFp();
+
+            work = A;
+            if (loop % 2 == 0) {
+                for (unsigned j = 0; j < n; ++j) {
+                    work[b * n + j] = fp61::Finalize(fp61::Multiply(work[a * n + j], scale));
+                }
+            }
+            else {
+                for (unsigned i = 0; i < n; ++i) {
+                    work[i * n + a] = 0;
+                }
+            }
+
+            if (fp61::InvertMatrix(&work[0], &inverse[0], n))
             {
-                cout << "Failed (data corruption) at i = " << i << " j = " << j << endl;
+                cout << "Failed (singular matrix inverted) for n = " << n << " at loop = " << loop << endl;
                 FP61_DEBUG_BREAK();
                 return false;
             }
@@ -1155,6 +4210,49 @@ bool TestIntegration()
 }
 
 
+//------------------------------------------------------------------------------
+// Tests: Kernel Dispatch
+
+// Run the tests for bulk operations with each set of kernels
+static bool TestKernels()
+{
+    static const unsigned kDisabledFeatures[] = {
+        0,
+        fp61::kCpuFeatureAVX512F,
+        fp61::kCpuFeatureAVX512F | fp61::kCpuFeatureAVX2,
+        ~0u
+    };
+
+    bool success = true;
+
+    for (unsigned disabled : kDisabledFeatures)
+    {
+        fp61::Init(disabled);
+
+        const fp61::KernelInfo& info = fp61::GetKernelInfo();
+        cout << "Kernels: MulAdd=" << info.MulAdd << " Read=" << info.Read
+            << " Write=" << info.Write
+            << " Random=" << info.Random << " Fp2=" << info.Fp2 << endl;
+
+        if (!TestMulAddMem() ||
+            !TestFixedMulAdd() ||
+            !TestByteReaderReadWords() ||
+            !TestMultiByteReader() ||
+            !TestWriteWords() ||
+            !TestRandomFill() ||
+            !TestFp2Mem())
+        {
+            success = false;
+            break;
+        }
+    }
+
+    fp61::Init();
+
+    return success;
+}
+
+
 //------------------------------------------------------------------------------
 // Entrypoint
 
@@ -1165,6 +4263,10 @@ int main()
 
     int result = FP61_RET_SUCCESS;
 
+    // First, before any test selects the kernels
+    if (!TestParallelEncoderWithoutInit()) {
+        result = FP61_RET_FAIL;
+    }
     if (!TestByteWriter()) {
         result = FP61_RET_FAIL;
     }
@@ -1174,9 +4276,15 @@ int main()
     if (!TestRandom()) {
         result = FP61_RET_FAIL;
     }
+    if (!TestRandomFill()) {
+        result = FP61_RET_FAIL;
+    }
     if (!TestWordSerialization()) {
         result = FP61_RET_FAIL;
     }
+    if (!TestFixedPacking()) {
+        result = FP61_RET_FAIL;
+    }
     if (!TestNegate()) {
         result = FP61_RET_FAIL;
     }
@@ -1192,12 +4300,78 @@ int main()
     if (!TestMultiply()) {
         result = FP61_RET_FAIL;
     }
+    if (!TestConstMultiplier()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestConstexpr()) {
+        result = FP61_RET_FAIL;
+    }
     if (!TestMulInverse()) {
         result = FP61_RET_FAIL;
     }
+    if (!TestInverseBatch()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestPow()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestInverseCT()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestDotProduct()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestFp2()) {
+        result = FP61_RET_FAIL;
+    }
     if (!TestByteReader()) {
         result = FP61_RET_FAIL;
     }
+    if (!TestKernels()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestPoly()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestMatMul()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestInvertMatrix()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestCoefficientSet()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestCodec()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestDecoderRowSelection()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestEncodeWithScratch()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestEncoderStream()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestFixedEncoder()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestEncoderStats()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestTransformEncoder()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestParallelEncoder()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestFileEncoder()) {
+        result = FP61_RET_FAIL;
+    }
+    if (!TestEncodePipeline()) {
+        result = FP61_RET_FAIL;
+    }
 
     cout << endl;
     if (result == FP61_RET_FAIL) {